@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 struct NetworkInterfaceInfo {
     std::string type;       // 网络类型: bridge, user等
@@ -11,6 +12,74 @@ struct NetworkInterfaceInfo {
     std::string modelType;  // 设备模型: virtio, e1000等
     std::string source;     // 网络源(如bridge名称)
     std::string target;     // 目标设备名称
+    std::string driverName; // 后端驱动: vhost, qemu，为空时virtio网卡自动使用vhost
+    unsigned int queues = 1;    // 队列数量，大于1时启用多队列
+};
+
+// 磁盘设备定义
+struct virDomainDiskDef {
+    std::string source;         // 镜像文件路径
+    std::string format;         // 镜像格式: raw, qcow2等，为空时由QEMU探测
+    std::string targetDev;      // 目标设备名: vda, sda, hda等
+    std::string bus;            // 总线类型: virtio, scsi, ide, sata
+    std::string alias;          // 设备别名，用于生成QEMU中的drive/device id
+    std::string cache;          // 缓存模式: none, writeback, writethrough, directsync, unsafe
+    std::string io;             // AIO模式: native, io_uring, threads
+    std::string discard;        // discard模式: unmap, ignore
+    unsigned int queues = 0;    // 队列数量，0表示使用QEMU默认值
+    unsigned int iothread = 0;  // 绑定的iothread编号(从1开始)，0表示不绑定
+};
+
+// 内存后端定义，对应<memoryBacking>
+struct virDomainMemoryBackingDef {
+    unsigned long long hugepageSizeKiB = 0; // 大页大小(KiB)，0表示不使用大页
+    std::string hugepageNodeset;            // 大页所在的宿主机NUMA节点集合
+    std::string source;                     // 内存来源: anonymous, file, memfd
+    bool prealloc = false;                  // 启动时预先分配全部内存
+    bool share = false;                     // 以MAP_SHARED方式映射
+    bool discard = false;                   // 退出时丢弃内存内容，不回写文件
+};
+
+// NUMA内存策略，对应<numatune><memory>
+struct virDomainNumatuneDef {
+    std::string mode;                       // strict, preferred, interleave
+    std::string nodeset;                    // 宿主机NUMA节点集合
+    std::string placement;                  // static, auto
+};
+
+// CPU绑定定义，对应<cputune>
+struct virDomainVcpuPinDef {
+    unsigned int vcpu = 0;
+    std::string cpuset;
+};
+
+struct virDomainIOThreadPinDef {
+    unsigned int iothread = 0;
+    std::string cpuset;
+};
+
+struct virDomainCputuneDef {
+    std::vector<virDomainVcpuPinDef> vcpupins;
+    std::vector<virDomainIOThreadPinDef> iothreadpins;
+    std::string emulatorpin;                // 除vcpu和iothread之外的QEMU线程
+    unsigned long long shares = 0;          // CPU权重，0表示使用默认值，对应cpu.weight
+    unsigned long long period = 0;          // 带宽控制周期(us)，对应cpu.max
+    long long quota = 0;                    // 每周期可用CPU时间(us)，0表示不限制
+};
+
+// 内存限制，对应<memtune>
+struct virDomainMemtuneDef {
+    unsigned long long hardLimitKiB = 0;    // 对应memory.max，0表示不限制
+    unsigned long long softLimitKiB = 0;    // 对应memory.high，0表示不限制
+};
+
+// 块设备IO限制，对应<blkiotune><device>
+struct virDomainBlkioDeviceDef {
+    std::string path;                       // 块设备路径，普通文件取其所在文件系统的设备
+    unsigned long long readIopsSec = 0;
+    unsigned long long writeIopsSec = 0;
+    unsigned long long readBytesSec = 0;
+    unsigned long long writeBytesSec = 0;
 };
 
 // 声明基础域定义类
@@ -25,9 +94,19 @@ public:
     unsigned long memory;       // 内存大小
     std::string memoryUnit;     // 内存单位
     int vcpus;                  // 虚拟CPU数量
+    std::string vcpuPlacement;  // vcpu放置策略: static, auto
+    std::string vcpuCpuset;     // <vcpu cpuset>，未单独绑定的vcpu使用该集合
+    virDomainCputuneDef cputune;
+    virDomainMemtuneDef memtune;
+    std::vector<virDomainBlkioDeviceDef> blkiotune;
+    virDomainMemoryBackingDef memoryBacking;
+    virDomainNumatuneDef numatune;
 
-    std::string diskPath;
+    std::vector<virDomainDiskDef> disks;    // 磁盘列表
+    unsigned int iothreads = 0;             // iothread对象数量
     std::string cdromPath;
+    std::string memballoonModel = "virtio";     // 气球设备模型: virtio, none
+    unsigned int memballoonStatsPeriod = 0;     // 客户机内存统计上报周期(秒)，0表示不上报
 
     // 虚拟化类型
     std::string type;           // 虚拟化类型(kvm, qemu等)
@@ -43,10 +122,11 @@ public:
 };
 
 // 定义状态原因类
+// 状态由事件循环线程和API线程并发更新，读取不需要加锁，state和reason分别原子更新
 class virDomainStateReason {
 public:
-    int state;
-    int reason;
+    std::atomic<int> state{ 0 };
+    std::atomic<int> reason{ 0 };
 };
 
 // 域对象类
@@ -0,0 +1,147 @@
+#include "domain_event.h"
+#include "../log/log.h"
+#include "../util/metrics.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+static MetricCounter* eventCounter() {
+    static MetricCounter* counter = Metrics::Instance()->counter("tinyvirt_domain_events_total",
+        "Domain events queued for delivery to registered callbacks");
+    return counter;
+}
+
+DomainEventState::DomainEventState()
+    : wakeupFd(-1), sleeping(false), nextID(1), callbackCount(0), running(false) {
+}
+
+DomainEventState::~DomainEventState() {
+    stop();
+}
+
+int DomainEventState::registerCallback(const std::string& domainName, int eventID, virConnectDomainEventCallback callback) {
+    if ( eventID < 0 || eventID >= VIR_DOMAIN_EVENT_ID_LAST ) {
+        throw std::invalid_argument("Unsupported event ID " + std::to_string(eventID));
+    }
+    if ( !callback ) {
+        throw std::invalid_argument("Event callback must not be empty");
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if ( !running ) {
+        start();
+    }
+    std::shared_ptr<Callback> entry = std::make_shared<Callback>();
+    entry->id = nextID++;
+    entry->domainName = domainName;
+    entry->eventID = eventID;
+    entry->callback = callback;
+    callbacks.push_back(entry);
+    callbackCount++;
+    return entry->id;
+}
+
+void DomainEventState::deregisterCallback(int callbackID) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = std::find_if(callbacks.begin(), callbacks.end(),
+        [callbackID](const std::shared_ptr<Callback>& entry) { return entry->id == callbackID; });
+    if ( it == callbacks.end() ) {
+        throw std::invalid_argument("Event callback " + std::to_string(callbackID) + " is not registered");
+    }
+    callbacks.erase(it);
+    callbackCount--;
+}
+
+void DomainEventState::queue(virDomainEvent event) {
+    if ( !hasCallbacks() ) {
+        return;
+    }
+    if ( event.timestamp == 0 ) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        event.timestamp = static_cast< unsigned long long >(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+    events.push(std::move(event));
+    eventCounter()->inc();
+    // 分发线程正在运行时不需要唤醒，省去一次系统调用
+    if ( sleeping.exchange(false) ) {
+        uint64_t one = 1;
+        if ( write(wakeupFd, &one, sizeof(one)) < 0 ) {
+            LOG_ERROR("Failed to wake up event dispatcher: %s", strerror(errno));
+        }
+    }
+}
+
+// 调用时需持有lock
+void DomainEventState::start() {
+    wakeupFd = eventfd(0, EFD_CLOEXEC);
+    if ( wakeupFd < 0 ) {
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
+    running = true;
+    worker = std::thread(&DomainEventState::run, this);
+}
+
+void DomainEventState::stop() {
+    if ( !running.exchange(false) ) {
+        return;
+    }
+    uint64_t one = 1;
+    if ( write(wakeupFd, &one, sizeof(one)) < 0 ) {
+        LOG_ERROR("Failed to wake up event dispatcher: %s", strerror(errno));
+    }
+    if ( worker.joinable() ) {
+        worker.join();
+    }
+    close(wakeupFd);
+    wakeupFd = -1;
+}
+
+void DomainEventState::run() {
+    LOG_INFO("Domain event dispatcher started");
+    virDomainEvent event;
+    while ( running ) {
+        if ( events.pop(event) ) {
+            dispatch(event);
+            continue;
+        }
+        // 先声明准备等待再检查一次队列，之后入队的生产者一定会看到sleeping并写wakeupFd
+        sleeping = true;
+        if ( !events.empty() ) {
+            sleeping = false;
+            continue;
+        }
+        uint64_t value;
+        if ( read(wakeupFd, &value, sizeof(value)) < 0 && errno != EINTR ) {
+            LOG_ERROR("Failed to wait for domain events: %s", strerror(errno));
+            break;
+        }
+        sleeping = false;
+    }
+    LOG_INFO("Domain event dispatcher stopped");
+}
+
+void DomainEventState::dispatch(const virDomainEvent& event) {
+    // 复制匹配的回调后再调用，回调中可以注册或注销回调
+    std::vector<std::shared_ptr<Callback>> matched;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for ( const auto& entry : callbacks ) {
+            if ( entry->eventID == event.eventID &&
+                (entry->domainName.empty() || entry->domainName == event.domainName) ) {
+                matched.push_back(entry);
+            }
+        }
+    }
+    for ( const auto& entry : matched ) {
+        try {
+            entry->callback(event);
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Domain event callback %d failed: %s", entry->id, e.what());
+        }
+    }
+}
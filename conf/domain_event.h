@@ -0,0 +1,124 @@
+#ifndef DOMAIN_EVENT_H
+#define DOMAIN_EVENT_H
+
+#include "../util/mpsc_queue.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+/**
+ * virDomainEventID: 注册回调时选择的事件类别
+ */
+typedef enum {
+    VIR_DOMAIN_EVENT_ID_LIFECYCLE = 0,      /* 生命周期变化，type为virDomainEventType */
+    VIR_DOMAIN_EVENT_ID_DEVICE_ADDED = 1,   /* 添加了设备，device为设备名 */
+    VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED = 2, /* 设备已从客户机中移除，device为设备ID */
+    VIR_DOMAIN_EVENT_ID_BLOCK_JOB = 3,      /* 块任务结束，device为磁盘镜像路径，type为virConnectDomainEventBlockJobStatus */
+    VIR_DOMAIN_EVENT_ID_LAST
+} virDomainEventID;
+
+/**
+ * virDomainEventType: 生命周期事件，取值与libvirt保持一致
+ */
+typedef enum {
+    VIR_DOMAIN_EVENT_STARTED = 2,
+    VIR_DOMAIN_EVENT_SUSPENDED = 3,
+    VIR_DOMAIN_EVENT_RESUMED = 4,
+    VIR_DOMAIN_EVENT_STOPPED = 5,
+    VIR_DOMAIN_EVENT_SHUTDOWN = 6,
+    VIR_DOMAIN_EVENT_CRASHED = 8,
+} virDomainEventType;
+
+// 各生命周期事件的detail
+typedef enum {
+    VIR_DOMAIN_EVENT_STARTED_BOOTED = 0,        /* 正常启动 */
+} virDomainEventStartedDetailType;
+
+typedef enum {
+    VIR_DOMAIN_EVENT_SUSPENDED_PAUSED = 0,      /* 被暂停 */
+} virDomainEventSuspendedDetailType;
+
+typedef enum {
+    VIR_DOMAIN_EVENT_RESUMED_UNPAUSED = 0,      /* 从暂停中恢复 */
+} virDomainEventResumedDetailType;
+
+typedef enum {
+    VIR_DOMAIN_EVENT_STOPPED_SHUTDOWN = 0,      /* 正常关机 */
+    VIR_DOMAIN_EVENT_STOPPED_DESTROYED = 1,     /* 被强制关闭 */
+    VIR_DOMAIN_EVENT_STOPPED_FAILED = 5,        /* QEMU进程意外退出 */
+} virDomainEventStoppedDetailType;
+
+typedef enum {
+    VIR_DOMAIN_EVENT_SHUTDOWN_FINISHED = 0,     /* 客户机完成关机，QEMU即将退出 */
+} virDomainEventShutdownDetailType;
+
+typedef enum {
+    VIR_DOMAIN_EVENT_CRASHED_PANICKED = 0,      /* 客户机内核panic */
+} virDomainEventCrashedDetailType;
+
+typedef enum {
+    VIR_DOMAIN_BLOCK_JOB_COMPLETED = 0,
+    VIR_DOMAIN_BLOCK_JOB_FAILED = 1,
+    VIR_DOMAIN_BLOCK_JOB_CANCELED = 2,
+} virConnectDomainEventBlockJobStatus;
+
+struct virDomainEvent {
+    int eventID = VIR_DOMAIN_EVENT_ID_LIFECYCLE;
+    std::string domainName;
+    std::string uuid;
+    int type = 0;                       // 生命周期事件类型或块任务状态
+    int detail = 0;
+    std::string device;                 // 设备相关事件的设备名
+    unsigned long long timestamp = 0;   // 事件发生时间(CLOCK_REALTIME, ms)
+};
+
+// 回调在事件分发线程中依次调用，不应长时间阻塞
+typedef std::function<void(const virDomainEvent& event)> virConnectDomainEventCallback;
+
+// 事件回调的注册表和分发线程
+// 驱动在任意线程中调用queue，事件经无锁队列交给分发线程，产生事件的一方不会被回调阻塞
+class DomainEventState {
+public:
+    DomainEventState();
+    ~DomainEventState();
+
+    // domainName为空表示接收所有虚拟机的事件，返回回调ID
+    int registerCallback(const std::string& domainName, int eventID, virConnectDomainEventCallback callback);
+    // 注销前已经开始分发的事件仍可能调用一次该回调
+    void deregisterCallback(int callbackID);
+    bool hasCallbacks() const { return callbackCount.load() > 0; }
+
+    // 没有任何回调时直接丢弃事件
+    void queue(virDomainEvent event);
+
+private:
+    struct Callback {
+        int id;
+        std::string domainName;
+        int eventID;
+        virConnectDomainEventCallback callback;
+    };
+
+    void start();
+    void stop();
+    void run();
+    void dispatch(const virDomainEvent& event);
+
+    MpscQueue<virDomainEvent> events;
+    int wakeupFd;                       // eventfd，分发线程空闲时在此等待
+    std::atomic<bool> sleeping;         // 分发线程是否准备等待，生产者只在此时写wakeupFd
+
+    std::mutex lock;                    // 保护callbacks和nextID
+    std::vector<std::shared_ptr<Callback>> callbacks;
+    int nextID;
+    std::atomic<int> callbackCount;
+
+    std::thread worker;
+    std::atomic<bool> running;
+};
+
+#endif // DOMAIN_EVENT_H
@@ -3,8 +3,8 @@
 
 #include <string>
 #include <vector>
-#include <mutex>
 #include <memory>
+#include "../util/rwlock.h"
 
 class StorageVolumeObj {
 public:
@@ -12,10 +12,16 @@ public:
     std::string uuid;           // 卷UUID
     std::string path;           // 卷路径
     std::string format;         // 卷格式, 例如qcow2, raw等
+    std::string backingStore;   // qcow2后备镜像的路径，没有时为空
     int type;                   // 卷类型
 
     size_t capacity = 0;        // 卷容量
     size_t allocation = 0;      // 卷已分配空间
+
+    // 路径索引使用的键，登记到索引时填写
+    std::string canonicalPath;  // 解析符号链接后的绝对路径
+    unsigned long long dev = 0; // 卷文件所在的设备号和inode，文件不存在时为0
+    unsigned long long ino = 0;
 };
 
 class StoragePoolObj {
@@ -32,8 +38,9 @@ public:
     size_t available;           // 存储池可用空间
     size_t allocation;          // 存储池已分配空间
 
-    std::mutex poolMutex;       // 互斥锁，用于线程安全
-
+    // 保护volumes、其中各个卷对象的字段和上面的空间信息，查询持有读锁，增删卷和更新卷信息持有写锁
+    // 只在访问内存中的对象时持有，擦除、克隆等长时间的文件操作不持有，不同存储池之间互不影响
+    mutable RWLock volumesLock;
     std::vector<std::shared_ptr<StorageVolumeObj>> volumes; // 存储池中的卷列表
 };
 
@@ -13,6 +13,65 @@ void initializeDrivers() {
     }
 }
 
+int HypervisorDriver::domainSetSchedulerParameters(std::shared_ptr<VirDomain>,
+    const std::map<std::string, long long>&, unsigned int) {
+    throw std::runtime_error("domainSetSchedulerParameters is not supported by this driver");
+}
+
+int HypervisorDriver::domainSetMemoryParameters(std::shared_ptr<VirDomain>,
+    const std::map<std::string, unsigned long long>&, unsigned int) {
+    throw std::runtime_error("domainSetMemoryParameters is not supported by this driver");
+}
+
+int HypervisorDriver::domainSetBlkioParameters(std::shared_ptr<VirDomain>,
+    const std::map<std::string, std::string>&, unsigned int) {
+    throw std::runtime_error("domainSetBlkioParameters is not supported by this driver");
+}
+
+int HypervisorDriver::domainGetStateFlags(std::shared_ptr<VirDomain> domain, int& reason, unsigned int) {
+    reason = 0;
+    return domainGetState(domain);
+}
+
+void HypervisorDriver::domainShutdownFlags(std::shared_ptr<VirDomain> domain, unsigned int flags, int timeoutSec) {
+    if ( flags != 0 || timeoutSec >= 0 ) {
+        throw std::runtime_error("domainShutdownFlags is not supported by this driver");
+    }
+    domainShutdown(domain);
+}
+
+std::vector<std::shared_ptr<VirDomain>> HypervisorDriver::connectShutdownAllDomains(unsigned int, int) {
+    throw std::runtime_error("connectShutdownAllDomains is not supported by this driver");
+}
+
+int HypervisorDriver::domainGetResourceUsage(std::shared_ptr<VirDomain>, virDomainResourceUsage&) {
+    throw std::runtime_error("domainGetResourceUsage is not supported by this driver");
+}
+
+int HypervisorDriver::domainBlockResize(std::shared_ptr<VirDomain>, const std::string&, unsigned long long, unsigned int) {
+    throw std::runtime_error("domainBlockResize is not supported by this driver");
+}
+
+int HypervisorDriver::domainBlockPull(std::shared_ptr<VirDomain>, const std::string&, unsigned long long, unsigned int) {
+    throw std::runtime_error("domainBlockPull is not supported by this driver");
+}
+
+std::shared_ptr<VirDomain> HypervisorDriver::domainLookupByDiskSource(const std::string&) {
+    return nullptr;
+}
+
+std::vector<virDomainStatsRecord> HypervisorDriver::connectGetAllDomainStats(unsigned int, unsigned int) {
+    throw std::runtime_error("connectGetAllDomainStats is not supported by this driver");
+}
+
+int HypervisorDriver::connectDomainEventRegisterAny(std::shared_ptr<VirDomain>, int, virConnectDomainEventCallback) {
+    throw std::runtime_error("connectDomainEventRegisterAny is not supported by this driver");
+}
+
+int HypervisorDriver::connectDomainEventDeregisterAny(int) {
+    throw std::runtime_error("connectDomainEventDeregisterAny is not supported by this driver");
+}
+
 void DriverFactory::registerDriver(const std::string& pattern, Creator creator) {
     getRegistry()[pattern] = std::move(creator);
 }
@@ -7,9 +7,96 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include "conf/domain_event.h"
 
 class VirDomain;
 
+// 虚拟机资源使用情况，数据来自虚拟机所在的cgroup
+struct virDomainBlockUsage {
+    std::string device;                 // 块设备号"major:minor"
+    unsigned long long rdBytes = 0;
+    unsigned long long wrBytes = 0;
+    unsigned long long rdReqs = 0;
+    unsigned long long wrReqs = 0;
+};
+
+struct virDomainResourceUsage {
+    unsigned long long cpuTime = 0;         // 总CPU时间(ns)
+    unsigned long long userTime = 0;        // 用户态CPU时间(ns)
+    unsigned long long systemTime = 0;      // 内核态CPU时间(ns)
+    unsigned long long throttledTime = 0;   // 因cpu.max被限流的时间(ns)
+    unsigned long long memoryCurrent = 0;   // 当前内存占用(KiB)
+    std::vector<virDomainBlockUsage> blocks;
+};
+
+// virConnectGetAllDomainStats返回的单个虚拟机统计，时间单位为ns，内存单位为KiB
+struct virDomainVcpuStatsRecord {
+    int id = 0;
+    int tid = 0;                            // 宿主机线程ID
+    char state = '?';                       // 线程状态，取自/proc
+    unsigned long long time = 0;            // 累计CPU时间
+    int cpu = -1;                           // 最近一次运行的宿主机CPU
+};
+
+struct virDomainBlockStatsRecord {
+    std::string name;                       // 目标设备名，如vda
+    std::string path;                       // 镜像路径
+    unsigned long long rdReqs = 0;
+    unsigned long long rdBytes = 0;
+    unsigned long long rdTimes = 0;
+    unsigned long long wrReqs = 0;
+    unsigned long long wrBytes = 0;
+    unsigned long long wrTimes = 0;
+    unsigned long long flReqs = 0;
+    unsigned long long flTimes = 0;
+};
+
+// 网卡计数以虚拟机为准，rx为虚拟机接收的数据
+struct virDomainInterfaceStatsRecord {
+    std::string name;                       // 宿主机上的TAP设备名
+    unsigned long long rxBytes = 0;
+    unsigned long long rxPkts = 0;
+    unsigned long long rxErrs = 0;
+    unsigned long long rxDrop = 0;
+    unsigned long long txBytes = 0;
+    unsigned long long txPkts = 0;
+    unsigned long long txErrs = 0;
+    unsigned long long txDrop = 0;
+};
+
+// 气球设备统计，客户机未上报的项为-1
+struct virDomainBalloonStatsRecord {
+    unsigned long long current = 0;         // 当前分配给客户机的内存
+    unsigned long long maximum = 0;         // 配置的最大内存
+    long long swapIn = -1;
+    long long swapOut = -1;
+    long long majorFault = -1;
+    long long minorFault = -1;
+    long long unused = -1;
+    long long available = -1;
+    long long usable = -1;
+    long long diskCaches = -1;
+    long long lastUpdate = -1;              // 客户机上次上报的时间(秒)
+};
+
+struct virDomainStatsRecord {
+    std::shared_ptr<VirDomain> dom;         // 由VirConnect填充
+    std::string name;
+    int state = 0;
+    int reason = 0;
+    unsigned int statsMask = 0;             // 实际采集到的virDomainStatsTypes
+
+    unsigned long long cpuTime = 0;         // QEMU进程的总CPU时间
+    unsigned long long cpuUser = 0;
+    unsigned long long cpuSystem = 0;
+    unsigned long long rss = 0;             // QEMU进程的常驻内存
+
+    virDomainBalloonStatsRecord balloon;
+    std::vector<virDomainVcpuStatsRecord> vcpus;
+    std::vector<virDomainBlockStatsRecord> blocks;
+    std::vector<virDomainInterfaceStatsRecord> interfaces;
+};
+
 class HypervisorDriver {
 public:
     virtual ~HypervisorDriver() = default;
@@ -36,12 +123,47 @@ public:
     // destroy会停止一个虚拟机
     virtual void domainDestroy(std::shared_ptr<VirDomain> domain) = 0;
     virtual void domainShutdown(std::shared_ptr<VirDomain> domain) = 0;
+    // flags为virDomainShutdownFlagValues，timeoutSec为等待客户机关机的秒数，小于0时使用驱动的默认值
+    // 只负责发起关机，超时后由驱动升级为强制关闭；默认实现只支持flags为0且不支持超时
+    virtual void domainShutdownFlags(std::shared_ptr<VirDomain> domain, unsigned int flags, int timeoutSec);
+    // 对所有运行中的虚拟机发起关机，返回已发起关机的虚拟机
+    virtual std::vector<std::shared_ptr<VirDomain>> connectShutdownAllDomains(unsigned int flags, int timeoutSec);
 
     // undefine会删除一个虚拟机对象
     virtual int domainUndefine(std::shared_ptr<VirDomain> domain) = 0;
     virtual int domainUndefineFlags(std::shared_ptr<VirDomain> domain, unsigned int flags) = 0;
 
     virtual int domainGetState(std::shared_ptr<VirDomain> domain) = 0;
+    // flags为virDomainGetStateFlags，默认实现每次都向hypervisor查询，reason为0
+    virtual int domainGetStateFlags(std::shared_ptr<VirDomain> domain, int& reason, unsigned int flags);
+
+    // 资源控制，参数名见virDomain.h中的VIR_DOMAIN_SCHEDULER_*、VIR_DOMAIN_MEMORY_*、VIR_DOMAIN_BLKIO_*
+    // 并非所有驱动都支持，默认实现直接抛出异常
+    virtual int domainSetSchedulerParameters(std::shared_ptr<VirDomain> domain,
+        const std::map<std::string, long long>& params, unsigned int flags);
+    virtual int domainSetMemoryParameters(std::shared_ptr<VirDomain> domain,
+        const std::map<std::string, unsigned long long>& params, unsigned int flags);
+    virtual int domainSetBlkioParameters(std::shared_ptr<VirDomain> domain,
+        const std::map<std::string, std::string>& params, unsigned int flags);
+    virtual int domainGetResourceUsage(std::shared_ptr<VirDomain> domain, virDomainResourceUsage& usage);
+
+    // 在线调整运行中虚拟机的磁盘大小，disk为目标设备名或镜像路径，flags为virDomainBlockResizeFlags
+    virtual int domainBlockResize(std::shared_ptr<VirDomain> domain, const std::string& disk,
+        unsigned long long size, unsigned int flags);
+    // 把后备链中的数据拉取到运行中虚拟机的磁盘镜像中，完成后去掉后备镜像，任务在后台运行
+    // 结束时产生VIR_DOMAIN_EVENT_ID_BLOCK_JOB事件，bandwidth为0表示不限速，flags为virDomainBlockPullFlags
+    virtual int domainBlockPull(std::shared_ptr<VirDomain> domain, const std::string& disk,
+        unsigned long long bandwidth, unsigned int flags);
+    // 返回以path为磁盘镜像的运行中虚拟机，没有时返回空，默认实现总是返回空
+    virtual std::shared_ptr<VirDomain> domainLookupByDiskSource(const std::string& path);
+
+    // 一次调用采集所有虚拟机的统计信息，stats为virDomainStatsTypes的组合，0表示全部
+    virtual std::vector<virDomainStatsRecord> connectGetAllDomainStats(unsigned int stats, unsigned int flags);
+
+    // 事件订阅，domain为空时接收所有虚拟机的事件，eventID为virDomainEventID，返回回调ID
+    virtual int connectDomainEventRegisterAny(std::shared_ptr<VirDomain> domain, int eventID,
+        virConnectDomainEventCallback callback);
+    virtual int connectDomainEventDeregisterAny(int callbackID);
 };
 
 class DriverFactory {
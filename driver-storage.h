@@ -4,14 +4,27 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
+#include "virStoragePool.h"
 
-class VirStoragePool;
 class VirStorageVol;
 
+// 存储卷正被运行中的虚拟机使用时由上层通过hypervisor在线调整大小
+// 返回true表示已由虚拟机完成调整，没有虚拟机使用该卷时返回false，调整失败时抛出异常
+typedef std::function<bool(const std::string& path, unsigned long long oldCapacity,
+    unsigned long long newCapacity)> StorageVolOnlineResizeHandler;
+// 与上面相同，由运行中的虚拟机在后台合并后备链，返回true表示已启动合并任务
+// 任务结束后(无论成功与否)调用一次onFinished，存储驱动据此重新读取镜像头
+// onFinished在调用进程中执行，进程在任务结束前退出时不会被调用
+typedef std::function<bool(const std::string& path, std::function<void()> onFinished)> StorageVolOnlineFlattenHandler;
+
 class StorageDriver {
 public:
     virtual ~StorageDriver() = default;
 
+    void setOnlineResizeHandler(StorageVolOnlineResizeHandler handler) { onlineResizeHandler = handler; }
+    void setOnlineFlattenHandler(StorageVolOnlineFlattenHandler handler) { onlineFlattenHandler = handler; }
+
     // 存储池相关操作
     virtual std::vector<std::shared_ptr<VirStoragePool>> connectListStoragePools(unsigned int flags = 0) const = 0;
     virtual std::shared_ptr<VirStoragePool> storagePoolLookupByName(const std::string& name) const = 0;
@@ -28,6 +41,8 @@ public:
     virtual int storagePoolGetState(std::shared_ptr<VirStoragePool> pool) const = 0;
     virtual int storagePoolGetType(std::shared_ptr<VirStoragePool> pool) const = 0;
     virtual std::string storagePoolGetPath(std::shared_ptr<VirStoragePool> pool) const = 0;
+    virtual int storagePoolGetInfo(std::shared_ptr<VirStoragePool> pool, virStoragePoolInfo& info) const = 0;
+    virtual int storagePoolRefresh(std::shared_ptr<VirStoragePool> pool, unsigned int flags = 0) = 0;
 
     // 存储卷相关操作
     virtual std::vector<std::shared_ptr<VirStorageVol>> storagePoolListAllVolumes(std::shared_ptr<VirStoragePool> pool, unsigned int flags = 0) const = 0;
@@ -39,11 +54,21 @@ public:
     virtual int storageVolDelete(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) = 0;
     virtual int storageVolResize(std::shared_ptr<VirStorageVol> vol, unsigned long long capacity, unsigned int flags = 0) = 0;
     virtual int storageVolWipe(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) = 0;
+    virtual int storageVolWipePattern(std::shared_ptr<VirStorageVol> vol, unsigned int algorithm, unsigned int flags = 0) = 0;
+    virtual int storageVolFlatten(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) = 0;
+    virtual int storageVolDownload(std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+        unsigned long long length, unsigned int flags = 0) = 0;
+    virtual int storageVolUpload(std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+        unsigned long long length, unsigned int flags = 0) = 0;
 
     virtual unsigned long long storageVolGetAllocation(std::shared_ptr<VirStorageVol> vol) const = 0;
     virtual unsigned long long storageVolGetCapacity(std::shared_ptr<VirStorageVol> vol) const = 0;
     virtual int storageVolGetType(std::shared_ptr<VirStorageVol> vol) const = 0;
     virtual std::string storageVolGetXMLDesc(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) const = 0;
+
+protected:
+    StorageVolOnlineResizeHandler onlineResizeHandler;
+    StorageVolOnlineFlattenHandler onlineFlattenHandler;
 };
 
 class StorageDriverFactory {
@@ -0,0 +1,132 @@
+#include "../stats/stats_shm_layout.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// 读取myVirsh stats-export导出的统计共享内存，默认路径与myLibvirt.conf中的stats.shm_path一致
+// 用法: ./stats_shm_reader [path] [count]，每秒打印一次，count次后退出(0表示一直运行)
+
+struct ShmMapping {
+    int fd = -1;
+    virStatsShmHeader* header = NULL;
+    size_t size = 0;
+};
+
+static void closeMapping(ShmMapping& map) {
+    if ( map.header ) {
+        munmap(map.header, map.size);
+    }
+    if ( map.fd >= 0 ) {
+        close(map.fd);
+    }
+    map = ShmMapping();
+}
+
+static bool mapFile(ShmMapping& map, int fd, size_t size) {
+    void* addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if ( addr == MAP_FAILED ) {
+        return false;
+    }
+    if ( map.header ) {
+        munmap(map.header, map.size);
+    }
+    map.header = static_cast< virStatsShmHeader* >(addr);
+    map.size = size;
+    return true;
+}
+
+static bool openMapping(ShmMapping& map, const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        std::cerr << "open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    map.fd = fd;
+    if ( !mapFile(map, fd, sizeof(virStatsShmHeader)) ) {
+        closeMapping(map);
+        return false;
+    }
+    if ( map.header->magic != VIR_STATS_SHM_MAGIC || map.header->version != VIR_STATS_SHM_VERSION ||
+        map.header->domainSize < sizeof(virStatsShmDomain) ) {
+        std::cerr << path << ": unsupported layout" << std::endl;
+        closeMapping(map);
+        return false;
+    }
+    return true;
+}
+
+// 按seqlock协议复制一份完整快照，返回false表示需要重新打开文件
+static bool readSnapshot(ShmMapping& map, virStatsShmHeader& header, std::vector<virStatsShmDomain>& domains) {
+    while ( true ) {
+        uint64_t seq = virStatsShmReadBegin(map.header);
+        memcpy(&header, map.header, sizeof(header));
+        size_t needed = header.headerSize + static_cast< size_t >(header.capacity) * header.domainSize;
+        if ( needed > map.size ) {
+            // 写者扩容了，先确认读到的capacity是一致的再重新映射
+            if ( virStatsShmReadRetry(map.header, seq) ) {
+                continue;
+            }
+            if ( !mapFile(map, map.fd, needed) ) {
+                return false;
+            }
+            continue;
+        }
+        domains.resize(header.domainCount);
+        const char* base = reinterpret_cast< const char* >(map.header) + header.headerSize;
+        for ( uint32_t i = 0; i < header.domainCount; i++ ) {
+            memcpy(&domains[i], base + static_cast< size_t >(i) * header.domainSize, sizeof(virStatsShmDomain));
+        }
+        if ( !virStatsShmReadRetry(map.header, seq) ) {
+            return !header.closed;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "../temp/run/stats.shm";
+    int count = argc > 2 ? atoi(argv[2]) : 0;
+
+    ShmMapping map;
+    virStatsShmHeader header;
+    std::vector<virStatsShmDomain> domains;
+    for ( int i = 0; count == 0 || i < count; i++ ) {
+        if ( i > 0 ) {
+            sleep(1);
+        }
+        if ( !map.header && !openMapping(map, path) ) {
+            continue;
+        }
+        if ( !readSnapshot(map, header, domains) ) {
+            // 写者已退出或文件被替换，下次重新打开
+            std::cout << "writer " << header.writerPid << " closed, reopening" << std::endl;
+            closeMapping(map);
+            continue;
+        }
+
+        std::cout << "timestamp=" << header.timestamp << " interval=" << header.intervalMs << "ms"
+            << " writer=" << header.writerPid << " domains=" << header.domainCount << "\n"
+            << "host cpus=" << header.host.cpuCount << " user=" << header.host.cpuUser
+            << " system=" << header.host.cpuSystem << " idle=" << header.host.cpuIdle
+            << " mem.total=" << header.host.memTotal << " mem.available=" << header.host.memAvailable << "\n";
+        for ( size_t j = 0; j < domains.size(); j++ ) {
+            const virStatsShmDomain& d = domains[j];
+            std::cout << "  " << d.name << " state=" << d.state << " cpu.time=" << d.cpuTime << " rss=" << d.rss
+                << " rd.bytes=" << d.rdBytes << " wr.bytes=" << d.wrBytes
+                << " rx.bytes=" << d.rxBytes << " tx.bytes=" << d.txBytes;
+            if ( d.hasRates ) {
+                std::cout << std::fixed << std::setprecision(1) << " cpu%=" << d.cpuPercent
+                    << " rd.B/s=" << d.rdBytesPerSec << " wr.B/s=" << d.wrBytesPerSec;
+            }
+            std::cout << "\n";
+        }
+        std::cout << std::endl;
+    }
+    closeMapping(map);
+    return 0;
+}
@@ -12,7 +12,10 @@ QemuDriverConfig::QemuDriverConfig() {
     configDir = configManager->getValue("qemu.config_dir", "./temp/domains");
     qmpSocketDir = configManager->getValue("qemu.qmp_socket_dir", "./temp/unix_sockets");
     qemuEmulator = configManager->getValue("qemu.qemu_emulator", "/usr/bin/qemu-system-x86_64");
+    cgroupPartition = configManager->getValue("qemu.cgroup_partition", "tinyvirt");
     openGraphics = configManager->getValue("qemu.open_graphics", "true") == "true";
+    shutdownTimeoutSec = configManager->getIntValue("qemu.shutdown_timeout", 60);
+    shutdownQuitTimeoutSec = configManager->getIntValue("qemu.shutdown_quit_timeout", 10);
      
     if ( !access(configDir.c_str(), F_OK) ) {
         createDirectoryIfNotExists(configDir);
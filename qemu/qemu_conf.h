@@ -9,19 +9,31 @@ private:
     std::string configDir;
     std::string qmpSocketDir;
     std::string qemuEmulator;
+    std::string cgroupPartition;    // 虚拟机cgroup所在的父控制组，相对于cgroup2挂载点
     bool openGraphics;
+    int shutdownTimeoutSec;         // 发送ACPI关机后等待客户机关机的时间，超时后发送quit
+    int shutdownQuitTimeoutSec;     // 发送quit后等待QEMU退出的时间，超时后SIGKILL
     // bool createDirectoryIfNotExists(const std::string& path) const;
 public:
     QemuDriverConfig();
     std::string getConfigDir() const;
     std::string getQmpSocketDir() const;
     std::string getQemuEmulator() const;
+    std::string getCgroupPartition() const {
+        return cgroupPartition;
+    }
     std::string getLogDir() const {
         return "./temp/log";
     }
     bool isOpenGraphics() const {
         return openGraphics;
     }
+    int getShutdownTimeoutSec() const {
+        return shutdownTimeoutSec;
+    }
+    int getShutdownQuitTimeoutSec() const {
+        return shutdownQuitTimeoutSec;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -5,23 +5,53 @@
 #include "qemu_monitor.h"
 #include <string>
 #include <memory>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <sys/types.h>
 
 // QEMU特定的域定义
 class qemuDomainDef : public virDomainDef {
 public:
     // QEMU特有配置
     std::string qmpSocketPath;    // QMP套接字路径
+    // 只用于接收事件的第二个QMP套接字，QEMU的每个QMP套接字同一时间只接受一个客户端，
+    // 事件订阅者长期占用这一个，其他进程的命令仍然可以使用qmpSocketPath
+    std::string qmpEventSocketPath;
     std::string monitorSocketPath; // 监控套接字路径
     bool enableKVM;               // 是否启用KVM
     
     // 其他QEMU特定配置
 };
 
+// 优雅关机所处的阶段，超时后依次升级
+typedef enum {
+    QEMU_DOMAIN_SHUTDOWN_NONE = 0,
+    QEMU_DOMAIN_SHUTDOWN_POWERDOWN,     // 已发送system_powerdown，等待客户机关机
+    QEMU_DOMAIN_SHUTDOWN_QUIT,          // 客户机没有响应，已发送quit
+    QEMU_DOMAIN_SHUTDOWN_KILL,          // QEMU没有退出，已发送SIGKILL
+} qemuDomainShutdownStage;
+
 // QEMU特定的域对象
 class qemuDomainObj : public virDomainObj {
 public:
     // QEMU特有运行时数据
-    std::shared_ptr<QemuMonitor> monitor;  // QMP监控对象
+    std::vector<pid_t> vcpuThreads;        // 第i个vcpu对应的宿主机线程ID
+    std::map<unsigned int, pid_t> iothreadThreads;  // iothread编号到宿主机线程ID的映射
+    std::vector<std::string> interfaceDevices;      // 每个网卡在宿主机上对应的TAP设备名，没有时为空
+    std::atomic<bool> guestShutdown{ false };       // 收到了客户机关机事件，进程随后退出属于正常关机
+    std::atomic<bool> stateSynced{ false };         // stateReason已与QEMU同步并由事件维护，为true时读取状态不需要驱动锁
+    std::atomic<bool> watched{ false };             // 当前进程已加入事件循环，进程退出或被销毁后清除
+    std::atomic<bool> eventsWatched{ false };       // 事件连接已加入事件循环，连接断开后清除
+    int shutdownStage = QEMU_DOMAIN_SHUTDOWN_NONE;  // qemuDomainShutdownStage，需持有驱动锁访问
+    uint64_t shutdownTimer = 0;                     // 关机超时定时器，0表示没有
+    unsigned long long shutdownDeadlineMs = 0;      // 当前关机阶段超时的时间点(CLOCK_MONOTONIC, ms)
+    unsigned int monitorFailures = 0;               // QMP连续连接失败的次数
+    unsigned long long monitorRetryAtMs = 0;        // 连接失败后的退避截止时间(CLOCK_MONOTONIC, ms)，之前不再尝试连接
+    std::map<std::string, std::string> blockJobs;   // 进行中的块任务，QEMU中的设备名到磁盘镜像路径的映射
+    std::mutex blockJobsLock;                       // 保护blockJobs，事件处理中不能获取驱动锁
     
     // 构造函数
     qemuDomainObj() {
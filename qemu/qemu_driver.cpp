@@ -3,11 +3,29 @@
 #include "../virConnect.h"
 #include "../tinyxml/tinyxml2.h"
 #include "../util/generate_uuid.h"
+#include "../util/netdev_tap.h"
+#include "../util/host_topology.h"
+#include "../util/cpuset.h"
+#include "../util/process_util.h"
+#include "../util/file_util.h"
+#include "../util/cgroup.h"
+#include "../util/proc_stat.h"
+#include "../util/metrics.h"
+#include "../util/timer_service.h"
 #include <dirent.h>
 #include <memory>
 #include <map>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <algorithm>
+
+#define MONITOR_RETRY_BASE_MS 100ULL    // QMP连接失败后第一次重试前的等待时间，之后每次翻倍
+#define MONITOR_RETRY_MAX_MS 5000ULL    // 退避的上限
+#define DOMAIN_RESCAN_INTERVAL_MS 2000  // 有事件订阅时检查其他进程启动的虚拟机的间隔
 
 QemuDriver::QemuDriver() {
     config = QemuDriverConfig();
@@ -41,7 +59,7 @@ void QemuDriver::loadAllDomainConfigs() {
                 std::string xmlDesc = readFileContent(filePath);
 
                 // 解析XML创建domain对象
-                this->domains.push_back(parseAndCreateDomainObj(xmlDesc));
+                addDomainObj(parseAndCreateDomainObj(xmlDesc));
             }
             catch ( const std::exception& e ) {
                 // std::cerr << "Failed to load domain config " << filename << ": " << e.what() << std::endl;
@@ -56,33 +74,62 @@ void QemuDriver::loadAllDomainConfigs() {
 
     // 遍历虚拟机对象，查看是否存在对应的pid文件
     for ( const auto& domainObj : domains ) {
-        std::string pidFilePath = config.getConfigDir() + "/" + domainObj->def->name + ".pid";
-        std::ifstream pidFile(pidFilePath);
-        if ( pidFile.is_open() ) {
-            int pid;
-            pidFile >> pid;
-            pidFile.close();
-
-            // 检查PID是否有效（进程是否存在）
-            if ( kill(pid, 0) == 0 ) {
-                // 进程存在，设置运行状态
-                domainObj->pid = pid;
-                domainObj->def->id = generateUniqueID(); // 生成唯一ID
-                domainObj->stateReason.state = VIR_DOMAIN_RUNNING;
-                LOG_INFO("Domain %s is running with PID: %d", domainObj->def->name.c_str(), pid);
-            }
-            else {
-                // 进程不存在，删除过期的PID文件
-                LOG_WARN("Domain %s has stale PID file (PID %d not running), cleaning up",
-                    domainObj->def->name.c_str(), pid);
-                remove(pidFilePath.c_str());
-                domainObj->pid = -1;
-                domainObj->stateReason.state = VIR_DOMAIN_SHUTOFF;
-            }
+        loadDomainPid(domainObj);
+    }
+}
+
+bool QemuDriver::loadDomainPid(std::shared_ptr<qemuDomainObj> domainObj) {
+    std::string pidFilePath = config.getConfigDir() + "/" + domainObj->def->name + ".pid";
+    std::ifstream pidFile(pidFilePath);
+    if ( !pidFile.is_open() ) {
+        return false;
+    }
+    int pid = -1;
+    pidFile >> pid;
+    pidFile.close();
+
+    // 检查PID是否有效（进程是否存在）
+    if ( pid > 0 && kill(pid, 0) == 0 ) {
+        // 进程存在，设置运行状态
+        domainObj->pid = pid;
+        domainObj->def->id = generateUniqueID(); // 生成唯一ID
+        domainObj->stateReason.state = VIR_DOMAIN_RUNNING;
+        domainObj->stateReason.reason = 0;
+        LOG_INFO("Domain %s is running with PID: %d", domainObj->def->name.c_str(), pid);
+        return true;
+    }
+    // 进程不存在，删除过期的PID文件
+    LOG_WARN("Domain %s has stale PID file (PID %d not running), cleaning up",
+        domainObj->def->name.c_str(), pid);
+    remove(pidFilePath.c_str());
+    domainObj->pid = -1;
+    domainObj->stateReason.state = VIR_DOMAIN_SHUTOFF;
+    return false;
+}
+
+void QemuDriver::rescanDomains() {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    for ( const auto& domainObj : domains ) {
+        if ( domainObj->pid > 0 || !loadDomainPid(domainObj) ) {
+            continue;
         }
+        queueDomainEvent(*domainObj->def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_STARTED, VIR_DOMAIN_EVENT_STARTED_BOOTED);
+        watchDomain(domainObj);
     }
 }
 
+void QemuDriver::addDomainObj(std::shared_ptr<qemuDomainObj> domainObj) {
+    domains.push_back(domainObj);
+    std::lock_guard<std::mutex> guard(domainsByNameLock);
+    domainsByName[domainObj->def->name] = domainObj;
+}
+
+std::shared_ptr<qemuDomainObj> QemuDriver::findDomainObj(const std::string& name) const {
+    std::lock_guard<std::mutex> guard(domainsByNameLock);
+    auto it = domainsByName.find(name);
+    return it != domainsByName.end() ? it->second : nullptr;
+}
+
 std::string QemuDriver::readFileContent(const std::string& filePath) const {
     std::ifstream file(filePath);
     if ( !file ) {
@@ -95,6 +142,45 @@ std::string QemuDriver::readFileContent(const std::string& filePath) const {
 }
 
 // 解析XML字段，并创建domainOBJ对象
+// 解析带unit属性的内存大小，返回KiB，元素不存在时返回0
+static unsigned long long parseScaledKiB(tinyxml2::XMLElement* elem) {
+    if ( !elem ) {
+        return 0;
+    }
+    uint64_t value = 0;
+    elem->QueryUnsigned64Text(&value);
+    const std::string unit = elem->Attribute("unit") ? elem->Attribute("unit") : "KiB";
+    if ( unit == "b" || unit == "bytes" ) {
+        return value / 1024;
+    }
+    if ( unit == "KiB" || unit == "K" || unit == "k" ) {
+        return value;
+    }
+    if ( unit == "MiB" || unit == "M" ) {
+        return value * 1024;
+    }
+    if ( unit == "GiB" || unit == "G" ) {
+        return value * 1024 * 1024;
+    }
+    if ( unit == "TiB" || unit == "T" ) {
+        return value * 1024 * 1024 * 1024;
+    }
+    throw std::runtime_error("Unknown memory unit: " + unit);
+}
+
+// 校验CPU权重与带宽参数，取值范围与cgroup v2的cpu.weight/cpu.max一致
+static void validateCpuBandwidth(const virDomainCputuneDef& cputune) {
+    if ( cputune.shares != 0 && cputune.shares > 10000 ) {
+        throw std::runtime_error("cputune shares must be in range [1, 10000]");
+    }
+    if ( cputune.period != 0 && (cputune.period < 1000 || cputune.period > 1000000) ) {
+        throw std::runtime_error("cputune period must be in range [1000, 1000000]");
+    }
+    if ( cputune.quota > 0 && cputune.quota < 1000 ) {
+        throw std::runtime_error("cputune quota must be at least 1000");
+    }
+}
+
 std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::string& xmlDesc) {
     using namespace tinyxml2;
 
@@ -119,6 +205,10 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
         throw std::runtime_error("Failed to find element: name");
     }
     std::string domainName = nameElem->GetText();
+    // 虚拟机名会用作配置文件、QMP套接字和cgroup的路径分量
+    if ( domainName[0] == '.' || domainName.find('/') != std::string::npos ) {
+        throw std::runtime_error("Invalid domain name: '" + domainName + "'");
+    }
 
     // 解析UUID
     XMLElement* uuidElem = domainElem->FirstChildElement("uuid");
@@ -174,16 +264,99 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
         }
     }
 
+    // 解析内存后端
+    virDomainMemoryBackingDef memoryBacking;
+    XMLElement* memBackingElem = domainElem->FirstChildElement("memoryBacking");
+    if ( memBackingElem ) {
+        XMLElement* hugepagesElem = memBackingElem->FirstChildElement("hugepages");
+        if ( hugepagesElem ) {
+            XMLElement* pageElem = hugepagesElem->FirstChildElement("page");
+            if ( pageElem && pageElem->Attribute("size") ) {
+                uint64_t size = 0;
+                pageElem->QueryUnsigned64Attribute("size", &size);
+                const std::string unit = pageElem->Attribute("unit") ? pageElem->Attribute("unit") : "KiB";
+                if ( unit == "KiB" || unit == "K" || unit == "k" ) {
+                    memoryBacking.hugepageSizeKiB = size;
+                }
+                else if ( unit == "MiB" || unit == "M" ) {
+                    memoryBacking.hugepageSizeKiB = size * 1024;
+                }
+                else if ( unit == "GiB" || unit == "G" ) {
+                    memoryBacking.hugepageSizeKiB = size * 1024 * 1024;
+                }
+                else {
+                    throw std::runtime_error("Unknown hugepage unit: " + unit);
+                }
+                if ( pageElem->Attribute("nodeset") ) {
+                    memoryBacking.hugepageNodeset = pageElem->Attribute("nodeset");
+                }
+            }
+            else {
+                // 未指定页大小时使用宿主机默认大页
+                memoryBacking.hugepageSizeKiB = HostInfo::Instance()->getDefaultHugepageSizeKiB();
+                if ( memoryBacking.hugepageSizeKiB == 0 ) {
+                    throw std::runtime_error("Hugepages requested but host has no hugepage support");
+                }
+            }
+        }
+
+        XMLElement* sourceElem = memBackingElem->FirstChildElement("source");
+        if ( sourceElem && sourceElem->Attribute("type") ) {
+            memoryBacking.source = sourceElem->Attribute("type");
+            if ( memoryBacking.source != "anonymous" && memoryBacking.source != "file" && memoryBacking.source != "memfd" ) {
+                throw std::runtime_error("Unknown memory source type: " + memoryBacking.source);
+            }
+        }
+        XMLElement* accessElem = memBackingElem->FirstChildElement("access");
+        if ( accessElem && accessElem->Attribute("mode") ) {
+            memoryBacking.share = std::string(accessElem->Attribute("mode")) == "shared";
+        }
+        XMLElement* allocationElem = memBackingElem->FirstChildElement("allocation");
+        if ( allocationElem && allocationElem->Attribute("mode") ) {
+            memoryBacking.prealloc = std::string(allocationElem->Attribute("mode")) == "immediate";
+        }
+        memoryBacking.discard = memBackingElem->FirstChildElement("discard") != nullptr;
+    }
+
+    // 解析NUMA内存策略
+    virDomainNumatuneDef numatune;
+    XMLElement* numatuneElem = domainElem->FirstChildElement("numatune");
+    XMLElement* numaMemElem = numatuneElem ? numatuneElem->FirstChildElement("memory") : nullptr;
+    if ( numaMemElem ) {
+        numatune.mode = numaMemElem->Attribute("mode") ? numaMemElem->Attribute("mode") : "strict";
+        if ( numatune.mode != "strict" && numatune.mode != "preferred" && numatune.mode != "interleave" ) {
+            throw std::runtime_error("Unknown numatune mode: " + numatune.mode);
+        }
+        if ( numaMemElem->Attribute("nodeset") ) {
+            numatune.nodeset = numaMemElem->Attribute("nodeset");
+            parseCpuSet(numatune.nodeset);  // 提前校验格式
+        }
+        numatune.placement = numaMemElem->Attribute("placement") ? numaMemElem->Attribute("placement") :
+            (numatune.nodeset.empty() ? "auto" : "static");
+    }
+
     // 解析vcpus
     int vcpus = 1;
+    std::string vcpuPlacement = "static";
+    std::string vcpuCpuset;
     XMLElement* vcpusElem = domainElem->FirstChildElement("vcpu");
     if ( vcpusElem ) {
         vcpusElem->QueryIntText(&vcpus);
+        if ( vcpusElem->Attribute("placement") ) {
+            vcpuPlacement = vcpusElem->Attribute("placement");
+            if ( vcpuPlacement != "static" && vcpuPlacement != "auto" ) {
+                throw std::runtime_error("Unsupported vcpu placement: " + vcpuPlacement);
+            }
+        }
+        if ( vcpusElem->Attribute("cpuset") ) {
+            vcpuCpuset = vcpusElem->Attribute("cpuset");
+            parseCpuSet(vcpuCpuset);
+        }
     }
 
-    // 更新解析磁盘部分的代码
-    // 解析磁盘镜像
-    std::string diskPath;
+    // 解析磁盘
+    std::vector<virDomainDiskDef> disks;
+    std::string cdromPath;
     XMLElement* devicesElem = domainElem ? domainElem->FirstChildElement("devices") : nullptr;
     if ( devicesElem ) {
         // 处理disk元素
@@ -193,23 +366,94 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
 
             // 检查设备类型
             const char* device = diskNode->Attribute("device");
-            if ( device && std::string(device) == "disk" ) {
-                XMLElement* sourceElem = diskNode->FirstChildElement("source");
-                if ( sourceElem && sourceElem->Attribute("file") ) {
-                    diskPath = sourceElem->Attribute("file");
-                    break;  // 只取第一个磁盘
+            std::string deviceType = device ? device : "disk";
+            XMLElement* sourceElem = diskNode->FirstChildElement("source");
+            if ( !sourceElem || !sourceElem->Attribute("file") ) {
+                LOG_WARN("Disk without source file found, skipping");
+                continue;
+            }
+
+            // <disk device='cdrom'>与旧的<cdrom>元素等价
+            if ( deviceType == "cdrom" ) {
+                cdromPath = sourceElem->Attribute("file");
+                continue;
+            }
+            if ( deviceType != "disk" ) {
+                LOG_WARN("Unsupported disk device type: %s, skipping", deviceType.c_str());
+                continue;
+            }
+
+            virDomainDiskDef disk;
+            disk.source = sourceElem->Attribute("file");
+
+            // 解析目标设备和总线类型，未指定总线时按照设备名前缀推断
+            XMLElement* targetElem = diskNode->FirstChildElement("target");
+            if ( targetElem && targetElem->Attribute("dev") ) {
+                disk.targetDev = targetElem->Attribute("dev");
+            }
+            if ( targetElem && targetElem->Attribute("bus") ) {
+                disk.bus = targetElem->Attribute("bus");
+            }
+            else if ( disk.targetDev.compare(0, 2, "sd") == 0 ) {
+                disk.bus = "scsi";
+            }
+            else if ( disk.targetDev.compare(0, 2, "hd") == 0 ) {
+                disk.bus = "ide";
+            }
+            else {
+                disk.bus = "virtio";
+            }
+            if ( disk.bus != "virtio" && disk.bus != "scsi" && disk.bus != "ide" && disk.bus != "sata" ) {
+                throw std::runtime_error("Unsupported disk bus: " + disk.bus);
+            }
+
+            // 解析driver元素中的格式和调优参数
+            XMLElement* driverElem = diskNode->FirstChildElement("driver");
+            if ( driverElem ) {
+                if ( driverElem->Attribute("type") ) {
+                    disk.format = driverElem->Attribute("type");
+                }
+                if ( driverElem->Attribute("cache") ) {
+                    disk.cache = driverElem->Attribute("cache");
+                    if ( disk.cache != "none" && disk.cache != "writeback" && disk.cache != "writethrough" &&
+                        disk.cache != "directsync" && disk.cache != "unsafe" ) {
+                        throw std::runtime_error("Unknown disk cache mode: " + disk.cache);
+                    }
                 }
+                if ( driverElem->Attribute("io") ) {
+                    disk.io = driverElem->Attribute("io");
+                    if ( disk.io != "native" && disk.io != "io_uring" && disk.io != "threads" ) {
+                        throw std::runtime_error("Unknown disk io mode: " + disk.io);
+                    }
+                }
+                if ( driverElem->Attribute("discard") ) {
+                    disk.discard = driverElem->Attribute("discard");
+                    if ( disk.discard != "unmap" && disk.discard != "ignore" ) {
+                        throw std::runtime_error("Unknown disk discard mode: " + disk.discard);
+                    }
+                }
+                driverElem->QueryUnsignedAttribute("queues", &disk.queues);
+                driverElem->QueryUnsignedAttribute("iothread", &disk.iothread);
             }
-        }
 
-        // 处理cdrom
-        // XMLElement* cdromElem = devicesElem->FirstChildElement("cdrom");
-        // 现有cdrom处理代码...
-    }
+            // aio=native要求绕过宿主机页缓存，否则QEMU拒绝启动
+            if ( disk.io == "native" && disk.cache != "none" && disk.cache != "directsync" ) {
+                LOG_WARN("Disk %s: io='native' requires cache='none' or 'directsync', falling back to io='threads'",
+                    disk.source.c_str());
+                disk.io = "threads";
+            }
+            if ( (disk.queues > 0 || disk.iothread > 0) && disk.bus != "virtio" && disk.bus != "scsi" ) {
+                LOG_WARN("Disk %s: queues/iothread are only supported on virtio and scsi bus, ignored",
+                    disk.source.c_str());
+                disk.queues = 0;
+                disk.iothread = 0;
+            }
 
-    // 解析CDROM镜像
-    std::string cdromPath;
-    if ( devicesElem ) {
+            disk.alias = disk.bus + "-disk" + std::to_string(disks.size());
+            disks.push_back(disk);
+        }
+
+        // 兼容旧的<cdrom>元素
         XMLElement* cdromElem1 = devicesElem->FirstChildElement("cdrom");
         if ( cdromElem1 ) {
             XMLElement* sourceElem = cdromElem1->FirstChildElement("source");
@@ -217,6 +461,151 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
                 cdromPath = sourceElem->Attribute("file");
             }
         }
+
+        // 气球设备，默认添加virtio气球以便获取客户机内存统计
+        XMLElement* memballoonElem = devicesElem->FirstChildElement("memballoon");
+        if ( memballoonElem ) {
+            def->memballoonModel = memballoonElem->Attribute("model") ? memballoonElem->Attribute("model") : "virtio";
+            if ( def->memballoonModel != "virtio" && def->memballoonModel != "none" ) {
+                throw std::runtime_error("Unsupported memballoon model: " + def->memballoonModel);
+            }
+            XMLElement* statsElem = memballoonElem->FirstChildElement("stats");
+            if ( statsElem ) {
+                statsElem->QueryUnsignedAttribute("period", &def->memballoonStatsPeriod);
+            }
+        }
+    }
+
+    // 解析iothreads，未显式配置时为每个virtio/scsi磁盘分配一个独立的iothread
+    unsigned int iothreads = 0;
+    XMLElement* iothreadsElem = domainElem->FirstChildElement("iothreads");
+    if ( iothreadsElem ) {
+        iothreadsElem->QueryUnsignedText(&iothreads);
+        unsigned int next = 0;
+        for ( auto& disk : disks ) {
+            if ( disk.bus != "virtio" && disk.bus != "scsi" ) {
+                continue;
+            }
+            if ( disk.iothread > iothreads ) {
+                throw std::runtime_error("Disk " + disk.source + " uses undefined iothread " + std::to_string(disk.iothread));
+            }
+            if ( disk.iothread == 0 && iothreads > 0 ) {
+                disk.iothread = (next++ % iothreads) + 1;
+            }
+        }
+    }
+    else {
+        // 保留显式指定的编号，其余磁盘依次分配新的iothread
+        for ( const auto& disk : disks ) {
+            iothreads = std::max(iothreads, disk.iothread);
+        }
+        for ( auto& disk : disks ) {
+            if ( disk.iothread == 0 && (disk.bus == "virtio" || disk.bus == "scsi") ) {
+                disk.iothread = ++iothreads;
+            }
+        }
+    }
+
+    // 解析<cputune>中的线程绑定
+    virDomainCputuneDef cputune;
+    XMLElement* cputuneElem = domainElem->FirstChildElement("cputune");
+    if ( cputuneElem ) {
+        for ( XMLElement* pinElem = cputuneElem->FirstChildElement("vcpupin");
+            pinElem;
+            pinElem = pinElem->NextSiblingElement("vcpupin") ) {
+            virDomainVcpuPinDef pin;
+            if ( pinElem->QueryUnsignedAttribute("vcpu", &pin.vcpu) != XML_SUCCESS || !pinElem->Attribute("cpuset") ) {
+                throw std::runtime_error("vcpupin requires vcpu and cpuset attributes");
+            }
+            if ( pin.vcpu >= static_cast< unsigned int >(vcpus) ) {
+                throw std::runtime_error("vcpupin refers to nonexistent vcpu " + std::to_string(pin.vcpu));
+            }
+            pin.cpuset = pinElem->Attribute("cpuset");
+            parseCpuSet(pin.cpuset);
+            cputune.vcpupins.push_back(pin);
+        }
+        for ( XMLElement* pinElem = cputuneElem->FirstChildElement("iothreadpin");
+            pinElem;
+            pinElem = pinElem->NextSiblingElement("iothreadpin") ) {
+            virDomainIOThreadPinDef pin;
+            if ( pinElem->QueryUnsignedAttribute("iothread", &pin.iothread) != XML_SUCCESS || !pinElem->Attribute("cpuset") ) {
+                throw std::runtime_error("iothreadpin requires iothread and cpuset attributes");
+            }
+            if ( pin.iothread == 0 || pin.iothread > iothreads ) {
+                throw std::runtime_error("iothreadpin refers to nonexistent iothread " + std::to_string(pin.iothread));
+            }
+            pin.cpuset = pinElem->Attribute("cpuset");
+            parseCpuSet(pin.cpuset);
+            cputune.iothreadpins.push_back(pin);
+        }
+        XMLElement* emulatorpinElem = cputuneElem->FirstChildElement("emulatorpin");
+        if ( emulatorpinElem && emulatorpinElem->Attribute("cpuset") ) {
+            cputune.emulatorpin = emulatorpinElem->Attribute("cpuset");
+            parseCpuSet(cputune.emulatorpin);
+        }
+
+        // CPU权重与带宽
+        XMLElement* sharesElem = cputuneElem->FirstChildElement("shares");
+        if ( sharesElem ) {
+            uint64_t shares = 0;
+            sharesElem->QueryUnsigned64Text(&shares);
+            cputune.shares = shares;
+        }
+        XMLElement* periodElem = cputuneElem->FirstChildElement("period");
+        if ( periodElem ) {
+            uint64_t period = 0;
+            periodElem->QueryUnsigned64Text(&period);
+            cputune.period = period;
+        }
+        XMLElement* quotaElem = cputuneElem->FirstChildElement("quota");
+        if ( quotaElem ) {
+            int64_t quota = 0;
+            quotaElem->QueryInt64Text(&quota);
+            cputune.quota = quota;
+        }
+        validateCpuBandwidth(cputune);
+    }
+
+    // 解析<memtune>
+    virDomainMemtuneDef memtune;
+    XMLElement* memtuneElem = domainElem->FirstChildElement("memtune");
+    if ( memtuneElem ) {
+        memtune.hardLimitKiB = parseScaledKiB(memtuneElem->FirstChildElement("hard_limit"));
+        memtune.softLimitKiB = parseScaledKiB(memtuneElem->FirstChildElement("soft_limit"));
+    }
+
+    // 解析<blkiotune>中的设备限速
+    std::vector<virDomainBlkioDeviceDef> blkiotune;
+    XMLElement* blkiotuneElem = domainElem->FirstChildElement("blkiotune");
+    if ( blkiotuneElem ) {
+        for ( XMLElement* deviceElem = blkiotuneElem->FirstChildElement("device");
+            deviceElem;
+            deviceElem = deviceElem->NextSiblingElement("device") ) {
+            virDomainBlkioDeviceDef device;
+            XMLElement* pathElem = deviceElem->FirstChildElement("path");
+            if ( !pathElem || !pathElem->GetText() ) {
+                throw std::runtime_error("blkiotune device requires a path");
+            }
+            device.path = pathElem->GetText();
+            struct {
+                const char* name;
+                unsigned long long* value;
+            } limits[] = {
+                { "read_iops_sec", &device.readIopsSec },
+                { "write_iops_sec", &device.writeIopsSec },
+                { "read_bytes_sec", &device.readBytesSec },
+                { "write_bytes_sec", &device.writeBytesSec },
+            };
+            for ( const auto& limit : limits ) {
+                XMLElement* limitElem = deviceElem->FirstChildElement(limit.name);
+                if ( limitElem ) {
+                    uint64_t value = 0;
+                    limitElem->QueryUnsigned64Text(&value);
+                    *limit.value = value;
+                }
+            }
+            blkiotune.push_back(device);
+        }
     }
 
     // 解析网络接口
@@ -253,6 +642,26 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
                 netIface.modelType = "e1000";
             }
 
+            // 获取后端驱动及队列数量
+            XMLElement* ifaceDriverElem = ifaceElem->FirstChildElement("driver");
+            if ( ifaceDriverElem ) {
+                if ( ifaceDriverElem->Attribute("name") ) {
+                    netIface.driverName = ifaceDriverElem->Attribute("name");
+                    if ( netIface.driverName != "vhost" && netIface.driverName != "qemu" ) {
+                        throw std::runtime_error("Unknown interface driver: " + netIface.driverName);
+                    }
+                }
+                ifaceDriverElem->QueryUnsignedAttribute("queues", &netIface.queues);
+                if ( netIface.queues == 0 ) {
+                    netIface.queues = 1;
+                }
+            }
+            if ( netIface.queues > 1 && netIface.modelType != "virtio" ) {
+                LOG_WARN("Multiqueue is only supported by virtio model, using a single queue for %s",
+                    netIface.modelType.c_str());
+                netIface.queues = 1;
+            }
+
             // 根据接口类型获取源
             XMLElement* sourceElem = ifaceElem->FirstChildElement("source");
             if ( sourceElem ) {
@@ -272,11 +681,12 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
 
             // 将网络接口添加到列表
             def->networkInterfaces.push_back(netIface);
-            LOG_INFO("Found network interface: type=%s, mac=%s, model=%s, source=%s",
+            LOG_INFO("Found network interface: type=%s, mac=%s, model=%s, source=%s, queues=%u",
                 netIface.type.c_str(),
                 netIface.macAddress.c_str(),
                 netIface.modelType.c_str(),
-                netIface.source.c_str());
+                netIface.source.c_str(),
+                netIface.queues);
         }
 
         // 添加处理<network>元素的代码
@@ -329,9 +739,17 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
     def->uuid = uuid;
     def->id = -1;  // 未运行状态
     def->vcpus = vcpus;
+    def->vcpuPlacement = vcpuPlacement;
+    def->vcpuCpuset = vcpuCpuset;
+    def->cputune = cputune;
+    def->memtune = memtune;
+    def->blkiotune = blkiotune;
     def->memory = memoryMB;
+    def->memoryBacking = memoryBacking;
+    def->numatune = numatune;
     def->xmlDesc = xmlDesc;
-    def->diskPath = diskPath;
+    def->disks = disks;
+    def->iothreads = iothreads;
     def->cdromPath = cdromPath;
     def->enableKVM = (featuresElem && featuresElem->FirstChildElement("kvm"));
 
@@ -342,6 +760,8 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
     }
 
     def->qmpSocketPath = qmpSocketPath;
+    // 放在单独的目录中，任何后缀都可能与另一个虚拟机的名称冲突
+    def->qmpEventSocketPath = config.getQmpSocketDir() + "/events/" + domainName + ".sock";
 
     // 创建virDomainObj对象
     std::shared_ptr<qemuDomainObj> domainObj = std::make_shared<qemuDomainObj>();
@@ -360,35 +780,342 @@ std::shared_ptr<qemuDomainObj> QemuDriver::parseAndCreateDomainObj(const std::st
     // 所以不创建QemuMonitor对象，只记录路径
 }
 
+// QEMU选项值中的逗号需要转义为两个逗号
+static std::string escapeQemuOptionValue(const std::string& value) {
+    std::string escaped;
+    for ( char c : value ) {
+        if ( c == ',' ) {
+            escaped += ',';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// 根据<memoryBacking>和<numatune>生成内存后端对象，普通匿名内存且无NUMA策略时不生成
+// preferredNode为vcpu自动放置选中的节点，numatune未指定节点时内存跟随vcpu放置
+static void appendMemoryBackendArgs(const qemuDomainDef& def, int preferredNode, std::vector<std::string>& args) {
+    const virDomainMemoryBackingDef& backing = def.memoryBacking;
+    const virDomainNumatuneDef& numatune = def.numatune;
+    bool hugepages = backing.hugepageSizeKiB > 0;
+    if ( !hugepages && backing.source.empty() && !backing.prealloc && !backing.share && numatune.mode.empty() &&
+        preferredNode < 0 ) {
+        return;
+    }
+
+    unsigned long long memoryKiB = static_cast< unsigned long long >(def.memory) * 1024;
+    std::vector<int> hostNodes;
+    if ( !numatune.nodeset.empty() ) {
+        hostNodes = parseCpuSet(numatune.nodeset);
+    }
+    else if ( !backing.hugepageNodeset.empty() ) {
+        hostNodes = parseCpuSet(backing.hugepageNodeset);
+    }
+    else if ( preferredNode >= 0 && numatune.placement != "static" && !hugepages ) {
+        hostNodes.push_back(preferredNode);
+    }
+    std::string policy = numatune.mode == "preferred" ? "preferred" :
+        numatune.mode == "interleave" ? "interleave" : "bind";
+
+    std::string backend;
+    if ( hugepages ) {
+        if ( memoryKiB % backing.hugepageSizeKiB != 0 ) {
+            throw std::runtime_error("Memory size of " + def.name + " is not a multiple of the hugepage size");
+        }
+        unsigned long long pagesNeeded = memoryKiB / backing.hugepageSizeKiB;
+        std::vector<HostNumaNode> nodes = HostInfo::Instance()->getNumaNodes();
+
+        // 检查空闲大页是否足够，未指定节点时挑选一个能容纳全部内存的节点，避免跨节点访问
+        unsigned long long freePages = 0;
+        for ( const auto& node : nodes ) {
+            auto it = node.hugepages.find(backing.hugepageSizeKiB);
+            bool allowed = hostNodes.empty() ||
+                std::find(hostNodes.begin(), hostNodes.end(), node.id) != hostNodes.end();
+            if ( allowed && it != node.hugepages.end() ) {
+                freePages += it->second.free;
+            }
+        }
+        if ( freePages < pagesNeeded ) {
+            throw std::runtime_error("Not enough free " + std::to_string(backing.hugepageSizeKiB) +
+                "KiB hugepages for " + def.name + ": need " + std::to_string(pagesNeeded) +
+                ", free " + std::to_string(freePages));
+        }
+        if ( hostNodes.empty() && numatune.placement != "static" ) {
+            // 优先使用vcpu所在的节点，大页不足时再挑选其他节点
+            int node = -1;
+            if ( preferredNode >= 0 ) {
+                node = HostTopology::pickNodeForHugepages(nodes, backing.hugepageSizeKiB, pagesNeeded,
+                    std::vector<int>(1, preferredNode));
+            }
+            if ( node < 0 ) {
+                node = HostTopology::pickNodeForHugepages(nodes, backing.hugepageSizeKiB, pagesNeeded, hostNodes);
+            }
+            if ( node >= 0 ) {
+                hostNodes.push_back(node);
+                LOG_INFO("Auto placed %s hugepage memory on NUMA node %d", def.name.c_str(), node);
+            }
+            else {
+                LOG_WARN("No single NUMA node has %llu free hugepages for %s, memory will span nodes",
+                    pagesNeeded, def.name.c_str());
+            }
+        }
+
+        // 优先使用hugetlbfs挂载点，未挂载时使用memfd的hugetlb模式
+        std::string mountPoint = HostTopology::hugetlbfsMountPoint(backing.hugepageSizeKiB);
+        if ( backing.source != "memfd" && !mountPoint.empty() ) {
+            backend = "memory-backend-file,id=pc.ram,mem-path=" + escapeQemuOptionValue(mountPoint);
+            if ( backing.discard ) {
+                backend += ",discard-data=on";
+            }
+        }
+        else {
+            if ( backing.source == "file" ) {
+                LOG_WARN("No hugetlbfs mounted for %lluKiB pages, using memfd backend", backing.hugepageSizeKiB);
+            }
+            backend = "memory-backend-memfd,id=pc.ram,hugetlb=on,hugetlbsize=" +
+                std::to_string(backing.hugepageSizeKiB) + "K";
+        }
+    }
+    else if ( backing.source == "memfd" ) {
+        backend = "memory-backend-memfd,id=pc.ram";
+    }
+    else if ( backing.source == "file" ) {
+        backend = "memory-backend-file,id=pc.ram,mem-path=/dev/shm";
+        if ( backing.discard ) {
+            backend += ",discard-data=on";
+        }
+    }
+    else {
+        backend = "memory-backend-ram,id=pc.ram";
+    }
+
+    backend += ",size=" + std::to_string(def.memory) + "M";
+    if ( backing.prealloc ) {
+        backend += ",prealloc=on";
+    }
+    if ( backing.share ) {
+        backend += ",share=on";
+    }
+    if ( !hostNodes.empty() ) {
+        if ( policy == "preferred" && hostNodes.size() > 1 ) {
+            throw std::runtime_error("numatune mode 'preferred' requires a single NUMA node");
+        }
+        // 不连续的节点范围需要拆分为多个host-nodes参数，避免与选项分隔符冲突
+        std::string ranges = formatCpuSet(hostNodes);
+        size_t pos = 0;
+        while ( pos <= ranges.size() ) {
+            size_t end = ranges.find(',', pos);
+            if ( end == std::string::npos ) {
+                end = ranges.size();
+            }
+            backend += ",host-nodes=" + ranges.substr(pos, end - pos);
+            pos = end + 1;
+        }
+        backend += ",policy=" + policy;
+    }
+
+    args.push_back("-object");
+    args.push_back(backend);
+    args.push_back("-machine");
+    args.push_back("memory-backend=pc.ram");
+}
+
+// 将fd列表拼接为QEMU fds=/vhostfds=所需的冒号分隔格式
+static std::string joinFds(const std::vector<int>& fds) {
+    std::string joined;
+    for ( size_t i = 0; i < fds.size(); i++ ) {
+        if ( i > 0 ) {
+            joined += ":";
+        }
+        joined += std::to_string(fds[i]);
+    }
+    return joined;
+}
+
+// 是否配置了需要cgroup实现的资源限制
+static bool hasCgroupLimits(const virDomainDef& def) {
+    return def.cputune.shares != 0 || def.cputune.period != 0 || def.cputune.quota != 0 ||
+        def.memtune.hardLimitKiB != 0 || def.memtune.softLimitKiB != 0 || !def.blkiotune.empty();
+}
+
+// 将<cputune>/<memtune>/<blkiotune>中的资源限制写入虚拟机的cgroup，未配置的项保持默认值
+static int applyCgroupLimits(Cgroup& cgroup, const virDomainDef& def) {
+    const virDomainCputuneDef& cputune = def.cputune;
+    if ( cputune.shares != 0 && cgroup.setCpuWeight(cputune.shares) < 0 ) {
+        return -1;
+    }
+    if ( cputune.period != 0 || cputune.quota != 0 ) {
+        unsigned long long period = cputune.period != 0 ? cputune.period : 100000;
+        if ( cgroup.setCpuMax(cputune.quota > 0 ? cputune.quota : -1, period) < 0 ) {
+            return -1;
+        }
+    }
+    if ( def.memtune.hardLimitKiB != 0 && cgroup.setMemoryMax(def.memtune.hardLimitKiB * 1024) < 0 ) {
+        return -1;
+    }
+    if ( def.memtune.softLimitKiB != 0 && cgroup.setMemoryHigh(def.memtune.softLimitKiB * 1024) < 0 ) {
+        return -1;
+    }
+    for ( const auto& device : def.blkiotune ) {
+        std::string devnum = Cgroup::deviceNumber(device.path);
+        if ( devnum.empty() ) {
+            LOG_ERROR("Failed to resolve block device of %s", device.path.c_str());
+            return -1;
+        }
+        CgroupIoLimit limit;
+        limit.riops = device.readIopsSec;
+        limit.wiops = device.writeIopsSec;
+        limit.rbps = device.readBytesSec;
+        limit.wbps = device.writeBytesSec;
+        if ( cgroup.setIoMax(devnum, limit) < 0 ) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int QemuDriver::generateUniqueID() {
     static int idCounter = 0;
     return idCounter++;
 }
 
+// 记录一次QEMU启动的耗时(从准备参数到可以运行)，没有走到成功出口的启动计为失败
+class QemuSpawnMetrics {
+public:
+    QemuSpawnMetrics() : succeeded(false), start(std::chrono::steady_clock::now()) {}
+    ~QemuSpawnMetrics() {
+        static MetricHistogram* duration = Metrics::Instance()->histogram("tinyvirt_qemu_spawn_duration_seconds",
+            "Time from preparing the QEMU command line until the domain is running");
+        static MetricCounter* failures = Metrics::Instance()->counter("tinyvirt_qemu_spawn_failures_total",
+            "QEMU launches that failed");
+        if ( succeeded ) {
+            duration->observe(std::chrono::duration_cast< std::chrono::duration<double> >(
+                std::chrono::steady_clock::now() - start).count());
+        }
+        else {
+            failures->inc();
+        }
+    }
+    void success() { succeeded = true; }
+private:
+    bool succeeded;
+    std::chrono::steady_clock::time_point start;
+};
+
 int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
     // 检查虚拟机状态
     if ( domainObj->pid != -1 ) {
         throw std::runtime_error("Domain " + domainObj->def->name + " is already running.");
     }
+    QemuSpawnMetrics spawnMetrics;
 
     std::shared_ptr<qemuDomainDef> qemuDef = std::dynamic_pointer_cast< qemuDomainDef >(domainObj->def);
     if ( !qemuDef ) {
         throw std::runtime_error("Failed to cast domain definition to QEMU definition");
     }
 
+    // vcpu自动放置：根据宿主机拓扑和其他运行中虚拟机已绑定的CPU挑选节点和CPU
+    QemuPlacementResult placement;
+    if ( qemuDef->vcpuPlacement == "auto" ) {
+        std::vector<pid_t> runningPids;
+        for ( const auto& other : domains ) {
+            if ( other != domainObj && other->pid > 0 ) {
+                runningPids.push_back(other->pid);
+            }
+        }
+        placement = QemuPlacement::placeVcpus(qemuDef->vcpus, HostInfo::Instance()->getCpus(),
+            QemuPlacement::collectLoad(runningPids));
+    }
+    bool needCpuTune = qemuDef->vcpuPlacement == "auto" || !qemuDef->vcpuCpuset.empty() ||
+        !qemuDef->cputune.vcpupins.empty() || !qemuDef->cputune.iothreadpins.empty() ||
+        !qemuDef->cputune.emulatorpin.empty();
+
     // 准备命令行参数数组
     std::vector<std::string> args;
     args.push_back(config.getQemuEmulator());
     args.push_back("-name");
     args.push_back(qemuDef->name);
+    if ( needCpuTune ) {
+        // 先暂停启动，完成线程绑定后再继续运行，避免vcpu在错误的CPU上开始执行
+        args.push_back("-S");
+    }
     args.push_back("-m");
     args.push_back(std::to_string(qemuDef->memory));
+    appendMemoryBackendArgs(*qemuDef, placement.node, args);
     args.push_back("-smp");
     args.push_back(std::to_string(qemuDef->vcpus));
 
-    if ( !qemuDef->diskPath.empty() ) {
-        args.push_back("-hda");
-        args.push_back(qemuDef->diskPath);
+    // iothread对象，磁盘通过iothread=<id>绑定
+    for ( unsigned int i = 1; i <= qemuDef->iothreads; i++ ) {
+        args.push_back("-object");
+        args.push_back("iothread,id=iothread" + std::to_string(i));
+    }
+
+    // 磁盘：后端使用-drive if=none，前端按总线类型生成对应的-device
+    bool sataControllerAdded = false;
+    unsigned int sataPort = 0;
+    for ( size_t i = 0; i < qemuDef->disks.size(); i++ ) {
+        const auto& disk = qemuDef->disks[i];
+        std::string driveId = "drive-" + disk.alias;
+
+        std::string drive = "file=" + escapeQemuOptionValue(disk.source) + ",if=none,id=" + driveId;
+        if ( !disk.format.empty() ) {
+            drive += ",format=" + disk.format;
+        }
+        if ( !disk.cache.empty() ) {
+            drive += ",cache=" + disk.cache;
+        }
+        if ( !disk.io.empty() ) {
+            drive += ",aio=" + disk.io;
+        }
+        if ( !disk.discard.empty() ) {
+            drive += ",discard=" + disk.discard;
+        }
+        args.push_back("-drive");
+        args.push_back(drive);
+
+        std::string device;
+        if ( disk.bus == "virtio" ) {
+            device = "virtio-blk-pci,drive=" + driveId + ",id=" + disk.alias;
+            if ( disk.queues > 0 ) {
+                device += ",num-queues=" + std::to_string(disk.queues);
+            }
+            if ( disk.iothread > 0 ) {
+                device += ",iothread=iothread" + std::to_string(disk.iothread);
+            }
+        }
+        else if ( disk.bus == "scsi" ) {
+            // 每个scsi磁盘使用独立的virtio-scsi控制器，以便绑定各自的iothread
+            std::string controller = "virtio-scsi-pci,id=scsi" + std::to_string(i);
+            if ( disk.queues > 0 ) {
+                controller += ",num_queues=" + std::to_string(disk.queues);
+            }
+            if ( disk.iothread > 0 ) {
+                controller += ",iothread=iothread" + std::to_string(disk.iothread);
+            }
+            args.push_back("-device");
+            args.push_back(controller);
+            device = "scsi-hd,bus=scsi" + std::to_string(i) + ".0,drive=" + driveId + ",id=" + disk.alias;
+        }
+        else if ( disk.bus == "sata" ) {
+            if ( !sataControllerAdded ) {
+                args.push_back("-device");
+                args.push_back("ahci,id=sata0");
+                sataControllerAdded = true;
+            }
+            device = "ide-hd,bus=sata0." + std::to_string(sataPort++) + ",drive=" + driveId + ",id=" + disk.alias;
+        }
+        else {
+            device = "ide-hd,drive=" + driveId + ",id=" + disk.alias;
+        }
+        args.push_back("-device");
+        args.push_back(device);
+
+        LOG_INFO("Added disk: source=%s, bus=%s, cache=%s, io=%s, iothread=%u",
+            disk.source.c_str(), disk.bus.c_str(),
+            disk.cache.empty() ? "default" : disk.cache.c_str(),
+            disk.io.empty() ? "default" : disk.io.c_str(),
+            disk.iothread);
     }
 
     if ( !qemuDef->cdromPath.empty() ) {
@@ -396,6 +1123,15 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
         args.push_back(qemuDef->cdromPath);
     }
 
+    if ( qemuDef->memballoonModel == "virtio" ) {
+        std::string balloon = "virtio-balloon-pci,id=balloon0";
+        if ( qemuDef->memballoonStatsPeriod > 0 ) {
+            balloon += ",guest-stats-polling-interval=" + std::to_string(qemuDef->memballoonStatsPeriod);
+        }
+        args.push_back("-device");
+        args.push_back(balloon);
+    }
+
     args.push_back("-boot");
     args.push_back("d");
 
@@ -413,28 +1149,73 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
         }
         args.push_back("-qmp");
         args.push_back("unix:" + qemuDef->qmpSocketPath + ",server,nowait");
+        std::string eventSocketDir = qemuDef->qmpEventSocketPath.substr(0, qemuDef->qmpEventSocketPath.find_last_of('/'));
+        if ( stat(eventSocketDir.c_str(), &st) == -1 ) {
+            mkdir(eventSocketDir.c_str(), 0700);
+        }
+        args.push_back("-qmp");
+        args.push_back("unix:" + qemuDef->qmpEventSocketPath + ",server,nowait");
     }
 
     // 处理网络接口
+    // TAP和vhost设备由驱动打开后以fd的形式传给QEMU，fork之后父进程需关闭这些fd
+    std::vector<int> passedFds;
+    domainObj->interfaceDevices.assign(qemuDef->networkInterfaces.size(), "");
     for ( size_t i = 0; i < qemuDef->networkInterfaces.size(); i++ ) {
         const auto& iface = qemuDef->networkInterfaces[i];
 
         if ( iface.type == "bridge" ) {
             // 使用桥接名生成TAP设备名
             std::string tapName = "tap_" + iface.source + "-net";
+            domainObj->interfaceDevices[i] = tapName;
+            bool isVirtio = iface.modelType == "virtio";
+            bool useVhost = iface.driverName == "vhost" ||
+                (iface.driverName.empty() && isVirtio && netdevVhostNetAvailable());
+
+            std::vector<int> tapfds;
+            std::vector<int> vhostfds;
+            // 只有virtio网卡可以使用多队列
+            if ( netdevTapOpen(tapName, isVirtio ? iface.queues : 1, isVirtio, tapfds) < 0 ) {
+                netdevCloseFds(passedFds);
+                throw std::runtime_error("Failed to open TAP device " + tapName);
+            }
+            if ( useVhost && netdevVhostNetOpen(static_cast< unsigned int >(tapfds.size()), vhostfds) < 0 ) {
+                netdevCloseFds(tapfds);
+                netdevCloseFds(passedFds);
+                throw std::runtime_error("Failed to open vhost-net for interface " + tapName);
+            }
+            passedFds.insert(passedFds.end(), tapfds.begin(), tapfds.end());
+            passedFds.insert(passedFds.end(), vhostfds.begin(), vhostfds.end());
 
-            // 添加netdev参数
+            // 添加netdev参数，单队列使用fd=，多队列使用fds=以冒号分隔
             std::string netdevId = "net" + std::to_string(i);
+            std::string netdev = "tap,id=" + netdevId;
+            netdev += (tapfds.size() > 1 ? ",fds=" : ",fd=") + joinFds(tapfds);
+            if ( useVhost ) {
+                netdev += ",vhost=on";
+                netdev += (vhostfds.size() > 1 ? ",vhostfds=" : ",vhostfd=") + joinFds(vhostfds);
+            }
             args.push_back("-netdev");
-            args.push_back("tap,id=" + netdevId + ",ifname=" + tapName + ",script=no,downscript=no");
+            args.push_back(netdev);
 
             // 添加device参数，使用指定的网卡模型或默认的e1000
             std::string deviceModel = iface.modelType.empty() ? "e1000" : iface.modelType;
+            if ( isVirtio ) {
+                deviceModel = "virtio-net-pci";
+            }
+            std::string device = deviceModel + ",netdev=" + netdevId;
+            if ( !iface.macAddress.empty() ) {
+                device += ",mac=" + iface.macAddress;
+            }
+            if ( iface.queues > 1 ) {
+                // 每个队列对需要一对MSI-X向量，另加配置与控制队列的两个向量
+                device += ",mq=on,vectors=" + std::to_string(2 * iface.queues + 2);
+            }
             args.push_back("-device");
-            args.push_back(deviceModel + ",netdev=" + netdevId);
+            args.push_back(device);
 
-            LOG_INFO("Added network interface: bridge=%s, tap=%s, model=%s",
-                iface.source.c_str(), tapName.c_str(), deviceModel.c_str());
+            LOG_INFO("Added network interface: bridge=%s, tap=%s, model=%s, queues=%u, vhost=%s",
+                iface.source.c_str(), tapName.c_str(), deviceModel.c_str(), iface.queues, useVhost ? "on" : "off");
         }
     }
 
@@ -443,6 +1224,27 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
         args.push_back("none");
     }
 
+    // 每个虚拟机放在独立的cgroup中，子进程在exec之前加入，QEMU创建的所有线程都受到限制
+    // 上次运行遗留的空控制组先删除，保证未配置的限制恢复为默认值
+    std::unique_ptr<Cgroup> staleCgroup = Cgroup::openForDomain(config.getCgroupPartition(), qemuDef->name);
+    if ( staleCgroup ) {
+        staleCgroup->remove();
+    }
+    std::unique_ptr<Cgroup> cgroup = Cgroup::createForDomain(config.getCgroupPartition(), qemuDef->name);
+    int cgroupProcsFd = -1;
+    if ( cgroup ) {
+        if ( applyCgroupLimits(*cgroup, *qemuDef) < 0 ) {
+            netdevCloseFds(passedFds);
+            cgroup->remove();
+            throw std::runtime_error("Failed to apply resource limits for domain " + qemuDef->name);
+        }
+        cgroupProcsFd = cgroup->openProcsFile();
+    }
+    if ( cgroupProcsFd < 0 && hasCgroupLimits(*qemuDef) ) {
+        netdevCloseFds(passedFds);
+        throw std::runtime_error("Resource limits of " + qemuDef->name + " require a cgroup v2 hierarchy");
+    }
+
     // 将参数转换为 char* 数组用于 execdd
     std::vector<char*> execArgs;
     for ( const auto& arg : args ) {
@@ -465,6 +1267,10 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
     if ( pid == -1 ) {
         // std::cerr << "Failed to fork: " << strerror(errno) << std::endl;
         LOG_ERROR("Failed to fork: %s", strerror(errno));
+        netdevCloseFds(passedFds);
+        if ( cgroupProcsFd >= 0 ) {
+            close(cgroupProcsFd);
+        }
         return -1;
     }
 
@@ -473,6 +1279,11 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
         // 设置进程组
         setpgid(0, 0);
 
+        // 向cgroup.procs写入0表示将当前进程加入控制组，失败时不启动未受限制的QEMU
+        if ( cgroupProcsFd >= 0 && write(cgroupProcsFd, "0", 1) < 0 ) {
+            _exit(EXIT_FAILURE);
+        }
+
         // 重定向标准输出和错误输出到日志文件
         std::string logPath = config.getLogDir() + "/" + qemuDef->name + ".log";
         int fd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
@@ -492,6 +1303,12 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
     }
     else {
         // 父进程
+        // TAP/vhost fd已经被子进程继承
+        netdevCloseFds(passedFds);
+        if ( cgroupProcsFd >= 0 ) {
+            close(cgroupProcsFd);
+        }
+
         // 更新域对象状态
         domainObj->pid = pid;
         domainObj->stateReason.state = VIR_DOMAIN_RUNNING;
@@ -513,17 +1330,375 @@ int QemuDriver::processQemuObject(std::shared_ptr<qemuDomainObj> domainObj) {
     pidFile << pid;
     pidFile.close();
 
+    if ( needCpuTune && applyCpuTune(domainObj, placement) < 0 ) {
+        LOG_ERROR("Failed to apply CPU tuning for %s, killing the domain", qemuDef->name.c_str());
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        remove(pidFilePath.c_str());
+        if ( cgroup ) {
+            cgroup->remove();
+        }
+        domainObj->vcpuThreads.clear();
+        domainObj->iothreadThreads.clear();
+        domainObj->pid = -1;
+        domainObj->def->id = -1;
+        domainObj->stateReason.state = VIR_DOMAIN_SHUTOFF;
+        throw std::runtime_error("Failed to apply CPU tuning for domain " + qemuDef->name);
+    }
+
+    spawnMetrics.success();
+    queueDomainEvent(*qemuDef, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_STARTED, VIR_DOMAIN_EVENT_STARTED_BOOTED);
+    watchDomain(domainObj);
     return 0;
 }
 
-QemuDriver::~QemuDriver() {
-    // std::cout << "QEMU Driver destroyed." << std::endl;
-    LOG_INFO("QEMU Driver destroyed.");
+std::shared_ptr<QemuMonitor> QemuDriver::getMonitor(std::shared_ptr<qemuDomainObj> domainObj) {
+    // 连接失败后按指数退避，QEMU没有响应时各个API调用不会反复阻塞在连接上
+    unsigned long long now = TimerWheel::nowMs();
+    if ( now < domainObj->monitorRetryAtMs ) {
+        return nullptr;
+    }
+    std::shared_ptr<qemuDomainDef> qemuDef = std::dynamic_pointer_cast< qemuDomainDef >(domainObj->def);
+    std::shared_ptr<QemuMonitor> monitor = std::make_shared<QemuMonitor>(qemuDef->qmpSocketPath);
+    if ( !monitor->isOpen() ) {
+        unsigned int shift = std::min(domainObj->monitorFailures, 6u);
+        domainObj->monitorFailures++;
+        domainObj->monitorRetryAtMs = TimerWheel::nowMs() +
+            std::min(MONITOR_RETRY_BASE_MS << shift, MONITOR_RETRY_MAX_MS);
+        return nullptr;
+    }
+    domainObj->monitorFailures = 0;
+    domainObj->monitorRetryAtMs = 0;
+    return monitor;
 }
 
-std::vector<std::shared_ptr<VirDomain>> QemuDriver::connectListAllDomains(unsigned int flags) const {
-    if ( flags != 0 ) {
-        throw std::runtime_error("Unsupported flags");
+void QemuDriver::queueDomainEvent(const virDomainDef& def, int eventID, int type, int detail, const std::string& device) {
+    virDomainEvent event;
+    event.eventID = eventID;
+    event.domainName = def.name;
+    event.uuid = def.uuid;
+    event.type = type;
+    event.detail = detail;
+    event.device = device;
+    eventState.queue(event);
+}
+
+void QemuDriver::watchMonitorEvents(std::shared_ptr<qemuDomainObj> domainObj, std::shared_ptr<QemuMonitor> monitor) {
+    std::weak_ptr<qemuDomainObj> weakObj = domainObj;
+    monitor->setEventHandler([this, weakObj](const JsonValue& event) { handleMonitorEvent(weakObj, event); });
+    domainObj->eventsWatched = true;
+    // 连接断开后事件会丢失，下一次查询状态时重新向QEMU查询
+    eventLoop->watchMonitor(domainObj->def->name, monitor, [weakObj]() {
+        std::shared_ptr<qemuDomainObj> domainObj = weakObj.lock();
+        if ( domainObj ) {
+            domainObj->eventsWatched = false;
+            domainObj->stateSynced = false;
+        }
+    });
+}
+
+void QemuDriver::startEventLoop() {
+    std::unique_ptr<QemuEventLoop> loop(new QemuEventLoop([this](const std::string& name, pid_t pid, int status) {
+        handleProcessExit(name, pid, status);
+    }));
+    loop->start();
+    eventLoop = std::move(loop);
+    // 其他进程启动的虚拟机不会通知本进程，定期检查pid文件，发现后补发STARTED事件并开始监视
+    // 检查需要驱动锁，定时器线程中只负责投递到事件循环
+    rescanTimer = TimerService::Instance()->addPeriodicTimer(DOMAIN_RESCAN_INTERVAL_MS, [this]() {
+        eventLoop->post([this]() { rescanDomains(); });
+    });
+}
+
+void QemuDriver::watchDomain(std::shared_ptr<qemuDomainObj> domainObj) {
+    if ( !eventLoop || !eventLoop->isRunning() || domainObj->pid <= 0 || domainObj->watched ) {
+        return;
+    }
+    domainObj->guestShutdown = false;
+    domainObj->stateSynced = false;
+    eventLoop->watchProcess(domainObj->def->name, domainObj->pid);
+    domainObj->watched = true;
+    // 事件使用单独的QMP套接字，长期持有这条连接不会阻塞其他进程的QMP命令
+    // 同一时间只有一个进程能收到某个虚拟机的QMP事件，其他订阅者只能得到进程退出
+    std::shared_ptr<qemuDomainDef> qemuDef = std::dynamic_pointer_cast< qemuDomainDef >(domainObj->def);
+    struct stat st;
+    std::shared_ptr<QemuMonitor> monitor;
+    if ( stat(qemuDef->qmpEventSocketPath.c_str(), &st) == 0 ) {
+        monitor = std::make_shared<QemuMonitor>(qemuDef->qmpEventSocketPath);
+    }
+    if ( monitor && monitor->isOpen() ) {
+        watchMonitorEvents(domainObj, monitor);
+    }
+    else {
+        LOG_WARN("No event monitor connection for %s, only process exit will be reported", domainObj->def->name.c_str());
+    }
+}
+
+void QemuDriver::handleMonitorEvent(std::weak_ptr<qemuDomainObj> weakObj, const JsonValue& event) {
+    std::shared_ptr<qemuDomainObj> domainObj = weakObj.lock();
+    if ( !domainObj ) {
+        return;
+    }
+    const virDomainDef& def = *domainObj->def;
+    std::string name = event.getString("event");
+    const JsonValue* data = event.get("data");
+    LOG_DEBUG("QMP event %s from %s", name.c_str(), def.name.c_str());
+    if ( name == "STOP" ) {
+        domainObj->stateReason.state = VIR_DOMAIN_PAUSED;
+        domainObj->stateReason.reason = 0;
+        queueDomainEvent(def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_SUSPENDED, VIR_DOMAIN_EVENT_SUSPENDED_PAUSED);
+    }
+    else if ( name == "RESUME" ) {
+        domainObj->stateReason.state = VIR_DOMAIN_RUNNING;
+        domainObj->stateReason.reason = 3;  // 对应libvirt的VIR_DOMAIN_RUNNING_UNPAUSED
+        queueDomainEvent(def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_RESUMED, VIR_DOMAIN_EVENT_RESUMED_UNPAUSED);
+    }
+    else if ( name == "SHUTDOWN" ) {
+        domainObj->guestShutdown = true;
+        domainObj->stateReason.state = VIR_DOMAIN_SHUTDOWN;
+        domainObj->stateReason.reason = 1;  // 对应libvirt的VIR_DOMAIN_SHUTDOWN_USER
+        queueDomainEvent(def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_SHUTDOWN, VIR_DOMAIN_EVENT_SHUTDOWN_FINISHED);
+    }
+    else if ( name == "GUEST_PANICKED" ) {
+        domainObj->stateReason.state = VIR_DOMAIN_CRASHED;
+        domainObj->stateReason.reason = 1;  // 对应libvirt的VIR_DOMAIN_CRASHED_PANICKED
+        queueDomainEvent(def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_CRASHED, VIR_DOMAIN_EVENT_CRASHED_PANICKED);
+    }
+    else if ( name == "DEVICE_DELETED" && data ) {
+        std::string device = data->getString("device", data->getString("path"));
+        queueDomainEvent(def, VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED, 0, 0, device);
+    }
+    else if ( (name == "BLOCK_JOB_COMPLETED" || name == "BLOCK_JOB_CANCELLED") && data ) {
+        int status = VIR_DOMAIN_BLOCK_JOB_CANCELED;
+        if ( name == "BLOCK_JOB_COMPLETED" ) {
+            status = data->has("error") ? VIR_DOMAIN_BLOCK_JOB_FAILED : VIR_DOMAIN_BLOCK_JOB_COMPLETED;
+        }
+        // 与libvirt一致，事件中报告磁盘镜像路径，不是由本驱动启动的任务报告QEMU中的设备名
+        std::string device = data->getString("device");
+        {
+            std::lock_guard<std::mutex> lock(domainObj->blockJobsLock);
+            auto it = domainObj->blockJobs.find(device);
+            if ( it != domainObj->blockJobs.end() ) {
+                device = it->second;
+                domainObj->blockJobs.erase(it);
+            }
+        }
+        queueDomainEvent(def, VIR_DOMAIN_EVENT_ID_BLOCK_JOB, status, 0, device);
+    }
+}
+
+void QemuDriver::handleProcessExit(const std::string& name, pid_t pid, int status) {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    std::shared_ptr<qemuDomainObj> domainObj;
+    for ( const auto& obj : domains ) {
+        if ( obj->def->name == name && obj->pid == pid ) {
+            domainObj = obj;
+            break;
+        }
+    }
+    // 通过destroy或shutdown关闭的虚拟机已经清理过
+    if ( !domainObj ) {
+        return;
+    }
+
+    // 收到过客户机关机事件或QEMU正常退出时视为关机，关机超时被升级为quit或SIGKILL时视为强制关闭，其余情况都是意外退出
+    bool forced = !domainObj->guestShutdown && domainObj->shutdownStage >= QEMU_DOMAIN_SHUTDOWN_QUIT;
+    bool shutdown = !forced &&
+        (domainObj->guestShutdown || (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0));
+    LOG_INFO("QEMU process %d of %s exited %s", pid, name.c_str(),
+        forced ? "after forced shutdown" : (shutdown ? "after shutdown" : "unexpectedly"));
+    cancelShutdown(domainObj);
+
+    domainObj->watched = false;
+    domainObj->eventsWatched = false;
+    domainObj->stateSynced = false;
+    {
+        std::lock_guard<std::mutex> lock(domainObj->blockJobsLock);
+        domainObj->blockJobs.clear();
+    }
+    domainObj->stateReason.state = VIR_DOMAIN_SHUTOFF;
+    // 对应libvirt的VIR_DOMAIN_SHUTOFF_SHUTDOWN、VIR_DOMAIN_SHUTOFF_DESTROYED和VIR_DOMAIN_SHUTOFF_FAILED
+    domainObj->stateReason.reason = shutdown ? 1 : (forced ? 2 : 6);
+    domainObj->pid = -1;
+    domainObj->def->id = -1;
+    domainObj->vcpuThreads.clear();
+    domainObj->iothreadThreads.clear();
+
+    std::unique_ptr<Cgroup> cgroup = Cgroup::openForDomain(config.getCgroupPartition(), name);
+    if ( cgroup ) {
+        cgroup->remove();
+    }
+    std::string pidFilePath = config.getConfigDir() + "/" + name + ".pid";
+    remove(pidFilePath.c_str());
+
+    queueDomainEvent(*domainObj->def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_STOPPED,
+        shutdown ? VIR_DOMAIN_EVENT_STOPPED_SHUTDOWN :
+        (forced ? VIR_DOMAIN_EVENT_STOPPED_DESTROYED : VIR_DOMAIN_EVENT_STOPPED_FAILED));
+}
+
+// 按照<cputune>、自动放置结果和<vcpu cpuset>的优先级确定线程的绑定集合
+static std::vector<int> resolvePinning(const std::string& explicitSet, const std::vector<int>& automatic,
+    const std::string& fallbackSet) {
+    if ( !explicitSet.empty() ) {
+        return parseCpuSet(explicitSet);
+    }
+    if ( !automatic.empty() ) {
+        return automatic;
+    }
+    if ( !fallbackSet.empty() ) {
+        return parseCpuSet(fallbackSet);
+    }
+    return std::vector<int>();
+}
+
+int QemuDriver::applyCpuTune(std::shared_ptr<qemuDomainObj> domainObj, const QemuPlacementResult& placement) {
+    std::shared_ptr<qemuDomainDef> qemuDef = std::dynamic_pointer_cast< qemuDomainDef >(domainObj->def);
+
+    // QMP socket由QEMU创建，等待其出现并开始监听，启动阶段不使用退避
+    std::shared_ptr<QemuMonitor> monitor;
+    for ( int i = 0; i < 50; i++ ) {
+        struct stat st;
+        if ( stat(qemuDef->qmpSocketPath.c_str(), &st) == 0 ) {
+            domainObj->monitorRetryAtMs = 0;
+            monitor = getMonitor(domainObj);
+            if ( monitor ) {
+                break;
+            }
+        }
+        if ( waitpid(domainObj->pid, nullptr, WNOHANG) == domainObj->pid ) {
+            LOG_ERROR("QEMU process of %s exited during startup", qemuDef->name.c_str());
+            return -1;
+        }
+        usleep(100 * 1000);
+    }
+    if ( !monitor ) {
+        LOG_ERROR("Failed to connect monitor of %s", qemuDef->name.c_str());
+        return -1;
+    }
+
+    // 查询vcpu和iothread对应的宿主机线程
+    JsonValue cpus;
+    if ( monitor->qemuMonitorCommand("{ \"execute\":\"query-cpus-fast\"}", cpus) < 0 ) {
+        return -1;
+    }
+    domainObj->vcpuThreads.assign(qemuDef->vcpus, 0);
+    for ( const auto& cpu : cpus.elements() ) {
+        long long index = cpu.getInt("cpu-index", -1);
+        if ( index >= 0 && index < qemuDef->vcpus ) {
+            domainObj->vcpuThreads[index] = static_cast< pid_t >(cpu.getInt("thread-id"));
+        }
+    }
+    domainObj->iothreadThreads.clear();
+    if ( qemuDef->iothreads > 0 ) {
+        JsonValue iothreads;
+        if ( monitor->qemuMonitorCommand("{ \"execute\":\"query-iothreads\"}", iothreads) < 0 ) {
+            return -1;
+        }
+        for ( const auto& iothread : iothreads.elements() ) {
+            std::string id = iothread.getString("id");
+            if ( id.compare(0, 8, "iothread") != 0 ) {
+                continue;
+            }
+            unsigned int num = static_cast< unsigned int >(atoi(id.c_str() + 8));
+            domainObj->iothreadThreads[num] = static_cast< pid_t >(iothread.getInt("thread-id"));
+        }
+    }
+
+    // vcpu线程
+    for ( int i = 0; i < qemuDef->vcpus; i++ ) {
+        std::string explicitSet;
+        for ( const auto& pin : qemuDef->cputune.vcpupins ) {
+            if ( pin.vcpu == static_cast< unsigned int >(i) ) {
+                explicitSet = pin.cpuset;
+            }
+        }
+        std::vector<int> automatic;
+        if ( i < static_cast< int >(placement.vcpuCpus.size()) ) {
+            automatic.push_back(placement.vcpuCpus[i]);
+        }
+        std::vector<int> cpuset = resolvePinning(explicitSet, automatic, qemuDef->vcpuCpuset);
+        pid_t tid = domainObj->vcpuThreads[i];
+        if ( cpuset.empty() || tid <= 0 ) {
+            continue;
+        }
+        if ( setThreadAffinity(tid, cpuset) < 0 ) {
+            LOG_ERROR("Failed to pin vcpu %d (thread %d) to %s: %s", i, tid, formatCpuSet(cpuset).c_str(), strerror(errno));
+            return -1;
+        }
+        LOG_INFO("Pinned vcpu %d (thread %d) of %s to %s", i, tid, qemuDef->name.c_str(), formatCpuSet(cpuset).c_str());
+    }
+
+    // iothread线程
+    for ( const auto& iothread : domainObj->iothreadThreads ) {
+        std::string explicitSet;
+        for ( const auto& pin : qemuDef->cputune.iothreadpins ) {
+            if ( pin.iothread == iothread.first ) {
+                explicitSet = pin.cpuset;
+            }
+        }
+        std::vector<int> cpuset = resolvePinning(explicitSet, placement.nodeCpus, qemuDef->vcpuCpuset);
+        if ( cpuset.empty() ) {
+            continue;
+        }
+        if ( setThreadAffinity(iothread.second, cpuset) < 0 ) {
+            LOG_ERROR("Failed to pin iothread %u to %s: %s", iothread.first, formatCpuSet(cpuset).c_str(), strerror(errno));
+            return -1;
+        }
+    }
+
+    // emulator线程：除vcpu和iothread之外的所有线程
+    std::vector<int> emulatorSet = resolvePinning(qemuDef->cputune.emulatorpin, placement.nodeCpus, qemuDef->vcpuCpuset);
+    if ( !emulatorSet.empty() ) {
+        for ( pid_t tid : listProcessThreads(domainObj->pid) ) {
+            bool vcpuOrIothread = std::find(domainObj->vcpuThreads.begin(), domainObj->vcpuThreads.end(), tid) !=
+                domainObj->vcpuThreads.end();
+            for ( const auto& iothread : domainObj->iothreadThreads ) {
+                vcpuOrIothread = vcpuOrIothread || iothread.second == tid;
+            }
+            if ( vcpuOrIothread ) {
+                continue;
+            }
+            if ( setThreadAffinity(tid, emulatorSet) < 0 ) {
+                LOG_ERROR("Failed to pin emulator thread %d to %s: %s", tid, formatCpuSet(emulatorSet).c_str(), strerror(errno));
+                return -1;
+            }
+        }
+    }
+
+    // 绑定完成，恢复运行
+    JsonValue ret;
+    if ( monitor->qemuMonitorCommand("{ \"execute\":\"cont\"}", ret) < 0 ) {
+        return -1;
+    }
+    return 0;
+}
+
+QemuDriver::~QemuDriver() {
+    // 事件循环的回调会访问domains，先于其他成员停止；关机定时器会向事件循环投递任务，先取消
+    // 还没有完成的关机交给看门狗进程继续升级，不随当前进程退出而中断
+    {
+        std::lock_guard<std::recursive_mutex> guard(driverLock);
+        for ( const auto& domainObj : domains ) {
+            if ( domainObj->shutdownStage != QEMU_DOMAIN_SHUTDOWN_NONE ) {
+                handOffShutdown(domainObj);
+            }
+            cancelShutdown(domainObj);
+        }
+    }
+    if ( rescanTimer ) {
+        TimerService::Instance()->cancelTimer(rescanTimer);
+    }
+    if ( eventLoop ) {
+        eventLoop->stop();
+    }
+    // std::cout << "QEMU Driver destroyed." << std::endl;
+    LOG_INFO("QEMU Driver destroyed.");
+}
+
+std::vector<std::shared_ptr<VirDomain>> QemuDriver::connectListAllDomains(unsigned int flags) const {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    if ( flags != 0 ) {
+        throw std::runtime_error("Unsupported flags");
     }
     std::vector<std::shared_ptr<VirDomain>> ret;
     for ( const auto& domain : domains ) {
@@ -533,6 +1708,7 @@ std::vector<std::shared_ptr<VirDomain>> QemuDriver::connectListAllDomains(unsign
 }
 
 std::shared_ptr<VirDomain> QemuDriver::domainLookupByName(const std::string& name) const {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     for ( const auto& domain : domains ) {
         if ( domain->def->name == name ) {
             return std::make_shared<VirDomain>(domain->def->name, domain->def->id, domain->def->uuid);
@@ -546,6 +1722,8 @@ std::shared_ptr<VirDomain> QemuDriver::domainDefineXML(const std::string& xml) {
 }
 
 std::shared_ptr<VirDomain> QemuDriver::domainDefineXMLFlags(const std::string& xml, unsigned int flags) {
+    MetricsOpTimer opTimer("domainDefineXML");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     // 创建VirDomain对象
     std::shared_ptr<VirDomain> domain = std::make_shared<VirDomain>(xml, this);
 
@@ -566,6 +1744,8 @@ std::shared_ptr<VirDomain> QemuDriver::domainDefineXMLFlags(const std::string& x
 }
 
 void QemuDriver::domainCreate(std::shared_ptr<VirDomain> domain) {
+    MetricsOpTimer opTimer("domainCreate");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     std::string name = domain->virDomainGetName();
     for ( const auto& domainObj : domains ) {
         if ( domainObj->def->name == name ) {
@@ -578,14 +1758,18 @@ void QemuDriver::domainCreate(std::shared_ptr<VirDomain> domain) {
 }
 
 std::shared_ptr<VirDomain> QemuDriver::domainCreateXML(const std::string& xmlDesc) {
+    MetricsOpTimer opTimer("domainCreateXML");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     std::shared_ptr<qemuDomainObj> domainObj = std::make_shared<qemuDomainObj>();
     domainObj = parseAndCreateDomainObj(xmlDesc);
-    domains.push_back(domainObj);
+    addDomainObj(domainObj);
     processQemuObject(domainObj);
     return std::make_shared<VirDomain>(domainObj->def->name, domainObj->def->id, domainObj->def->uuid);
 }
 
 int QemuDriver::domainAttachDevice(std::shared_ptr<VirDomain> domain, const std::string& xmlDesc, unsigned int flags) {
+    MetricsOpTimer opTimer("domainAttachDevice");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     if ( flags != 0 ) {
         throw std::runtime_error("Unsupported flags");
     }
@@ -665,10 +1849,15 @@ int QemuDriver::domainAttachDevice(std::shared_ptr<VirDomain> domain, const std:
 
     LOG_INFO("Successfully attached %s device to domain %s XML configuration",
         deviceType.c_str(), domainName.c_str());
+    XMLElement* targetElem = deviceElem->FirstChildElement("target");
+    const char* targetDev = targetElem ? targetElem->Attribute("dev") : nullptr;
+    queueDomainEvent(*domainObj->def, VIR_DOMAIN_EVENT_ID_DEVICE_ADDED, 0, 0, targetDev ? targetDev : deviceType);
     return 0;
 }
 
 void QemuDriver::domainDestroy(std::shared_ptr<VirDomain> domain) {
+    MetricsOpTimer opTimer("domainDestroy");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     if ( domain->virDomainGetID() < 0 ) {
         throw std::runtime_error("Domain " + domain->virDomainGetName() + " is not running.");
     }
@@ -704,13 +1893,33 @@ void QemuDriver::domainDestroy(std::shared_ptr<VirDomain> domain) {
         return;
     }
 
+    cancelShutdown(domainObj);
+
     // Update domain state to reflect shutdown
+    // 旧进程的监视在其退出后由事件循环移除，再次启动时重新加入
+    domainObj->watched = false;
+    domainObj->eventsWatched = false;
+    domainObj->stateSynced = false;
+    {
+        std::lock_guard<std::mutex> lock(domainObj->blockJobsLock);
+        domainObj->blockJobs.clear();
+    }
     domainObj->stateReason.state = VIR_DOMAIN_SHUTOFF;
     domainObj->stateReason.reason = 1; // Destroyed
     domainObj->pid = -1; // Mark as not running
+    domainObj->vcpuThreads.clear();
+    domainObj->iothreadThreads.clear();
 
     // std::cout << "Domain " << domainObj->def->name << " destroyed." << std::endl;
     LOG_INFO("Domain %s destroyed.", domainObj->def->name.c_str());
+    queueDomainEvent(*domainObj->def, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_STOPPED,
+        VIR_DOMAIN_EVENT_STOPPED_DESTROYED);
+
+    // 删除虚拟机的cgroup
+    std::unique_ptr<Cgroup> cgroup = Cgroup::openForDomain(config.getCgroupPartition(), domainObj->def->name);
+    if ( cgroup ) {
+        cgroup->remove();
+    }
 
     // 删除pid文件
     std::string pidFilePath = config.getConfigDir() + "/" + domainObj->def->name + ".pid";
@@ -723,59 +1932,252 @@ void QemuDriver::domainDestroy(std::shared_ptr<VirDomain> domain) {
 }
 
 void QemuDriver::domainShutdown(std::shared_ptr<VirDomain> domain) {
-    // TODO: add ID and finish it
-    if ( domain->virDomainGetID() < 0 ) {
-        throw std::runtime_error("Domain " + domain->virDomainGetName() + " is not running.");
+    domainShutdownFlags(domain, VIR_DOMAIN_SHUTDOWN_DEFAULT, -1);
+}
+
+void QemuDriver::domainShutdownFlags(std::shared_ptr<VirDomain> domain, unsigned int flags, int timeoutSec) {
+    MetricsOpTimer opTimer("domainShutdown");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    if ( flags & VIR_DOMAIN_SHUTDOWN_GUEST_AGENT ) {
+        throw std::runtime_error("Shutdown through the guest agent is not supported.");
+    }
+    if ( flags & ~static_cast< unsigned int >(VIR_DOMAIN_SHUTDOWN_ACPI_POWER_BTN) ) {
+        throw std::invalid_argument("Unsupported flags for domainShutdownFlags.");
     }
     std::shared_ptr<qemuDomainObj> domainObj;
-    bool found = false;
     for ( const auto& domainObj_ : domains ) {
         if ( domainObj_->def->name == domain->virDomainGetName() ) {
             domainObj = domainObj_;
-            found = true;
             break;
         }
     }
-    if ( !found ) {
+    if ( !domainObj ) {
         throw std::runtime_error("Domain not found.");
     }
-    std::shared_ptr<qemuDomainDef> qemuDef = std::dynamic_pointer_cast< qemuDomainDef >(domainObj->def);
-    domainObj->monitor = std::make_shared<QemuMonitor>(qemuDef->qmpSocketPath);
+    if ( domainObj->pid <= 0 ) {
+        throw std::runtime_error("Domain " + domain->virDomainGetName() + " is not running.");
+    }
+    beginShutdown(domainObj, timeoutSec);
+}
 
-    if ( !found || !domainObj || !domainObj->monitor ) {
-        // std::cout << "found: " << (!found) << std::endl;
-        LOG_INFO("found: %d", !found);
-        // std::cout << "domainObj: " << (!domainObj) << std::endl;
-        LOG_INFO("domainObj: %d", !domainObj);
-        // std::cout << "domainMon: " << (!domainObj->monitor) << std::endl;
-        LOG_INFO("domainMon: %d", !domainObj->monitor);
+std::vector<std::shared_ptr<VirDomain>> QemuDriver::connectShutdownAllDomains(unsigned int flags, int timeoutSec) {
+    MetricsOpTimer opTimer("connectShutdownAllDomains");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    if ( flags & VIR_DOMAIN_SHUTDOWN_GUEST_AGENT ) {
+        throw std::runtime_error("Shutdown through the guest agent is not supported.");
+    }
+    if ( flags & ~static_cast< unsigned int >(VIR_DOMAIN_SHUTDOWN_ACPI_POWER_BTN) ) {
+        throw std::invalid_argument("Unsupported flags for connectShutdownAllDomains.");
+    }
+    // 所有虚拟机共用事件循环的时间轮计时，单个虚拟机失败不影响其余虚拟机
+    std::vector<std::shared_ptr<VirDomain>> ret;
+    for ( const auto& domainObj : domains ) {
+        if ( domainObj->pid <= 0 ) {
+            continue;
+        }
+        try {
+            beginShutdown(domainObj, timeoutSec);
+            ret.push_back(std::make_shared<VirDomain>(domainObj->def->name, domainObj->def->id, domainObj->def->uuid));
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Failed to shut down domain %s: %s", domainObj->def->name.c_str(), e.what());
+        }
+    }
+    LOG_INFO("Shutdown requested for %zu domains", ret.size());
+    return ret;
+}
+
+void QemuDriver::beginShutdown(std::shared_ptr<qemuDomainObj> domainObj, int timeoutSec) {
+    // 关机的完成依靠事件循环发现进程退出，超时由共享的定时器服务触发
+    if ( !eventLoop ) {
+        startEventLoop();
+    }
+    watchDomain(domainObj);
+    if ( domainObj->shutdownStage != QEMU_DOMAIN_SHUTDOWN_NONE ) {
+        LOG_INFO("Domain %s is already shutting down", domainObj->def->name.c_str());
         return;
     }
 
-    std::string cmd = "{ \"execute\":\"quit\"}";
-    std::string result;
+    std::shared_ptr<QemuMonitor> monitor = getMonitor(domainObj);
+    if ( !monitor ) {
+        throw std::runtime_error("Failed to connect to monitor of domain " + domainObj->def->name + ".");
+    }
+    JsonValue reply;
+    if ( monitor->qemuMonitorCommand("{ \"execute\": \"system_powerdown\" }", reply) < 0 ) {
+        throw std::runtime_error("Failed to send ACPI shutdown to domain " + domainObj->def->name + ".");
+    }
+    domainObj->shutdownStage = QEMU_DOMAIN_SHUTDOWN_POWERDOWN;
+    scheduleShutdownTimer(domainObj, timeoutSec >= 0 ? timeoutSec : config.getShutdownTimeoutSec());
+    LOG_INFO("ACPI shutdown sent to domain %s", domainObj->def->name.c_str());
+}
+
+void QemuDriver::scheduleShutdownTimer(std::shared_ptr<qemuDomainObj> domainObj, int timeoutSec) {
+    std::string name = domainObj->def->name;
+    pid_t pid = domainObj->pid;
+    unsigned int delayMs = static_cast< unsigned int >(timeoutSec > 0 ? timeoutSec : 0) * 1000;
+    domainObj->shutdownDeadlineMs = TimerWheel::nowMs() + delayMs;
+    // 定时器线程中不能等待驱动锁，升级交给事件循环线程执行
+    domainObj->shutdownTimer = TimerService::Instance()->addTimer(delayMs, [this, name, pid]() {
+        eventLoop->post([this, name, pid]() { escalateShutdown(name, pid); });
+    });
+}
 
-    // std::cout << "first send..." << cmd << std::endl;
-    LOG_INFO("first send...%s", cmd.c_str());
-    if ( domainObj->monitor->qemuMonitorSendMessage(cmd, result) < 0 ) {
+void QemuDriver::cancelShutdown(std::shared_ptr<qemuDomainObj> domainObj) {
+    if ( domainObj->shutdownTimer != 0 ) {
+        TimerService::Instance()->cancelTimer(domainObj->shutdownTimer);
+    }
+    domainObj->shutdownTimer = 0;
+    domainObj->shutdownDeadlineMs = 0;
+    domainObj->shutdownStage = QEMU_DOMAIN_SHUTDOWN_NONE;
+}
+
+void QemuDriver::escalateShutdown(const std::string& name, pid_t pid) {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    std::shared_ptr<qemuDomainObj> domainObj;
+    for ( const auto& obj : domains ) {
+        if ( obj->def->name == name && obj->pid == pid ) {
+            domainObj = obj;
+            break;
+        }
+    }
+    // 定时器触发前虚拟机已经退出或被destroy
+    if ( !domainObj || domainObj->shutdownStage == QEMU_DOMAIN_SHUTDOWN_NONE ) {
         return;
     }
+    domainObj->shutdownTimer = 0;
+
+    if ( domainObj->shutdownStage == QEMU_DOMAIN_SHUTDOWN_POWERDOWN ) {
+        static MetricCounter* quits = Metrics::Instance()->counter("tinyvirt_shutdown_escalations_total",
+            "Graceful shutdowns escalated after the guest did not stop in time", "stage=\"quit\"");
+        quits->inc();
+        LOG_WARN("Domain %s did not shut down in time, sending quit", name.c_str());
+        std::shared_ptr<QemuMonitor> monitor = getMonitor(domainObj);
+        JsonValue reply;
+        if ( monitor && monitor->qemuMonitorCommand("{ \"execute\": \"quit\" }", reply) == 0 ) {
+            domainObj->shutdownStage = QEMU_DOMAIN_SHUTDOWN_QUIT;
+            scheduleShutdownTimer(domainObj, config.getShutdownQuitTimeoutSec());
+            return;
+        }
+        LOG_WARN("Failed to send quit to domain %s", name.c_str());
+    }
 
-    domainObj->stateReason.state = VIR_DOMAIN_SHUTOFF;
-    domainObj->stateReason.reason = 1; // Destroyed
-    domainObj->pid = -1; // Mark as not running
+    static MetricCounter* kills = Metrics::Instance()->counter("tinyvirt_shutdown_escalations_total",
+        "Graceful shutdowns escalated after the guest did not stop in time", "stage=\"kill\"");
+    kills->inc();
+    LOG_WARN("QEMU process %d of %s did not exit, killing it", pid, name.c_str());
+    domainObj->shutdownStage = QEMU_DOMAIN_SHUTDOWN_KILL;
+    // 进程退出后由handleProcessExit清理
+    if ( kill(pid, SIGKILL) < 0 && errno != ESRCH ) {
+        LOG_ERROR("Failed to kill domain process: %s", strerror(errno));
+    }
+}
 
-    // std::cout << "Domain " << domainObj->def->name << " shutdown." << std::endl;
-    LOG_INFO("Domain %s shutdown.", domainObj->def->name.c_str());
+// 以下两个函数在fork出的看门狗进程中运行，只能使用异步信号安全的系统调用
+// 等待进程退出，超时返回false；有pidfd时用poll等待，否则每200ms检查一次进程是否存在
+static bool waitProcessExit(pid_t pid, int pidfd, unsigned long long timeoutMs) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for ( ;; ) {
+        if ( pidfd < 0 && kill(pid, 0) < 0 && errno == ESRCH ) {
+            return true;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        unsigned long long elapsedMs = static_cast< unsigned long long >(now.tv_sec - start.tv_sec) * 1000 +
+            (now.tv_nsec - start.tv_nsec) / 1000000;
+        if ( elapsedMs >= timeoutMs ) {
+            return false;
+        }
+        unsigned long long leftMs = timeoutMs - elapsedMs;
+        if ( pidfd >= 0 ) {
+            struct pollfd pfd = { pidfd, POLLIN, 0 };
+            if ( poll(&pfd, 1, static_cast< int >(std::min(leftMs, 60000ULL))) > 0 ) {
+                return true;
+            }
+        }
+        else {
+            unsigned long long sleepMs = std::min(leftMs, 200ULL);
+            struct timespec ts = { static_cast< time_t >(sleepMs / 1000), static_cast< long >(sleepMs % 1000) * 1000000 };
+            nanosleep(&ts, nullptr);
+        }
+    }
+}
 
-    // 删除pid文件
-    std::string pidFilePath = config.getConfigDir() + "/" + domainObj->def->name + ".pid";
-    if ( remove(pidFilePath.c_str()) != 0 ) {
-        // std::cerr << "Failed to delete PID file: " << pidFilePath << std::endl;
-        LOG_ERROR("Failed to delete PID file: %s", pidFilePath.c_str());
+// 有pidfd时通过pidfd发送信号，避免进程号被复用后误杀其他进程
+static void signalProcess(pid_t pid, int pidfd, int sig) {
+#ifdef SYS_pidfd_send_signal
+    if ( pidfd >= 0 && syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0) == 0 ) {
+        return;
     }
+#else
+    (void)pidfd;
+#endif
+    kill(pid, sig);
+}
 
-    return;
+void QemuDriver::handOffShutdown(std::shared_ptr<qemuDomainObj> domainObj) {
+    pid_t pid = domainObj->pid;
+    if ( pid <= 0 || domainObj->shutdownStage == QEMU_DOMAIN_SHUTDOWN_KILL ) {
+        return;
+    }
+    // 当前阶段剩余的时间；看门狗中用SIGTERM代替quit，QEMU收到后同样保存状态并退出
+    unsigned long long now = TimerWheel::nowMs();
+    unsigned long long leftMs = domainObj->shutdownDeadlineMs > now ? domainObj->shutdownDeadlineMs - now : 0;
+    bool powerdown = domainObj->shutdownStage == QEMU_DOMAIN_SHUTDOWN_POWERDOWN;
+    unsigned long long quitMs = static_cast< unsigned long long >(std::max(config.getShutdownQuitTimeoutSec(), 0)) * 1000;
+
+    // fork之后不能再分配内存，需要的值都在这里准备好
+    int pidfd = -1;
+#ifdef SYS_pidfd_open
+    pidfd = static_cast< int >(syscall(SYS_pidfd_open, pid, 0));
+#endif
+    long maxFd = sysconf(_SC_OPEN_MAX);
+    if ( maxFd < 0 ) {
+        maxFd = 1024;
+    }
+    pid_t child = fork();
+    if ( child < 0 ) {
+        LOG_ERROR("Failed to fork shutdown watchdog for %s: %s", domainObj->def->name.c_str(), strerror(errno));
+        if ( pidfd >= 0 ) {
+            close(pidfd);
+        }
+        return;
+    }
+    if ( child == 0 ) {
+        // 两次fork，看门狗由init收养，不依赖当前进程回收；关闭继承的QMP连接等描述符
+        setsid();
+        if ( fork() != 0 ) {
+            _exit(0);
+        }
+        int devNull = open("/dev/null", O_RDWR);
+        if ( devNull >= 0 ) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+        for ( int fd = STDERR_FILENO + 1; fd < maxFd; fd++ ) {
+            if ( fd != pidfd ) {
+                close(fd);
+            }
+        }
+        if ( powerdown ) {
+            if ( waitProcessExit(pid, pidfd, leftMs) ) {
+                _exit(0);
+            }
+            signalProcess(pid, pidfd, SIGTERM);
+            leftMs = quitMs;
+        }
+        if ( !waitProcessExit(pid, pidfd, leftMs) ) {
+            signalProcess(pid, pidfd, SIGKILL);
+        }
+        _exit(0);
+    }
+    if ( pidfd >= 0 ) {
+        close(pidfd);
+    }
+    waitpid(child, nullptr, 0);
+    LOG_INFO("Shutdown of domain %s handed over to watchdog, escalating in %llu ms",
+        domainObj->def->name.c_str(), leftMs);
 }
 
 int QemuDriver::domainUndefine(std::shared_ptr<VirDomain> domain) {
@@ -783,6 +2185,8 @@ int QemuDriver::domainUndefine(std::shared_ptr<VirDomain> domain) {
 }
 
 int QemuDriver::domainUndefineFlags(std::shared_ptr<VirDomain> domain, unsigned int flags) {
+    MetricsOpTimer opTimer("domainUndefine");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
     if ( flags != 0 ) {
         throw std::runtime_error("Unsupported flags");
     }
@@ -794,56 +2198,702 @@ int QemuDriver::domainUndefineFlags(std::shared_ptr<VirDomain> domain, unsigned
 }
 
 int QemuDriver::domainGetState(std::shared_ptr<VirDomain> domain) {
-    if ( domain->virDomainGetID() < 0 ) {
+    int reason = 0;
+    return domainGetStateFlags(domain, reason, 0);
+}
+
+int QemuDriver::domainGetStateFlags(std::shared_ptr<VirDomain> domain, int& reason, unsigned int flags) {
+    MetricsOpTimer opTimer("domainGetState");
+    if ( flags & ~VIR_DOMAIN_GET_STATE_FORCE_REFRESH ) {
+        throw std::runtime_error("Unsupported flags");
+    }
+    std::shared_ptr<qemuDomainObj> domainObj = findDomainObj(domain->virDomainGetName());
+    if ( !domainObj ) {
+        throw std::runtime_error("Domain not found.");
+    }
+    // 已同步的状态由QMP事件和进程退出维护，直接读取，不与创建、关机等持有driverLock的长操作竞争
+    if ( !(flags & VIR_DOMAIN_GET_STATE_FORCE_REFRESH) && domainObj->stateSynced ) {
+        reason = domainObj->stateReason.reason;
+        return domainObj->stateReason.state;
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    if ( domainObj->pid <= 0 ) {
+        reason = domainObj->stateReason.reason;
         return VIR_DOMAIN_SHUTOFF;
     }
-    std::shared_ptr<qemuDomainObj> domainObj;
-    bool found = false;
+
+    // 只有注册了事件回调、由事件维护状态的进程才走上面的快速路径，其他情况每次都通过QMP查询
+    // 查询失败时返回-1，不返回过期的缓存状态
+    if ( refreshDomainState(domainObj) < 0 ) {
+        return -1;
+    }
+    reason = domainObj->stateReason.reason;
+    return domainObj->stateReason.state;
+}
+
+int QemuDriver::refreshDomainState(std::shared_ptr<qemuDomainObj> domainObj) {
+    std::shared_ptr<QemuMonitor> monitor = getMonitor(domainObj);
+    JsonValue status;
+    if ( !monitor || monitor->qemuMonitorCommand("{ \"execute\":\"query-status\"}", status) < 0 ) {
+        LOG_ERROR("Failed to query status of %s", domainObj->def->name.c_str());
+        return -1;
+    }
+    // 原因也按查询结果设置，不能沿用之前事件或上一次运行留下的值，取值与libvirt一致
+    std::string runState = status.getString("status");
+    int state = VIR_DOMAIN_PAUSED;
+    int reason = 0;
+    if ( runState == "running" ) {
+        state = VIR_DOMAIN_RUNNING;
+        reason = 0;     // VIR_DOMAIN_RUNNING_UNKNOWN
+    }
+    else if ( runState == "shutdown" ) {
+        state = VIR_DOMAIN_SHUTDOWN;
+        reason = 0;     // VIR_DOMAIN_SHUTDOWN_UNKNOWN
+    }
+    else if ( runState == "guest-panicked" ) {
+        state = VIR_DOMAIN_CRASHED;
+        reason = 1;     // VIR_DOMAIN_CRASHED_PANICKED
+    }
+    else if ( runState == "internal-error" ) {
+        state = VIR_DOMAIN_CRASHED;
+        reason = 0;     // VIR_DOMAIN_CRASHED_UNKNOWN
+    }
+    else if ( runState == "suspended" ) {
+        state = VIR_DOMAIN_PMSUSPENDED;
+        reason = 0;     // VIR_DOMAIN_PMSUSPENDED_UNKNOWN
+    }
+    else if ( runState == "paused" ) {
+        reason = 1;     // VIR_DOMAIN_PAUSED_USER
+    }
+    else if ( runState == "io-error" ) {
+        reason = 5;     // VIR_DOMAIN_PAUSED_IOERROR
+    }
+    else if ( runState == "watchdog" ) {
+        reason = 6;     // VIR_DOMAIN_PAUSED_WATCHDOG
+    }
+    else if ( runState == "inmigrate" || runState == "postmigrate" || runState == "finish-migrate" ) {
+        reason = 2;     // VIR_DOMAIN_PAUSED_MIGRATION
+    }
+    else if ( runState == "save-vm" ) {
+        reason = 3;     // VIR_DOMAIN_PAUSED_SAVE
+    }
+    else if ( runState == "prelaunch" ) {
+        reason = 11;    // VIR_DOMAIN_PAUSED_STARTING_UP
+    }
+    // 其余状态(debug、restore-vm等)都是暂停，原因未知
+    domainObj->stateReason.state = state;
+    domainObj->stateReason.reason = reason;
+    // 只有事件循环在接收这个虚拟机的事件时缓存才是可靠的
+    domainObj->stateSynced = eventLoop && domainObj->watched && domainObj->eventsWatched;
+    return domainObj->stateReason.state;
+}
+
+std::unique_ptr<Cgroup> QemuDriver::openDomainCgroup(std::shared_ptr<VirDomain> domain,
+    std::shared_ptr<qemuDomainObj>& domainObj, unsigned int flags) {
+    if ( flags & ~(VIR_DOMAIN_AFFECT_LIVE | VIR_DOMAIN_AFFECT_CONFIG) ) {
+        throw std::runtime_error("Unsupported flags");
+    }
+    if ( flags & VIR_DOMAIN_AFFECT_CONFIG ) {
+        throw std::runtime_error("Changing the persistent resource configuration is not supported");
+    }
+    domainObj.reset();
     for ( const auto& domainObj_ : domains ) {
         if ( domainObj_->def->name == domain->virDomainGetName() ) {
             domainObj = domainObj_;
-            found = true;
             break;
         }
     }
-    if ( !found ) {
+    if ( !domainObj ) {
         throw std::runtime_error("Domain not found.");
     }
-    std::shared_ptr<qemuDomainDef> qemuDef = std::dynamic_pointer_cast< qemuDomainDef >(domainObj->def);
-    domainObj->monitor = std::make_shared<QemuMonitor>(qemuDef->qmpSocketPath);
+    if ( domainObj->pid == -1 ) {
+        throw std::runtime_error("Domain " + domainObj->def->name + " is not running.");
+    }
+    std::unique_ptr<Cgroup> cgroup = Cgroup::openForDomain(config.getCgroupPartition(), domainObj->def->name);
+    if ( !cgroup ) {
+        throw std::runtime_error("Domain " + domainObj->def->name + " has no cgroup");
+    }
+    return cgroup;
+}
 
-    if ( !found || !domainObj || !domainObj->monitor ) {
-        // std::cout << "found: " << (!found) << std::endl;
-        LOG_INFO("found: %d", !found);
-        // std::cout << "domainObj: " << (!domainObj) << std::endl;
-        LOG_INFO("domainObj: %d", !domainObj);
-        // std::cout << "domainMon: " << (!domainObj->monitor) << std::endl;
-        LOG_INFO("domainMon: %d", !domainObj->monitor);
-        return VIR_DOMAIN_NOSTATE;  // 返回无状态而不是崩溃
+int QemuDriver::domainSetSchedulerParameters(std::shared_ptr<VirDomain> domain,
+    const std::map<std::string, long long>& params, unsigned int flags) {
+    MetricsOpTimer opTimer("domainSetSchedulerParameters");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    std::shared_ptr<qemuDomainObj> domainObj;
+    std::unique_ptr<Cgroup> cgroup = openDomainCgroup(domain, domainObj, flags);
+
+    // 在当前配置的基础上合并新参数，校验通过后再写入cgroup
+    virDomainCputuneDef cputune = domainObj->def->cputune;
+    bool bandwidthChanged = false;
+    for ( const auto& param : params ) {
+        if ( param.first == VIR_DOMAIN_SCHEDULER_CPU_SHARES ) {
+            if ( param.second <= 0 ) {
+                throw std::runtime_error("cpu_shares must be positive");
+            }
+            cputune.shares = static_cast< unsigned long long >(param.second);
+        }
+        else if ( param.first == VIR_DOMAIN_SCHEDULER_GLOBAL_PERIOD ) {
+            cputune.period = param.second > 0 ? static_cast< unsigned long long >(param.second) : 0;
+            bandwidthChanged = true;
+        }
+        else if ( param.first == VIR_DOMAIN_SCHEDULER_GLOBAL_QUOTA ) {
+            cputune.quota = param.second > 0 ? param.second : 0;
+            bandwidthChanged = true;
+        }
+        else {
+            throw std::runtime_error("Unknown scheduler parameter: " + param.first);
+        }
+    }
+    validateCpuBandwidth(cputune);
+
+    if ( params.count(VIR_DOMAIN_SCHEDULER_CPU_SHARES) && cgroup->setCpuWeight(cputune.shares) < 0 ) {
+        return -1;
+    }
+    if ( bandwidthChanged ) {
+        unsigned long long period = cputune.period != 0 ? cputune.period : 100000;
+        if ( cgroup->setCpuMax(cputune.quota > 0 ? cputune.quota : -1, period) < 0 ) {
+            return -1;
+        }
     }
+    domainObj->def->cputune = cputune;
+    LOG_INFO("Updated scheduler parameters of %s: shares=%llu, period=%llu, quota=%lld",
+        domainObj->def->name.c_str(), cputune.shares, cputune.period, cputune.quota);
+    return 0;
+}
 
-    // if ( domainObj->monitor->qemuMonitorOpenUnixSocket() < 0 ) {
-    //     throw std::runtime_error("Failed to open monitor socket.");
-    // }
+int QemuDriver::domainSetMemoryParameters(std::shared_ptr<VirDomain> domain,
+    const std::map<std::string, unsigned long long>& params, unsigned int flags) {
+    MetricsOpTimer opTimer("domainSetMemoryParameters");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    std::shared_ptr<qemuDomainObj> domainObj;
+    std::unique_ptr<Cgroup> cgroup = openDomainCgroup(domain, domainObj, flags);
 
-    std::string cmd = "{ \"execute\":\"query-status\"}";
-    std::string cmdQuit = "{ \"execute\":\"quit\"}";
-    std::string result;
+    virDomainMemtuneDef memtune = domainObj->def->memtune;
+    for ( const auto& param : params ) {
+        if ( param.first == VIR_DOMAIN_MEMORY_HARD_LIMIT ) {
+            memtune.hardLimitKiB = param.second;
+        }
+        else if ( param.first == VIR_DOMAIN_MEMORY_SOFT_LIMIT ) {
+            memtune.softLimitKiB = param.second;
+        }
+        else {
+            throw std::runtime_error("Unknown memory parameter: " + param.first);
+        }
+    }
+    if ( memtune.hardLimitKiB != 0 && memtune.softLimitKiB > memtune.hardLimitKiB ) {
+        throw std::runtime_error("soft_limit must not exceed hard_limit");
+    }
 
-    // std::cout << "first send..." << cmd << std::endl;
-    LOG_INFO("first send...%s", cmd.c_str());
-    if ( domainObj->monitor->qemuMonitorSendMessage(cmd, result) < 0 ) {
+    if ( params.count(VIR_DOMAIN_MEMORY_HARD_LIMIT) && cgroup->setMemoryMax(memtune.hardLimitKiB * 1024) < 0 ) {
         return -1;
     }
+    if ( params.count(VIR_DOMAIN_MEMORY_SOFT_LIMIT) && cgroup->setMemoryHigh(memtune.softLimitKiB * 1024) < 0 ) {
+        return -1;
+    }
+    domainObj->def->memtune = memtune;
+    LOG_INFO("Updated memory parameters of %s: hard_limit=%lluKiB, soft_limit=%lluKiB",
+        domainObj->def->name.c_str(), memtune.hardLimitKiB, memtune.softLimitKiB);
+    return 0;
+}
 
-    // 解析JSON响应获取状态
-    if ( result.find("\"status\": \"running\"") != std::string::npos ) {
-        domainObj->stateReason.state = VIR_DOMAIN_RUNNING;
+int QemuDriver::domainSetBlkioParameters(std::shared_ptr<VirDomain> domain,
+    const std::map<std::string, std::string>& params, unsigned int flags) {
+    MetricsOpTimer opTimer("domainSetBlkioParameters");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    std::shared_ptr<qemuDomainObj> domainObj;
+    std::unique_ptr<Cgroup> cgroup = openDomainCgroup(domain, domainObj, flags);
+
+    std::vector<virDomainBlkioDeviceDef> blkiotune = domainObj->def->blkiotune;
+    std::vector<std::string> changed;
+    for ( const auto& param : params ) {
+        unsigned long long virDomainBlkioDeviceDef::* field;
+        if ( param.first == VIR_DOMAIN_BLKIO_DEVICE_READ_IOPS ) {
+            field = &virDomainBlkioDeviceDef::readIopsSec;
+        }
+        else if ( param.first == VIR_DOMAIN_BLKIO_DEVICE_WRITE_IOPS ) {
+            field = &virDomainBlkioDeviceDef::writeIopsSec;
+        }
+        else if ( param.first == VIR_DOMAIN_BLKIO_DEVICE_READ_BPS ) {
+            field = &virDomainBlkioDeviceDef::readBytesSec;
+        }
+        else if ( param.first == VIR_DOMAIN_BLKIO_DEVICE_WRITE_BPS ) {
+            field = &virDomainBlkioDeviceDef::writeBytesSec;
+        }
+        else {
+            throw std::runtime_error("Unknown blkio parameter: " + param.first);
+        }
+
+        // 值的格式为"path,value[,path,value...]"
+        std::vector<std::string> tokens;
+        size_t pos = 0;
+        while ( pos <= param.second.size() ) {
+            size_t end = param.second.find(',', pos);
+            if ( end == std::string::npos ) {
+                end = param.second.size();
+            }
+            tokens.push_back(param.second.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        if ( tokens.size() % 2 != 0 ) {
+            throw std::runtime_error("Invalid value for " + param.first + ": " + param.second);
+        }
+        for ( size_t i = 0; i < tokens.size(); i += 2 ) {
+            char* endptr = nullptr;
+            unsigned long long value = strtoull(tokens[i + 1].c_str(), &endptr, 10);
+            if ( tokens[i].empty() || !endptr || *endptr != '\0' ) {
+                throw std::runtime_error("Invalid value for " + param.first + ": " + param.second);
+            }
+            auto it = std::find_if(blkiotune.begin(), blkiotune.end(),
+                [&](const virDomainBlkioDeviceDef& device) { return device.path == tokens[i]; });
+            if ( it == blkiotune.end() ) {
+                virDomainBlkioDeviceDef device;
+                device.path = tokens[i];
+                it = blkiotune.insert(blkiotune.end(), device);
+            }
+            (*it).*field = value;
+            if ( std::find(changed.begin(), changed.end(), tokens[i]) == changed.end() ) {
+                changed.push_back(tokens[i]);
+            }
+        }
     }
-    else if ( result.find("\"status\": \"paused\"") != std::string::npos ) {
-        domainObj->stateReason.state = VIR_DOMAIN_PAUSED;
+
+    for ( const auto& device : blkiotune ) {
+        if ( std::find(changed.begin(), changed.end(), device.path) == changed.end() ) {
+            continue;
+        }
+        std::string devnum = Cgroup::deviceNumber(device.path);
+        if ( devnum.empty() ) {
+            throw std::runtime_error("Failed to resolve block device of " + device.path);
+        }
+        CgroupIoLimit limit;
+        limit.riops = device.readIopsSec;
+        limit.wiops = device.writeIopsSec;
+        limit.rbps = device.readBytesSec;
+        limit.wbps = device.writeBytesSec;
+        if ( cgroup->setIoMax(devnum, limit) < 0 ) {
+            return -1;
+        }
     }
-    // 其他状态...
+    domainObj->def->blkiotune = blkiotune;
+    return 0;
+}
 
-    return domainObj->stateReason.state;
-}
\ No newline at end of file
+int QemuDriver::domainBlockResize(std::shared_ptr<VirDomain> domain, const std::string& disk,
+    unsigned long long size, unsigned int flags) {
+    MetricsOpTimer opTimer("domainBlockResize");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    if ( flags & ~VIR_DOMAIN_BLOCK_RESIZE_BYTES ) {
+        throw std::runtime_error("Unsupported flags");
+    }
+    std::shared_ptr<qemuDomainObj> domainObj;
+    for ( const auto& domainObj_ : domains ) {
+        if ( domainObj_->def->name == domain->virDomainGetName() ) {
+            domainObj = domainObj_;
+            break;
+        }
+    }
+    if ( !domainObj ) {
+        throw std::runtime_error("Domain not found.");
+    }
+    if ( domainObj->pid <= 0 ) {
+        throw std::runtime_error("Domain " + domainObj->def->name + " is not running.");
+    }
+    auto it = std::find_if(domainObj->def->disks.begin(), domainObj->def->disks.end(),
+        [&disk](const virDomainDiskDef& def) { return def.targetDev == disk || isSameFile(def.source, disk); });
+    if ( it == domainObj->def->disks.end() ) {
+        throw std::runtime_error("Domain " + domainObj->def->name + " has no disk " + disk);
+    }
+    if ( !(flags & VIR_DOMAIN_BLOCK_RESIZE_BYTES) ) {
+        size *= 1024;
+    }
+
+    std::shared_ptr<QemuMonitor> monitor = getMonitor(domainObj);
+    if ( !monitor ) {
+        throw std::runtime_error("Failed to connect to monitor of domain " + domainObj->def->name + ".");
+    }
+    std::string cmd = "{ \"execute\": \"block_resize\", \"arguments\": { \"device\": " +
+        JsonValue::quote("drive-" + it->alias) + ", \"size\": " + std::to_string(size) + " } }";
+    JsonValue reply;
+    if ( monitor->qemuMonitorCommand(cmd, reply) < 0 ) {
+        LOG_ERROR("block_resize of %s on domain %s failed", disk.c_str(), domainObj->def->name.c_str());
+        return -1;
+    }
+    LOG_INFO("Disk %s of domain %s resized to %llu bytes", disk.c_str(), domainObj->def->name.c_str(), size);
+    return 0;
+}
+
+int QemuDriver::domainBlockPull(std::shared_ptr<VirDomain> domain, const std::string& disk,
+    unsigned long long bandwidth, unsigned int flags) {
+    MetricsOpTimer opTimer("domainBlockPull");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    if ( flags & ~VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES ) {
+        throw std::runtime_error("Unsupported flags");
+    }
+    std::shared_ptr<qemuDomainObj> domainObj;
+    for ( const auto& domainObj_ : domains ) {
+        if ( domainObj_->def->name == domain->virDomainGetName() ) {
+            domainObj = domainObj_;
+            break;
+        }
+    }
+    if ( !domainObj ) {
+        throw std::runtime_error("Domain not found.");
+    }
+    if ( domainObj->pid <= 0 ) {
+        throw std::runtime_error("Domain " + domainObj->def->name + " is not running.");
+    }
+    auto it = std::find_if(domainObj->def->disks.begin(), domainObj->def->disks.end(),
+        [&disk](const virDomainDiskDef& def) { return def.targetDev == disk || isSameFile(def.source, disk); });
+    if ( it == domainObj->def->disks.end() ) {
+        throw std::runtime_error("Domain " + domainObj->def->name + " has no disk " + disk);
+    }
+    if ( !(flags & VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES) ) {
+        bandwidth <<= 20;
+    }
+
+    std::shared_ptr<QemuMonitor> monitor = getMonitor(domainObj);
+    if ( !monitor ) {
+        throw std::runtime_error("Failed to connect to monitor of domain " + domainObj->def->name + ".");
+    }
+    // 不指定job-id时任务以设备名命名，BLOCK_JOB_COMPLETED事件中的device即为该名称
+    std::string device = "drive-" + it->alias;
+    std::string cmd = "{ \"execute\": \"block-stream\", \"arguments\": { \"device\": " +
+        JsonValue::quote(device);
+    if ( bandwidth > 0 ) {
+        cmd += ", \"speed\": " + std::to_string(bandwidth);
+    }
+    cmd += " } }";
+    // 任务可能在命令返回前就已结束，先登记再下发
+    {
+        std::lock_guard<std::mutex> lock(domainObj->blockJobsLock);
+        domainObj->blockJobs[device] = it->source;
+    }
+    JsonValue reply;
+    if ( monitor->qemuMonitorCommand(cmd, reply) < 0 ) {
+        LOG_ERROR("block-stream of %s on domain %s failed", disk.c_str(), domainObj->def->name.c_str());
+        std::lock_guard<std::mutex> lock(domainObj->blockJobsLock);
+        domainObj->blockJobs.erase(device);
+        return -1;
+    }
+    LOG_INFO("Block pull of disk %s started on domain %s", disk.c_str(), domainObj->def->name.c_str());
+    return 0;
+}
+
+std::shared_ptr<VirDomain> QemuDriver::domainLookupByDiskSource(const std::string& path) {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    for ( const auto& domainObj : domains ) {
+        if ( domainObj->pid <= 0 ) {
+            continue;
+        }
+        for ( const auto& disk : domainObj->def->disks ) {
+            if ( isSameFile(disk.source, path) ) {
+                return std::make_shared<VirDomain>(domainObj->def->name, domainObj->def->id, domainObj->def->uuid, this);
+            }
+        }
+    }
+    return nullptr;
+}
+
+int QemuDriver::domainGetResourceUsage(std::shared_ptr<VirDomain> domain, virDomainResourceUsage& usage) {
+    MetricsOpTimer opTimer("domainGetResourceUsage");
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    std::shared_ptr<qemuDomainObj> domainObj;
+    std::unique_ptr<Cgroup> cgroup = openDomainCgroup(domain, domainObj, 0);
+
+    usage = virDomainResourceUsage();
+    CgroupCpuStat cpuStat;
+    if ( cgroup->getCpuStat(cpuStat) == 0 ) {
+        usage.cpuTime = cpuStat.usageUsec * 1000;
+        usage.userTime = cpuStat.userUsec * 1000;
+        usage.systemTime = cpuStat.systemUsec * 1000;
+        usage.throttledTime = cpuStat.throttledUsec * 1000;
+    }
+    unsigned long long memoryBytes = 0;
+    if ( cgroup->getMemoryCurrent(memoryBytes) == 0 ) {
+        usage.memoryCurrent = memoryBytes / 1024;
+    }
+    std::map<std::string, CgroupIoStat> ioStats;
+    if ( cgroup->getIoStat(ioStats) == 0 ) {
+        for ( const auto& io : ioStats ) {
+            virDomainBlockUsage block;
+            block.device = io.first;
+            block.rdBytes = io.second.rbytes;
+            block.wrBytes = io.second.wbytes;
+            block.rdReqs = io.second.rios;
+            block.wrReqs = io.second.wios;
+            usage.blocks.push_back(block);
+        }
+    }
+    return 0;
+}
+
+// 单个运行中虚拟机的采集上下文，快照在持有driverLock时生成，之后的IO不再持有driverLock
+struct QemuStatsContext {
+    size_t record;
+    pid_t pid;
+    std::shared_ptr<virDomainDef> def;
+    std::shared_ptr<QemuMonitor> monitor;
+    std::vector<pid_t> vcpuThreads;
+    std::vector<std::string> interfaceDevices;
+    std::vector<std::string> commands;
+};
+
+static void fillBlockStats(const JsonValue& reply, const virDomainDef& def, virDomainStatsRecord& record) {
+    for ( const auto& entry : reply.elements() ) {
+        std::string device = entry.getString("device");
+        if ( device.empty() ) {
+            continue;
+        }
+        virDomainBlockStatsRecord block;
+        block.name = device;
+        for ( const auto& disk : def.disks ) {
+            if ( "drive-" + disk.alias == device ) {
+                block.name = disk.targetDev.empty() ? disk.alias : disk.targetDev;
+                block.path = disk.source;
+                break;
+            }
+        }
+        const JsonValue* stats = entry.get("stats");
+        if ( stats ) {
+            block.rdReqs = stats->getUInt("rd_operations");
+            block.rdBytes = stats->getUInt("rd_bytes");
+            block.rdTimes = stats->getUInt("rd_total_time_ns");
+            block.wrReqs = stats->getUInt("wr_operations");
+            block.wrBytes = stats->getUInt("wr_bytes");
+            block.wrTimes = stats->getUInt("wr_total_time_ns");
+            block.flReqs = stats->getUInt("flush_operations");
+            block.flTimes = stats->getUInt("flush_total_time_ns");
+        }
+        record.blocks.push_back(block);
+    }
+}
+
+static void fillBalloonGuestStats(const JsonValue& reply, virDomainBalloonStatsRecord& balloon) {
+    const JsonValue* stats = reply.get("stats");
+    if ( !stats ) {
+        return;
+    }
+    // QEMU以字节上报内存大小，未上报的项为-1
+    auto memoryKiB = [stats](const char* key) {
+        long long value = stats->getInt(key, -1);
+        return value < 0 ? -1 : value / 1024;
+    };
+    balloon.swapIn = memoryKiB("stat-swap-in");
+    balloon.swapOut = memoryKiB("stat-swap-out");
+    balloon.majorFault = stats->getInt("stat-major-faults", -1);
+    balloon.minorFault = stats->getInt("stat-minor-faults", -1);
+    balloon.unused = memoryKiB("stat-free-memory");
+    balloon.available = memoryKiB("stat-total-memory");
+    balloon.usable = memoryKiB("stat-available-memory");
+    balloon.diskCaches = memoryKiB("stat-disk-caches");
+    balloon.lastUpdate = reply.getInt("last-update", -1);
+}
+
+std::vector<virDomainStatsRecord> QemuDriver::connectGetAllDomainStats(unsigned int stats, unsigned int flags) {
+    MetricsOpTimer opTimer("connectGetAllDomainStats");
+    const unsigned int allStats = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL | VIR_DOMAIN_STATS_BALLOON |
+        VIR_DOMAIN_STATS_VCPU | VIR_DOMAIN_STATS_INTERFACE | VIR_DOMAIN_STATS_BLOCK;
+    const unsigned int allFlags = VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE | VIR_CONNECT_GET_ALL_DOMAINS_STATS_INACTIVE;
+    if ( flags & ~allFlags ) {
+        throw std::runtime_error("Unsupported flags");
+    }
+    if ( stats & ~allStats ) {
+        throw std::runtime_error("Unsupported stats types");
+    }
+    if ( stats == 0 ) {
+        stats = allStats;
+    }
+    bool wantActive = !(flags & allFlags) || (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+    bool wantInactive = !(flags & allFlags) || (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_INACTIVE);
+
+    std::vector<virDomainStatsRecord> records;
+    std::vector<QemuStatsContext> contexts;
+    {
+        std::lock_guard<std::recursive_mutex> guard(driverLock);
+        for ( const auto& domainObj : domains ) {
+            bool running = domainObj->pid > 0;
+            if ( (running && !wantActive) || (!running && !wantInactive) ) {
+                continue;
+            }
+            virDomainStatsRecord record;
+            record.name = domainObj->def->name;
+            record.state = domainObj->stateReason.state;
+            record.reason = domainObj->stateReason.reason;
+            record.statsMask = stats & VIR_DOMAIN_STATS_STATE;
+            records.push_back(record);
+            if ( !running ) {
+                continue;
+            }
+
+            QemuStatsContext ctx;
+            ctx.record = records.size() - 1;
+            ctx.pid = domainObj->pid;
+            ctx.def = domainObj->def;
+            ctx.vcpuThreads = domainObj->vcpuThreads;
+            ctx.interfaceDevices = domainObj->interfaceDevices;
+            if ( stats & VIR_DOMAIN_STATS_BLOCK ) {
+                ctx.commands.push_back("{ \"execute\":\"query-blockstats\"}");
+            }
+            if ( (stats & VIR_DOMAIN_STATS_BALLOON) && ctx.def->memballoonModel == "virtio" ) {
+                ctx.commands.push_back("{ \"execute\":\"query-balloon\"}");
+                if ( ctx.def->memballoonStatsPeriod > 0 ) {
+                    ctx.commands.push_back("{ \"execute\":\"qom-get\", \"arguments\":"
+                        "{ \"path\":\"/machine/peripheral/balloon0\", \"property\":\"guest-stats\"}}");
+                }
+            }
+            if ( (stats & VIR_DOMAIN_STATS_VCPU) && ctx.vcpuThreads.empty() ) {
+                ctx.commands.push_back("{ \"execute\":\"query-cpus-fast\"}");
+            }
+            // 连接只在本轮采样内使用，contexts析构时关闭，不占用QEMU唯一的QMP客户端位置
+            if ( !ctx.commands.empty() ) {
+                ctx.monitor = getMonitor(domainObj);
+                if ( !ctx.monitor ) {
+                    LOG_WARN("Monitor of %s is unavailable, skipping QMP statistics", record.name.c_str());
+                    ctx.commands.clear();
+                }
+            }
+            contexts.push_back(ctx);
+        }
+    }
+
+    // 第一步：向所有虚拟机发送查询，不等待回复，QEMU在后台并行处理
+    // 每个monitor的锁一直持有到回复读取完毕，防止其他线程的命令插入
+    std::vector<std::unique_lock<std::recursive_mutex>> monitorLocks;
+    for ( auto& ctx : contexts ) {
+        if ( ctx.commands.empty() ) {
+            continue;
+        }
+        monitorLocks.push_back(std::unique_lock<std::recursive_mutex>(ctx.monitor->getLock()));
+        if ( ctx.monitor->qemuMonitorSendCommands(ctx.commands) < 0 ) {
+            ctx.commands.clear();
+        }
+    }
+
+    // 第二步：在QEMU处理查询期间读取宿主机侧的数据，/proc/net/dev只读一次
+    std::map<std::string, ProcNetDevStat> netdevs;
+    if ( stats & VIR_DOMAIN_STATS_INTERFACE ) {
+        procReadNetDev(netdevs);
+    }
+    for ( auto& ctx : contexts ) {
+        virDomainStatsRecord& record = records[ctx.record];
+        if ( stats & VIR_DOMAIN_STATS_CPU_TOTAL ) {
+            ProcTaskStat taskStat;
+            if ( procReadTaskStat(ctx.pid, 0, taskStat) == 0 ) {
+                record.cpuUser = taskStat.userTime;
+                record.cpuSystem = taskStat.systemTime;
+                record.cpuTime = taskStat.userTime + taskStat.systemTime;
+                record.rss = taskStat.rssKiB;
+                record.statsMask |= VIR_DOMAIN_STATS_CPU_TOTAL;
+            }
+        }
+        if ( stats & VIR_DOMAIN_STATS_INTERFACE ) {
+            for ( const auto& device : ctx.interfaceDevices ) {
+                auto it = netdevs.find(device);
+                if ( device.empty() || it == netdevs.end() ) {
+                    continue;
+                }
+                // TAP设备的接收方向对应虚拟机的发送方向
+                virDomainInterfaceStatsRecord iface;
+                iface.name = device;
+                iface.rxBytes = it->second.txBytes;
+                iface.rxPkts = it->second.txPackets;
+                iface.rxErrs = it->second.txErrs;
+                iface.rxDrop = it->second.txDrop;
+                iface.txBytes = it->second.rxBytes;
+                iface.txPkts = it->second.rxPackets;
+                iface.txErrs = it->second.rxErrs;
+                iface.txDrop = it->second.rxDrop;
+                record.interfaces.push_back(iface);
+            }
+            record.statsMask |= VIR_DOMAIN_STATS_INTERFACE;
+        }
+    }
+
+    // 第三步：按发送顺序收集回复
+    for ( auto& ctx : contexts ) {
+        virDomainStatsRecord& record = records[ctx.record];
+        std::vector<JsonValue> replies;
+        if ( !ctx.commands.empty() && ctx.monitor->qemuMonitorReceiveReplies(ctx.commands.size(), replies) < 0 ) {
+            LOG_WARN("Failed to receive statistics of %s", record.name.c_str());
+            replies.clear();
+        }
+        for ( size_t i = 0; i < replies.size(); i++ ) {
+            const std::string& cmd = ctx.commands[i];
+            if ( cmd.find("query-blockstats") != std::string::npos ) {
+                fillBlockStats(replies[i], *ctx.def, record);
+                record.statsMask |= VIR_DOMAIN_STATS_BLOCK;
+            }
+            else if ( cmd.find("query-balloon") != std::string::npos ) {
+                record.balloon.current = replies[i].getUInt("actual") / 1024;
+                record.balloon.maximum = static_cast< unsigned long long >(ctx.def->memory) * 1024;
+                record.statsMask |= VIR_DOMAIN_STATS_BALLOON;
+            }
+            else if ( cmd.find("guest-stats") != std::string::npos ) {
+                fillBalloonGuestStats(replies[i], record.balloon);
+            }
+            else if ( cmd.find("query-cpus-fast") != std::string::npos ) {
+                ctx.vcpuThreads.assign(ctx.def->vcpus, 0);
+                for ( const auto& cpu : replies[i].elements() ) {
+                    long long index = cpu.getInt("cpu-index", -1);
+                    if ( index >= 0 && index < ctx.def->vcpus ) {
+                        ctx.vcpuThreads[index] = static_cast< pid_t >(cpu.getInt("thread-id"));
+                    }
+                }
+            }
+        }
+
+        if ( (stats & VIR_DOMAIN_STATS_VCPU) && !ctx.vcpuThreads.empty() ) {
+            for ( size_t i = 0; i < ctx.vcpuThreads.size(); i++ ) {
+                virDomainVcpuStatsRecord vcpu;
+                vcpu.id = static_cast< int >(i);
+                vcpu.tid = ctx.vcpuThreads[i];
+                ProcTaskStat taskStat;
+                if ( vcpu.tid > 0 && procReadTaskStat(ctx.pid, vcpu.tid, taskStat) == 0 ) {
+                    vcpu.state = taskStat.state;
+                    vcpu.time = taskStat.userTime + taskStat.systemTime;
+                    vcpu.cpu = taskStat.processor;
+                }
+                record.vcpus.push_back(vcpu);
+            }
+            record.statsMask |= VIR_DOMAIN_STATS_VCPU;
+        }
+    }
+    monitorLocks.clear();
+
+    // vcpu线程在虚拟机运行期间不会变化，缓存下来避免下次重复查询
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    for ( const auto& ctx : contexts ) {
+        for ( const auto& domainObj : domains ) {
+            if ( domainObj->pid == ctx.pid && domainObj->vcpuThreads.empty() ) {
+                domainObj->vcpuThreads = ctx.vcpuThreads;
+            }
+        }
+    }
+    return records;
+}
+
+int QemuDriver::connectDomainEventRegisterAny(std::shared_ptr<VirDomain> domain, int eventID,
+    virConnectDomainEventCallback callback) {
+    std::lock_guard<std::recursive_mutex> guard(driverLock);
+    int callbackID = eventState.registerCallback(domain ? domain->virDomainGetName() : "", eventID, callback);
+    if ( !eventLoop ) {
+        try {
+            startEventLoop();
+        }
+        catch ( ... ) {
+            eventState.deregisterCallback(callbackID);
+            throw;
+        }
+    }
+    for ( const auto& domainObj : domains ) {
+        watchDomain(domainObj);
+    }
+    return callbackID;
+}
+
+int QemuDriver::connectDomainEventDeregisterAny(int callbackID) {
+    eventState.deregisterCallback(callbackID);
+    return 0;
+}
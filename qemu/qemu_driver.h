@@ -5,11 +5,15 @@
 #include "qemu_monitor.h"
 #include "qemu_conf.h"
 #include "qemu_domain.h"
+#include "qemu_placement.h"
+#include "qemu_event_loop.h"
 #include "../conf/domain_conf.h"
+#include "../util/cgroup.h"
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
 #include <unordered_map>
+#include <mutex>
 #include <unistd.h>
 #include <sys/wait.h>
 
@@ -19,15 +23,60 @@ private:
     // std::unordered_map<std::string, std::string> domainSockets; // 存储虚拟机的socket
     QemuDriverConfig config;
     std::vector<std::shared_ptr<qemuDomainObj>> domains;
+    // 保护domains及其中对象的运行时状态，采样线程与API调用可能并发访问
+    mutable std::recursive_mutex driverLock;
+    // 按名称查找虚拟机对象，与domains同时更新，由自己的锁保护，查询状态时不需要获取driverLock
+    std::unordered_map<std::string, std::shared_ptr<qemuDomainObj>> domainsByName;
+    mutable std::mutex domainsByNameLock;
 
     static int idCounter;
     // 辅助函数
     void loadAllDomainConfigs();
+    // 根据pid文件判断虚拟机是否在运行并设置pid和状态，进程已不存在时删除pid文件，返回是否在运行
+    bool loadDomainPid(std::shared_ptr<qemuDomainObj> domainObj);
     std::string readFileContent(const std::string& filePath) const;
     std::shared_ptr<qemuDomainObj> parseAndCreateDomainObj(const std::string& xmlDesc);
+    // 把虚拟机对象加入domains和名称索引，调用时需持有driverLock
+    void addDomainObj(std::shared_ptr<qemuDomainObj> domainObj);
+    std::shared_ptr<qemuDomainObj> findDomainObj(const std::string& name) const;
     int processQemuObject(std::shared_ptr<qemuDomainObj> domainObj);
+    // 为一次操作建立新的QMP连接，调用者用完即释放，不在对象中缓存
+    // QEMU的QMP套接字同一时间只接受一个客户端，长期持有连接会让其他进程的QMP命令超时
+    std::shared_ptr<QemuMonitor> getMonitor(std::shared_ptr<qemuDomainObj> domainObj);
+    int applyCpuTune(std::shared_ptr<qemuDomainObj> domainObj, const QemuPlacementResult& placement);
+    // 查找运行中的虚拟机并打开其cgroup，flags为virDomainModificationImpact
+    std::unique_ptr<Cgroup> openDomainCgroup(std::shared_ptr<VirDomain> domain,
+        std::shared_ptr<qemuDomainObj>& domainObj, unsigned int flags);
     // int processQemuObject(std::shared_ptr<qemuDomainObj> domainObj);
     int generateUniqueID();
+
+    // 事件：eventState负责回调的注册和分发，eventLoop在第一次注册回调时启动，监视QEMU进程和QMP连接
+    DomainEventState eventState;
+    std::unique_ptr<QemuEventLoop> eventLoop;
+    uint64_t rescanTimer = 0;           // 定期执行rescanDomains的定时器，随事件循环启动
+    void queueDomainEvent(const virDomainDef& def, int eventID, int type, int detail, const std::string& device = "");
+    // 把运行中的虚拟机加入事件循环，调用时需持有driverLock
+    void startEventLoop();
+    void watchDomain(std::shared_ptr<qemuDomainObj> domainObj);
+    // 在事件循环线程中调用，发现其他进程启动的虚拟机
+    void rescanDomains();
+    // 通过query-status刷新缓存的状态
+    int refreshDomainState(std::shared_ptr<qemuDomainObj> domainObj);
+    void watchMonitorEvents(std::shared_ptr<qemuDomainObj> domainObj, std::shared_ptr<QemuMonitor> monitor);
+    // 在持有监视器锁的线程中调用，只负责转换事件并入队
+    void handleMonitorEvent(std::weak_ptr<qemuDomainObj> weakObj, const JsonValue& event);
+    // 在事件循环线程中调用
+    void handleProcessExit(const std::string& name, pid_t pid, int status);
+
+    // 优雅关机：发送system_powerdown后在共享的定时器服务上计时，超时依次升级为quit和SIGKILL
+    // 以下函数调用时需持有driverLock
+    void beginShutdown(std::shared_ptr<qemuDomainObj> domainObj, int timeoutSec);
+    void scheduleShutdownTimer(std::shared_ptr<qemuDomainObj> domainObj, int timeoutSec);
+    void cancelShutdown(std::shared_ptr<qemuDomainObj> domainObj);
+    // 关机定时器到期后投递到事件循环线程中调用
+    void escalateShutdown(const std::string& name, pid_t pid);
+    // 驱动析构时关机还没有完成，由脱离当前进程的看门狗进程按剩余时间继续升级为SIGTERM和SIGKILL
+    void handOffShutdown(std::shared_ptr<qemuDomainObj> domainObj);
 public:
     // 构造函数与析构函数
     QemuDriver();
@@ -55,11 +104,39 @@ public:
 
     void domainDestroy(std::shared_ptr<VirDomain> domain) override;
     void domainShutdown(std::shared_ptr<VirDomain> domain) override;
+    // 发送ACPI关机请求后立即返回，超时升级由当前进程的定时器执行；连接关闭时关机还没有完成，
+    // 升级交给看门狗进程继续，此后虚拟机退出的STOPPED事件只有订阅了事件的连接能收到
+    void domainShutdownFlags(std::shared_ptr<VirDomain> domain, unsigned int flags, int timeoutSec) override;
+    std::vector<std::shared_ptr<VirDomain>> connectShutdownAllDomains(unsigned int flags, int timeoutSec) override;
 
     int domainUndefine(std::shared_ptr<VirDomain> domain) override;
     int domainUndefineFlags(std::shared_ptr<VirDomain> domain, unsigned int flags) override;
 
     int domainGetState(std::shared_ptr<VirDomain> domain) override;
+    // 默认只读取由事件维护的状态，VIR_DOMAIN_GET_STATE_FORCE_REFRESH时通过QMP查询
+    int domainGetStateFlags(std::shared_ptr<VirDomain> domain, int& reason, unsigned int flags) override;
+
+    int domainSetSchedulerParameters(std::shared_ptr<VirDomain> domain,
+        const std::map<std::string, long long>& params, unsigned int flags) override;
+    int domainSetMemoryParameters(std::shared_ptr<VirDomain> domain,
+        const std::map<std::string, unsigned long long>& params, unsigned int flags) override;
+    int domainSetBlkioParameters(std::shared_ptr<VirDomain> domain,
+        const std::map<std::string, std::string>& params, unsigned int flags) override;
+    int domainGetResourceUsage(std::shared_ptr<VirDomain> domain, virDomainResourceUsage& usage) override;
+
+    // 通过QMP block_resize调整磁盘大小，QEMU负责扩展镜像文件并通知客户机
+    int domainBlockResize(std::shared_ptr<VirDomain> domain, const std::string& disk,
+        unsigned long long size, unsigned int flags) override;
+    // 通过QMP block-stream合并后备链，QEMU完成后改写镜像头中的后备文件
+    int domainBlockPull(std::shared_ptr<VirDomain> domain, const std::string& disk,
+        unsigned long long bandwidth, unsigned int flags) override;
+    std::shared_ptr<VirDomain> domainLookupByDiskSource(const std::string& path) override;
+
+    std::vector<virDomainStatsRecord> connectGetAllDomainStats(unsigned int stats, unsigned int flags) override;
+
+    int connectDomainEventRegisterAny(std::shared_ptr<VirDomain> domain, int eventID,
+        virConnectDomainEventCallback callback) override;
+    int connectDomainEventDeregisterAny(int callbackID) override;
 };
 
 #endif // QEMU_DRIVER_H
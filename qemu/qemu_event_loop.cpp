@@ -0,0 +1,304 @@
+#include "qemu_event_loop.h"
+#include "../log/log.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define MAX_EPOLL_EVENTS 32
+#define BUSY_RETRY_MS 20        // QMP连接被其他线程占用时的重试间隔
+#define PROCESS_POLL_MS 1000    // 没有pidfd时检查进程的间隔
+
+static const uint64_t WAKEUP_ID = 0;
+
+static int pidfdOpen(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast< int >(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+QemuEventLoop::QemuEventLoop(ExitHandler onExit)
+    : onExit(onExit), epollFd(-1), wakeupFd(-1), nextID(1), running(false) {
+}
+
+QemuEventLoop::~QemuEventLoop() {
+    stop();
+}
+
+void QemuEventLoop::start() {
+    if ( running ) {
+        return;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ( epollFd < 0 || wakeupFd < 0 ) {
+        std::string err = strerror(errno);
+        if ( epollFd >= 0 ) {
+            close(epollFd);
+        }
+        if ( wakeupFd >= 0 ) {
+            close(wakeupFd);
+        }
+        epollFd = wakeupFd = -1;
+        throw std::runtime_error("Failed to create QEMU event loop: " + err);
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKEUP_ID;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &ev);
+
+    running = true;
+    worker = std::thread(&QemuEventLoop::run, this);
+}
+
+void QemuEventLoop::stop() {
+    if ( !running.exchange(false) ) {
+        return;
+    }
+    uint64_t one = 1;
+    if ( write(wakeupFd, &one, sizeof(one)) < 0 ) {
+        LOG_ERROR("Failed to wake up QEMU event loop: %s", strerror(errno));
+    }
+    if ( worker.joinable() ) {
+        worker.join();
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    while ( !watches.empty() ) {
+        removeWatch(watches.begin()->first);
+    }
+    busyMonitors.clear();
+    close(wakeupFd);
+    close(epollFd);
+    wakeupFd = epollFd = -1;
+}
+
+void QemuEventLoop::addWatch(Watch watch) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t id = nextID++;
+    if ( watch.fd >= 0 ) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        // QMP连接使用边沿触发，连接被其他线程占用时不会反复唤醒，改由定时重试
+        ev.events = watch.type == WATCH_MONITOR ? EPOLLIN | EPOLLET : EPOLLIN;
+        ev.data.u64 = id;
+        if ( epoll_ctl(epollFd, EPOLL_CTL_ADD, watch.fd, &ev) < 0 ) {
+            LOG_ERROR("Failed to watch %s: %s", watch.name.c_str(), strerror(errno));
+            close(watch.fd);
+            return;
+        }
+    }
+    watches[id] = watch;
+}
+
+void QemuEventLoop::removeWatch(uint64_t id) {
+    auto it = watches.find(id);
+    if ( it == watches.end() ) {
+        return;
+    }
+    if ( it->second.fd >= 0 ) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+    }
+    watches.erase(it);
+}
+
+void QemuEventLoop::watchProcess(const std::string& name, pid_t pid) {
+    if ( !running ) {
+        return;
+    }
+    Watch watch;
+    watch.type = WATCH_PROCESS;
+    watch.name = name;
+    watch.pid = pid;
+    watch.fd = pidfdOpen(pid);
+    if ( watch.fd < 0 ) {
+        LOG_WARN("pidfd_open(%d) failed: %s, falling back to polling", pid, strerror(errno));
+    }
+    addWatch(watch);
+    LOG_INFO("Watching QEMU process %d of %s", pid, name.c_str());
+}
+
+void QemuEventLoop::watchMonitor(const std::string& name, std::shared_ptr<QemuMonitor> monitor,
+    std::function<void()> onClose) {
+    if ( !running || !monitor || !monitor->isOpen() ) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for ( auto it = watches.begin(); it != watches.end(); ) {
+            auto current = it++;
+            if ( current->second.type == WATCH_MONITOR && current->second.name == name ) {
+                removeWatch(current->first);
+            }
+        }
+    }
+    // 监视socket的副本，监视器关闭自己的fd之后编号可能被复用，副本保证epoll中的登记始终对应这条连接
+    Watch watch;
+    watch.type = WATCH_MONITOR;
+    watch.name = name;
+    watch.monitor = monitor;
+    watch.onClose = onClose;
+    watch.fd = fcntl(monitor->getFd(), F_DUPFD_CLOEXEC, 0);
+    if ( watch.fd < 0 ) {
+        LOG_ERROR("Failed to duplicate monitor socket of %s: %s", name.c_str(), strerror(errno));
+        return;
+    }
+    addWatch(watch);
+}
+
+void QemuEventLoop::post(std::function<void()> task) {
+    if ( !running ) {
+        return;
+    }
+    tasks.push(std::move(task));
+    uint64_t one = 1;
+    if ( write(wakeupFd, &one, sizeof(one)) < 0 ) {
+        LOG_ERROR("Failed to wake up QEMU event loop: %s", strerror(errno));
+    }
+}
+
+void QemuEventLoop::handleProcess(uint64_t id) {
+    Watch watch;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = watches.find(id);
+        if ( it == watches.end() ) {
+            return;
+        }
+        watch = it->second;
+        removeWatch(id);
+    }
+    // 是本进程启动的QEMU时顺便回收，避免留下僵尸进程
+    int status = 0;
+    if ( waitpid(watch.pid, &status, WNOHANG) != watch.pid ) {
+        status = -1;
+    }
+    LOG_INFO("QEMU process %d of %s exited, status %d", watch.pid, watch.name.c_str(), status);
+    onExit(watch.name, watch.pid, status);
+}
+
+void QemuEventLoop::handleMonitor(uint64_t id) {
+    std::shared_ptr<QemuMonitor> monitor;
+    std::function<void()> onClose;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = watches.find(id);
+        if ( it == watches.end() ) {
+            return;
+        }
+        monitor = it->second.monitor;
+        onClose = it->second.onClose;
+    }
+    int ret = monitor->qemuMonitorDispatchEvents();
+    if ( ret > 0 ) {
+        busyMonitors.insert(id);
+        return;
+    }
+    busyMonitors.erase(id);
+    if ( ret < 0 ) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            removeWatch(id);
+        }
+        if ( onClose ) {
+            onClose();
+        }
+    }
+}
+
+void QemuEventLoop::pollProcesses() {
+    std::vector<uint64_t> exited;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for ( const auto& entry : watches ) {
+            const Watch& watch = entry.second;
+            if ( watch.type != WATCH_PROCESS || watch.fd >= 0 ) {
+                continue;
+            }
+            // 僵尸进程对kill仍然返回成功，先检查是否有可回收的子进程，回收留给handleProcess
+            siginfo_t info;
+            memset(&info, 0, sizeof(info));
+            if ( (waitid(P_PID, watch.pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == watch.pid) ||
+                (kill(watch.pid, 0) < 0 && errno == ESRCH) ) {
+                exited.push_back(entry.first);
+            }
+        }
+    }
+    for ( uint64_t id : exited ) {
+        handleProcess(id);
+    }
+}
+
+void QemuEventLoop::run() {
+    LOG_INFO("QEMU event loop started");
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    while ( running ) {
+        bool polling = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for ( const auto& entry : watches ) {
+                polling = polling || (entry.second.type == WATCH_PROCESS && entry.second.fd < 0);
+            }
+        }
+        int timeout = !busyMonitors.empty() ? BUSY_RETRY_MS : (polling ? PROCESS_POLL_MS : -1);
+        int n = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, timeout);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            LOG_ERROR("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        std::set<uint64_t> retry;
+        retry.swap(busyMonitors);
+        for ( int i = 0; i < n; i++ ) {
+            uint64_t id = events[i].data.u64;
+            if ( id == WAKEUP_ID ) {
+                uint64_t value;
+                while ( read(wakeupFd, &value, sizeof(value)) > 0 ) {
+                }
+                continue;
+            }
+            retry.erase(id);
+            WatchType type;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                auto it = watches.find(id);
+                if ( it == watches.end() ) {
+                    continue;
+                }
+                type = it->second.type;
+            }
+            if ( type == WATCH_PROCESS ) {
+                handleProcess(id);
+            }
+            else {
+                handleMonitor(id);
+            }
+        }
+        for ( uint64_t id : retry ) {
+            handleMonitor(id);
+        }
+        if ( polling ) {
+            pollProcesses();
+        }
+        std::function<void()> task;
+        while ( tasks.pop(task) ) {
+            task();
+        }
+    }
+    LOG_INFO("QEMU event loop stopped");
+}
@@ -0,0 +1,71 @@
+#ifndef QEMU_EVENT_LOOP_H
+#define QEMU_EVENT_LOOP_H
+
+#include "qemu_monitor.h"
+#include "../util/mpsc_queue.h"
+#include <string>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <sys/types.h>
+
+// 监视运行中的QEMU进程和QMP连接的事件循环
+// 进程通过pidfd加入epoll，退出时立即得到通知，不需要轮询；QMP连接可读时读取其中的异步事件
+// 内核不支持pidfd时退化为每秒检查一次进程是否存在
+class QemuEventLoop {
+public:
+    // 进程退出时在事件循环线程中调用，status为waitpid得到的状态，进程不是本进程的子进程时为-1
+    typedef std::function<void(const std::string& name, pid_t pid, int status)> ExitHandler;
+
+    explicit QemuEventLoop(ExitHandler onExit);
+    ~QemuEventLoop();
+
+    void start();
+    void stop();
+    bool isRunning() const { return running; }
+
+    void watchProcess(const std::string& name, pid_t pid);
+    // 同一个虚拟机再次调用时替换原来的连接，连接断开后在事件循环线程中调用onClose，此后的事件都会丢失
+    void watchMonitor(const std::string& name, std::shared_ptr<QemuMonitor> monitor,
+        std::function<void()> onClose = nullptr);
+
+    // 在事件循环线程中执行task，供不能在定时器线程中执行的工作使用，循环未运行时丢弃
+    void post(std::function<void()> task);
+
+private:
+    enum WatchType { WATCH_PROCESS, WATCH_MONITOR };
+    struct Watch {
+        WatchType type;
+        std::string name;
+        int fd = -1;                            // pidfd或QMP socket的副本，没有pidfd时为-1
+        pid_t pid = -1;
+        std::shared_ptr<QemuMonitor> monitor;
+        std::function<void()> onClose;
+    };
+
+    void run();
+    void addWatch(Watch watch);
+    void removeWatch(uint64_t id);              // 调用时需持有lock
+    void handleProcess(uint64_t id);
+    void handleMonitor(uint64_t id);
+    void pollProcesses();                       // 检查没有pidfd的进程
+
+    ExitHandler onExit;
+    int epollFd;
+    int wakeupFd;
+
+    std::mutex lock;                            // 保护watches和nextID
+    std::map<uint64_t, Watch> watches;
+    uint64_t nextID;
+    std::set<uint64_t> busyMonitors;            // 其他线程正占用连接，稍后重试，只在循环线程中访问
+    MpscQueue<std::function<void()>> tasks;
+
+    std::thread worker;
+    std::atomic<bool> running;
+};
+
+#endif // QEMU_EVENT_LOOP_H
@@ -1,15 +1,67 @@
 #include "qemu_monitor.h"
 #include "../log/log.h"
+#include "../util/metrics.h"
+#include "../util/timer_service.h"
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <cstring>
+#include <cerrno>
 
-#define MAX_RETRY_TIMES 2  // 连接失败重试次数
-#define RETRY_INTERVAL_SEC 1  // 连接失败重试间隔
-#define MAX_RECV_WAIT_TIME 5  // 接收函数等待时间
+#define MAX_REPLY_WAIT_MS 5000  // 等待一条命令(或一批流水线命令)回复的最长时间
+
+// QMP相关指标，所有监视器共享
+struct QmpMetrics {
+    MetricCounter* connects;
+    MetricCounter* commands;
+    MetricCounter* errors;
+    MetricCounter* ioFailures;
+    MetricCounter* events;
+    MetricCounter* timeouts;
+};
+
+static const QmpMetrics& qmpMetrics() {
+    static const QmpMetrics metrics = {
+        Metrics::Instance()->counter("tinyvirt_qmp_connects_total", "QMP connections established"),
+        Metrics::Instance()->counter("tinyvirt_qmp_commands_total", "QMP commands sent"),
+        Metrics::Instance()->counter("tinyvirt_qmp_errors_total", "QMP commands answered with an error"),
+        Metrics::Instance()->counter("tinyvirt_qmp_io_failures_total", "QMP connections dropped by send or receive failures"),
+        Metrics::Instance()->counter("tinyvirt_qmp_events_total", "Asynchronous QMP events received"),
+        Metrics::Instance()->counter("tinyvirt_qmp_timeouts_total", "QMP replies that missed their deadline"),
+    };
+    return metrics;
+}
+
+// 等待QMP回复的截止时间，登记在共享的定时器服务上，不再依赖每次recv的SO_RCVTIMEO
+// 到期时关闭socket的读写，阻塞中的recv立即返回，调用者按读取失败处理
+// 关闭fd之前必须先调用finish，否则到期时可能作用在被复用的fd上
+class QmpReplyDeadline {
+public:
+    explicit QmpReplyDeadline(int fd) : finished(false), expired(false) {
+        id = TimerService::Instance()->addTimer(MAX_REPLY_WAIT_MS, [fd]() { shutdown(fd, SHUT_RDWR); });
+    }
+    ~QmpReplyDeadline() {
+        finish();
+    }
+    // 取消截止时间，已经到期时返回true，此时连接已不可用
+    bool finish() {
+        if ( !finished ) {
+            finished = true;
+            expired = !TimerService::Instance()->cancelTimer(id);
+            if ( expired ) {
+                qmpMetrics().timeouts->inc();
+            }
+        }
+        return expired;
+    }
+private:
+    uint64_t id;
+    bool finished;
+    bool expired;
+};
 
 // 构造函数
-QemuMonitor::QemuMonitor(std::string socketPath) :unixSocketPath(socketPath) {
+QemuMonitor::QemuMonitor(std::string socketPath) :unixSocketPath(socketPath), open(false), unixSocketFd(-1) {
     // std::cout << "Create a QMP socket at " << socketPath << std::endl;
     LOG_INFO("Create a QMP socket at %s", socketPath.c_str());
     qemuMonitorOpenUnixSocket();
@@ -27,33 +79,6 @@ int sendToUnixSocket(int socketFd, const std::string& message) {
     LOG_INFO("send msg: %s", message.c_str());
     return 0; // 发送成功
 }
-// 从 Unix Socket 接收信息
-std::string receiveFromUnixSocket(int socketFd) {
-    char buffer[4096]; // 缓冲区大小可根据需要调整
-    std::string receivedMessage = "";
-
-    struct timeval timeout;
-    timeout.tv_sec = 5;  // 设置超时时间为5秒
-    timeout.tv_usec = 0;
-    setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-
-    ssize_t bytesRead = recv(socketFd, buffer, sizeof(buffer) - 1, 0);
-    if ( bytesRead < 0 ) {
-        // std::cerr << "Failed to receive message from socket" << std::endl;
-        LOG_ERROR("Failed to receive message from socket");
-        return "";
-    }
-
-    buffer[bytesRead] = '\0'; // 确保字符串以 '\0' 结尾
-    receivedMessage = buffer;
-    // std::cout << "recv msg:" << receivedMessage << std::endl;
-    // QMP协议返回的消息是JSON格式的字符串，通常最后会有一个换行符
-    // 这里不进行额外处理，以保留原始格式
-    LOG_INFO("recv msg: %s", receivedMessage.c_str());
-
-    return receivedMessage;
-}
-
 // QMP协议握手
 int QemuMonitor::qemuMonitorNegotiation() {
     // std::cout << "Negotiating..." << std::endl;
@@ -88,11 +113,6 @@ int QemuMonitor::qemuMonitorOpenUnixSocket() {
     }
     // std::cout << "client socket created! sockfd: " << sockfd << std::endl;
     LOG_INFO("client socket created! sockfd: %d", sockfd);
-    // 设置接收数据的超时时间
-    struct timeval timeout;
-    timeout.tv_sec = MAX_RECV_WAIT_TIME;  // 超时时间为 5 秒
-    timeout.tv_usec = 0;
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
     // 连接到服务器
     struct sockaddr_un serverAddr;
@@ -101,30 +121,15 @@ int QemuMonitor::qemuMonitorOpenUnixSocket() {
     strncpy(serverAddr.sun_path, this->unixSocketPath.c_str(), sizeof(serverAddr.sun_path) - 1);
 
 
-    int count = 0;  // 尝试连接次数
-    int conn = -1;  // 连接结果
-    while ( count < MAX_RETRY_TIMES ) {
-        conn = connect(sockfd, ( struct sockaddr* )&serverAddr, sizeof(struct sockaddr_un));
-        if ( conn < 0 ) {
-            // std::cout << count + 1 << " times connect failed, sleep and retry..." << std::endl;
-            LOG_INFO("%d times connect failed, sleep and retry...", count + 1);
-            count++;
-            sleep(RETRY_INTERVAL_SEC);
-            continue;
-        }
-        else {
-            // std::cout << "Connected to server!" << std::endl;
-            LOG_INFO("Connected to server!");
-            break;
-        }
-    }
-
-    if ( conn < 0 ) {
+    // 连接失败时不在这里睡眠重试，由调用者按退避时间决定何时重连
+    if ( connect(sockfd, ( struct sockaddr* )&serverAddr, sizeof(struct sockaddr_un)) < 0 ) {
         // std::cerr << "Failed to connect to server, socket closed!" << std::endl;
-        LOG_ERROR("Failed to connect to server, socket closed!");
+        LOG_ERROR("Failed to connect to %s: %s", this->unixSocketPath.c_str(), strerror(errno));
         close(sockfd);
         return -1;
     }
+    // std::cout << "Connected to server!" << std::endl;
+    LOG_INFO("Connected to server!");
 
     // if (connect(sockfd, (struct sockaddr *)&serverAddr, sizeof(struct sockaddr_un)) == -1)
     // {
@@ -135,9 +140,19 @@ int QemuMonitor::qemuMonitorOpenUnixSocket() {
     // std::cout << "Connected to server!" << std::endl;
 
 
-    receiveFromUnixSocket(sockfd);  // 接收连接时的hello消息
     this->open = true;
     this->unixSocketFd = sockfd;
+    this->readBuffer.clear();
+    qmpMetrics().connects->inc();
+
+    std::string greeting;
+    QmpReplyDeadline deadline(sockfd);
+    int ret = qemuMonitorReadLine(greeting);  // 接收连接时的hello消息
+    if ( deadline.finish() || ret < 0 ) {
+        LOG_ERROR("Failed to receive QMP greeting");
+        qemuMonitorCloseUnixSocket();
+        return -1;
+    }
 
     qemuMonitorNegotiation();  // 连接时进行协议握手
 
@@ -145,7 +160,9 @@ int QemuMonitor::qemuMonitorOpenUnixSocket() {
 }
 
 int QemuMonitor::qemuMonitorCloseUnixSocket() {
-    close(this->unixSocketFd);
+    if ( this->unixSocketFd >= 0 ) {
+        close(this->unixSocketFd);
+    }
     // std::cout << "Connect Closed!" << std::endl;
     LOG_INFO("Connect Closed!");
     this->unixSocketFd = -1;
@@ -153,16 +170,237 @@ int QemuMonitor::qemuMonitorCloseUnixSocket() {
     return 0;
 }
 
-int QemuMonitor::qemuMonitorSendMessage(const std::string cmd, std::string& reply) {
+int QemuMonitor::qemuMonitorReadLine(std::string& line) {
+    while ( true ) {
+        size_t pos = readBuffer.find('\n');
+        if ( pos != std::string::npos ) {
+            line = readBuffer.substr(0, pos);
+            readBuffer.erase(0, pos + 1);
+            if ( !line.empty() && line.back() == '\r' ) {
+                line.pop_back();
+            }
+            if ( line.empty() ) {
+                continue;
+            }
+            LOG_DEBUG("recv msg: %s", line.c_str());
+            return 0;
+        }
+
+        // 超时由调用者登记的QmpReplyDeadline控制
+        char buffer[4096];
+        ssize_t bytesRead = recv(this->unixSocketFd, buffer, sizeof(buffer), 0);
+        if ( bytesRead <= 0 ) {
+            LOG_ERROR("Failed to receive message from socket");
+            return -1;
+        }
+        readBuffer.append(buffer, bytesRead);
+    }
+}
 
-    // todo 判断socket连接状态
+int QemuMonitor::qemuMonitorSendMessage(const std::string cmd, std::string& reply) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if ( !this->open ) {
+        LOG_ERROR("Monitor %s is not connected", unixSocketPath.c_str());
+        return -1;
+    }
+    qmpMetrics().commands->inc();
+    QmpReplyDeadline deadline(this->unixSocketFd);
     if ( sendToUnixSocket(this->unixSocketFd, cmd) < 0 ) {
+        deadline.finish();
+        qmpMetrics().ioFailures->inc();
+        qemuMonitorCloseUnixSocket();
+        return -1;
+    }
+    // 接收服务器的回复，期间收到的异步事件交给事件处理函数
+    std::string line;
+    while ( qemuMonitorReadLine(line) == 0 ) {
+        if ( line.find("\"event\"") != std::string::npos &&
+            line.find("\"return\"") == std::string::npos && line.find("\"error\"") == std::string::npos ) {
+            qemuMonitorHandleEvent(line);
+            continue;
+        }
+        reply = line;
+        qemuMonitorFlushEvents();
+        // 回复到达时截止时间恰好到期，socket已被关闭读写，回复仍然有效，连接留待下次重建
+        if ( deadline.finish() ) {
+            qemuMonitorCloseUnixSocket();
+        }
+        return 0;
+    }
+    // 读取失败后连接中的数据已经无法与命令对应，关闭连接以便下次重新建立
+    if ( deadline.finish() ) {
+        LOG_ERROR("Timed out waiting for reply to %s from %s", cmd.c_str(), unixSocketPath.c_str());
+    }
+    qmpMetrics().ioFailures->inc();
+    qemuMonitorCloseUnixSocket();
+    reply.clear();
+    return -1;
+}
+
+int QemuMonitor::qemuMonitorSendCommands(const std::vector<std::string>& cmds) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if ( !this->open ) {
+        LOG_ERROR("Monitor %s is not connected", unixSocketPath.c_str());
         return -1;
     }
-    // sleep(1);
-    // 接收服务器的回复
-    reply = receiveFromUnixSocket(this->unixSocketFd);
-    if ( reply.empty() ) {
+    std::string batch;
+    for ( const auto& cmd : cmds ) {
+        batch += cmd;
+        batch += "\n";
+    }
+    qmpMetrics().commands->inc(cmds.size());
+    size_t sent = 0;
+    while ( sent < batch.size() ) {
+        ssize_t ret = send(this->unixSocketFd, batch.data() + sent, batch.size() - sent, MSG_NOSIGNAL);
+        if ( ret < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            LOG_ERROR("Failed to send %zu commands to %s: %s", cmds.size(), unixSocketPath.c_str(), strerror(errno));
+            qmpMetrics().ioFailures->inc();
+            qemuMonitorCloseUnixSocket();
+            return -1;
+        }
+        sent += ret;
+    }
+    return 0;
+}
+
+int QemuMonitor::qemuMonitorReceiveReplies(size_t count, std::vector<JsonValue>& replies) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    replies.clear();
+    if ( !this->open ) {
+        qmpMetrics().ioFailures->inc();
+        return -1;
+    }
+    // 整批回复共用一个截止时间
+    QmpReplyDeadline deadline(this->unixSocketFd);
+    std::string line;
+    while ( replies.size() < count ) {
+        if ( qemuMonitorReadLine(line) < 0 ) {
+            if ( deadline.finish() ) {
+                LOG_ERROR("Timed out waiting for %zu replies from %s", count, unixSocketPath.c_str());
+            }
+            qmpMetrics().ioFailures->inc();
+            qemuMonitorCloseUnixSocket();
+            return -1;
+        }
+        JsonValue msg;
+        try {
+            msg = JsonValue::parse(line);
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Failed to parse QMP reply: %s", e.what());
+            deadline.finish();
+            qemuMonitorCloseUnixSocket();
+            return -1;
+        }
+        if ( msg.has("event") ) {
+            qemuMonitorHandleEvent(line);
+            continue;
+        }
+        const JsonValue* value = msg.get("return");
+        if ( !value ) {
+            qmpMetrics().errors->inc();
+        }
+        replies.push_back(value ? *value : JsonValue());
+    }
+    qemuMonitorFlushEvents();
+    if ( deadline.finish() ) {
+        qemuMonitorCloseUnixSocket();
+    }
+    return 0;
+}
+
+void QemuMonitor::setEventHandler(std::function<void(const JsonValue&)> handler) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    eventHandler = handler;
+}
+
+void QemuMonitor::qemuMonitorHandleEvent(const std::string& line) {
+    qmpMetrics().events->inc();
+    if ( !eventHandler ) {
+        return;
+    }
+    try {
+        JsonValue event = JsonValue::parse(line);
+        eventHandler(event);
+    }
+    catch ( const std::exception& e ) {
+        LOG_ERROR("Failed to handle QMP event %s: %s", line.c_str(), e.what());
+    }
+}
+
+void QemuMonitor::qemuMonitorFlushEvents() {
+    size_t pos;
+    while ( (pos = readBuffer.find('\n')) != std::string::npos ) {
+        std::string line = readBuffer.substr(0, pos);
+        readBuffer.erase(0, pos + 1);
+        if ( !line.empty() && line.back() == '\r' ) {
+            line.pop_back();
+        }
+        if ( line.empty() ) {
+            continue;
+        }
+        // 没有命令在等待回复，此时收到的只可能是事件
+        if ( line.find("\"event\"") == std::string::npos ) {
+            LOG_WARN("Discarding unexpected QMP message from %s: %s", unixSocketPath.c_str(), line.c_str());
+            continue;
+        }
+        qemuMonitorHandleEvent(line);
+    }
+}
+
+int QemuMonitor::qemuMonitorDispatchEvents() {
+    std::unique_lock<std::recursive_mutex> guard(lock, std::try_to_lock);
+    if ( !guard.owns_lock() ) {
+        return 1;
+    }
+    if ( !this->open ) {
+        return -1;
+    }
+    char buffer[4096];
+    while ( true ) {
+        ssize_t bytesRead = recv(this->unixSocketFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if ( bytesRead > 0 ) {
+            readBuffer.append(buffer, bytesRead);
+            continue;
+        }
+        if ( bytesRead < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+            break;
+        }
+        // 对端关闭或读取出错
+        qemuMonitorFlushEvents();
+        LOG_INFO("Monitor %s closed by peer", unixSocketPath.c_str());
+        qemuMonitorCloseUnixSocket();
+        return -1;
+    }
+    qemuMonitorFlushEvents();
+    return 0;
+}
+
+int QemuMonitor::qemuMonitorCommand(const std::string& cmd, JsonValue& ret) {
+    std::string reply;
+    if ( qemuMonitorSendMessage(cmd, reply) < 0 ) {
+        return -1;
+    }
+    try {
+        JsonValue msg = JsonValue::parse(reply);
+        const JsonValue* value = msg.get("return");
+        if ( !value ) {
+            qmpMetrics().errors->inc();
+            const JsonValue* error = msg.get("error");
+            LOG_ERROR("QMP command %s failed: %s", cmd.c_str(),
+                error ? error->getString("desc").c_str() : reply.c_str());
+            return -1;
+        }
+        ret = *value;
+    }
+    catch ( const std::exception& e ) {
+        LOG_ERROR("Failed to parse QMP reply: %s", e.what());
         return -1;
     }
     return 0;
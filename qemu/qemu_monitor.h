@@ -1,6 +1,10 @@
 #ifndef QEMU_QemuMonitor_H
 #define QEMU_QemuMonitor_H
 #include <iostream>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include "../util/json_value.h"
 
 // 每个虚拟机对象有一个Monitor对象，这个对象必须是线程安全的
 class QemuMonitor {
@@ -11,16 +15,40 @@ private:
 
     bool open;  // 是否在连接状态（似乎没什么用）
     int unixSocketFd;  // 内部连接unixSocket的fd
+    std::string readBuffer;  // 尚未处理完的接收数据，QMP消息以换行分隔
+    std::recursive_mutex lock;  // 保证一条命令的发送和接收不被其他线程打断
+
+    std::function<void(const JsonValue&)> eventHandler;  // 异步事件的处理函数，调用时持有lock
+
+    int qemuMonitorReadLine(std::string& line);  // 读取一条完整的QMP消息
+    void qemuMonitorHandleEvent(const std::string& line);
+    void qemuMonitorFlushEvents();  // 处理readBuffer中命令回复之后已经收到的事件
 
 public:
     int qemuMonitorOpenUnixSocket();
     int qemuMonitorCloseUnixSocket();
     int qemuMonitorNegotiation();  // QMP协议握手，理论上应该设为private，只在Open内部调用，防止有问题先不改
     int qemuMonitorSendMessage(const std::string, std::string& reply);  // 直接发送给定指令并获取返回结果
+    // 发送指令并解析返回结果中的"return"字段，QEMU返回error时返回-1
+    int qemuMonitorCommand(const std::string& cmd, JsonValue& ret);
+
+    // 流水线方式：一次发送多条命令，再按发送顺序读取全部回复，调用者需在两步之间持有getLock()
+    // 返回error的命令对应的回复为null值，连接出错时返回-1
+    int qemuMonitorSendCommands(const std::vector<std::string>& cmds);
+    int qemuMonitorReceiveReplies(size_t count, std::vector<JsonValue>& replies);
+    std::recursive_mutex& getLock() { return lock; }
+
+    // 设置异步事件的处理函数，无论事件是在等待命令回复时读到还是由事件循环读到都会调用
+    // 处理函数在持有监视器锁的线程中执行，不能再获取驱动锁
+    void setEventHandler(std::function<void(const JsonValue&)> handler);
+    // 非阻塞地读取并处理已经到达的事件，供事件循环在socket可读时调用
+    // 其他线程正在执行命令时返回1(事件会由该线程处理)，连接已断开时返回-1
+    int qemuMonitorDispatchEvents();
+    int getFd() const { return unixSocketFd; }
 
 
     // 构造函数与析构函数
-    QemuMonitor() {};
+    QemuMonitor() : open(false), unixSocketFd(-1) {};
     QemuMonitor(std::string socketPath);
     ~QemuMonitor();
 
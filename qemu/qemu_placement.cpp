@@ -0,0 +1,90 @@
+#include "qemu_placement.h"
+#include "../util/cpuset.h"
+#include "../util/process_util.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <limits>
+
+QemuPlacementResult QemuPlacement::placeVcpus(int vcpus, const std::vector<HostCpu>& cpus, std::map<int, int> load) {
+    QemuPlacementResult result;
+    if ( vcpus <= 0 || cpus.empty() ) {
+        return result;
+    }
+
+    // 按NUMA节点分组
+    std::map<int, std::vector<const HostCpu*>> nodes;
+    for ( const auto& cpu : cpus ) {
+        nodes[cpu.nodeId].push_back(&cpu);
+    }
+
+    // 选择能容纳全部vcpu且放置后平均负载最低的节点
+    double bestScore = std::numeric_limits<double>::max();
+    for ( const auto& node : nodes ) {
+        if ( static_cast< int >(node.second.size()) < vcpus ) {
+            continue;
+        }
+        long total = vcpus;
+        for ( const HostCpu* cpu : node.second ) {
+            total += load[cpu->id];
+        }
+        double score = static_cast< double >(total) / node.second.size();
+        if ( score < bestScore ) {
+            bestScore = score;
+            result.node = node.first;
+        }
+    }
+
+    std::vector<const HostCpu*> candidates;
+    if ( result.node >= 0 ) {
+        candidates = nodes[result.node];
+    }
+    else {
+        // 没有单个节点能容纳，跨节点分散放置
+        for ( const auto& cpu : cpus ) {
+            candidates.push_back(&cpu);
+        }
+    }
+
+    // 物理核负载 = 该核上所有超线程的负载之和
+    std::map<std::pair<int, int>, int> coreLoad;
+    for ( const HostCpu* cpu : candidates ) {
+        coreLoad[std::make_pair(cpu->packageId, cpu->coreId)] += load[cpu->id];
+        result.nodeCpus.push_back(cpu->id);
+    }
+
+    for ( int i = 0; i < vcpus; i++ ) {
+        const HostCpu* best = nullptr;
+        for ( const HostCpu* cpu : candidates ) {
+            if ( !best ) {
+                best = cpu;
+                continue;
+            }
+            int cpuLoad = load[cpu->id];
+            int bestLoad = load[best->id];
+            int cpuCore = coreLoad[std::make_pair(cpu->packageId, cpu->coreId)];
+            int bestCore = coreLoad[std::make_pair(best->packageId, best->coreId)];
+            if ( cpuLoad < bestLoad || (cpuLoad == bestLoad && cpuCore < bestCore) ) {
+                best = cpu;
+            }
+        }
+        result.vcpuCpus.push_back(best->id);
+        load[best->id]++;
+        coreLoad[std::make_pair(best->packageId, best->coreId)]++;
+    }
+
+    LOG_INFO("Placed %d vcpus on node %d, cpus: %s", vcpus, result.node, formatCpuSet(result.vcpuCpus).c_str());
+    return result;
+}
+
+std::map<int, int> QemuPlacement::collectLoad(const std::vector<pid_t>& pids) {
+    std::map<int, int> load;
+    for ( pid_t pid : pids ) {
+        for ( pid_t tid : listProcessThreads(pid) ) {
+            std::vector<int> affinity = getThreadAffinity(tid);
+            if ( affinity.size() == 1 ) {
+                load[affinity[0]]++;
+            }
+        }
+    }
+    return load;
+}
@@ -0,0 +1,27 @@
+#ifndef QEMU_PLACEMENT_H
+#define QEMU_PLACEMENT_H
+
+#include "../util/host_topology.h"
+#include <vector>
+#include <map>
+#include <sys/types.h>
+
+// vcpu自动放置的结果
+struct QemuPlacementResult {
+    int node = -1;                  // 选中的NUMA节点，-1表示跨节点放置
+    std::vector<int> vcpuCpus;      // 第i个vcpu绑定的宿主机CPU
+    std::vector<int> nodeCpus;      // 选中范围内的全部CPU，供emulator和iothread线程使用
+};
+
+// vcpu自动放置引擎
+// 优先选择平均负载最低且能容纳全部vcpu的NUMA节点，节点内先分散到不同物理核，再使用超线程
+class QemuPlacement {
+public:
+    // load为每个宿主机CPU上已经独占绑定的线程数量
+    static QemuPlacementResult placeVcpus(int vcpus, const std::vector<HostCpu>& cpus, std::map<int, int> load);
+
+    // 统计给定QEMU进程中绑定到单个CPU的线程，作为现有负载
+    static std::map<int, int> collectLoad(const std::vector<pid_t>& pids);
+};
+
+#endif // QEMU_PLACEMENT_H
@@ -0,0 +1,393 @@
+#include "prometheus_exporter.h"
+#include "../virConnect.h"
+#include "../util/metrics.h"
+#include "../log/log.h"
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CLIENTS 64              // 同时保持的抓取连接数量
+#define MAX_REQUEST_SIZE 8192       // 请求头的最大长度
+
+static void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+PrometheusExporter::PrometheusExporter(const std::string& socketPath, int port)
+    : socketPath(socketPath), port(port), running(false) {
+    wakeupPipe[0] = wakeupPipe[1] = -1;
+    if ( socketPath.empty() && port <= 0 ) {
+        throw std::runtime_error("Prometheus exporter needs a UNIX socket path or a loopback port");
+    }
+    render(std::vector<virDomainStatsRecord>());
+}
+
+PrometheusExporter::~PrometheusExporter() {
+    stop();
+}
+
+void PrometheusExporter::start() {
+    if ( running ) {
+        return;
+    }
+    if ( pipe2(wakeupPipe, O_CLOEXEC | O_NONBLOCK) < 0 ) {
+        throw std::runtime_error(std::string("Failed to create wakeup pipe: ") + strerror(errno));
+    }
+
+    if ( !socketPath.empty() ) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        // 上次异常退出可能遗留socket文件
+        unlink(socketPath.c_str());
+        if ( fd < 0 || bind(fd, ( struct sockaddr* )&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0 ) {
+            std::string err = strerror(errno);
+            if ( fd >= 0 ) {
+                close(fd);
+            }
+            stop();
+            throw std::runtime_error("Failed to listen on " + socketPath + ": " + err);
+        }
+        setNonBlocking(fd);
+        listenFds.push_back(fd);
+        LOG_INFO("Prometheus exporter listening on unix:%s", socketPath.c_str());
+    }
+    if ( port > 0 ) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ( fd >= 0 ) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if ( fd < 0 || bind(fd, ( struct sockaddr* )&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0 ) {
+            std::string err = strerror(errno);
+            if ( fd >= 0 ) {
+                close(fd);
+            }
+            stop();
+            throw std::runtime_error("Failed to listen on 127.0.0.1:" + std::to_string(port) + ": " + err);
+        }
+        setNonBlocking(fd);
+        listenFds.push_back(fd);
+        LOG_INFO("Prometheus exporter listening on 127.0.0.1:%d", port);
+    }
+
+    running = true;
+    worker = std::thread(&PrometheusExporter::run, this);
+}
+
+void PrometheusExporter::stop() {
+    if ( running ) {
+        running = false;
+        char c = 0;
+        if ( write(wakeupPipe[1], &c, 1) < 0 ) {
+            LOG_ERROR("Failed to wake up Prometheus exporter: %s", strerror(errno));
+        }
+        worker.join();
+    }
+    for ( auto& entry : clients ) {
+        close(entry.first);
+    }
+    clients.clear();
+    for ( int fd : listenFds ) {
+        close(fd);
+    }
+    if ( !listenFds.empty() && !socketPath.empty() ) {
+        unlink(socketPath.c_str());
+    }
+    listenFds.clear();
+    for ( int i = 0; i < 2; i++ ) {
+        if ( wakeupPipe[i] >= 0 ) {
+            close(wakeupPipe[i]);
+            wakeupPipe[i] = -1;
+        }
+    }
+}
+
+std::shared_ptr<const PrometheusExporter::Response> PrometheusExporter::makeResponse(const char* status,
+    const std::string& body) {
+    std::shared_ptr<Response> resp = std::make_shared<Response>();
+    char header[256];
+    snprintf(header, sizeof(header),
+        "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: %zu\r\n\r\n",
+        status, body.size());
+    resp->header = header;
+    resp->body = body;
+    return resp;
+}
+
+std::shared_ptr<const PrometheusExporter::Response> PrometheusExporter::currentResponse() {
+    std::lock_guard<std::mutex> guard(responseLock);
+    return response;
+}
+
+void PrometheusExporter::statsPublish(const std::vector<virDomainStatsRecord>& records,
+    const std::map<std::string, virDomainStatsSample>&, unsigned int) {
+    render(records);
+}
+
+// 输出一个指标族：HELP/TYPE行之后为每个虚拟机(及设备)一行
+template <typename Fn>
+static void renderFamily(std::string& out, const char* name, const char* type, const char* help,
+    const std::vector<virDomainStatsRecord>& records, Fn fn) {
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+    for ( const auto& record : records ) {
+        fn(record, Metrics::escapeLabel(record.name));
+    }
+}
+
+static void appendSample(std::string& out, const char* name, const std::string& labels, double value) {
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s{%s} %.15g\n", name, labels.c_str(), value);
+    out += buf;
+}
+
+void PrometheusExporter::render(const std::vector<virDomainStatsRecord>& records) {
+    std::string body;
+    body.reserve(4096 + records.size() * 2048);
+
+    renderFamily(body, "tinyvirt_domain_state", "gauge", "Domain state (virDomainState)", records,
+        [&body](const virDomainStatsRecord& r, const std::string& dom) {
+            appendSample(body, "tinyvirt_domain_state", "domain=\"" + dom + "\"", r.state);
+        });
+    renderFamily(body, "tinyvirt_domain_cpu_seconds_total", "counter", "CPU time consumed by the QEMU process",
+        records, [&body](const virDomainStatsRecord& r, const std::string& dom) {
+            appendSample(body, "tinyvirt_domain_cpu_seconds_total", "domain=\"" + dom + "\",mode=\"user\"",
+                r.cpuUser / 1e9);
+            appendSample(body, "tinyvirt_domain_cpu_seconds_total", "domain=\"" + dom + "\",mode=\"system\"",
+                r.cpuSystem / 1e9);
+        });
+    renderFamily(body, "tinyvirt_domain_memory_rss_bytes", "gauge", "Resident memory of the QEMU process",
+        records, [&body](const virDomainStatsRecord& r, const std::string& dom) {
+            appendSample(body, "tinyvirt_domain_memory_rss_bytes", "domain=\"" + dom + "\"", r.rss * 1024.0);
+        });
+    renderFamily(body, "tinyvirt_domain_balloon_current_bytes", "gauge", "Current balloon size", records,
+        [&body](const virDomainStatsRecord& r, const std::string& dom) {
+            if ( r.statsMask & VIR_DOMAIN_STATS_BALLOON ) {
+                appendSample(body, "tinyvirt_domain_balloon_current_bytes", "domain=\"" + dom + "\"",
+                    r.balloon.current * 1024.0);
+            }
+        });
+    renderFamily(body, "tinyvirt_domain_vcpu_seconds_total", "counter", "CPU time consumed by each vCPU thread",
+        records, [&body](const virDomainStatsRecord& r, const std::string& dom) {
+            for ( const auto& vcpu : r.vcpus ) {
+                appendSample(body, "tinyvirt_domain_vcpu_seconds_total",
+                    "domain=\"" + dom + "\",vcpu=\"" + std::to_string(vcpu.id) + "\"", vcpu.time / 1e9);
+            }
+        });
+
+    // 磁盘与网卡计数，每个设备一行
+    struct DeviceFamily {
+        const char* name;
+        const char* help;
+        bool block;
+        int field;
+    };
+    static const DeviceFamily deviceFamilies[] = {
+        { "tinyvirt_domain_block_read_requests_total", "Read requests completed by the disk", true, 0 },
+        { "tinyvirt_domain_block_read_bytes_total", "Bytes read from the disk", true, 1 },
+        { "tinyvirt_domain_block_write_requests_total", "Write requests completed by the disk", true, 2 },
+        { "tinyvirt_domain_block_write_bytes_total", "Bytes written to the disk", true, 3 },
+        { "tinyvirt_domain_net_receive_packets_total", "Packets received by the guest interface", false, 0 },
+        { "tinyvirt_domain_net_receive_bytes_total", "Bytes received by the guest interface", false, 1 },
+        { "tinyvirt_domain_net_transmit_packets_total", "Packets sent by the guest interface", false, 2 },
+        { "tinyvirt_domain_net_transmit_bytes_total", "Bytes sent by the guest interface", false, 3 },
+    };
+    for ( const auto& family : deviceFamilies ) {
+        renderFamily(body, family.name, "counter", family.help, records,
+            [&body, &family](const virDomainStatsRecord& r, const std::string& dom) {
+                if ( family.block ) {
+                    for ( const auto& block : r.blocks ) {
+                        const unsigned long long values[] = { block.rdReqs, block.rdBytes, block.wrReqs, block.wrBytes };
+                        appendSample(body, family.name,
+                            "domain=\"" + dom + "\",device=\"" + Metrics::escapeLabel(block.name) + "\"",
+                            static_cast< double >(values[family.field]));
+                    }
+                }
+                else {
+                    for ( const auto& iface : r.interfaces ) {
+                        const unsigned long long values[] = { iface.rxPkts, iface.rxBytes, iface.txPkts, iface.txBytes };
+                        appendSample(body, family.name,
+                            "domain=\"" + dom + "\",interface=\"" + Metrics::escapeLabel(iface.name) + "\"",
+                            static_cast< double >(values[family.field]));
+                    }
+                }
+            });
+    }
+
+    Metrics::Instance()->render(body);
+
+    std::shared_ptr<const Response> resp = makeResponse("200 OK", body);
+    std::lock_guard<std::mutex> guard(responseLock);
+    response = resp;
+}
+
+void PrometheusExporter::run() {
+    std::vector<struct pollfd> fds;
+    while ( running ) {
+        fds.clear();
+        struct pollfd pfd;
+        pfd.fd = wakeupPipe[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+        for ( int fd : listenFds ) {
+            pfd.fd = fd;
+            fds.push_back(pfd);
+        }
+        for ( const auto& entry : clients ) {
+            pfd.fd = entry.first;
+            pfd.events = entry.second.pending ? POLLOUT : POLLIN;
+            fds.push_back(pfd);
+        }
+
+        if ( poll(fds.data(), fds.size(), -1) < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            LOG_ERROR("Prometheus exporter poll failed: %s", strerror(errno));
+            break;
+        }
+        if ( fds[0].revents ) {
+            break;
+        }
+        for ( size_t i = 1; i < fds.size(); i++ ) {
+            if ( !fds[i].revents ) {
+                continue;
+            }
+            if ( i <= listenFds.size() ) {
+                acceptClients(fds[i].fd);
+                continue;
+            }
+            auto it = clients.find(fds[i].fd);
+            if ( it == clients.end() ) {
+                continue;
+            }
+            Client& client = it->second;
+            bool keep = client.pending ? flushClient(client) : handleRequest(client);
+            if ( !keep ) {
+                close(client.fd);
+                clients.erase(it);
+            }
+        }
+    }
+}
+
+void PrometheusExporter::acceptClients(int listenFd) {
+    while ( true ) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if ( fd < 0 ) {
+            return;
+        }
+        if ( clients.size() >= MAX_CLIENTS ) {
+            close(fd);
+            continue;
+        }
+        Client& client = clients[fd];
+        client.fd = fd;
+    }
+}
+
+bool PrometheusExporter::handleRequest(Client& client) {
+    char buf[4096];
+    ssize_t n = recv(client.fd, buf, sizeof(buf), 0);
+    if ( n <= 0 ) {
+        return n < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+    client.request.append(buf, n);
+    size_t end = client.request.find("\r\n\r\n");
+    if ( end == std::string::npos ) {
+        return client.request.size() < MAX_REQUEST_SIZE;
+    }
+
+    // 请求行形如"GET /metrics HTTP/1.1"，抓取请求没有请求体
+    std::string head = client.request.substr(0, end);
+    client.request.erase(0, end + 4);
+    std::string requestLine = head.substr(0, head.find("\r\n"));
+    char method[16] = { 0 };
+    char path[256] = { 0 };
+    char version[16] = { 0 };
+    sscanf(requestLine.c_str(), "%15s %255s %15s", method, path, version);
+
+    std::string lowerHead = head;
+    for ( auto& c : lowerHead ) {
+        c = tolower(c);
+    }
+    client.closeAfterWrite = strcmp(version, "HTTP/1.1") != 0 ||
+        lowerHead.find("\r\nconnection: close") != std::string::npos;
+
+    std::shared_ptr<const Response> resp;
+    if ( strcmp(method, "GET") != 0 ) {
+        resp = makeResponse("405 Method Not Allowed", "only GET is supported\n");
+        client.closeAfterWrite = true;
+    }
+    else if ( strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0 ) {
+        resp = makeResponse("404 Not Found", "metrics are served at /metrics\n");
+    }
+    else {
+        resp = currentResponse();
+    }
+    client.pending = resp;
+    client.offset = 0;
+    return flushClient(client);
+}
+
+bool PrometheusExporter::flushClient(Client& client) {
+    const Response& resp = *client.pending;
+    size_t total = resp.header.size() + resp.body.size();
+    while ( client.offset < total ) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if ( client.offset < resp.header.size() ) {
+            iov[iovcnt].iov_base = const_cast< char* >(resp.header.data() + client.offset);
+            iov[iovcnt].iov_len = resp.header.size() - client.offset;
+            iovcnt++;
+            iov[iovcnt].iov_base = const_cast< char* >(resp.body.data());
+            iov[iovcnt].iov_len = resp.body.size();
+            iovcnt++;
+        }
+        else {
+            size_t bodyOffset = client.offset - resp.header.size();
+            iov[iovcnt].iov_base = const_cast< char* >(resp.body.data() + bodyOffset);
+            iov[iovcnt].iov_len = resp.body.size() - bodyOffset;
+            iovcnt++;
+        }
+        ssize_t n = writev(client.fd, iov, iovcnt);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            // 发送缓冲区已满时等待POLLOUT后继续
+            return errno == EAGAIN;
+        }
+        client.offset += n;
+    }
+    client.pending.reset();
+    client.offset = 0;
+    return !client.closeAfterWrite;
+}
@@ -0,0 +1,65 @@
+#ifndef PROMETHEUS_EXPORTER_H
+#define PROMETHEUS_EXPORTER_H
+
+#include "stats_sampler.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+// 以Prometheus文本格式提供指标的本地HTTP/1.1服务，只监听UNIX socket或127.0.0.1
+// 响应在每轮采样后预先渲染好，一次抓取只需一次writev，抓取频率不会增加采集开销
+class PrometheusExporter : public StatsSink {
+public:
+    // socketPath为空时不监听UNIX socket，port为0时不监听TCP端口，两者至少指定一个
+    PrometheusExporter(const std::string& socketPath, int port);
+    ~PrometheusExporter();
+
+    void start();
+    void stop();
+
+    // 重新渲染虚拟机统计与进程内指标
+    void statsPublish(const std::vector<virDomainStatsRecord>& records,
+        const std::map<std::string, virDomainStatsSample>& samples, unsigned int intervalMs) override;
+
+private:
+    // 预先渲染的完整响应，抓取过程中持有引用，替换时不影响正在发送的连接
+    struct Response {
+        std::string header;
+        std::string body;
+    };
+    struct Client {
+        int fd = -1;
+        std::string request;
+        std::shared_ptr<const Response> pending;    // 尚未发送完的响应
+        size_t offset = 0;                          // 已发送的字节数
+        bool closeAfterWrite = false;
+    };
+
+    void render(const std::vector<virDomainStatsRecord>& records);
+    std::shared_ptr<const Response> currentResponse();
+    static std::shared_ptr<const Response> makeResponse(const char* status, const std::string& body);
+
+    void run();
+    void acceptClients(int listenFd);
+    // 返回false表示连接需要关闭
+    bool handleRequest(Client& client);
+    bool flushClient(Client& client);
+
+    std::string socketPath;
+    int port;
+    std::vector<int> listenFds;
+    int wakeupPipe[2];
+
+    std::shared_ptr<const Response> response;
+    std::mutex responseLock;
+
+    std::map<int, Client> clients;   // 只在服务线程中访问
+    std::thread worker;
+    std::atomic<bool> running;
+};
+
+#endif // PROMETHEUS_EXPORTER_H
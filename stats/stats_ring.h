@@ -0,0 +1,53 @@
+#ifndef STATS_RING_H
+#define STATS_RING_H
+
+#include <vector>
+#include <cstddef>
+
+// 固定容量的环形缓冲区，存储空间在构造时一次性分配，写满后覆盖最旧的元素
+// 本身不加锁，由持有者负责同步
+template <typename T>
+class StatsRing {
+public:
+    explicit StatsRing(size_t capacity) : buffer(capacity > 0 ? capacity : 1), head(0), count(0) {}
+
+    void push(const T& value) {
+        buffer[head] = value;
+        head = (head + 1) % buffer.size();
+        if ( count < buffer.size() ) {
+            count++;
+        }
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return buffer.size(); }
+    bool empty() const { return count == 0; }
+
+    // 下标0为最旧的元素
+    const T& at(size_t index) const {
+        return buffer[(head + buffer.size() - count + index) % buffer.size()];
+    }
+    const T& latest() const { return at(count - 1); }
+
+    // 按时间顺序复制最近的最多n个元素
+    void copyRecent(size_t n, std::vector<T>& out) const {
+        size_t start = n < count ? count - n : 0;
+        out.clear();
+        out.reserve(count - start);
+        for ( size_t i = start; i < count; i++ ) {
+            out.push_back(at(i));
+        }
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t head;    // 下一个写入位置
+    size_t count;
+};
+
+#endif // STATS_RING_H
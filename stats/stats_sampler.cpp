@@ -0,0 +1,208 @@
+#include "stats_sampler.h"
+#include "../virConnect.h"
+#include "../log/log.h"
+#include "../util/timer_service.h"
+#include <chrono>
+
+static unsigned long long monotonicMs() {
+    return std::chrono::duration_cast< std::chrono::milliseconds >(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StatsSampler::StatsSampler(HypervisorDriver* driver, unsigned int intervalMs, size_t historySize)
+    : driver(driver), intervalMs(intervalMs > 0 ? intervalMs : 1000), historySize(historySize > 0 ? historySize : 1),
+    generation(0), tickTimer(0), due(false), running(false) {
+}
+
+StatsSampler::~StatsSampler() {
+    stop();
+}
+
+void StatsSampler::start() {
+    std::lock_guard<std::mutex> guard(stateLock);
+    if ( running ) {
+        return;
+    }
+    running = true;
+    due = false;
+    worker = std::thread(&StatsSampler::run, this);
+    // 节拍由共享定时器服务产生，采集本身在采样线程中进行，不占用定时器线程
+    tickTimer = TimerService::Instance()->addPeriodicTimer(intervalMs, [this]() {
+        std::lock_guard<std::mutex> guard(stateLock);
+        due = true;
+        wakeup.notify_all();
+    });
+    LOG_INFO("Stats sampler started, interval %u ms, history %zu samples", intervalMs, historySize);
+}
+
+void StatsSampler::stop() {
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        if ( !running ) {
+            return;
+        }
+        running = false;
+    }
+    // 定时器回调需要stateLock，取消时不能持有
+    TimerService::Instance()->cancelTimer(tickTimer);
+    tickTimer = 0;
+    wakeup.notify_all();
+    if ( worker.joinable() ) {
+        worker.join();
+    }
+    LOG_INFO("Stats sampler stopped");
+}
+
+bool StatsSampler::isRunning() const {
+    std::lock_guard<std::mutex> guard(stateLock);
+    return running;
+}
+
+void StatsSampler::run() {
+    // 以固定节拍采样，采集本身的耗时不会累积成漂移
+    std::unique_lock<std::mutex> lock(stateLock);
+    while ( running ) {
+        lock.unlock();
+        try {
+            sampleOnce();
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Stats sampling failed: %s", e.what());
+        }
+        lock.lock();
+
+        // 采集耗时超过间隔时，期间错过的节拍合并为一次
+        wakeup.wait(lock, [this]() { return due || !running; });
+        due = false;
+    }
+}
+
+void StatsSampler::sampleOnce() {
+    std::lock_guard<std::mutex> sampleGuard(sampleLock);
+    unsigned int types = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL | VIR_DOMAIN_STATS_BALLOON |
+        VIR_DOMAIN_STATS_INTERFACE | VIR_DOMAIN_STATS_BLOCK;
+    std::vector<virDomainStatsRecord> records =
+        driver->connectGetAllDomainStats(types, VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+    unsigned long long now = monotonicMs();
+    std::map<std::string, virDomainStatsSample> published;
+
+    std::unique_lock<std::mutex> guard(seriesLock);
+    generation++;
+    for ( const auto& record : records ) {
+        auto it = series.find(record.name);
+        if ( it == series.end() ) {
+            // 只在虚拟机第一次出现时分配环形缓冲区
+            it = series.insert(std::make_pair(record.name,
+                std::unique_ptr<DomainSeries>(new DomainSeries(historySize)))).first;
+        }
+        DomainSeries& s = *it->second;
+        s.generation = generation;
+
+        unsigned long long rdReqs = 0, wrReqs = 0, rdBytes = 0, wrBytes = 0;
+        for ( const auto& block : record.blocks ) {
+            rdReqs += block.rdReqs;
+            wrReqs += block.wrReqs;
+            rdBytes += block.rdBytes;
+            wrBytes += block.wrBytes;
+        }
+        unsigned long long rxPkts = 0, txPkts = 0, rxBytes = 0, txBytes = 0;
+        for ( const auto& iface : record.interfaces ) {
+            rxPkts += iface.rxPkts;
+            txPkts += iface.txPkts;
+            rxBytes += iface.rxBytes;
+            txBytes += iface.txBytes;
+        }
+
+        // 计数变小说明虚拟机重启过，重新以本次结果为基准
+        bool reset = !s.hasPrev || now <= s.prevTimestamp || record.cpuTime < s.prevCpuTime ||
+            rdReqs < s.prevRdReqs || wrReqs < s.prevWrReqs || rxPkts < s.prevRxPkts || txPkts < s.prevTxPkts;
+        if ( !reset ) {
+            double seconds = (now - s.prevTimestamp) / 1000.0;
+            virDomainStatsSample sample;
+            sample.timestamp = now;
+            sample.state = record.state;
+            sample.cpuPercent = (record.cpuTime - s.prevCpuTime) / (seconds * 1e9) * 100.0;
+            sample.memory = record.rss;
+            sample.balloon = record.balloon.current;
+            sample.rdIops = (rdReqs - s.prevRdReqs) / seconds;
+            sample.wrIops = (wrReqs - s.prevWrReqs) / seconds;
+            sample.rdBytesPerSec = (rdBytes - s.prevRdBytes) / seconds;
+            sample.wrBytesPerSec = (wrBytes - s.prevWrBytes) / seconds;
+            sample.rxPktsPerSec = (rxPkts - s.prevRxPkts) / seconds;
+            sample.txPktsPerSec = (txPkts - s.prevTxPkts) / seconds;
+            sample.rxBytesPerSec = (rxBytes - s.prevRxBytes) / seconds;
+            sample.txBytesPerSec = (txBytes - s.prevTxBytes) / seconds;
+            s.ring.push(sample);
+            if ( !sinks.empty() ) {
+                published[record.name] = sample;
+            }
+        }
+        else if ( s.hasPrev ) {
+            s.ring.clear();
+        }
+
+        s.hasPrev = true;
+        s.prevTimestamp = now;
+        s.prevCpuTime = record.cpuTime;
+        s.prevRdReqs = rdReqs;
+        s.prevWrReqs = wrReqs;
+        s.prevRdBytes = rdBytes;
+        s.prevWrBytes = wrBytes;
+        s.prevRxPkts = rxPkts;
+        s.prevTxPkts = txPkts;
+        s.prevRxBytes = rxBytes;
+        s.prevTxBytes = txBytes;
+    }
+
+    // 已停止的虚拟机不再保留历史
+    for ( auto it = series.begin(); it != series.end(); ) {
+        if ( it->second->generation != generation ) {
+            it = series.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    guard.unlock();
+
+    for ( StatsSink* sink : sinks ) {
+        sink->statsPublish(records, published, intervalMs);
+    }
+}
+
+void StatsSampler::addSink(StatsSink* sink) {
+    std::lock_guard<std::mutex> guard(sampleLock);
+    sinks.push_back(sink);
+}
+
+void StatsSampler::removeSink(StatsSink* sink) {
+    std::lock_guard<std::mutex> guard(sampleLock);
+    for ( auto it = sinks.begin(); it != sinks.end(); ++it ) {
+        if ( *it == sink ) {
+            sinks.erase(it);
+            break;
+        }
+    }
+}
+
+bool StatsSampler::getHistory(const std::string& name, size_t count, std::vector<virDomainStatsSample>& samples) const {
+    std::lock_guard<std::mutex> guard(seriesLock);
+    auto it = series.find(name);
+    if ( it == series.end() || it->second->ring.empty() ) {
+        samples.clear();
+        return false;
+    }
+    it->second->ring.copyRecent(count, samples);
+    return true;
+}
+
+std::map<std::string, virDomainStatsSample> StatsSampler::getLatest() const {
+    std::map<std::string, virDomainStatsSample> latest;
+    std::lock_guard<std::mutex> guard(seriesLock);
+    for ( const auto& entry : series ) {
+        if ( !entry.second->ring.empty() ) {
+            latest[entry.first] = entry.second->ring.latest();
+        }
+    }
+    return latest;
+}
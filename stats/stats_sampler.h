@@ -0,0 +1,103 @@
+#ifndef STATS_SAMPLER_H
+#define STATS_SAMPLER_H
+
+#include "stats_ring.h"
+#include "../driver-hypervisor.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// 一次采样的结果，速率由相邻两次采集的计数差值计算
+struct virDomainStatsSample {
+    unsigned long long timestamp = 0;   // 采样时间(CLOCK_MONOTONIC, ms)
+    int state = 0;
+    double cpuPercent = 0;              // QEMU进程CPU使用率，100表示占满一个宿主机CPU
+    unsigned long long memory = 0;      // QEMU进程RSS(KiB)
+    unsigned long long balloon = 0;     // 气球设备当前大小(KiB)，没有气球时为0
+    double rdIops = 0;
+    double wrIops = 0;
+    double rdBytesPerSec = 0;
+    double wrBytesPerSec = 0;
+    double rxPktsPerSec = 0;
+    double txPktsPerSec = 0;
+    double rxBytesPerSec = 0;
+    double txBytesPerSec = 0;
+};
+
+// 采样结果的订阅者，每轮采样结束后在采样线程中依次调用
+class StatsSink {
+public:
+    virtual ~StatsSink() {}
+    // records为本轮采集到的原始计数，samples为本轮能够计算出速率的虚拟机
+    virtual void statsPublish(const std::vector<virDomainStatsRecord>& records,
+        const std::map<std::string, virDomainStatsSample>& samples, unsigned int intervalMs) = 0;
+};
+
+// 后台统计采样器：按固定间隔调用connectGetAllDomainStats，把每个运行中虚拟机的结果写入各自的环形缓冲区
+// 读取历史数据只复制缓冲区内容，不会触发新的采集
+class StatsSampler {
+public:
+    StatsSampler(HypervisorDriver* driver, unsigned int intervalMs, size_t historySize);
+    ~StatsSampler();
+
+    void start();
+    void stop();
+    bool isRunning() const;
+    unsigned int getInterval() const { return intervalMs; }
+
+    // 按时间顺序返回最近的最多count个样本，虚拟机没有样本时返回false
+    bool getHistory(const std::string& name, size_t count, std::vector<virDomainStatsSample>& samples) const;
+    // 所有虚拟机最新的一个样本
+    std::map<std::string, virDomainStatsSample> getLatest() const;
+
+    // 立即采集一次，后台线程也通过它完成采样
+    void sampleOnce();
+
+    // 注册或移除订阅者，removeSink返回后不会再有对该订阅者的调用
+    void addSink(StatsSink* sink);
+    void removeSink(StatsSink* sink);
+
+private:
+    // 单个虚拟机的历史以及上次采集到的原始计数
+    struct DomainSeries {
+        explicit DomainSeries(size_t historySize) : ring(historySize) {}
+        StatsRing<virDomainStatsSample> ring;
+        bool hasPrev = false;
+        unsigned long long prevTimestamp = 0;
+        unsigned long long prevCpuTime = 0;
+        unsigned long long prevRdReqs = 0;
+        unsigned long long prevWrReqs = 0;
+        unsigned long long prevRdBytes = 0;
+        unsigned long long prevWrBytes = 0;
+        unsigned long long prevRxPkts = 0;
+        unsigned long long prevTxPkts = 0;
+        unsigned long long prevRxBytes = 0;
+        unsigned long long prevTxBytes = 0;
+        unsigned long long generation = 0;  // 最近一次出现在采集结果中的轮次
+    };
+
+    void run();
+
+    HypervisorDriver* driver;
+    unsigned int intervalMs;
+    size_t historySize;
+    unsigned long long generation;
+
+    std::map<std::string, std::unique_ptr<DomainSeries>> series;
+    mutable std::mutex seriesLock;      // 保护series
+    std::mutex sampleLock;              // 保证同一时间只有一次采集，同时保护sinks
+    std::vector<StatsSink*> sinks;
+
+    std::thread worker;
+    uint64_t tickTimer;                 // 共享定时器服务上的周期定时器
+    mutable std::mutex stateLock;
+    std::condition_variable wakeup;
+    bool due;                           // 到了下一次采样的时间
+    bool running;
+};
+
+#endif // STATS_SAMPLER_H
@@ -0,0 +1,177 @@
+#include "stats_shm.h"
+#include "../util/proc_stat.h"
+#include "../log/log.h"
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 逐级创建统计文件所在的运行时目录
+static void createParentDirectory(const std::string& path) {
+    size_t pos = path.find('/', 1);
+    while ( pos != std::string::npos ) {
+        std::string dir = path.substr(0, pos);
+        if ( mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST ) {
+            throw std::runtime_error("Failed to create directory " + dir + ": " + strerror(errno));
+        }
+        pos = path.find('/', pos + 1);
+    }
+}
+
+StatsShmWriter::StatsShmWriter(const std::string& path, unsigned int capacity)
+    : path(path), fd(-1), header(nullptr), mappedSize(0), fileDev(0), fileIno(0) {
+    if ( capacity == 0 ) {
+        capacity = 1;
+    }
+    createParentDirectory(path);
+
+    // 先在临时文件中完成初始化再原子地替换，读者不会看到未初始化的头部
+    std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ( fd < 0 ) {
+        throw std::runtime_error("Failed to create " + tmpPath + ": " + strerror(errno));
+    }
+    mappedSize = virStatsShmFileSize(capacity);
+    void* addr = MAP_FAILED;
+    if ( ftruncate(fd, mappedSize) == 0 ) {
+        addr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if ( addr == MAP_FAILED ) {
+        std::string err = strerror(errno);
+        close(fd);
+        unlink(tmpPath.c_str());
+        throw std::runtime_error("Failed to map " + tmpPath + ": " + err);
+    }
+    header = static_cast< virStatsShmHeader* >(addr);
+    header->magic = VIR_STATS_SHM_MAGIC;
+    header->version = VIR_STATS_SHM_VERSION;
+    header->headerSize = sizeof(virStatsShmHeader);
+    header->domainSize = sizeof(virStatsShmDomain);
+    header->capacity = capacity;
+    header->writerPid = getpid();
+
+    struct stat st;
+    if ( fstat(fd, &st) < 0 || rename(tmpPath.c_str(), path.c_str()) < 0 ) {
+        std::string err = strerror(errno);
+        munmap(header, mappedSize);
+        close(fd);
+        unlink(tmpPath.c_str());
+        throw std::runtime_error("Failed to publish " + path + ": " + err);
+    }
+    fileDev = st.st_dev;
+    fileIno = st.st_ino;
+    LOG_INFO("Stats shared memory exported at %s, %u slots", path.c_str(), capacity);
+}
+
+StatsShmWriter::~StatsShmWriter() {
+    virStatsShmWriteBegin(header);
+    header->closed = 1;
+    header->domainCount = 0;
+    virStatsShmWriteEnd(header);
+    munmap(header, mappedSize);
+    close(fd);
+
+    // 文件可能已经被新的写者替换，只删除自己创建的那一个
+    struct stat st;
+    if ( stat(path.c_str(), &st) == 0 && st.st_dev == fileDev && st.st_ino == fileIno ) {
+        unlink(path.c_str());
+    }
+}
+
+void StatsShmWriter::grow(unsigned int capacity) {
+    size_t newSize = virStatsShmFileSize(capacity);
+    if ( ftruncate(fd, newSize) < 0 ) {
+        throw std::runtime_error("Failed to resize " + path + ": " + strerror(errno));
+    }
+    void* addr = mremap(header, mappedSize, newSize, MREMAP_MAYMOVE);
+    if ( addr == MAP_FAILED ) {
+        throw std::runtime_error("Failed to remap " + path + ": " + strerror(errno));
+    }
+    header = static_cast< virStatsShmHeader* >(addr);
+    mappedSize = newSize;
+    LOG_INFO("Stats shared memory %s grown to %u slots", path.c_str(), capacity);
+}
+
+void StatsShmWriter::statsPublish(const std::vector<virDomainStatsRecord>& records,
+    const std::map<std::string, virDomainStatsSample>& samples, unsigned int intervalMs) {
+    // 耗时的读取都在进入写临界区之前完成，尽量缩短读者需要重试的窗口
+    ProcHostStat host;
+    procReadHostStat(host);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    unsigned int capacity = header->capacity;
+    if ( records.size() > capacity ) {
+        while ( capacity < records.size() ) {
+            capacity *= 2;
+        }
+        // 扩大文件不影响读者已有的映射，读者看到新的capacity后自行重新映射
+        grow(capacity);
+    }
+
+    virStatsShmWriteBegin(header);
+    header->capacity = capacity;
+    header->timestamp = static_cast< uint64_t >(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    header->intervalMs = intervalMs;
+    header->host.cpuCount = host.cpuCount;
+    header->host.cpuUser = host.cpuUser;
+    header->host.cpuNice = host.cpuNice;
+    header->host.cpuSystem = host.cpuSystem;
+    header->host.cpuIdle = host.cpuIdle;
+    header->host.cpuIowait = host.cpuIowait;
+    header->host.memTotal = host.memTotalKiB;
+    header->host.memFree = host.memFreeKiB;
+    header->host.memAvailable = host.memAvailableKiB;
+
+    virStatsShmDomain* slots = virStatsShmDomains(header);
+    for ( size_t i = 0; i < records.size(); i++ ) {
+        const virDomainStatsRecord& record = records[i];
+        virStatsShmDomain& slot = slots[i];
+        memset(&slot, 0, sizeof(slot));
+        strncpy(slot.name, record.name.c_str(), VIR_STATS_SHM_NAME_LEN - 1);
+        slot.state = record.state;
+        slot.reason = record.reason;
+        slot.cpuTime = record.cpuTime;
+        slot.cpuUser = record.cpuUser;
+        slot.cpuSystem = record.cpuSystem;
+        slot.rss = record.rss;
+        slot.balloonCurrent = record.balloon.current;
+        slot.balloonMaximum = record.balloon.maximum;
+        for ( const auto& block : record.blocks ) {
+            slot.rdReqs += block.rdReqs;
+            slot.rdBytes += block.rdBytes;
+            slot.wrReqs += block.wrReqs;
+            slot.wrBytes += block.wrBytes;
+        }
+        for ( const auto& iface : record.interfaces ) {
+            slot.rxBytes += iface.rxBytes;
+            slot.rxPkts += iface.rxPkts;
+            slot.txBytes += iface.txBytes;
+            slot.txPkts += iface.txPkts;
+        }
+        slot.vcpuCount = record.vcpus.size();
+        slot.blockCount = record.blocks.size();
+        slot.interfaceCount = record.interfaces.size();
+
+        auto it = samples.find(record.name);
+        if ( it != samples.end() ) {
+            const virDomainStatsSample& sample = it->second;
+            slot.hasRates = 1;
+            slot.cpuPercent = sample.cpuPercent;
+            slot.rdIops = sample.rdIops;
+            slot.wrIops = sample.wrIops;
+            slot.rdBytesPerSec = sample.rdBytesPerSec;
+            slot.wrBytesPerSec = sample.wrBytesPerSec;
+            slot.rxPktsPerSec = sample.rxPktsPerSec;
+            slot.txPktsPerSec = sample.txPktsPerSec;
+            slot.rxBytesPerSec = sample.rxBytesPerSec;
+            slot.txBytesPerSec = sample.txBytesPerSec;
+        }
+    }
+    header->domainCount = records.size();
+    virStatsShmWriteEnd(header);
+}
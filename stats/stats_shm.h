@@ -0,0 +1,33 @@
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+#include "stats_shm_layout.h"
+#include "stats_sampler.h"
+#include <string>
+#include <sys/types.h>
+
+// 把每轮采样结果发布到内存映射文件中，布局与读取协议见stats_shm_layout.h
+// 外部采集程序直接读取映射内存，采集频率不会影响管理程序本身
+class StatsShmWriter : public StatsSink {
+public:
+    // 在path处创建新的统计文件，capacity为初始槽位数量，虚拟机更多时会自动扩容
+    StatsShmWriter(const std::string& path, unsigned int capacity);
+    ~StatsShmWriter();
+
+    const std::string& getPath() const { return path; }
+
+    void statsPublish(const std::vector<virDomainStatsRecord>& records,
+        const std::map<std::string, virDomainStatsSample>& samples, unsigned int intervalMs) override;
+
+private:
+    void grow(unsigned int capacity);
+
+    std::string path;
+    int fd;
+    virStatsShmHeader* header;
+    size_t mappedSize;
+    dev_t fileDev;
+    ino_t fileIno;
+};
+
+#endif // STATS_SHM_H
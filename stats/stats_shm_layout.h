@@ -0,0 +1,127 @@
+#ifndef STATS_SHM_LAYOUT_H
+#define STATS_SHM_LAYOUT_H
+
+/*
+ * 统计共享内存文件的布局，外部采集程序只需包含本文件即可读取，不依赖管理程序的其它代码
+ *
+ * 文件结构: virStatsShmHeader | virStatsShmDomain[capacity]
+ *
+ * 一致性采用seqlock协议：写者在更新前把seq加1(变为奇数)，更新完成后再加1(变为偶数)。
+ * 读者先读取seq，为奇数说明正在更新需重试；复制所需数据后再次读取seq，两次相同才说明复制的是完整快照。
+ * 读者只读映射内存，不会阻塞写者，也不需要任何系统调用。
+ *
+ * capacity可能随虚拟机数量增加而增大，读者在快照中发现文件长度超出自己的映射长度时需要重新映射；
+ * 写者退出或文件被新的写者替换时closed置1，读者应重新打开文件。
+ */
+
+#include <stdint.h>
+
+#define VIR_STATS_SHM_MAGIC 0x3153544154535654ULL  /* "TVSTATS1" */
+#define VIR_STATS_SHM_VERSION 1
+#define VIR_STATS_SHM_NAME_LEN 64
+
+/* 宿主机计数，CPU时间为所有CPU的累计值(ns) */
+typedef struct {
+    uint32_t cpuCount;
+    uint32_t reserved;
+    uint64_t cpuUser;
+    uint64_t cpuNice;
+    uint64_t cpuSystem;
+    uint64_t cpuIdle;
+    uint64_t cpuIowait;
+    uint64_t memTotal;          /* KiB */
+    uint64_t memFree;           /* KiB */
+    uint64_t memAvailable;      /* KiB */
+} virStatsShmHost;
+
+/* 单个运行中虚拟机的累计计数以及最近一个采样间隔内的速率 */
+typedef struct {
+    char name[VIR_STATS_SHM_NAME_LEN];  /* 以'\0'结尾，超长时截断 */
+    int32_t state;                      /* virDomainState */
+    int32_t reason;
+    uint64_t cpuTime;                   /* ns */
+    uint64_t cpuUser;                   /* ns */
+    uint64_t cpuSystem;                 /* ns */
+    uint64_t rss;                       /* KiB */
+    uint64_t balloonCurrent;            /* KiB */
+    uint64_t balloonMaximum;            /* KiB */
+    uint64_t rdReqs;                    /* 以下为所有磁盘与网卡的合计，网卡方向以虚拟机为准 */
+    uint64_t rdBytes;
+    uint64_t wrReqs;
+    uint64_t wrBytes;
+    uint64_t rxBytes;
+    uint64_t rxPkts;
+    uint64_t txBytes;
+    uint64_t txPkts;
+    uint32_t vcpuCount;
+    uint32_t blockCount;
+    uint32_t interfaceCount;
+    uint32_t hasRates;                  /* 为0时下面的速率无效(虚拟机刚启动或计数被重置) */
+    double cpuPercent;
+    double rdIops;
+    double wrIops;
+    double rdBytesPerSec;
+    double wrBytesPerSec;
+    double rxPktsPerSec;
+    double txPktsPerSec;
+    double rxBytesPerSec;
+    double txBytesPerSec;
+} virStatsShmDomain;
+
+typedef struct {
+    uint64_t magic;             /* VIR_STATS_SHM_MAGIC */
+    uint32_t version;           /* VIR_STATS_SHM_VERSION */
+    uint32_t headerSize;        /* sizeof(virStatsShmHeader)，新版本只会在末尾追加字段 */
+    uint32_t domainSize;        /* sizeof(virStatsShmDomain) */
+    uint32_t capacity;          /* 虚拟机槽位数量 */
+    uint64_t seq;               /* seqlock序号，只能通过原子操作访问 */
+    uint64_t timestamp;         /* 最近一次更新时间(CLOCK_REALTIME, ms) */
+    uint32_t intervalMs;        /* 采样间隔 */
+    uint32_t domainCount;       /* 有效槽位数量，位于[0, domainCount) */
+    int32_t writerPid;
+    uint32_t closed;            /* 写者已退出或文件已被替换 */
+    virStatsShmHost host;
+} virStatsShmHeader;
+
+#ifdef __cplusplus
+static_assert(sizeof(virStatsShmHost) == 72, "virStatsShmHost layout changed");
+static_assert(sizeof(virStatsShmDomain) == 272, "virStatsShmDomain layout changed");
+static_assert(sizeof(virStatsShmHeader) == 128, "virStatsShmHeader layout changed");
+#endif
+
+static inline uint64_t virStatsShmFileSize(uint32_t capacity) {
+    return sizeof(virStatsShmHeader) + (uint64_t)capacity * sizeof(virStatsShmDomain);
+}
+
+static inline virStatsShmDomain* virStatsShmDomains(virStatsShmHeader* header) {
+    return (virStatsShmDomain*)((char*)header + header->headerSize);
+}
+
+/* 读者：开始读取，返回本次快照的序号 */
+static inline uint64_t virStatsShmReadBegin(const virStatsShmHeader* header) {
+    uint64_t seq;
+    while ( (seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE)) & 1 ) {
+        /* 写者正在更新 */
+    }
+    return seq;
+}
+
+/* 读者：复制完成后调用，返回非0表示期间发生了更新，需要重新读取 */
+static inline int virStatsShmReadRetry(const virStatsShmHeader* header, uint64_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&header->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/* 写者：开始与结束一次更新 */
+static inline void virStatsShmWriteBegin(virStatsShmHeader* header) {
+    uint64_t seq = __atomic_load_n(&header->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void virStatsShmWriteEnd(virStatsShmHeader* header) {
+    uint64_t seq = __atomic_load_n(&header->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* STATS_SHM_LAYOUT_H */
@@ -1,4 +1,6 @@
 #include "storage_driver.h"
+#include "storage_qcow2.h"
+#include "storage_scan.h"
 #include "../virConnect.h"
 #include "../virStoragePool.h"
 #include "../virStorageVol.h"
@@ -6,18 +8,27 @@
 #include "../conf/config_manager.h"
 #include "../tinyxml/tinyxml2.h"
 #include "../util/generate_uuid.h"
+#include "../util/file_copy.h"
+#include "../util/file_wipe.h"
+#include "../util/file_stream.h"
+#include "../util/file_util.h"
+#include "../util/metrics.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <random>
 #include <iomanip>
 #include <ctime>
+#include <chrono>
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
 #include <cerrno>
+#include <climits>
 #include <cstring>
 
 FileSystemStorageDriver::FileSystemStorageDriver() {
@@ -46,7 +57,7 @@ std::vector<std::shared_ptr<VirStoragePool>> FileSystemStorageDriver::connectLis
         return {};
     }
     std::vector<std::shared_ptr<VirStoragePool>> poolList;
-    std::lock_guard<std::mutex> lock(poolsMutex);
+    SharedLockGuard lock(poolsLock);
 
     // 遍历存储池映射，添加到返回列表中
     for ( const auto& pool : pools ) {
@@ -57,7 +68,7 @@ std::vector<std::shared_ptr<VirStoragePool>> FileSystemStorageDriver::connectLis
 }
 
 std::shared_ptr<VirStoragePool> FileSystemStorageDriver::storagePoolLookupByName(const std::string& name) const {
-    std::lock_guard<std::mutex> lock(poolsMutex);
+    SharedLockGuard lock(poolsLock);
 
     for ( const auto& pool : pools ) {
         if ( pool->name == name ) {
@@ -70,7 +81,7 @@ std::shared_ptr<VirStoragePool> FileSystemStorageDriver::storagePoolLookupByName
 }
 
 std::shared_ptr<VirStoragePool> FileSystemStorageDriver::storagePoolLookupByUUID(const std::string& uuid) const {
-    std::lock_guard<std::mutex> lock(poolsMutex);
+    SharedLockGuard lock(poolsLock);
 
     for ( const auto& pool : pools ) {
         if ( pool->uuid == uuid ) {
@@ -90,7 +101,7 @@ std::shared_ptr<VirStoragePool> FileSystemStorageDriver::storagePoolDefine(const
     try {
         auto poolObj = parseAndCreateStoragePoolObj(xml);
         {
-            std::lock_guard<std::mutex> lock(poolsMutex);
+            std::lock_guard<RWLock> lock(poolsLock);
             // 检查存储池是否已存在
             std::string name = poolObj->name;
             for ( const auto& existingPool : pools ) {
@@ -156,10 +167,10 @@ int FileSystemStorageDriver::storagePoolUndefine(std::shared_ptr<VirStoragePool>
     }
 
     {
-        std::lock_guard<std::mutex> lock(poolsMutex);
-        // 从列表中删除
-        std::remove_if(pools.begin(), pools.end(),
-            [&uuid](const std::shared_ptr<StoragePoolObj>& pool) { return pool->uuid == uuid; });
+        std::lock_guard<RWLock> lock(poolsLock);
+        // 从列表中删除，已经取得存储池对象的操作继续持有它，完成后随最后一个引用释放
+        pools.erase(std::remove_if(pools.begin(), pools.end(),
+            [&uuid](const std::shared_ptr<StoragePoolObj>& pool) { return pool->uuid == uuid; }), pools.end());
     }
 
     LOG_INFO("Storage pool undefined: %s", name.c_str());
@@ -223,6 +234,7 @@ int FileSystemStorageDriver::storagePoolGetState(std::shared_ptr<VirStoragePool>
         LOG_ERROR("Attempt to get state of null storage pool");
         return -1;
     }
+    SharedLockGuard lock(poolsLock);
     for ( const auto& poolObj : pools ) {
         if ( poolObj->name == pool->virStoragePoolGetName() ) {
             return poolObj->active ? VIR_STORAGE_POOL_RUNNING : VIR_STORAGE_POOL_INACTIVE;
@@ -237,6 +249,7 @@ int FileSystemStorageDriver::storagePoolGetType(std::shared_ptr<VirStoragePool>
         LOG_ERROR("Attempt to get type of null storage pool");
         return -1;
     }
+    SharedLockGuard lock(poolsLock);
     for ( const auto& poolObj : pools ) {
         if ( poolObj->uuid == pool->virStoragePoolGetUUID() ) {
             return poolObj->type;
@@ -251,6 +264,7 @@ std::string FileSystemStorageDriver::storagePoolGetPath(std::shared_ptr<VirStora
         LOG_ERROR("Attempt to get path of null storage pool");
         return "";
     }
+    SharedLockGuard lock(poolsLock);
     for ( const auto& poolObj : pools ) {
         if ( poolObj->uuid == pool->virStoragePoolGetUUID() ) {
             return poolObj->path;
@@ -259,6 +273,146 @@ std::string FileSystemStorageDriver::storagePoolGetPath(std::shared_ptr<VirStora
     return "";
 }
 
+int FileSystemStorageDriver::storagePoolGetInfo(std::shared_ptr<VirStoragePool> pool, virStoragePoolInfo& info) const {
+    if ( !pool ) {
+        LOG_ERROR("Attempt to get info of null storage pool");
+        return -1;
+    }
+    std::shared_ptr<StoragePoolObj> poolObj = findPoolObj(pool);
+    if ( !poolObj ) {
+        LOG_ERROR("Storage pool not found: %s", pool->virStoragePoolGetName().c_str());
+        return -1;
+    }
+    SharedLockGuard lock(poolObj->volumesLock);
+    info.state = poolObj->active ? VIR_STORAGE_POOL_RUNNING : VIR_STORAGE_POOL_INACTIVE;
+    info.capacity = poolObj->capacity;
+    info.allocation = poolObj->allocation;
+    info.available = poolObj->available;
+    return 0;
+}
+
+int FileSystemStorageDriver::storagePoolRefresh(std::shared_ptr<VirStoragePool> pool, unsigned int flags) {
+    if ( flags != 0 ) {
+        LOG_ERROR("Invalid flags for storage pool refresh: %u", flags);
+        return -1;
+    }
+    if ( !pool ) {
+        LOG_ERROR("Attempt to refresh null storage pool");
+        return -1;
+    }
+    std::shared_ptr<StoragePoolObj> poolObj = findPoolObj(pool);
+    if ( !poolObj ) {
+        LOG_ERROR("Storage pool not found: %s", pool->virStoragePoolGetName().c_str());
+        return -1;
+    }
+    return refreshPoolObj(poolObj);
+}
+
+int FileSystemStorageDriver::refreshPoolObj(const std::shared_ptr<StoragePoolObj>& poolObj) {
+    auto start = std::chrono::steady_clock::now();
+    // 扫描和statvfs都在加锁之前完成，刷新期间存储池中的查询不受影响
+    unsigned int threads = static_cast< unsigned int >(std::max(ConfigManager::Instance()->getIntValue("storage.refresh_threads", 8), 1));
+    std::vector<StorageScanEntry> entries;
+    if ( storageScanDirectory(poolObj->path, threads, entries) < 0 ) {
+        LOG_ERROR("Failed to scan storage pool %s (%s): %s", poolObj->name.c_str(), poolObj->path.c_str(), strerror(errno));
+        return -1;
+    }
+    struct statvfs vfs;
+    if ( statvfs(poolObj->path.c_str(), &vfs) != 0 ) {
+        LOG_ERROR("Failed to get file system info of storage pool %s: %s", poolObj->path.c_str(), strerror(errno));
+        return -1;
+    }
+    // 卷都是存储池目录中的普通文件，规范路径由目录的规范路径拼接，不需要对每个文件调用realpath
+    char resolved[PATH_MAX];
+    std::string canonicalDir = realpath(poolObj->path.c_str(), resolved) ? resolved : poolObj->path;
+
+    size_t added = 0;
+    size_t removed = 0;
+    std::vector<std::shared_ptr<StorageVolumeObj>> unrecorded;
+    {
+        std::lock_guard<RWLock> lock(poolObj->volumesLock);
+        std::unordered_map<std::string, std::shared_ptr<StorageVolumeObj>> existing;
+        for ( const auto& volObj : poolObj->volumes ) {
+            existing[volObj->name] = volObj;
+        }
+        std::vector<std::shared_ptr<StorageVolumeObj>> volumes;
+        volumes.reserve(entries.size());
+        for ( const auto& entry : entries ) {
+            std::shared_ptr<StorageVolumeObj> volObj;
+            auto it = existing.find(entry.name);
+            if ( it != existing.end() ) {
+                volObj = it->second;
+                existing.erase(it);
+                // 文件被替换后inode会变化
+                if ( volObj->dev != entry.dev || volObj->ino != entry.ino ) {
+                    unindexVolumeObj(volObj);
+                    volObj->ino = 0;
+                }
+            }
+            else {
+                // 扫描之后、加锁之前被删除的卷不能重新加入
+                struct stat st;
+                if ( stat((poolObj->path + "/" + entry.name).c_str(), &st) != 0 ) {
+                    continue;
+                }
+                volObj = std::make_shared<StorageVolumeObj>();
+                volObj->name = entry.name;
+                volObj->uuid = generateUUID();
+                volObj->path = poolObj->path + "/" + entry.name;
+                volObj->format = entry.image.format;
+                if ( !entry.formatRecorded ) {
+                    unrecorded.push_back(volObj);
+                }
+                added++;
+            }
+            // 已知卷的格式保持不变，探测结果与之不符时(例如客户机在raw卷中写入了qcow2头)只使用文件大小
+            if ( volObj->format == entry.image.format ) {
+                volObj->capacity = static_cast< size_t >(entry.image.capacity);
+                volObj->backingStore = entry.image.backingFile;
+            }
+            else {
+                volObj->capacity = static_cast< size_t >(entry.size);
+                volObj->backingStore.clear();
+            }
+            volObj->allocation = static_cast< size_t >(entry.image.allocation);
+            if ( volObj->ino == 0 ) {
+                volObj->canonicalPath = canonicalDir + "/" + entry.name;
+                volObj->dev = entry.dev;
+                volObj->ino = entry.ino;
+                indexVolumeObj(volObj);
+            }
+            volumes.push_back(volObj);
+        }
+        // 扫描之后才创建的卷不在扫描结果中，文件仍然存在时保留
+        for ( const auto& it : existing ) {
+            struct stat st;
+            if ( stat(it.second->path.c_str(), &st) == 0 ) {
+                volumes.push_back(it.second);
+                continue;
+            }
+            unindexVolumeObj(it.second);
+            removed++;
+        }
+        poolObj->volumes.swap(volumes);
+        poolObj->capacity = static_cast< size_t >(vfs.f_blocks) * vfs.f_frsize;
+        poolObj->allocation = static_cast< size_t >(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+        poolObj->available = static_cast< size_t >(vfs.f_bavail) * vfs.f_frsize;
+    }
+    // 第一次发现的卷按探测结果记录格式，之后客户机改写卷的内容也不会改变它的格式
+    for ( const auto& volObj : unrecorded ) {
+        if ( storageRecordFormat(volObj->path, volObj->format) < 0 ) {
+            LOG_WARN("Failed to record format of storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Metrics::Instance()->histogram("tinyvirt_storage_pool_refresh_duration_seconds",
+        "Time spent scanning storage pool directories")->observe(seconds);
+    LOG_INFO("Storage pool %s refreshed: %zu volumes (%zu added, %zu removed) in %.3f s", poolObj->name.c_str(),
+        entries.size(), added, removed, seconds);
+    return 0;
+}
+
 // 以下是存储池相关的操作
 
 std::vector<std::shared_ptr<VirStorageVol>> FileSystemStorageDriver::storagePoolListAllVolumes(
@@ -271,23 +425,15 @@ std::vector<std::shared_ptr<VirStorageVol>> FileSystemStorageDriver::storagePool
         LOG_ERROR("Attempt to list volumes in null storage pool");
         return {};
     }
-    std::vector<std::shared_ptr<VirStorageVol>> volumeList;
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    std::shared_ptr<StoragePoolObj> poolObj;
-    for ( const auto& it : pools ) {
-        if ( it->uuid == pool->virStoragePoolGetUUID() ) {
-            poolObj = it;
-            break;
-        }
-    }
-    auto it = volumesMap.find(poolObj);
-    if ( it != volumesMap.end() ) {
-        for ( const auto& volPair : it->second ) {
-            volumeList.push_back(std::make_shared<VirStorageVol>(volPair->name, volPair->uuid, volPair->path));
-        }
-    }
-    else {
+    std::shared_ptr<StoragePoolObj> poolObj = findPoolObj(pool);
+    if ( !poolObj ) {
         LOG_WARN("No volumes found in storage pool: %s", pool->virStoragePoolGetName().c_str());
+        return {};
+    }
+    std::vector<std::shared_ptr<VirStorageVol>> volumeList;
+    SharedLockGuard lock(poolObj->volumesLock);
+    for ( const auto& volObj : poolObj->volumes ) {
+        volumeList.push_back(std::make_shared<VirStorageVol>(volObj->name, volObj->uuid, volObj->path, pool, self()));
     }
     return volumeList;
 }
@@ -298,19 +444,12 @@ std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolLookupByName(
         LOG_ERROR("Attempt to lookup volume in null storage pool");
         return nullptr;
     }
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    std::shared_ptr<StoragePoolObj> poolObj;
-    for ( const auto& it : pools ) {
-        if ( it->uuid == pool->virStoragePoolGetUUID() ) {
-            poolObj = it;
-            break;
-        }
-    }
-    auto it = volumesMap.find(poolObj);
-    if ( it != volumesMap.end() ) {
-        for ( const auto& volPair : it->second ) {
-            if ( volPair->name == name ) {
-                return std::make_shared<VirStorageVol>(volPair->name, volPair->uuid, volPair->path);
+    std::shared_ptr<StoragePoolObj> poolObj = findPoolObj(pool);
+    if ( poolObj ) {
+        SharedLockGuard lock(poolObj->volumesLock);
+        for ( const auto& volObj : poolObj->volumes ) {
+            if ( volObj->name == name ) {
+                return std::make_shared<VirStorageVol>(volObj->name, volObj->uuid, volObj->path, pool, self());
             }
         }
     }
@@ -320,18 +459,139 @@ std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolLookupByName(
 
 
 std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolLookupByPath(const std::string& path) const {
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    for ( auto it : volumesMap ) {
-        for ( auto vol : it.second ) {
-            if ( vol->path == path ) {
-                return std::make_shared<VirStorageVol>(vol->name, vol->uuid, vol->path);
-            }
+    // 系统调用在加锁之前完成
+    char resolved[PATH_MAX];
+    std::string canonical = realpath(path.c_str(), resolved) ? resolved : "";
+    struct stat st;
+    bool exists = stat(path.c_str(), &st) == 0;
+
+    SharedLockGuard lock(indexLock);
+    auto it = volumesByPath.find(path);
+    if ( it == volumesByPath.end() && !canonical.empty() ) {
+        it = volumesByPath.find(canonical);
+    }
+    std::shared_ptr<StorageVolumeObj> vol = it != volumesByPath.end() ? it->second : nullptr;
+    if ( !vol && exists ) {
+        auto idIt = volumesByFileId.find(StorageFileId{ static_cast< unsigned long long >(st.st_dev), static_cast< unsigned long long >(st.st_ino) });
+        if ( idIt != volumesByFileId.end() ) {
+            vol = idIt->second;
         }
     }
+    if ( vol ) {
+        return std::make_shared<VirStorageVol>(vol->name, vol->uuid, vol->path, nullptr, self());
+    }
     LOG_WARN("Storage volume not found by path: %s", path.c_str());
     return nullptr;
 }
 
+// 解析卷文件的规范路径、设备号和inode，需要访问文件系统，在获取存储池和索引的锁之前调用
+static void resolveVolumeFileId(const std::string& path, std::string& canonicalPath, unsigned long long& dev,
+    unsigned long long& ino) {
+    char resolved[PATH_MAX];
+    canonicalPath = realpath(path.c_str(), resolved) ? resolved : path;
+    struct stat st;
+    if ( stat(path.c_str(), &st) == 0 ) {
+        dev = static_cast< unsigned long long >(st.st_dev);
+        ino = static_cast< unsigned long long >(st.st_ino);
+    }
+    else {
+        dev = 0;
+        ino = 0;
+    }
+}
+
+void FileSystemStorageDriver::indexVolumeObj(const std::shared_ptr<StorageVolumeObj>& volObj) {
+    std::lock_guard<RWLock> lock(indexLock);
+    if ( volObj->ino != 0 ) {
+        volumesByFileId[StorageFileId{ volObj->dev, volObj->ino }] = volObj;
+    }
+    volumesByPath[volObj->path] = volObj;
+    volumesByPath[volObj->canonicalPath] = volObj;
+}
+
+void FileSystemStorageDriver::unindexVolumeObj(const std::shared_ptr<StorageVolumeObj>& volObj) {
+    // 只移除仍指向该卷的项，同一路径可能已被新建的卷占用
+    std::lock_guard<RWLock> lock(indexLock);
+    for ( const std::string& key : { volObj->path, volObj->canonicalPath } ) {
+        auto it = volumesByPath.find(key);
+        if ( it != volumesByPath.end() && it->second == volObj ) {
+            volumesByPath.erase(it);
+        }
+    }
+    auto it = volumesByFileId.find(StorageFileId{ volObj->dev, volObj->ino });
+    if ( it != volumesByFileId.end() && it->second == volObj ) {
+        volumesByFileId.erase(it);
+    }
+}
+
+// 根据卷文件的内容更新虚拟容量、实际占用和后备镜像
+// format为空时按魔数探测，qcow2头损坏时按raw处理；已确定的格式保持不变，raw卷不读取其中由客户机控制的镜像头
+static void probeVolumeObj(StorageVolumeObj& volObj) {
+    bool probe = volObj.format.empty();
+    if ( probe ) {
+        volObj.format = "raw";
+    }
+    volObj.backingStore.clear();
+    int fd = open(volObj.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        LOG_WARN("Failed to open storage volume %s: %s", volObj.path.c_str(), strerror(errno));
+        return;
+    }
+    struct stat st;
+    if ( fstat(fd, &st) == 0 ) {
+        volObj.capacity = static_cast< size_t >(st.st_size);
+        volObj.allocation = static_cast< size_t >(st.st_blocks) * 512;
+    }
+    try {
+        Qcow2Header header;
+        if ( S_ISREG(st.st_mode) && volObj.format != "raw" && qcow2ReadHeader(fd, header) ) {
+            volObj.format = "qcow2";
+            volObj.capacity = static_cast< size_t >(header.virtualSize);
+            volObj.backingStore = storageResolveBackingPath(volObj.path, header.backingFile);
+        }
+    }
+    catch ( const std::exception& e ) {
+        LOG_WARN("Invalid qcow2 header in %s: %s", volObj.path.c_str(), e.what());
+    }
+    close(fd);
+}
+
+// 卷XML中unit属性对应的字节数，与libvirt相同：KB等为1000的幂，K、KiB等为1024的幂，没有unit时为字节
+static unsigned long long parseSizeUnit(const char* unit) {
+    std::string u = unit ? unit : "";
+    if ( u.empty() || u == "b" || u == "B" || u == "bytes" ) {
+        return 1;
+    }
+    const std::string prefixes = "KMGTPE";
+    size_t index = prefixes.find(static_cast< char >(toupper(u[0])));
+    if ( index != std::string::npos ) {
+        std::string rest = u.substr(1);
+        unsigned long long base = 0;
+        if ( rest.empty() || rest == "iB" ) {
+            base = 1024;
+        }
+        else if ( rest == "B" ) {
+            base = 1000;
+        }
+        if ( base != 0 ) {
+            unsigned long long value = 1;
+            for ( size_t i = 0; i <= index; i++ ) {
+                value *= base;
+            }
+            return value;
+        }
+    }
+    throw std::runtime_error("Unknown size unit: " + u);
+}
+
+// 卷名直接拼接到存储池目录后作为文件名，不能借助'/'或".."指向池外的文件
+// 以'.'开头的文件是克隆、合并时使用的临时文件，扫描时会被跳过，也不能作为卷名
+static void checkVolumeName(const std::string& name) {
+    if ( name.empty() || name[0] == '.' || name.find('/') != std::string::npos ) {
+        throw std::runtime_error("Invalid volume name: '" + name + "'");
+    }
+}
+
 std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolCreateXML(
     std::shared_ptr<VirStoragePool> pool, const std::string& xml, unsigned int flags) {
     if ( flags != 0 ) {
@@ -366,18 +626,78 @@ std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolCreateXML(
             throw std::runtime_error("Volume name not specified");
         }
         std::string name = nameElem->GetText();
+        checkVolumeName(name);
+
+        // 卷格式和qcow2的簇大小
+        std::string format = "raw";
+        unsigned int clusterSize = QCOW2_DEFAULT_CLUSTER_SIZE;
+        tinyxml2::XMLElement* targetElem = volElem->FirstChildElement("target");
+        if ( targetElem ) {
+            tinyxml2::XMLElement* formatElem = targetElem->FirstChildElement("format");
+            if ( formatElem && formatElem->Attribute("type") ) {
+                format = formatElem->Attribute("type");
+            }
+            tinyxml2::XMLElement* clusterElem = targetElem->FirstChildElement("clusterSize");
+            if ( clusterElem && clusterElem->GetText() ) {
+                clusterSize = static_cast< unsigned int >(std::stoull(clusterElem->GetText()) * parseSizeUnit(clusterElem->Attribute("unit")));
+            }
+        }
+        if ( format != "raw" && format != "qcow2" ) {
+            throw std::runtime_error("Unsupported volume format: " + format);
+        }
+
+        // 后备镜像，只有qcow2支持；相对路径以新卷所在目录为基准，与qcow2头中的含义一致
+        std::string backingPath;
+        std::string backingFormat;
+        tinyxml2::XMLElement* backingElem = volElem->FirstChildElement("backingStore");
+        if ( backingElem ) {
+            tinyxml2::XMLElement* pathElem = backingElem->FirstChildElement("path");
+            if ( !pathElem || !pathElem->GetText() ) {
+                throw std::runtime_error("Backing store path not specified");
+            }
+            backingPath = pathElem->GetText();
+            tinyxml2::XMLElement* formatElem = backingElem->FirstChildElement("format");
+            if ( formatElem && formatElem->Attribute("type") ) {
+                backingFormat = formatElem->Attribute("type");
+            }
+            if ( format != "qcow2" ) {
+                throw std::runtime_error("Backing store requires qcow2 volume format");
+            }
+        }
+        std::vector<StorageImageInfo> backingChain;
+        if ( !backingPath.empty() ) {
+            // 检查整条后备链可以打开，没有指定格式时记录探测到的格式，避免以后每次打开都重新探测
+            backingChain = storageImageGetChain(storageResolveBackingPath(pool->virStoragePoolGetPath() + "/" + name, backingPath), backingFormat);
+            backingFormat = backingChain.front().format;
+        }
 
-        // 获取卷容量
+        // 获取卷容量，有后备镜像时默认与后备镜像的虚拟大小相同
         unsigned long long capacity = 0;
         tinyxml2::XMLElement* capacityElem = volElem->FirstChildElement("capacity");
         if ( capacityElem && capacityElem->GetText() ) {
-            capacity = std::stoull(capacityElem->GetText());
+            capacity = std::stoull(capacityElem->GetText()) * parseSizeUnit(capacityElem->Attribute("unit"));
+        }
+        else if ( !backingChain.empty() ) {
+            capacity = backingChain.front().capacity;
         }
         else {
             // 默认容量
             capacity = 1024 * 1024; // 1MB
         }
 
+        // 预分配方式: off为稀疏文件，falloc由文件系统分配空间，full实际写入零
+        std::string prealloc = "off";
+        tinyxml2::XMLElement* preallocElem = volElem->FirstChildElement("preallocation");
+        if ( preallocElem && preallocElem->GetText() ) {
+            prealloc = preallocElem->GetText();
+        }
+        if ( prealloc != "off" && prealloc != "falloc" && prealloc != "full" ) {
+            throw std::runtime_error("Unknown preallocation mode: " + prealloc);
+        }
+        if ( format == "qcow2" && prealloc != "off" ) {
+            throw std::runtime_error("Preallocation is not supported for qcow2 volumes");
+        }
+
         // 生成卷路径
         std::string poolPath = pool->virStoragePoolGetPath();
         std::string volPath = poolPath + "/" + name;
@@ -388,31 +708,66 @@ std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolCreateXML(
         }
 
         // 创建卷文件
-        int fd = open(volPath.c_str(), O_CREAT | O_WRONLY, 0644);
+        int fd = open(volPath.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
         if ( fd < 0 ) {
             throw std::runtime_error("Failed to create volume file: " + std::string(strerror(errno)));
         }
 
+        if ( format == "qcow2" ) {
+            try {
+                qcow2Create(fd, capacity, clusterSize, backingPath, backingFormat);
+            }
+            catch ( ... ) {
+                close(fd);
+                unlink(volPath.c_str());
+                throw;
+            }
+        }
         // 调整文件大小
-        if ( ftruncate(fd, capacity) != 0 ) {
+        else if ( ftruncate(fd, capacity) != 0 ) {
             close(fd);
             unlink(volPath.c_str());
             throw std::runtime_error("Failed to set volume size: " + std::string(strerror(errno)));
         }
-
+        if ( prealloc == "falloc" && capacity > 0 && fallocate(fd, 0, 0, static_cast< off_t >(capacity)) != 0 ) {
+            std::string err = strerror(errno);
+            close(fd);
+            unlink(volPath.c_str());
+            throw std::runtime_error("Failed to preallocate volume: " + err);
+        }
         close(fd);
 
+        if ( prealloc == "full" ) {
+            FileWipeOptions options;
+            options.writeOnly = true;
+            options.idlePriority = false;
+            options.threads = static_cast< unsigned int >(std::max(ConfigManager::Instance()->getIntValue("storage.copy_threads", 4), 1));
+            FileWipeResult result;
+            if ( fileWipe(volPath, options, result) < 0 ) {
+                std::string err = strerror(errno);
+                unlink(volPath.c_str());
+                throw std::runtime_error("Failed to preallocate volume: " + err);
+            }
+            LOG_INFO("Storage volume %s fully preallocated: %llu bytes in %.3f s", name.c_str(), result.bytes, result.seconds);
+        }
+        struct stat st;
+        unsigned long long allocation = stat(volPath.c_str(), &st) == 0 ? static_cast< unsigned long long >(st.st_blocks) * 512 : 0;
+
         // 创建卷对象
-        auto vol = std::make_shared<VirStorageVol>(name, generateUUID(), volPath);
+        auto vol = std::make_shared<VirStorageVol>(name, generateUUID(), volPath, pool, this);
         auto volObj = std::make_shared<StorageVolumeObj>();
         volObj->name = name;
         volObj->uuid = vol->virStorageVolGetKey();
         volObj->path = volPath;
         volObj->capacity = capacity;
-        volObj->allocation = capacity; // 初始分配等于容量
-        volObj->format = "raw"; // 默认格式为raw
+        volObj->allocation = allocation;
+        volObj->format = format;
+        if ( !backingChain.empty() ) {
+            volObj->backingStore = backingChain.front().path;
+        }
+        addVolumeObj(pool, volObj);
 
-        LOG_INFO("Storage volume created: %s (path: %s)", name.c_str(), volPath.c_str());
+        LOG_INFO("Storage volume created: %s (path: %s, format: %s)", name.c_str(), volPath.c_str(), format.c_str());
         return vol;
     }
     catch ( const std::exception& e ) {
@@ -423,46 +778,676 @@ std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolCreateXML(
 }
 
 std::shared_ptr<VirStorageVol> FileSystemStorageDriver::storageVolCreateXMLFrom(std::shared_ptr<VirStoragePool> pool, const std::string& xml, std::shared_ptr<VirStorageVol> srcVol, unsigned int flags) {
-    if ( flags != 0 ) {
+    if ( flags & ~VIR_STORAGE_VOL_CREATE_LINKED ) {
         LOG_ERROR("Invalid flags for storage pool listing: %u", flags);
         return {};
     }
-    // fix warning: unused parameter 'srcVol' 'pool'
-    ( void )pool;
-    ( void )srcVol;
+    if ( !pool || !srcVol ) {
+        LOG_ERROR("Attempt to clone volume with null storage pool or source volume");
+        throw std::runtime_error("Invalid storage pool or source volume");
+    }
+    if ( pool->virStoragePoolGetState() != VIR_STORAGE_POOL_RUNNING ) {
+        LOG_ERROR("Creating volume in inactive storage pool: %s", pool->virStoragePoolGetName().c_str());
+        throw std::runtime_error("Storage pool not active");
+    }
+
+    tinyxml2::XMLDocument doc;
+    if ( doc.Parse(xml.c_str()) != tinyxml2::XML_SUCCESS ) {
+        throw std::runtime_error("Failed to parse volume XML description");
+    }
+    tinyxml2::XMLElement* volElem = doc.FirstChildElement("volume");
+    if ( !volElem ) {
+        throw std::runtime_error("Volume element not found in XML");
+    }
+    tinyxml2::XMLElement* nameElem = volElem->FirstChildElement("name");
+    if ( !nameElem || !nameElem->GetText() ) {
+        throw std::runtime_error("Volume name not specified");
+    }
+    std::string name = nameElem->GetText();
+    checkVolumeName(name);
+    // 未指定容量时与源卷相同，指定的容量比源卷小时按源卷大小处理
+    unsigned long long capacity = 0;
+    tinyxml2::XMLElement* capacityElem = volElem->FirstChildElement("capacity");
+    if ( capacityElem && capacityElem->GetText() ) {
+        capacity = std::stoull(capacityElem->GetText()) * parseSizeUnit(capacityElem->Attribute("unit"));
+    }
+
+    std::string srcPath = srcVol->virStorageVolGetPath();
+    std::string volPath = pool->virStoragePoolGetPath() + "/" + name;
+    if ( flags & VIR_STORAGE_VOL_CREATE_LINKED ) {
+        return createLinkedClone(pool, name, volPath, srcVol, capacity);
+    }
+    int srcFd = open(srcPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( srcFd < 0 ) {
+        throw std::runtime_error("Failed to open source volume " + srcPath + ": " + strerror(errno));
+    }
+    struct stat srcStat;
+    if ( fstat(srcFd, &srcStat) != 0 ) {
+        std::string err = strerror(errno);
+        close(srcFd);
+        throw std::runtime_error("Failed to stat source volume " + srcPath + ": " + err);
+    }
+    // FICLONE要求目标以可写方式打开，O_EXCL保证不会覆盖已有的卷
+    int dstFd = open(volPath.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if ( dstFd < 0 ) {
+        std::string err = strerror(errno);
+        close(srcFd);
+        throw std::runtime_error("Failed to create volume file " + volPath + ": " + err);
+    }
+
+    unsigned long long srcSize = static_cast< unsigned long long >(srcStat.st_size);
+    unsigned int threads = static_cast< unsigned int >(std::max(ConfigManager::Instance()->getIntValue("storage.copy_threads", 4), 1));
+    FileCopyResult result;
+    // 先把目标设为源文件大小，并行分块写入时不会因为写入顺序而改变文件长度
+    int ret = ftruncate(dstFd, static_cast< off_t >(srcSize));
+    if ( ret == 0 ) {
+        ret = fileCopyFd(srcFd, dstFd, srcSize, threads, result);
+    }
+    if ( ret == 0 && capacity > srcSize ) {
+        ret = ftruncate(dstFd, static_cast< off_t >(capacity));
+    }
+    std::string err = ret == 0 ? "" : strerror(errno);
+    close(srcFd);
+    close(dstFd);
+    if ( ret != 0 ) {
+        unlink(volPath.c_str());
+        LOG_ERROR("Failed to clone volume %s from %s: %s", name.c_str(), srcPath.c_str(), err.c_str());
+        throw std::runtime_error("Failed to clone volume " + name + ": " + err);
+    }
+
+    std::string labels = "method=\"" + std::string(fileCopyMethodName(result.method)) + "\"";
+    Metrics::Instance()->counter("tinyvirt_storage_copy_bytes_total",
+        "Bytes of data copied when cloning storage volumes, holes excluded", labels)->inc(result.dataBytes);
+    Metrics::Instance()->histogram("tinyvirt_storage_copy_duration_seconds",
+        "Time spent copying data when cloning storage volumes", labels)->observe(result.seconds);
+    LOG_INFO("Storage volume %s cloned from %s using %s: %llu bytes (%llu bytes of data) in %.3f s (%.1f MiB/s)",
+        name.c_str(), srcPath.c_str(), fileCopyMethodName(result.method), result.bytes, result.dataBytes,
+        result.seconds, result.throughput() / (1024 * 1024));
+
+    auto vol = std::make_shared<VirStorageVol>(name, generateUUID(), volPath, pool, this);
+    auto volObj = std::make_shared<StorageVolumeObj>();
+    volObj->name = name;
+    volObj->uuid = vol->virStorageVolGetKey();
+    volObj->path = volPath;
+    // 逐字节复制的卷与源卷格式相同，容量以新文件的内容为准
+    std::shared_ptr<StoragePoolObj> srcPoolObj;
+    std::shared_ptr<StorageVolumeObj> srcObj = findVolumeObj(srcVol, &srcPoolObj);
+    if ( srcObj ) {
+        SharedLockGuard lock(srcPoolObj->volumesLock);
+        volObj->format = srcObj->format;
+    }
+    probeVolumeObj(*volObj);
+    addVolumeObj(pool, volObj);
+    return vol;
+}
+
+// 链接克隆只写入一个以源卷为后备镜像的qcow2头，不复制数据，源卷之后不能再被写入或删除
+std::shared_ptr<VirStorageVol> FileSystemStorageDriver::createLinkedClone(std::shared_ptr<VirStoragePool> pool,
+    const std::string& name, const std::string& volPath, std::shared_ptr<VirStorageVol> srcVol, unsigned long long capacity) {
+    checkVolumeName(name);
+    // 从确认源卷存在到克隆登记完成之间，源卷不能被删除
+    std::lock_guard<std::mutex> backingGuard(backingLock);
+    std::shared_ptr<StoragePoolObj> srcPoolObj;
+    std::shared_ptr<StorageVolumeObj> srcObj = findVolumeObj(srcVol, &srcPoolObj);
+    if ( !srcObj ) {
+        throw std::runtime_error("Source volume not found: " + srcVol->virStorageVolGetName());
+    }
+    std::string srcFormat;
+    {
+        SharedLockGuard lock(srcPoolObj->volumesLock);
+        srcFormat = srcObj->format;
+    }
+    // 检查源卷的整条后备链，容量以源卷的虚拟大小为准
+    std::vector<StorageImageInfo> chain = storageImageGetChain(srcObj->path, srcFormat);
+    capacity = std::max(capacity, chain.front().capacity);
+    // 同一目录中的卷以相对路径记录后备镜像，整个存储池目录移动后链接仍然有效
+    std::string backingFile = srcObj->path;
+    size_t slash = srcObj->path.find_last_of('/');
+    if ( slash != std::string::npos && srcObj->path.compare(0, slash + 1, volPath, 0, volPath.find_last_of('/') + 1) == 0 ) {
+        backingFile = srcObj->path.substr(slash + 1);
+    }
+
+    int fd = open(volPath.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if ( fd < 0 ) {
+        throw std::runtime_error("Failed to create volume file " + volPath + ": " + strerror(errno));
+    }
+    try {
+        qcow2Create(fd, capacity, QCOW2_DEFAULT_CLUSTER_SIZE, backingFile, chain.front().format);
+    }
+    catch ( const std::exception& e ) {
+        close(fd);
+        unlink(volPath.c_str());
+        LOG_ERROR("Failed to create linked clone %s of %s: %s", name.c_str(), srcObj->path.c_str(), e.what());
+        throw;
+    }
+    close(fd);
+
+    auto vol = std::make_shared<VirStorageVol>(name, generateUUID(), volPath, pool, this);
+    auto volObj = std::make_shared<StorageVolumeObj>();
+    volObj->name = name;
+    volObj->uuid = vol->virStorageVolGetKey();
+    volObj->path = volPath;
+    volObj->format = "qcow2";
+    probeVolumeObj(*volObj);
+    addVolumeObj(pool, volObj);
+    LOG_INFO("Storage volume %s created as linked clone of %s", name.c_str(), srcObj->path.c_str());
+    return vol;
+}
+
+std::shared_ptr<StoragePoolObj> FileSystemStorageDriver::findPoolObj(std::shared_ptr<VirStoragePool> pool) const {
+    SharedLockGuard lock(poolsLock);
+    for ( const auto& poolObj : pools ) {
+        if ( poolObj->uuid == pool->virStoragePoolGetUUID() ) {
+            return poolObj;
+        }
+    }
+    return nullptr;
+}
 
-    // TODO
-    LOG_DEBUG("Creating storage volume from XML: %s", xml.c_str());
+std::shared_ptr<StorageVolumeObj> FileSystemStorageDriver::findVolumeObj(std::shared_ptr<VirStorageVol> vol,
+    std::shared_ptr<StoragePoolObj>* poolObj) const {
+    // 先复制存储池列表，逐个获取存储池的读锁时不再持有poolsLock
+    std::vector<std::shared_ptr<StoragePoolObj>> poolList;
+    {
+        SharedLockGuard lock(poolsLock);
+        poolList = pools;
+    }
+    for ( const auto& it : poolList ) {
+        SharedLockGuard lock(it->volumesLock);
+        for ( const auto& volObj : it->volumes ) {
+            if ( volObj->uuid == vol->virStorageVolGetKey() ) {
+                if ( poolObj ) {
+                    *poolObj = it;
+                }
+                return volObj;
+            }
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<StorageVolumeObj> FileSystemStorageDriver::findBackingChild(const std::shared_ptr<StorageVolumeObj>& volObj) const {
+    // 后备镜像可能在另一个存储池中
+    std::vector<std::shared_ptr<StoragePoolObj>> poolList;
+    {
+        SharedLockGuard lock(poolsLock);
+        poolList = pools;
+    }
+    for ( const auto& it : poolList ) {
+        SharedLockGuard lock(it->volumesLock);
+        for ( const auto& other : it->volumes ) {
+            if ( other != volObj && !other->backingStore.empty() && isSameFile(other->backingStore, volObj->path) ) {
+                return other;
+            }
+        }
+    }
     return nullptr;
 }
 
 int FileSystemStorageDriver::storageVolDelete(std::shared_ptr<VirStorageVol> vol, unsigned int flags) {
     if ( flags != 0 ) {
-        LOG_ERROR("Invalid flags for storage pool listing: %u", flags);
-        return {};
+        LOG_ERROR("Invalid flags for storage volume delete: %u", flags);
+        return -1;
+    }
+    if ( !vol ) {
+        LOG_ERROR("Attempt to delete null storage volume");
+        return -1;
     }
-    // TODO
     LOG_DEBUG("Deleting storage volume: %s", vol->virStorageVolGetName().c_str());
+    std::shared_ptr<StoragePoolObj> owner;
+    std::shared_ptr<StorageVolumeObj> target = findVolumeObj(vol, &owner);
+    if ( !target ) {
+        LOG_ERROR("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
+        return -1;
+    }
+    // 仍被其他卷用作后备镜像的卷不能删除，否则这些卷的数据会丢失
+    // 检查和删除文件之间不能插入以它为源的链接克隆
+    std::lock_guard<std::mutex> backingGuard(backingLock);
+    std::shared_ptr<StorageVolumeObj> child = findBackingChild(target);
+    if ( child ) {
+        LOG_ERROR("Cannot delete storage volume %s, it is the backing store of %s", target->path.c_str(), child->path.c_str());
+        return -1;
+    }
+    std::lock_guard<RWLock> lock(owner->volumesLock);
+    auto it = std::find(owner->volumes.begin(), owner->volumes.end(), target);
+    if ( it == owner->volumes.end() ) {
+        LOG_ERROR("Storage volume %s was deleted concurrently", target->path.c_str());
+        return -1;
+    }
+    if ( unlink(target->path.c_str()) != 0 && errno != ENOENT ) {
+        LOG_ERROR("Failed to delete storage volume %s: %s", target->path.c_str(), strerror(errno));
+        return -1;
+    }
+    owner->volumes.erase(it);
+    unindexVolumeObj(target);
+    LOG_INFO("Storage volume deleted: %s", target->path.c_str());
     return 0;
 }
 
-int FileSystemStorageDriver::storageVolResize(std::shared_ptr<VirStorageVol> vol, unsigned long long capacity, unsigned int flags) {
+static void recordTransfer(const char* direction, const std::string& path, const FileStreamResult& result) {
+    std::string labels = "direction=\"" + std::string(direction) + "\"";
+    Metrics::Instance()->counter("tinyvirt_storage_transfer_bytes_total",
+        "Bytes of data transferred by volume upload and download, holes excluded", labels)->inc(result.dataBytes);
+    LOG_INFO("Storage volume %s %s: %llu bytes (%llu bytes of data) in %.3f s (%.1f MiB/s, %s)", path.c_str(),
+        direction, result.bytes, result.dataBytes, result.seconds, result.throughput() / (1024 * 1024),
+        result.zeroCopy ? "zero-copy" : "buffered");
+}
+
+int FileSystemStorageDriver::storageVolDownload(std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+    unsigned long long length, unsigned int flags) {
+    if ( flags & ~VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM ) {
+        LOG_ERROR("Invalid flags for storage volume download: %u", flags);
+        return -1;
+    }
+    std::shared_ptr<StorageVolumeObj> volObj = vol ? findVolumeObj(vol) : nullptr;
+    if ( !volObj ) {
+        LOG_ERROR("Storage volume not found for download");
+        return -1;
+    }
+    int volFd = open(volObj->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( volFd < 0 ) {
+        LOG_ERROR("Failed to open storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if ( fstat(volFd, &st) != 0 ) {
+        LOG_ERROR("Failed to stat storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+        close(volFd);
+        return -1;
+    }
+    unsigned long long size = static_cast< unsigned long long >(st.st_size);
+    if ( offset > size || length > size - offset ) {
+        LOG_ERROR("Download range %llu+%llu is outside storage volume %s of %llu bytes", offset, length, volObj->path.c_str(), size);
+        close(volFd);
+        return -1;
+    }
+    if ( length == 0 ) {
+        length = size - offset;
+    }
+    FileStreamResult result;
+    int ret = fileStreamSend(volFd, fd, offset, length, flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, result);
+    if ( ret < 0 ) {
+        LOG_ERROR("Failed to download storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+    }
+    close(volFd);
+    if ( ret < 0 ) {
+        return -1;
+    }
+    recordTransfer("download", volObj->path, result);
+    return 0;
+}
+
+int FileSystemStorageDriver::storageVolUpload(std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+    unsigned long long length, unsigned int flags) {
+    if ( flags & ~VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM ) {
+        LOG_ERROR("Invalid flags for storage volume upload: %u", flags);
+        return -1;
+    }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = vol ? findVolumeObj(vol, &poolObj) : nullptr;
+    if ( !volObj ) {
+        LOG_ERROR("Storage volume not found for upload");
+        return -1;
+    }
+    // 改写后备镜像会破坏以它为基础的所有卷
+    std::shared_ptr<StorageVolumeObj> child = findBackingChild(volObj);
+    if ( child ) {
+        LOG_ERROR("Cannot upload to storage volume %s, it is the backing store of %s", volObj->path.c_str(), child->path.c_str());
+        return -1;
+    }
+    int volFd = open(volObj->path.c_str(), O_WRONLY | O_CLOEXEC);
+    if ( volFd < 0 ) {
+        LOG_ERROR("Failed to open storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+        return -1;
+    }
+    // 与libvirt一致，上传不能超出卷的容量，length为0时写到容量为止，输入更多时失败
+    struct stat st;
+    unsigned long long capacity;
+    {
+        SharedLockGuard lock(poolObj->volumesLock);
+        capacity = volObj->capacity;
+    }
+    if ( fstat(volFd, &st) != 0 ) {
+        LOG_ERROR("Failed to stat storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+        close(volFd);
+        return -1;
+    }
+    // qcow2卷的文件中还有元数据，可能比虚拟容量略大
+    capacity = std::max(capacity, static_cast< unsigned long long >(st.st_size));
+    if ( offset >= capacity || length > capacity - offset ) {
+        LOG_ERROR("Upload of %llu bytes at offset %llu exceeds capacity %llu of storage volume %s",
+            length, offset, capacity, volObj->path.c_str());
+        close(volFd);
+        return -1;
+    }
+    if ( length == 0 ) {
+        length = capacity - offset;
+    }
+    FileStreamResult result;
+    int ret = fileStreamReceive(fd, volFd, offset, length, flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, result);
+    // 上传完成即认为镜像已可用，数据需要落盘
+    if ( ret == 0 && fdatasync(volFd) != 0 ) {
+        ret = -1;
+    }
+    if ( ret < 0 ) {
+        LOG_ERROR("Failed to upload storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+    }
+    close(volFd);
+    // 卷记录的格式保持不变，向raw卷上传qcow2镜像后仍按raw使用；只更新占用空间，qcow2卷同时重新读取虚拟容量和后备镜像
+    {
+        std::lock_guard<RWLock> lock(poolObj->volumesLock);
+        probeVolumeObj(*volObj);
+    }
+    if ( ret < 0 ) {
+        return -1;
+    }
+    recordTransfer("upload", volObj->path, result);
+    return 0;
+}
+
+int FileSystemStorageDriver::storageVolFlatten(std::shared_ptr<VirStorageVol> vol, unsigned int flags) {
     if ( flags != 0 ) {
-        LOG_ERROR("Invalid flags for storage pool listing: %u", flags);
-        return {};
+        LOG_ERROR("Invalid flags for storage volume flatten: %u", flags);
+        return -1;
+    }
+    if ( !vol ) {
+        LOG_ERROR("Attempt to flatten null storage volume");
+        return -1;
+    }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = findVolumeObj(vol, &poolObj);
+    if ( !volObj ) {
+        LOG_ERROR("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
+        return -1;
+    }
+    std::string path = volObj->path;
+    std::string format;
+    {
+        SharedLockGuard lock(poolObj->volumesLock);
+        format = volObj->format;
+    }
+    std::vector<StorageImageInfo> chain;
+    try {
+        chain = storageImageGetChain(path, format);
+        if ( chain.size() == 1 ) {
+            LOG_INFO("Storage volume %s has no backing store", path.c_str());
+            return 0;
+        }
+        // 卷正被使用时不能替换文件，由QEMU在后台拉取数据，完成后QEMU自己改写镜像头，之后重新读取
+        // 重新读取只在调用进程仍在运行、收到任务完成事件时发生，其他进程在下一次刷新存储池时看到新的后备链
+        std::weak_ptr<StoragePoolObj> weakPool = poolObj;
+        std::weak_ptr<StorageVolumeObj> weakVol = volObj;
+        auto onFinished = [weakPool, weakVol]() {
+            std::shared_ptr<StoragePoolObj> poolObj = weakPool.lock();
+            std::shared_ptr<StorageVolumeObj> volObj = weakVol.lock();
+            if ( !poolObj || !volObj ) {
+                return;
+            }
+            std::lock_guard<RWLock> lock(poolObj->volumesLock);
+            probeVolumeObj(*volObj);
+            LOG_INFO("Storage volume %s reloaded after online flatten, backing store: %s", volObj->path.c_str(),
+                volObj->backingStore.empty() ? "none" : volObj->backingStore.c_str());
+        };
+        if ( onlineFlattenHandler && onlineFlattenHandler(path, onFinished) ) {
+            LOG_INFO("Storage volume %s is being flattened by its running domain", path.c_str());
+            return 0;
+        }
+    }
+    catch ( const std::exception& e ) {
+        LOG_ERROR("Failed to flatten storage volume %s: %s", path.c_str(), e.what());
+        return -1;
+    }
+
+    // 先写入同一目录下的临时文件，完成并落盘后再替换原文件，中途失败时原卷保持不变
+    auto start = std::chrono::steady_clock::now();
+    size_t slash = path.find_last_of('/');
+    std::string tmpPath = path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".flatten";
+    struct stat st;
+    if ( stat(path.c_str(), &st) != 0 ) {
+        LOG_ERROR("Failed to stat storage volume %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    int fd = open(tmpPath.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, st.st_mode & 07777);
+    if ( fd < 0 ) {
+        LOG_ERROR("Failed to create %s: %s", tmpPath.c_str(), strerror(errno));
+        return -1;
+    }
+    try {
+        qcow2Flatten(chain, fd, static_cast< unsigned int >(chain.front().clusterSize));
+        if ( fsync(fd) != 0 ) {
+            throw std::runtime_error(std::string("fsync failed: ") + strerror(errno));
+        }
+    }
+    catch ( const std::exception& e ) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        LOG_ERROR("Failed to flatten storage volume %s: %s", path.c_str(), e.what());
+        return -1;
+    }
+    close(fd);
+    if ( rename(tmpPath.c_str(), path.c_str()) != 0 ) {
+        LOG_ERROR("Failed to replace storage volume %s: %s", path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+    // 替换后的文件是新的inode
+    std::string canonicalPath;
+    unsigned long long dev;
+    unsigned long long ino;
+    resolveVolumeFileId(path, canonicalPath, dev, ino);
+    size_t allocation;
+    {
+        std::lock_guard<RWLock> lock(poolObj->volumesLock);
+        probeVolumeObj(*volObj);
+        allocation = volObj->allocation;
+        unindexVolumeObj(volObj);
+        volObj->canonicalPath = canonicalPath;
+        volObj->dev = dev;
+        volObj->ino = ino;
+        indexVolumeObj(volObj);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Storage volume %s flattened offline from a chain of %zu images in %.3f s, %zu bytes allocated",
+        path.c_str(), chain.size(), seconds, allocation);
+    return 0;
+}
+
+int FileSystemStorageDriver::storageVolResize(std::shared_ptr<VirStorageVol> vol, unsigned long long capacity, unsigned int flags) {
+    if ( flags & ~(VIR_STORAGE_VOL_RESIZE_ALLOCATE | VIR_STORAGE_VOL_RESIZE_DELTA | VIR_STORAGE_VOL_RESIZE_SHRINK) ) {
+        LOG_ERROR("Invalid flags for storage volume resize: %u", flags);
+        return -1;
+    }
+    if ( !vol ) {
+        LOG_ERROR("Attempt to resize null storage volume");
+        return -1;
+    }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = findVolumeObj(vol, &poolObj);
+    if ( !volObj ) {
+        LOG_ERROR("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
+        return -1;
+    }
+    std::string path = volObj->path;
+    std::string format;
+    {
+        SharedLockGuard lock(poolObj->volumesLock);
+        format = volObj->format;
+    }
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if ( fd < 0 ) {
+        LOG_ERROR("Failed to open storage volume %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if ( fstat(fd, &st) != 0 ) {
+        LOG_ERROR("Failed to stat storage volume %s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    unsigned long long oldCapacity = static_cast< unsigned long long >(st.st_size);
+    // qcow2的容量记录在头中，离线时不能通过截断文件修改，只能由运行中的QEMU调整
+    // 格式以卷记录的为准，raw卷的内容由客户机控制，不能按头部猜测格式
+    bool qcow2 = format == "qcow2";
+    if ( qcow2 ) {
+        try {
+            Qcow2Header header;
+            if ( !qcow2ReadHeader(fd, header) ) {
+                LOG_ERROR("Storage volume %s is recorded as qcow2 but has no qcow2 header", path.c_str());
+                close(fd);
+                return -1;
+            }
+            oldCapacity = header.virtualSize;
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Invalid qcow2 header in storage volume %s: %s", path.c_str(), e.what());
+            close(fd);
+            return -1;
+        }
+    }
+    if ( qcow2 && (flags & VIR_STORAGE_VOL_RESIZE_ALLOCATE) ) {
+        LOG_ERROR("Preallocation is not supported when resizing qcow2 volume %s", path.c_str());
+        close(fd);
+        return -1;
+    }
+    unsigned long long newCapacity = capacity;
+    if ( flags & VIR_STORAGE_VOL_RESIZE_DELTA ) {
+        if ( (flags & VIR_STORAGE_VOL_RESIZE_SHRINK) && capacity > oldCapacity ) {
+            LOG_ERROR("Cannot shrink storage volume %s by %llu bytes, it has only %llu", path.c_str(), capacity, oldCapacity);
+            close(fd);
+            return -1;
+        }
+        newCapacity = (flags & VIR_STORAGE_VOL_RESIZE_SHRINK) ? oldCapacity - capacity : oldCapacity + capacity;
+    }
+    if ( newCapacity < oldCapacity && !(flags & VIR_STORAGE_VOL_RESIZE_SHRINK) ) {
+        LOG_ERROR("Shrinking storage volume %s requires VIR_STORAGE_VOL_RESIZE_SHRINK", path.c_str());
+        close(fd);
+        return -1;
+    }
+    if ( newCapacity > oldCapacity && (flags & VIR_STORAGE_VOL_RESIZE_SHRINK) ) {
+        LOG_ERROR("Cannot grow storage volume %s with VIR_STORAGE_VOL_RESIZE_SHRINK", path.c_str());
+        close(fd);
+        return -1;
+    }
+    // 缩小后备镜像会截掉以它为基础的卷仍在引用的数据，扩大则不影响它们
+    if ( newCapacity < oldCapacity ) {
+        std::shared_ptr<StorageVolumeObj> child = findBackingChild(volObj);
+        if ( child ) {
+            LOG_ERROR("Cannot shrink storage volume %s, it is the backing store of %s", path.c_str(), child->path.c_str());
+            close(fd);
+            return -1;
+        }
     }
-    // TODO
-    LOG_DEBUG("Resizing storage volume: %s to %llu", vol->virStorageVolGetName().c_str(), capacity);
+
+    int ret = 0;
+    // 在文件末尾之外预先分配，文件大小不变，之后无论由QEMU还是ftruncate扩大都直接使用这些空间
+    if ( (flags & VIR_STORAGE_VOL_RESIZE_ALLOCATE) && newCapacity > oldCapacity ) {
+        ret = fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast< off_t >(oldCapacity), static_cast< off_t >(newCapacity - oldCapacity));
+        if ( ret != 0 ) {
+            LOG_ERROR("Failed to allocate %llu bytes for storage volume %s: %s", newCapacity - oldCapacity, path.c_str(), strerror(errno));
+        }
+    }
+    bool online = false;
+    if ( ret == 0 && newCapacity != oldCapacity ) {
+        try {
+            online = onlineResizeHandler && onlineResizeHandler(path, oldCapacity, newCapacity);
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Online resize of storage volume %s failed: %s", path.c_str(), e.what());
+            ret = -1;
+        }
+        if ( ret == 0 && !online && qcow2 ) {
+            LOG_ERROR("Offline resize of qcow2 volume %s is not supported", path.c_str());
+            ret = -1;
+        }
+        else if ( ret == 0 && !online && ftruncate(fd, static_cast< off_t >(newCapacity)) != 0 ) {
+            LOG_ERROR("Failed to resize storage volume %s: %s", path.c_str(), strerror(errno));
+            ret = -1;
+        }
+    }
+    if ( ret == 0 && fstat(fd, &st) != 0 ) {
+        st.st_blocks = 0;
+    }
+    close(fd);
+    if ( ret != 0 ) {
+        return -1;
+    }
+
+    {
+        std::lock_guard<RWLock> lock(poolObj->volumesLock);
+        volObj->capacity = static_cast< size_t >(newCapacity);
+        volObj->allocation = static_cast< size_t >(st.st_blocks) * 512;
+    }
+    LOG_INFO("Storage volume %s resized %s from %llu to %llu bytes", vol->virStorageVolGetName().c_str(),
+        online ? "online" : "offline", oldCapacity, newCapacity);
     return 0;
 }
 
 int FileSystemStorageDriver::storageVolWipe(std::shared_ptr<VirStorageVol> vol, unsigned int flags) {
+    return storageVolWipePattern(vol, VIR_STORAGE_VOL_WIPE_ALG_ZERO, flags);
+}
+
+int FileSystemStorageDriver::storageVolWipePattern(std::shared_ptr<VirStorageVol> vol, unsigned int algorithm, unsigned int flags) {
     if ( flags != 0 ) {
-        LOG_ERROR("Invalid flags for storage pool listing: %u", flags);
-        return {};
+        LOG_ERROR("Invalid flags for storage volume wipe: %u", flags);
+        return -1;
+    }
+    if ( !vol ) {
+        LOG_ERROR("Attempt to wipe null storage volume");
+        return -1;
+    }
+    // 擦除后备镜像会破坏以它为基础的所有卷
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = findVolumeObj(vol, &poolObj);
+    std::shared_ptr<StorageVolumeObj> child = volObj ? findBackingChild(volObj) : nullptr;
+    if ( child ) {
+        LOG_ERROR("Cannot wipe storage volume %s, it is the backing store of %s", volObj->path.c_str(), child->path.c_str());
+        return -1;
+    }
+    auto configManager = ConfigManager::Instance();
+    FileWipeOptions options;
+    switch ( algorithm ) {
+    case VIR_STORAGE_VOL_WIPE_ALG_ZERO:
+        break;
+    case VIR_STORAGE_VOL_WIPE_ALG_RANDOM:
+        options.random = true;
+        break;
+    case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
+        options.discard = true;
+        break;
+    default:
+        LOG_ERROR("Unsupported wipe algorithm %u for volume %s", algorithm, vol->virStorageVolGetName().c_str());
+        return -1;
+    }
+    options.threads = static_cast< unsigned int >(std::max(configManager->getIntValue("storage.wipe_threads", 2), 1));
+    options.bandwidth = static_cast< unsigned long long >(std::max(configManager->getIntValue("storage.wipe_bandwidth_mb", 256), 0)) << 20;
+    std::string name = vol->virStorageVolGetName();
+    int lastPercent = -1;
+    options.progress = [&name, &lastPercent](unsigned long long done, unsigned long long total) {
+        int percent = total > 0 ? static_cast< int >(done * 100 / total) : 100;
+        // 每10%记录一次，避免长时间擦除刷屏
+        if ( percent / 10 != lastPercent / 10 ) {
+            LOG_INFO("Wiping storage volume %s: %d%% (%llu/%llu bytes)", name.c_str(), percent, done, total);
+            lastPercent = percent;
+        }
+    };
+
+    std::string path = vol->virStorageVolGetPath();
+    FileWipeResult result;
+    if ( fileWipe(path, options, result) < 0 ) {
+        LOG_ERROR("Failed to wipe storage volume %s (%s): %s", name.c_str(), path.c_str(), strerror(errno));
+        return -1;
+    }
+    Metrics::Instance()->counter("tinyvirt_storage_wipe_bytes_total", "Bytes wiped from storage volumes",
+        "method=\"" + std::string(fileWipeMethodName(result.method)) + "\"")->inc(result.bytes);
+    LOG_INFO("Storage volume %s wiped using %s: %llu bytes in %.3f s", name.c_str(),
+        fileWipeMethodName(result.method), result.bytes, result.seconds);
+
+    // 打洞之后实际占用会变小
+    struct stat st;
+    if ( volObj && stat(path.c_str(), &st) == 0 ) {
+        std::lock_guard<RWLock> lock(poolObj->volumesLock);
+        volObj->allocation = static_cast< size_t >(st.st_blocks) * 512;
     }
-    // TODO
-    LOG_DEBUG("Wiping storage volume: %s", vol->virStorageVolGetName().c_str());
     return 0;
 }
 
@@ -471,13 +1456,18 @@ unsigned long long FileSystemStorageDriver::storageVolGetAllocation(std::shared_
         LOG_ERROR("Attempt to get allocation of null storage volume");
         return 0;
     }
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    for ( auto it : volumesMap ) {
-        for ( auto volObj : it.second ) {
-            if ( volObj->uuid == vol->virStorageVolGetKey() ) {
-                return volObj->allocation;
-            }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = findVolumeObj(vol, &poolObj);
+    if ( volObj ) {
+        // 卷可能正被虚拟机写入，实际占用每次从st_blocks读取，读取失败时返回上次记录的值
+        struct stat st;
+        if ( stat(volObj->path.c_str(), &st) == 0 ) {
+            std::lock_guard<RWLock> lock(poolObj->volumesLock);
+            volObj->allocation = static_cast< size_t >(st.st_blocks) * 512;
+            return volObj->allocation;
         }
+        SharedLockGuard lock(poolObj->volumesLock);
+        return volObj->allocation;
     }
     LOG_WARN("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
     return 0;
@@ -488,13 +1478,11 @@ unsigned long long FileSystemStorageDriver::storageVolGetCapacity(std::shared_pt
         LOG_ERROR("Attempt to get capacity of null storage volume");
         return 0;
     }
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    for ( auto it : volumesMap ) {
-        for ( auto volObj : it.second ) {
-            if ( volObj->uuid == vol->virStorageVolGetKey() ) {
-                return volObj->capacity;
-            }
-        }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = findVolumeObj(vol, &poolObj);
+    if ( volObj ) {
+        SharedLockGuard lock(poolObj->volumesLock);
+        return volObj->capacity;
     }
     LOG_WARN("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
     return 0;
@@ -505,13 +1493,11 @@ int FileSystemStorageDriver::storageVolGetType(std::shared_ptr<VirStorageVol> vo
         LOG_ERROR("Attempt to get type of null storage volume");
         return -1;
     }
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    for ( auto it : volumesMap ) {
-        for ( auto volObj : it.second ) {
-            if ( volObj->uuid == vol->virStorageVolGetKey() ) {
-                return volObj->type;
-            }
-        }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> volObj = findVolumeObj(vol, &poolObj);
+    if ( volObj ) {
+        SharedLockGuard lock(poolObj->volumesLock);
+        return volObj->type;
     }
     LOG_WARN("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
     return -1;
@@ -526,16 +1512,69 @@ std::string FileSystemStorageDriver::storageVolGetXMLDesc(std::shared_ptr<VirSto
         LOG_ERROR("Attempt to get XML description of null storage volume");
         return "";
     }
-    std::lock_guard<std::mutex> lock(volumesMutex);
-    for ( auto it : volumesMap ) {
-        for ( auto volObj : it.second ) {
-            if ( volObj->uuid == vol->virStorageVolGetKey() ) {
-                return "volObj->name is returned";  // TODO: 返回卷的 XML 描述
-            }
-        }
+    std::shared_ptr<StoragePoolObj> poolObj;
+    std::shared_ptr<StorageVolumeObj> found = findVolumeObj(vol, &poolObj);
+    if ( !found ) {
+        LOG_WARN("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
+        return "";
     }
-    LOG_WARN("Storage volume not found: %s", vol->virStorageVolGetName().c_str());
-    return "";
+    std::string format;
+    {
+        SharedLockGuard lock(poolObj->volumesLock);
+        format = found->format;
+    }
+
+    // 容量和后备链每次都从镜像头中读取，反映卷被QEMU或外部工具修改后的状态
+    std::vector<StorageImageInfo> chain;
+    try {
+        chain = storageImageGetChain(found->path, format);
+    }
+    catch ( const std::exception& e ) {
+        LOG_ERROR("Failed to read image chain of storage volume %s: %s", found->name.c_str(), e.what());
+        return "";
+    }
+
+    tinyxml2::XMLDocument doc;
+    tinyxml2::XMLElement* volElem = doc.NewElement("volume");
+    volElem->SetAttribute("type", "file");
+    doc.InsertEndChild(volElem);
+    auto addText = [&doc](tinyxml2::XMLElement* parent, const char* name, const std::string& text) {
+        tinyxml2::XMLElement* elem = doc.NewElement(name);
+        elem->SetText(text.c_str());
+        parent->InsertEndChild(elem);
+        return elem;
+    };
+    auto addFormat = [&doc](tinyxml2::XMLElement* parent, const std::string& format) {
+        tinyxml2::XMLElement* elem = doc.NewElement("format");
+        elem->SetAttribute("type", format.c_str());
+        parent->InsertEndChild(elem);
+    };
+    const StorageImageInfo& image = chain.front();
+    addText(volElem, "name", found->name);
+    addText(volElem, "key", found->uuid);
+    addText(volElem, "capacity", std::to_string(image.capacity))->SetAttribute("unit", "bytes");
+    addText(volElem, "allocation", std::to_string(image.allocation))->SetAttribute("unit", "bytes");
+    tinyxml2::XMLElement* targetElem = doc.NewElement("target");
+    volElem->InsertEndChild(targetElem);
+    addText(targetElem, "path", image.path);
+    addFormat(targetElem, image.format);
+    if ( image.clusterSize != 0 ) {
+        addText(targetElem, "clusterSize", std::to_string(image.clusterSize))->SetAttribute("unit", "B");
+    }
+    // 后备链中的每一层嵌套在上一层的backingStore中
+    tinyxml2::XMLElement* parent = volElem;
+    for ( size_t i = 1; i < chain.size(); i++ ) {
+        tinyxml2::XMLElement* backingElem = doc.NewElement("backingStore");
+        parent->InsertEndChild(backingElem);
+        addText(backingElem, "path", chain[i].path);
+        addFormat(backingElem, chain[i].format);
+        addText(backingElem, "capacity", std::to_string(chain[i].capacity))->SetAttribute("unit", "bytes");
+        parent = backingElem;
+    }
+
+    tinyxml2::XMLPrinter printer;
+    doc.Print(&printer);
+    return printer.CStr();
 }
 
 // TODO: 实现存储池的 XML 描述解析和创建
@@ -719,26 +1758,30 @@ void FileSystemStorageDriver::loadPoolConfigs() {
     }
     closedir(dir);
     LOG_INFO("Loaded %zu storage pool configurations", pools.size());
-    // 遍历存储池对象，查看是否存在对应的卷
+    // 扫描每个存储池目录，发现其中已有的卷
+    size_t volumeCount = 0;
     for ( const auto& poolObj : pools ) {
-        std::string poolPath = poolObj->path;
-        LOG_INFO("Loading storage volumes from pool: %s", poolPath.c_str());
-        DIR* volDir = opendir(poolPath.c_str());
-        if ( volDir ) {
-            struct dirent* volEntry;
-            while ( (volEntry = readdir(volDir)) != nullptr ) {
-                if ( volEntry->d_type == DT_REG ) { // 仅处理常规文件
-                    std::string volName = volEntry->d_name;
-                    std::string volPath = poolPath + "/" + volName;
-                    auto volObj = std::make_shared<StorageVolumeObj>();
-                    volObj->name = volName;
-                    volObj->uuid = generateUUID();
-                    volObj->path = volPath;
-                    volumesMap[poolObj].push_back(volObj);
-                }
-            }
-            closedir(volDir);
+        LOG_INFO("Loading storage volumes from pool: %s", poolObj->path.c_str());
+        if ( refreshPoolObj(poolObj) == 0 ) {
+            volumeCount += poolObj->volumes.size();
         }
     }
-    LOG_INFO("Loaded %zu storage volumes", volumesMap.size());
-}
\ No newline at end of file
+    LOG_INFO("Loaded %zu storage volumes", volumeCount);
+}
+
+void FileSystemStorageDriver::addVolumeObj(std::shared_ptr<VirStoragePool> pool, std::shared_ptr<StorageVolumeObj> volObj) {
+    std::shared_ptr<StoragePoolObj> poolObj = findPoolObj(pool);
+    if ( !poolObj ) {
+        LOG_WARN("Storage pool not found: %s", pool->virStoragePoolGetName().c_str());
+        return;
+    }
+    // 记录格式后，之后的刷新和重新加载都以它为准
+    if ( storageRecordFormat(volObj->path, volObj->format) < 0 ) {
+        LOG_WARN("Failed to record format of storage volume %s: %s", volObj->path.c_str(), strerror(errno));
+    }
+    // 新卷还没有登记，其他线程看不到，可以在加锁之前直接填写
+    resolveVolumeFileId(volObj->path, volObj->canonicalPath, volObj->dev, volObj->ino);
+    std::lock_guard<RWLock> lock(poolObj->volumesLock);
+    poolObj->volumes.push_back(volObj);
+    indexVolumeObj(volObj);
+}
@@ -3,10 +3,25 @@
 
 #include "../conf/storage_conf.h"
 #include "../driver-storage.h"
+#include "../util/rwlock.h"
 #include <unordered_map>
 #include <mutex>
 #include <sys/stat.h>
 
+// 按设备号和inode标识一个文件，不受符号链接、硬链接和绑定挂载的影响
+struct StorageFileId {
+    unsigned long long dev;
+    unsigned long long ino;
+
+    bool operator==(const StorageFileId& other) const { return dev == other.dev && ino == other.ino; }
+};
+
+struct StorageFileIdHash {
+    size_t operator()(const StorageFileId& id) const {
+        return std::hash<unsigned long long>()(id.ino * 0x9e3779b97f4a7c15ULL ^ id.dev);
+    }
+};
+
 class FileSystemStorageDriver : public StorageDriver {
 public:
     FileSystemStorageDriver();
@@ -27,6 +42,8 @@ public:
     int storagePoolGetState(std::shared_ptr<VirStoragePool> pool) const override;
     int storagePoolGetType(std::shared_ptr<VirStoragePool> pool) const override;
     std::string storagePoolGetPath(std::shared_ptr<VirStoragePool> pool) const override;
+    int storagePoolGetInfo(std::shared_ptr<VirStoragePool> pool, virStoragePoolInfo& info) const override;
+    int storagePoolRefresh(std::shared_ptr<VirStoragePool> pool, unsigned int flags = 0) override;
 
     // 存储卷相关操作
     std::vector<std::shared_ptr<VirStorageVol>> storagePoolListAllVolumes(std::shared_ptr<VirStoragePool> pool, unsigned int flags = 0) const override;
@@ -37,6 +54,12 @@ public:
     std::shared_ptr<VirStorageVol> storageVolCreateXMLFrom(std::shared_ptr<VirStoragePool> pool, const std::string& xml, std::shared_ptr<VirStorageVol> srcVol, unsigned int flags = 0) override;
     int storageVolDelete(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) override;
     int storageVolWipe(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) override;
+    int storageVolWipePattern(std::shared_ptr<VirStorageVol> vol, unsigned int algorithm, unsigned int flags = 0) override;
+    int storageVolFlatten(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) override;
+    int storageVolDownload(std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+        unsigned long long length, unsigned int flags = 0) override;
+    int storageVolUpload(std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+        unsigned long long length, unsigned int flags = 0) override;
     int storageVolResize(std::shared_ptr<VirStorageVol> vol, unsigned long long capacity, unsigned int flags = 0) override;
     
     unsigned long long storageVolGetAllocation(std::shared_ptr<VirStorageVol> vol) const override;
@@ -44,13 +67,19 @@ public:
     int storageVolGetType(std::shared_ptr<VirStorageVol> vol) const override;
     std::string storageVolGetXMLDesc(std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0) const override;
 private:
-    // 存储池管理
-    mutable std::mutex poolsMutex;
+    // 锁的顺序：backingLock -> poolsLock -> StoragePoolObj::volumesLock -> indexLock，同一时刻最多持有一个存储池的锁
+    // 删除卷时检查后备关系到删除文件之间持有backingLock，创建链接克隆时同样持有，避免删掉刚被克隆引用的卷
+    // 只在当前进程内互斥，其他进程创建的克隆在刷新存储池之前看不到
+    std::mutex backingLock;
+    // 存储池管理，pools列表本身由poolsLock保护，每个存储池的卷列表由其自身的volumesLock保护
+    mutable RWLock poolsLock;
     std::vector<std::shared_ptr<StoragePoolObj>> pools; // 存储池列表
 
-    // 存储卷管理
-    mutable std::mutex volumesMutex;
-    std::unordered_map<std::shared_ptr<StoragePoolObj>, std::vector<std::shared_ptr<StorageVolumeObj>>> volumesMap; // 存储卷映射
+    // 按路径查找卷的索引，与存储池的卷列表同时更新，由indexLock保护
+    // 键为卷的原始路径和规范路径，虚拟机磁盘路径经过符号链接时按设备号和inode查找
+    mutable RWLock indexLock;
+    std::unordered_map<std::string, std::shared_ptr<StorageVolumeObj>> volumesByPath;
+    std::unordered_map<StorageFileId, std::shared_ptr<StorageVolumeObj>, StorageFileIdHash> volumesByFileId;
 
     // 配置目录
     std::string configDir;
@@ -59,7 +88,28 @@ private:
     // 辅助函数
     std::shared_ptr<StoragePoolObj> parseAndCreateStoragePoolObj(const std::string& xmlDesc);
     std::shared_ptr<VirStorageVol> parseAndCreateStorageVolume(const std::string& xmlDesc, std::shared_ptr<VirStoragePool> pool);
+    // 把新建的卷登记到所属存储池，之后才能按名称或路径查到
+    void addVolumeObj(std::shared_ptr<VirStoragePool> pool, std::shared_ptr<StorageVolumeObj> volObj);
+    std::shared_ptr<StoragePoolObj> findPoolObj(std::shared_ptr<VirStoragePool> pool) const;
+    // 查找卷对象，poolObj非空时同时返回其所属的存储池，读写卷对象的字段前需持有该存储池的volumesLock
+    std::shared_ptr<StorageVolumeObj> findVolumeObj(std::shared_ptr<VirStorageVol> vol,
+        std::shared_ptr<StoragePoolObj>* poolObj = nullptr) const;
+    // 在路径索引中登记或移除卷，卷文件被替换(inode改变)后需要先移除再登记
+    // 登记使用卷对象中已填写的规范路径、设备号和inode，调用者在加锁之前解析好，锁内不访问文件系统
+    // 调用者需持有卷所属存储池的volumesLock写锁，函数内部获取indexLock
+    void indexVolumeObj(const std::shared_ptr<StorageVolumeObj>& volObj);
+    void unindexVolumeObj(const std::shared_ptr<StorageVolumeObj>& volObj);
+    // 返回以volObj为后备镜像的一个卷，没有时返回空，依次获取各个存储池的读锁，调用者不能持有任何存储池的锁
+    std::shared_ptr<StorageVolumeObj> findBackingChild(const std::shared_ptr<StorageVolumeObj>& volObj) const;
+    std::shared_ptr<VirStorageVol> createLinkedClone(std::shared_ptr<VirStoragePool> pool, const std::string& name,
+        const std::string& volPath, std::shared_ptr<VirStorageVol> srcVol, unsigned long long capacity);
+
+
+    // 查询接口返回的卷对象需要指回驱动，之后才能通过卷对象查询容量等信息
+    StorageDriver* self() const { return const_cast< FileSystemStorageDriver* >(this); }
 
+    // 扫描存储池目录，与内存中的卷列表合并，已有卷的key保持不变，并由statvfs更新存储池的空间信息
+    int refreshPoolObj(const std::shared_ptr<StoragePoolObj>& poolObj);
 
     bool fileExists(const std::string& path) const;
     bool createDirectoryIfNotExists(const std::string& path) const;
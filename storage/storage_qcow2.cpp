@@ -0,0 +1,543 @@
+#include "storage_qcow2.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define QCOW2_MAGIC 0x514649fbU             // "QFI\xfb"
+#define QCOW2_V2_HEADER_LENGTH 72
+#define QCOW2_V3_HEADER_LENGTH 104
+#define QCOW2_REFCOUNT_ORDER 4              // 16位引用计数
+#define QCOW2_EXT_END 0x00000000U
+#define QCOW2_EXT_BACKING_FORMAT 0xe2792acaU
+#define QCOW2_BACKING_FILE_MAX 1023
+#define QCOW2_MIN_CLUSTER_BITS 9
+#define QCOW2_MAX_CLUSTER_BITS 21
+#define QCOW2_MAX_L1_SIZE 0x2000000ULL
+
+// 头中各字段的偏移，所有整数均为大端
+#define QCOW2_OFF_VERSION 4
+#define QCOW2_OFF_BACKING_FILE_OFFSET 8
+#define QCOW2_OFF_BACKING_FILE_SIZE 16
+#define QCOW2_OFF_CLUSTER_BITS 20
+#define QCOW2_OFF_SIZE 24
+#define QCOW2_OFF_CRYPT_METHOD 32
+#define QCOW2_OFF_L1_SIZE 36
+#define QCOW2_OFF_L1_TABLE_OFFSET 40
+#define QCOW2_OFF_REFCOUNT_TABLE_OFFSET 48
+#define QCOW2_OFF_REFCOUNT_TABLE_CLUSTERS 56
+#define QCOW2_OFF_INCOMPATIBLE_FEATURES 72
+#define QCOW2_OFF_REFCOUNT_ORDER 96
+#define QCOW2_OFF_HEADER_LENGTH 100
+
+static void put32(std::vector<unsigned char>& buf, size_t off, uint32_t value) {
+    value = htobe32(value);
+    memcpy(&buf[off], &value, sizeof(value));
+}
+
+static void put64(std::vector<unsigned char>& buf, size_t off, uint64_t value) {
+    value = htobe64(value);
+    memcpy(&buf[off], &value, sizeof(value));
+}
+
+static uint32_t get32(const unsigned char* buf) {
+    uint32_t value;
+    memcpy(&value, buf, sizeof(value));
+    return be32toh(value);
+}
+
+static uint64_t get64(const unsigned char* buf) {
+    uint64_t value;
+    memcpy(&value, buf, sizeof(value));
+    return be64toh(value);
+}
+
+static void writeAll(int fd, const std::vector<unsigned char>& buf, unsigned long long offset) {
+    size_t done = 0;
+    while ( done < buf.size() ) {
+        ssize_t n = pwrite(fd, buf.data() + done, buf.size() - done, static_cast< off_t >(offset + done));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Failed to write qcow2 metadata: ") + strerror(errno));
+        }
+        done += n;
+    }
+}
+
+static ssize_t readAll(int fd, void* buf, size_t len, unsigned long long offset) {
+    size_t done = 0;
+    while ( done < len ) {
+        ssize_t n = pread(fd, static_cast< char* >(buf) + done, len - done, static_cast< off_t >(offset + done));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        done += n;
+    }
+    return static_cast< ssize_t >(done);
+}
+
+static unsigned int qcow2ClusterBits(unsigned int clusterSize) {
+    unsigned int clusterBits = 0;
+    while ( (1U << clusterBits) < clusterSize ) {
+        clusterBits++;
+    }
+    if ( (1U << clusterBits) != clusterSize || clusterBits < QCOW2_MIN_CLUSTER_BITS || clusterBits > QCOW2_MAX_CLUSTER_BITS ) {
+        throw std::invalid_argument("qcow2 cluster size must be a power of two between 512 and 2M");
+    }
+    return clusterBits;
+}
+
+// 生成簇0中实际使用的部分：v3头、头扩展和后备文件名，其余部分保持为空洞
+static std::vector<unsigned char> qcow2BuildHeader(unsigned int clusterBits, unsigned long long capacity,
+    unsigned long long l1Size, unsigned long long l1Offset, unsigned long long refcountTableOffset,
+    unsigned long long refcountTableClusters, const std::string& backingFile, const std::string& backingFormat) {
+    unsigned long long cs = 1ULL << clusterBits;
+    if ( backingFile.size() > QCOW2_BACKING_FILE_MAX ) {
+        throw std::invalid_argument("qcow2 backing file name is too long");
+    }
+    std::vector<unsigned char> header(cs, 0);
+    put32(header, 0, QCOW2_MAGIC);
+    put32(header, QCOW2_OFF_VERSION, 3);
+    put32(header, QCOW2_OFF_CLUSTER_BITS, clusterBits);
+    put64(header, QCOW2_OFF_SIZE, capacity);
+    put32(header, QCOW2_OFF_L1_SIZE, static_cast< uint32_t >(l1Size));
+    put64(header, QCOW2_OFF_L1_TABLE_OFFSET, l1Offset);
+    put64(header, QCOW2_OFF_REFCOUNT_TABLE_OFFSET, refcountTableOffset);
+    put32(header, QCOW2_OFF_REFCOUNT_TABLE_CLUSTERS, static_cast< uint32_t >(refcountTableClusters));
+    put32(header, QCOW2_OFF_REFCOUNT_ORDER, QCOW2_REFCOUNT_ORDER);
+    put32(header, QCOW2_OFF_HEADER_LENGTH, QCOW2_V3_HEADER_LENGTH);
+
+    // 头扩展紧跟在头之后，每个扩展的数据按8字节对齐，最后是结束标记，后备文件名放在扩展之后
+    size_t off = QCOW2_V3_HEADER_LENGTH;
+    if ( !backingFile.empty() && !backingFormat.empty() ) {
+        if ( off + 16 + backingFormat.size() > cs ) {
+            throw std::invalid_argument("qcow2 backing format does not fit in the header cluster");
+        }
+        put32(header, off, QCOW2_EXT_BACKING_FORMAT);
+        put32(header, off + 4, static_cast< uint32_t >(backingFormat.size()));
+        memcpy(&header[off + 8], backingFormat.data(), backingFormat.size());
+        off += 8 + (backingFormat.size() + 7) / 8 * 8;
+    }
+    put32(header, off, QCOW2_EXT_END);
+    put32(header, off + 4, 0);
+    off += 8;
+    if ( !backingFile.empty() ) {
+        if ( off + backingFile.size() > cs ) {
+            throw std::invalid_argument("qcow2 backing file name does not fit in the header cluster");
+        }
+        put64(header, QCOW2_OFF_BACKING_FILE_OFFSET, off);
+        put32(header, QCOW2_OFF_BACKING_FILE_SIZE, static_cast< uint32_t >(backingFile.size()));
+        memcpy(&header[off], backingFile.data(), backingFile.size());
+        off += backingFile.size();
+    }
+    header.resize(off);
+    return header;
+}
+
+// 写入引用计数表和从blockOffset开始连续的blocks个引用计数块，把[0, usedClusters)中的每个簇的引用计数设为1
+// 预留的块都登记在表中，否则会被qemu-img check报告为泄漏；文件应已扩展到最终大小，只写入非零的部分
+static void qcow2WriteRefcounts(int fd, unsigned long long cs, unsigned long long tableOffset,
+    unsigned long long blockOffset, unsigned long long blocks, unsigned long long usedClusters) {
+    unsigned long long perBlock = cs / 2;
+    std::vector<unsigned char> table(blocks * sizeof(uint64_t), 0);
+    for ( unsigned long long i = 0; i < blocks; i++ ) {
+        put64(table, i * sizeof(uint64_t), blockOffset + i * cs);
+    }
+    writeAll(fd, table, tableOffset);
+    for ( unsigned long long i = 0; i < blocks && i * perBlock < usedClusters; i++ ) {
+        unsigned long long count = std::min(perBlock, usedClusters - i * perBlock);
+        std::vector<unsigned char> block(count * 2, 0);
+        for ( unsigned long long j = 0; j < count; j++ ) {
+            block[j * 2 + 1] = 1;
+        }
+        writeAll(fd, block, blockOffset + i * cs);
+    }
+}
+
+void qcow2Create(int fd, unsigned long long capacity, unsigned int clusterSize,
+    const std::string& backingFile, const std::string& backingFormat) {
+    unsigned int clusterBits = qcow2ClusterBits(clusterSize);
+
+    // 布局与qemu-img一致：簇0为头，簇1为引用计数表，簇2为引用计数块，之后是L1表
+    unsigned long long cs = clusterSize;
+    unsigned long long l2Coverage = cs * (cs / sizeof(uint64_t));     // 一个L2表映射的虚拟大小
+    unsigned long long l1Size = (capacity + l2Coverage - 1) / l2Coverage;
+    if ( l1Size > QCOW2_MAX_L1_SIZE ) {
+        throw std::invalid_argument("qcow2 virtual size is too large for the cluster size");
+    }
+    unsigned long long l1Clusters = (l1Size * sizeof(uint64_t) + cs - 1) / cs;
+    unsigned long long metadataClusters = 3 + l1Clusters;
+    // 一个16位引用计数块可以覆盖cs / 2个簇，元数据必须落在这个范围内
+    if ( metadataClusters > cs / 2 ) {
+        throw std::invalid_argument("qcow2 virtual size is too large for the cluster size");
+    }
+    std::vector<unsigned char> header = qcow2BuildHeader(clusterBits, capacity, l1Size, 3 * cs, cs, 1,
+        backingFile, backingFormat);
+
+    // L1表全为零，直接扩展文件，不写入数据；新镜像只写入几百字节，批量创建时代价很小
+    if ( ftruncate(fd, static_cast< off_t >(metadataClusters * cs)) != 0 ) {
+        throw std::runtime_error(std::string("Failed to extend qcow2 image: ") + strerror(errno));
+    }
+    qcow2WriteRefcounts(fd, cs, cs, 2 * cs, 1, metadataClusters);
+    // 头最后写入，中途失败时文件不会被识别为qcow2
+    writeAll(fd, header, 0);
+}
+
+bool qcow2ReadHeader(int fd, Qcow2Header& header) {
+    unsigned char buf[QCOW2_V3_HEADER_LENGTH];
+    ssize_t n = readAll(fd, buf, sizeof(buf), 0);
+    if ( n < 0 ) {
+        throw std::runtime_error(std::string("Failed to read image header: ") + strerror(errno));
+    }
+    if ( n < QCOW2_V2_HEADER_LENGTH || get32(buf) != QCOW2_MAGIC ) {
+        return false;
+    }
+    header = Qcow2Header();
+    header.version = get32(buf + QCOW2_OFF_VERSION);
+    if ( header.version != 2 && header.version != 3 ) {
+        throw std::runtime_error("Unsupported qcow2 version " + std::to_string(header.version));
+    }
+    header.clusterBits = get32(buf + QCOW2_OFF_CLUSTER_BITS);
+    if ( header.clusterBits < QCOW2_MIN_CLUSTER_BITS || header.clusterBits > QCOW2_MAX_CLUSTER_BITS ) {
+        throw std::runtime_error("Invalid qcow2 cluster size");
+    }
+    header.virtualSize = get64(buf + QCOW2_OFF_SIZE);
+    header.l1Size = get32(buf + QCOW2_OFF_L1_SIZE);
+    header.l1TableOffset = get64(buf + QCOW2_OFF_L1_TABLE_OFFSET);
+    header.cryptMethod = get32(buf + QCOW2_OFF_CRYPT_METHOD);
+
+    unsigned long long clusterSize = 1ULL << header.clusterBits;
+    unsigned long long headerLength = QCOW2_V2_HEADER_LENGTH;
+    if ( header.version == 3 ) {
+        if ( n < QCOW2_V3_HEADER_LENGTH ) {
+            throw std::runtime_error("Truncated qcow2 header");
+        }
+        headerLength = get32(buf + QCOW2_OFF_HEADER_LENGTH);
+        header.incompatibleFeatures = get64(buf + QCOW2_OFF_INCOMPATIBLE_FEATURES);
+    }
+    // 头扩展只能位于第一个簇内
+    unsigned long long off = headerLength;
+    while ( off + 8 <= clusterSize ) {
+        unsigned char ext[8];
+        if ( readAll(fd, ext, sizeof(ext), off) != sizeof(ext) ) {
+            break;
+        }
+        uint32_t type = get32(ext);
+        uint32_t len = get32(ext + 4);
+        if ( type == QCOW2_EXT_END || off + 8 + len > clusterSize ) {
+            break;
+        }
+        if ( type == QCOW2_EXT_BACKING_FORMAT ) {
+            std::string format(len, '\0');
+            if ( readAll(fd, &format[0], len, off + 8) == static_cast< ssize_t >(len) ) {
+                header.backingFormat = format;
+            }
+        }
+        off += 8 + (static_cast< unsigned long long >(len) + 7) / 8 * 8;
+    }
+
+    unsigned long long backingOffset = get64(buf + QCOW2_OFF_BACKING_FILE_OFFSET);
+    uint32_t backingSize = get32(buf + QCOW2_OFF_BACKING_FILE_SIZE);
+    if ( backingOffset != 0 && backingSize > 0 ) {
+        if ( backingSize > QCOW2_BACKING_FILE_MAX ) {
+            throw std::runtime_error("Invalid qcow2 backing file name");
+        }
+        std::string backing(backingSize, '\0');
+        if ( readAll(fd, &backing[0], backingSize, backingOffset) != static_cast< ssize_t >(backingSize) ) {
+            throw std::runtime_error("Failed to read qcow2 backing file name");
+        }
+        header.backingFile = backing;
+    }
+    return true;
+}
+
+std::string storageResolveBackingPath(const std::string& imagePath, const std::string& backingFile) {
+    size_t slash = imagePath.find_last_of('/');
+    if ( backingFile.empty() || backingFile[0] == '/' || slash == std::string::npos ) {
+        return backingFile;
+    }
+    return imagePath.substr(0, slash + 1) + backingFile;
+}
+
+std::vector<StorageImageInfo> storageImageGetChain(const std::string& path, const std::string& format) {
+    std::vector<StorageImageInfo> chain;
+    std::string current = path;
+    std::string currentFormat = format;
+    while ( !current.empty() ) {
+        if ( chain.size() >= STORAGE_BACKING_CHAIN_MAX ) {
+            throw std::runtime_error("Backing chain of " + path + " is too deep");
+        }
+        int fd = open(current.c_str(), O_RDONLY | O_CLOEXEC);
+        if ( fd < 0 ) {
+            throw std::runtime_error("Failed to open image " + current + ": " + strerror(errno));
+        }
+        StorageImageInfo info;
+        info.path = current;
+        struct stat st;
+        Qcow2Header header;
+        bool isQcow2 = false;
+        try {
+            if ( fstat(fd, &st) != 0 ) {
+                throw std::runtime_error("Failed to stat image " + current + ": " + strerror(errno));
+            }
+            // 明确指定为raw时不探测，避免把客户机写入的内容当作qcow2头
+            if ( currentFormat != "raw" ) {
+                isQcow2 = qcow2ReadHeader(fd, header);
+            }
+        }
+        catch ( ... ) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        if ( currentFormat == "qcow2" && !isQcow2 ) {
+            throw std::runtime_error("Image " + current + " is not a qcow2 image");
+        }
+        info.allocation = static_cast< unsigned long long >(st.st_blocks) * 512;
+        if ( isQcow2 ) {
+            info.format = "qcow2";
+            info.capacity = header.virtualSize;
+            info.clusterSize = 1ULL << header.clusterBits;
+            info.backingFormat = header.backingFormat;
+            info.backingFile = storageResolveBackingPath(current, header.backingFile);
+        }
+        else {
+            info.format = "raw";
+            info.capacity = static_cast< unsigned long long >(st.st_size);
+        }
+        for ( const auto& seen : chain ) {
+            if ( seen.path == info.backingFile ) {
+                throw std::runtime_error("Backing chain of " + path + " contains a loop");
+            }
+        }
+        current = info.backingFile;
+        currentFormat = info.backingFormat;
+        chain.push_back(info);
+    }
+    return chain;
+}
+
+#define QCOW2_OFFSET_MASK 0x00fffffffffffe00ULL   // L1、L2表项中的主机偏移
+#define QCOW2_OFLAG_COPIED (1ULL << 63)           // 引用计数为1，可以直接写入
+#define QCOW2_OFLAG_COMPRESSED (1ULL << 62)
+#define QCOW2_OFLAG_ZERO 1ULL                     // v3中该簇读为零
+#define QCOW2_INCOMPAT_DIRTY 1ULL                 // 只表示引用计数可能不准确，不影响读取
+
+// 按后备链读取虚拟磁盘内容，上层未分配的簇从下一层读取，超出某一层容量的部分读为零
+class ImageChainReader {
+public:
+    explicit ImageChainReader(const std::vector<StorageImageInfo>& chain) {
+        for ( const auto& info : chain ) {
+            Layer layer;
+            layer.capacity = info.capacity;
+            layer.fd = open(info.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if ( layer.fd < 0 ) {
+                throw std::runtime_error("Failed to open image " + info.path + ": " + strerror(errno));
+            }
+            layers.push_back(layer);
+            if ( info.format != "qcow2" ) {
+                continue;
+            }
+            Layer& l = layers.back();
+            Qcow2Header header;
+            if ( !qcow2ReadHeader(l.fd, header) ) {
+                throw std::runtime_error("Image " + info.path + " is not a qcow2 image");
+            }
+            if ( header.cryptMethod != 0 || (header.incompatibleFeatures & ~QCOW2_INCOMPAT_DIRTY) != 0 ) {
+                throw std::runtime_error("Image " + info.path + " uses unsupported qcow2 features");
+            }
+            l.qcow2 = true;
+            l.clusterBits = header.clusterBits;
+            l.l1.resize(header.l1Size);
+            size_t len = l.l1.size() * sizeof(uint64_t);
+            if ( readAll(l.fd, l.l1.data(), len, header.l1TableOffset) != static_cast< ssize_t >(len) ) {
+                throw std::runtime_error("Failed to read L1 table of " + info.path);
+            }
+            for ( auto& entry : l.l1 ) {
+                entry = be64toh(entry);
+            }
+        }
+    }
+
+    ~ImageChainReader() {
+        for ( const auto& layer : layers ) {
+            close(layer.fd);
+        }
+    }
+
+    // 从第index层开始读取虚拟磁盘[offset, offset + len)的内容
+    void read(size_t index, unsigned long long offset, unsigned long long len, unsigned char* buf) {
+        if ( index >= layers.size() || offset >= layers[index].capacity ) {
+            memset(buf, 0, len);
+            return;
+        }
+        Layer& layer = layers[index];
+        if ( offset + len > layer.capacity ) {
+            unsigned long long inside = layer.capacity - offset;
+            memset(buf + inside, 0, len - inside);
+            len = inside;
+        }
+        if ( !layer.qcow2 ) {
+            readHost(layer, offset, len, buf);
+            return;
+        }
+        unsigned long long cs = 1ULL << layer.clusterBits;
+        unsigned int l2Bits = layer.clusterBits - 3;
+        while ( len > 0 ) {
+            unsigned long long inCluster = offset & (cs - 1);
+            unsigned long long n = std::min(len, cs - inCluster);
+            uint64_t entry = lookup(layer, offset >> layer.clusterBits, l2Bits);
+            if ( entry & QCOW2_OFLAG_COMPRESSED ) {
+                throw std::runtime_error("Compressed qcow2 clusters are not supported");
+            }
+            if ( entry & QCOW2_OFLAG_ZERO ) {
+                memset(buf, 0, n);
+            }
+            else if ( (entry & QCOW2_OFFSET_MASK) != 0 ) {
+                readHost(layer, (entry & QCOW2_OFFSET_MASK) + inCluster, n, buf);
+            }
+            else {
+                read(index + 1, offset, n, buf);
+            }
+            offset += n;
+            len -= n;
+            buf += n;
+        }
+    }
+
+private:
+    struct Layer {
+        int fd = -1;
+        bool qcow2 = false;
+        unsigned int clusterBits = 0;
+        unsigned long long capacity = 0;
+        std::vector<uint64_t> l1;
+        unsigned long long l2Offset = 0;   // 缓存的L2表的位置，顺序读取时大部分查找命中缓存
+        std::vector<uint64_t> l2;
+    };
+
+    // 返回虚拟簇cluster的L2表项，未分配L2表时返回0
+    uint64_t lookup(Layer& layer, unsigned long long cluster, unsigned int l2Bits) {
+        unsigned long long l1Index = cluster >> l2Bits;
+        if ( l1Index >= layer.l1.size() ) {
+            return 0;
+        }
+        unsigned long long l2Offset = layer.l1[l1Index] & QCOW2_OFFSET_MASK;
+        if ( l2Offset == 0 ) {
+            return 0;
+        }
+        if ( l2Offset != layer.l2Offset ) {
+            layer.l2.assign(1ULL << l2Bits, 0);
+            size_t len = layer.l2.size() * sizeof(uint64_t);
+            if ( readAll(layer.fd, layer.l2.data(), len, l2Offset) != static_cast< ssize_t >(len) ) {
+                layer.l2Offset = 0;
+                throw std::runtime_error("Failed to read qcow2 L2 table");
+            }
+            for ( auto& entry : layer.l2 ) {
+                entry = be64toh(entry);
+            }
+            layer.l2Offset = l2Offset;
+        }
+        return layer.l2[cluster & ((1ULL << l2Bits) - 1)];
+    }
+
+    // 读取主机文件，文件末尾之后读为零
+    void readHost(Layer& layer, unsigned long long offset, unsigned long long len, unsigned char* buf) {
+        ssize_t n = readAll(layer.fd, buf, len, offset);
+        if ( n < 0 ) {
+            throw std::runtime_error(std::string("Failed to read image data: ") + strerror(errno));
+        }
+        memset(buf + n, 0, len - n);
+    }
+
+    std::vector<Layer> layers;
+};
+
+static bool isZeroBuffer(const unsigned char* buf, size_t len) {
+    return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+void qcow2Flatten(const std::vector<StorageImageInfo>& chain, int fd, unsigned int clusterSize) {
+    if ( chain.empty() ) {
+        throw std::invalid_argument("Empty image chain");
+    }
+    unsigned int clusterBits = qcow2ClusterBits(clusterSize);
+    unsigned long long cs = clusterSize;
+    unsigned long long capacity = chain.front().capacity;
+    unsigned long long l2Entries = cs / sizeof(uint64_t);
+    unsigned long long guestClusters = (capacity + cs - 1) / cs;
+    unsigned long long l1Size = (guestClusters + l2Entries - 1) / l2Entries;
+    if ( l1Size > QCOW2_MAX_L1_SIZE ) {
+        throw std::invalid_argument("qcow2 virtual size is too large for the cluster size");
+    }
+    unsigned long long l1Clusters = (l1Size * sizeof(uint64_t) + cs - 1) / cs;
+
+    // 按所有簇都分配的最坏情况预留引用计数块，引用计数表和块本身也要计入
+    unsigned long long tableClusters = 1;
+    unsigned long long blockClusters = 1;
+    for ( ;; ) {
+        unsigned long long total = 1 + tableClusters + blockClusters + l1Clusters + l1Size + guestClusters;
+        unsigned long long blocks = (total + cs / 2 - 1) / (cs / 2);
+        unsigned long long tables = (blocks * sizeof(uint64_t) + cs - 1) / cs;
+        if ( blocks <= blockClusters && tables <= tableClusters ) {
+            break;
+        }
+        blockClusters = std::max(blockClusters, blocks);
+        tableClusters = std::max(tableClusters, tables);
+    }
+    // 簇0为头，之后依次是引用计数表、引用计数块和L1表，数据簇和L2表从元数据之后顺序追加
+    unsigned long long tableOffset = cs;
+    unsigned long long blockOffset = tableOffset + tableClusters * cs;
+    unsigned long long l1Offset = blockOffset + blockClusters * cs;
+    unsigned long long next = l1Offset + l1Clusters * cs;
+
+    ImageChainReader reader(chain);
+    std::vector<unsigned char> cluster(cs);
+    std::vector<unsigned char> l1(l1Size * sizeof(uint64_t), 0);
+    std::vector<unsigned char> l2(cs, 0);
+    for ( unsigned long long i = 0; i < l1Size; i++ ) {
+        bool used = false;
+        std::fill(l2.begin(), l2.end(), 0);
+        for ( unsigned long long j = 0; j < l2Entries; j++ ) {
+            unsigned long long guest = (i * l2Entries + j) * cs;
+            if ( guest >= capacity ) {
+                break;
+            }
+            unsigned long long len = std::min(cs, capacity - guest);
+            reader.read(0, guest, len, cluster.data());
+            if ( isZeroBuffer(cluster.data(), len) ) {
+                continue;
+            }
+            memset(cluster.data() + len, 0, cs - len);
+            writeAll(fd, cluster, next);
+            put64(l2, j * sizeof(uint64_t), next | QCOW2_OFLAG_COPIED);
+            next += cs;
+            used = true;
+        }
+        if ( used ) {
+            writeAll(fd, l2, next);
+            put64(l1, i * sizeof(uint64_t), next | QCOW2_OFLAG_COPIED);
+            next += cs;
+        }
+    }
+
+    if ( ftruncate(fd, static_cast< off_t >(next)) != 0 ) {
+        throw std::runtime_error(std::string("Failed to extend qcow2 image: ") + strerror(errno));
+    }
+    writeAll(fd, l1, l1Offset);
+    qcow2WriteRefcounts(fd, cs, tableOffset, blockOffset, blockClusters, next / cs);
+    writeAll(fd, qcow2BuildHeader(clusterBits, capacity, l1Size, l1Offset, tableOffset, tableClusters, "", ""), 0);
+}
@@ -0,0 +1,52 @@
+#ifndef STORAGE_QCOW2_H
+#define STORAGE_QCOW2_H
+
+#include <string>
+#include <vector>
+
+#define QCOW2_DEFAULT_CLUSTER_SIZE 65536
+#define STORAGE_BACKING_CHAIN_MAX 16    // 后备链的最大深度，超过时认为存在环或配置错误
+
+// qcow2头中与存储管理相关的字段
+struct Qcow2Header {
+    unsigned int version = 0;
+    unsigned long long virtualSize = 0;
+    unsigned int clusterBits = 0;
+    unsigned long long l1TableOffset = 0;
+    unsigned int l1Size = 0;
+    unsigned int cryptMethod = 0;
+    unsigned long long incompatibleFeatures = 0;    // v2中总是0
+    std::string backingFile;        // 头中记录的原始字符串，相对路径以镜像所在目录为基准
+    std::string backingFormat;      // 来自后备格式扩展，没有时为空
+};
+
+// 镜像链中一个镜像的信息，第一个元素为卷本身
+struct StorageImageInfo {
+    std::string path;
+    std::string format;             // raw或qcow2
+    unsigned long long capacity = 0;    // 虚拟大小
+    unsigned long long allocation = 0;  // 宿主机上实际占用
+    unsigned long long clusterSize = 0; // 只对qcow2有效
+    std::string backingFile;        // 已解析为可以直接打开的路径，没有后备镜像时为空
+    std::string backingFormat;
+};
+
+// 在空文件fd中写入qcow2 v3的头、引用计数表、引用计数块和全零的L1表，不分配任何数据簇
+// backingFile非空时记录后备镜像，backingFormat非空时写入后备格式扩展，失败时抛出异常
+void qcow2Create(int fd, unsigned long long capacity, unsigned int clusterSize,
+    const std::string& backingFile, const std::string& backingFormat);
+
+// 读取qcow2头，不是qcow2镜像时返回false，头损坏时抛出异常
+bool qcow2ReadHeader(int fd, Qcow2Header& header);
+
+// 把镜像头中记录的后备文件名解析为可以直接打开的路径，相对路径以镜像所在目录为基准
+std::string storageResolveBackingPath(const std::string& imagePath, const std::string& backingFile);
+
+// 探测path的格式并沿后备链读取每个镜像的信息，format为空时自动探测
+std::vector<StorageImageInfo> storageImageGetChain(const std::string& path, const std::string& format = "");
+
+// 读取chain(由storageImageGetChain得到)合并后的虚拟磁盘内容，写入空文件fd，生成没有后备镜像的qcow2镜像
+// 读到全零的簇不分配，不支持压缩、加密和带外部数据文件的镜像，失败时抛出异常
+void qcow2Flatten(const std::vector<StorageImageInfo>& chain, int fd, unsigned int clusterSize);
+
+#endif // STORAGE_QCOW2_H
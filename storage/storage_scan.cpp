@@ -0,0 +1,158 @@
+#include "storage_scan.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#define SCAN_DIRENT_BUFFER_SIZE (64 * 1024)    // 每次getdents64读取的缓冲区大小，一次可以取回上千个目录项
+#define SCAN_BATCH 64                           // 工作线程每次领取的目录项数
+
+// getdents64返回的目录项，glibc没有导出该结构
+struct LinuxDirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[256];
+};
+
+// statx确认是普通文件后读取镜像头，不是普通文件或已被删除时返回false
+static bool scanEntry(int dirFd, const std::string& dir, const std::string& name, StorageScanEntry& entry) {
+    struct statx stx;
+    if ( statx(dirFd, name.c_str(), AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_INO, &stx) != 0 ) {
+        // 扫描期间被删除的文件直接跳过
+        if ( errno != ENOENT ) {
+            LOG_WARN("Failed to stat %s/%s: %s", dir.c_str(), name.c_str(), strerror(errno));
+        }
+        return false;
+    }
+    if ( !S_ISREG(stx.stx_mode) ) {
+        return false;
+    }
+    entry.name = name;
+    entry.dev = static_cast< unsigned long long >(makedev(stx.stx_dev_major, stx.stx_dev_minor));
+    entry.ino = stx.stx_ino;
+    StorageImageInfo& image = entry.image;
+    image.path = dir + "/" + name;
+    image.format = "raw";
+    image.capacity = stx.stx_size;
+    image.allocation = stx.stx_blocks * 512;
+    entry.size = stx.stx_size;
+
+    int fd = openat(dirFd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if ( fd < 0 ) {
+        LOG_WARN("Failed to open %s: %s", image.path.c_str(), strerror(errno));
+        return true;
+    }
+    char recorded[16];
+    ssize_t len = fgetxattr(fd, STORAGE_FORMAT_XATTR, recorded, sizeof(recorded) - 1);
+    if ( len > 0 ) {
+        recorded[len] = '\0';
+        image.format = recorded;
+        entry.formatRecorded = true;
+    }
+    // 记录为raw的卷不读取镜像头，其中的内容完全由客户机控制
+    if ( image.format == "raw" && entry.formatRecorded ) {
+        close(fd);
+        return true;
+    }
+    try {
+        Qcow2Header header;
+        if ( qcow2ReadHeader(fd, header) ) {
+            image.format = "qcow2";
+            image.capacity = header.virtualSize;
+            image.clusterSize = 1ULL << header.clusterBits;
+            image.backingFile = storageResolveBackingPath(image.path, header.backingFile);
+            image.backingFormat = header.backingFormat;
+        }
+    }
+    catch ( const std::exception& e ) {
+        LOG_WARN("Invalid qcow2 header in %s: %s", image.path.c_str(), e.what());
+    }
+    close(fd);
+    return true;
+}
+
+int storageScanDirectory(const std::string& dir, unsigned int threads, std::vector<StorageScanEntry>& entries) {
+    entries.clear();
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( dirFd < 0 ) {
+        return -1;
+    }
+
+    // 先读出全部文件名，d_type为DT_UNKNOWN的文件系统由之后的statx判断类型
+    std::vector<std::string> names;
+    std::vector<char> buffer(SCAN_DIRENT_BUFFER_SIZE);
+    for ( ;; ) {
+        long n = syscall(SYS_getdents64, dirFd, buffer.data(), buffer.size());
+        if ( n < 0 ) {
+            int err = errno;
+            close(dirFd);
+            errno = err;
+            return -1;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        for ( long pos = 0; pos < n; ) {
+            const LinuxDirent64* d = reinterpret_cast< const LinuxDirent64* >(buffer.data() + pos);
+            pos += d->d_reclen;
+            // 跳过.、..以及克隆、合并时使用的隐藏临时文件
+            if ( d->d_name[0] == '.' || (d->d_type != DT_REG && d->d_type != DT_UNKNOWN) ) {
+                continue;
+            }
+            names.emplace_back(d->d_name);
+        }
+    }
+
+    std::vector<StorageScanEntry> results(names.size());
+    std::vector<char> valid(names.size(), 0);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for ( ;; ) {
+            size_t begin = next.fetch_add(SCAN_BATCH);
+            if ( begin >= names.size() ) {
+                return;
+            }
+            size_t end = std::min(begin + SCAN_BATCH, names.size());
+            for ( size_t i = begin; i < end; i++ ) {
+                valid[i] = scanEntry(dirFd, dir, names[i], results[i]);
+            }
+        }
+    };
+    unsigned int count = static_cast< unsigned int >(std::min<size_t>(std::max(threads, 1U),
+        std::max<size_t>((names.size() + SCAN_BATCH - 1) / SCAN_BATCH, 1)));
+    std::vector<std::thread> workers;
+    for ( unsigned int i = 1; i < count; i++ ) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for ( auto& t : workers ) {
+        t.join();
+    }
+    close(dirFd);
+
+    entries.reserve(names.size());
+    for ( size_t i = 0; i < results.size(); i++ ) {
+        if ( valid[i] ) {
+            entries.push_back(std::move(results[i]));
+        }
+    }
+    // 目录项的顺序由文件系统决定，按名称排序使列表稳定
+    std::sort(entries.begin(), entries.end(),
+        [](const StorageScanEntry& a, const StorageScanEntry& b) { return a.name < b.name; });
+    return 0;
+}
+
+int storageRecordFormat(const std::string& path, const std::string& format) {
+    return setxattr(path.c_str(), STORAGE_FORMAT_XATTR, format.c_str(), format.size(), 0);
+}
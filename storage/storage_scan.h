@@ -0,0 +1,30 @@
+#ifndef STORAGE_SCAN_H
+#define STORAGE_SCAN_H
+
+#include "storage_qcow2.h"
+#include <string>
+#include <vector>
+
+// 记录卷格式的扩展属性，卷由驱动创建或第一次被发现时写入，之后以它为准，不再按魔数探测
+// 客户机可以在raw卷中写入伪造的qcow2头，但无法修改宿主机上文件的扩展属性
+#define STORAGE_FORMAT_XATTR "user.tinyvirt.format"
+
+// 目录扫描得到的一个镜像文件
+struct StorageScanEntry {
+    std::string name;               // 目录中的文件名
+    StorageImageInfo image;         // 格式、容量和实际占用，backingFile已解析为可以直接打开的路径
+    unsigned long long size = 0;    // 文件大小，qcow2镜像的image.capacity为虚拟大小
+    bool formatRecorded = false;    // 格式来自STORAGE_FORMAT_XATTR，为false时是按魔数探测的
+    unsigned long long dev = 0;     // 与stat的st_dev/st_ino一致
+    unsigned long long ino = 0;
+};
+
+// 扫描dir中的普通文件(不跟随符号链接，跳过以'.'开头的隐藏文件)，有格式记录时按记录处理，否则按魔数识别raw和qcow2
+// 目录项由getdents64成批读取，之后由threads个线程并行statx并读取镜像头，单个文件出错时按raw处理或跳过
+// 成功返回0，目录无法打开或读取时返回-1并设置errno
+int storageScanDirectory(const std::string& dir, unsigned int threads, std::vector<StorageScanEntry>& entries);
+
+// 把format记录到path的扩展属性中，文件系统不支持扩展属性时返回-1并设置errno
+int storageRecordFormat(const std::string& path, const std::string& format);
+
+#endif // STORAGE_SCAN_H
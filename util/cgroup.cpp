@@ -0,0 +1,280 @@
+#include "cgroup.h"
+#include "../log/log.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+static const char* CGROUP_CONTROLLERS[] = { "cpu", "memory", "io" };
+
+std::string Cgroup::mountPoint() {
+    std::ifstream mounts("/proc/mounts");
+    std::string line;
+    std::string found;
+    while ( std::getline(mounts, line) ) {
+        std::istringstream is(line);
+        std::string device, dir, type;
+        is >> device >> dir >> type;
+        if ( type != "cgroup2" ) {
+            continue;
+        }
+        // 纯v2系统挂载在/sys/fs/cgroup，混合模式下通常是/sys/fs/cgroup/unified
+        if ( dir == "/sys/fs/cgroup" ) {
+            return dir;
+        }
+        if ( found.empty() ) {
+            found = dir;
+        }
+    }
+    return found;
+}
+
+// 虚拟机名直接拼接到分区路径后，不能借助'/'或".."指向其他控制组，remove()会杀死其中的进程并删除它
+static bool isValidDomainName(const std::string& name) {
+    if ( name.empty() || name[0] == '.' || name.find('/') != std::string::npos ) {
+        LOG_ERROR("Invalid domain name for cgroup: '%s'", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 在parent的cgroup.subtree_control中启用可用的控制器，子节点才能使用对应的接口文件
+static void enableControllers(const std::string& parent) {
+    std::ifstream file(parent + "/cgroup.controllers");
+    std::string available;
+    std::getline(file, available);
+    for ( const char* controller : CGROUP_CONTROLLERS ) {
+        std::istringstream is(available);
+        std::string name;
+        bool present = false;
+        while ( is >> name ) {
+            present = present || name == controller;
+        }
+        if ( !present ) {
+            LOG_WARN("cgroup controller %s is not available in %s", controller, parent.c_str());
+            continue;
+        }
+        std::string value = std::string("+") + controller;
+        int fd = open((parent + "/cgroup.subtree_control").c_str(), O_WRONLY);
+        if ( fd < 0 || write(fd, value.c_str(), value.size()) < 0 ) {
+            LOG_WARN("Failed to enable cgroup controller %s in %s: %s", controller, parent.c_str(), strerror(errno));
+        }
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+    }
+}
+
+std::unique_ptr<Cgroup> Cgroup::createForDomain(const std::string& partition, const std::string& name) {
+    if ( !isValidDomainName(name) ) {
+        return nullptr;
+    }
+    std::string root = mountPoint();
+    if ( root.empty() ) {
+        LOG_WARN("cgroup v2 is not mounted, resource controls are disabled");
+        return nullptr;
+    }
+    std::string partitionPath = root + "/" + partition;
+    if ( mkdir(partitionPath.c_str(), 0755) < 0 && errno != EEXIST ) {
+        LOG_ERROR("Failed to create cgroup %s: %s", partitionPath.c_str(), strerror(errno));
+        return nullptr;
+    }
+    enableControllers(root);
+    enableControllers(partitionPath);
+
+    std::string domainPath = partitionPath + "/" + name;
+    if ( mkdir(domainPath.c_str(), 0755) < 0 && errno != EEXIST ) {
+        LOG_ERROR("Failed to create cgroup %s: %s", domainPath.c_str(), strerror(errno));
+        return nullptr;
+    }
+    return std::unique_ptr<Cgroup>(new Cgroup(domainPath));
+}
+
+std::unique_ptr<Cgroup> Cgroup::openForDomain(const std::string& partition, const std::string& name) {
+    if ( !isValidDomainName(name) ) {
+        return nullptr;
+    }
+    std::string root = mountPoint();
+    if ( root.empty() ) {
+        return nullptr;
+    }
+    std::string domainPath = root + "/" + partition + "/" + name;
+    struct stat st;
+    if ( stat(domainPath.c_str(), &st) < 0 || !S_ISDIR(st.st_mode) ) {
+        return nullptr;
+    }
+    return std::unique_ptr<Cgroup>(new Cgroup(domainPath));
+}
+
+std::string Cgroup::deviceNumber(const std::string& path) {
+    struct stat st;
+    if ( stat(path.c_str(), &st) < 0 ) {
+        return "";
+    }
+    dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    return std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+}
+
+bool Cgroup::hasController(const std::string& controller) const {
+    std::string controllers;
+    if ( readFile("cgroup.controllers", controllers) < 0 ) {
+        return false;
+    }
+    std::istringstream is(controllers);
+    std::string name;
+    while ( is >> name ) {
+        if ( name == controller ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Cgroup::writeFile(const std::string& file, const std::string& value) const {
+    std::string filePath = path + "/" + file;
+    int fd = open(filePath.c_str(), O_WRONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        LOG_ERROR("Failed to open %s: %s", filePath.c_str(), strerror(errno));
+        return -1;
+    }
+    ssize_t ret = write(fd, value.c_str(), value.size());
+    int savedErrno = errno;
+    close(fd);
+    if ( ret < 0 ) {
+        LOG_ERROR("Failed to write '%s' to %s: %s", value.c_str(), filePath.c_str(), strerror(savedErrno));
+        return -1;
+    }
+    return 0;
+}
+
+int Cgroup::readFile(const std::string& file, std::string& value) const {
+    std::ifstream in(path + "/" + file);
+    if ( !in.is_open() ) {
+        return -1;
+    }
+    std::ostringstream os;
+    os << in.rdbuf();
+    value = os.str();
+    return 0;
+}
+
+int Cgroup::openProcsFile() const {
+    int fd = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        LOG_ERROR("Failed to open %s/cgroup.procs: %s", path.c_str(), strerror(errno));
+    }
+    return fd;
+}
+
+int Cgroup::addProcess(pid_t pid) {
+    return writeFile("cgroup.procs", std::to_string(pid));
+}
+
+int Cgroup::setCpuMax(long long quotaUsec, unsigned long long periodUsec) {
+    std::string quota = quotaUsec < 0 ? "max" : std::to_string(quotaUsec);
+    return writeFile("cpu.max", quota + " " + std::to_string(periodUsec));
+}
+
+int Cgroup::setCpuWeight(unsigned long long weight) {
+    return writeFile("cpu.weight", std::to_string(weight));
+}
+
+int Cgroup::setMemoryMax(unsigned long long bytes) {
+    return writeFile("memory.max", bytes == 0 ? "max" : std::to_string(bytes));
+}
+
+int Cgroup::setMemoryHigh(unsigned long long bytes) {
+    return writeFile("memory.high", bytes == 0 ? "max" : std::to_string(bytes));
+}
+
+int Cgroup::setIoMax(const std::string& device, const CgroupIoLimit& limit) {
+    auto value = [](unsigned long long v) {
+        return v == 0 ? std::string("max") : std::to_string(v);
+    };
+    return writeFile("io.max", device +
+        " riops=" + value(limit.riops) + " wiops=" + value(limit.wiops) +
+        " rbps=" + value(limit.rbps) + " wbps=" + value(limit.wbps));
+}
+
+int Cgroup::getCpuStat(CgroupCpuStat& stat) const {
+    std::string content;
+    if ( readFile("cpu.stat", content) < 0 ) {
+        return -1;
+    }
+    std::istringstream is(content);
+    std::string key;
+    unsigned long long value;
+    while ( is >> key >> value ) {
+        if ( key == "usage_usec" ) stat.usageUsec = value;
+        else if ( key == "user_usec" ) stat.userUsec = value;
+        else if ( key == "system_usec" ) stat.systemUsec = value;
+        else if ( key == "nr_periods" ) stat.nrPeriods = value;
+        else if ( key == "nr_throttled" ) stat.nrThrottled = value;
+        else if ( key == "throttled_usec" ) stat.throttledUsec = value;
+    }
+    return 0;
+}
+
+int Cgroup::getMemoryCurrent(unsigned long long& bytes) const {
+    std::string content;
+    if ( readFile("memory.current", content) < 0 ) {
+        return -1;
+    }
+    bytes = strtoull(content.c_str(), nullptr, 10);
+    return 0;
+}
+
+int Cgroup::getIoStat(std::map<std::string, CgroupIoStat>& stats) const {
+    std::string content;
+    if ( readFile("io.stat", content) < 0 ) {
+        return -1;
+    }
+    // 每行格式: "8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0"
+    std::istringstream lines(content);
+    std::string line;
+    while ( std::getline(lines, line) ) {
+        std::istringstream is(line);
+        std::string device, field;
+        if ( !(is >> device) ) {
+            continue;
+        }
+        CgroupIoStat& stat = stats[device];
+        while ( is >> field ) {
+            size_t eq = field.find('=');
+            if ( eq == std::string::npos ) {
+                continue;
+            }
+            std::string key = field.substr(0, eq);
+            unsigned long long value = strtoull(field.c_str() + eq + 1, nullptr, 10);
+            if ( key == "rbytes" ) stat.rbytes = value;
+            else if ( key == "wbytes" ) stat.wbytes = value;
+            else if ( key == "rios" ) stat.rios = value;
+            else if ( key == "wios" ) stat.wios = value;
+        }
+    }
+    return 0;
+}
+
+int Cgroup::remove() {
+    std::string procs;
+    if ( readFile("cgroup.procs", procs) == 0 && !procs.empty() ) {
+        writeFile("cgroup.kill", "1");
+        // 等待进程退出后控制组才能被删除
+        for ( int i = 0; i < 50; i++ ) {
+            std::string events;
+            if ( readFile("cgroup.events", events) < 0 || events.find("populated 0") != std::string::npos ) {
+                break;
+            }
+            usleep(20 * 1000);
+        }
+    }
+    if ( rmdir(path.c_str()) < 0 ) {
+        LOG_ERROR("Failed to remove cgroup %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <string>
+#include <map>
+#include <memory>
+#include <sys/types.h>
+
+// cpu.stat中的CPU时间统计(微秒)
+struct CgroupCpuStat {
+    unsigned long long usageUsec = 0;
+    unsigned long long userUsec = 0;
+    unsigned long long systemUsec = 0;
+    unsigned long long nrPeriods = 0;
+    unsigned long long nrThrottled = 0;
+    unsigned long long throttledUsec = 0;
+};
+
+// io.stat中单个块设备的统计
+struct CgroupIoStat {
+    unsigned long long rbytes = 0;
+    unsigned long long wbytes = 0;
+    unsigned long long rios = 0;
+    unsigned long long wios = 0;
+};
+
+// io.max中单个块设备的限制，0表示不限制
+struct CgroupIoLimit {
+    unsigned long long riops = 0;
+    unsigned long long wiops = 0;
+    unsigned long long rbps = 0;
+    unsigned long long wbps = 0;
+};
+
+// cgroup v2中的一个控制组，每个虚拟机对应<mount>/<partition>/<name>
+// 对象本身不保存状态，所有值都直接读写cgroupfs，因此可以在任意进程中重新打开
+class Cgroup {
+public:
+    // 查找cgroup2的挂载点，未挂载时返回空字符串
+    static std::string mountPoint();
+
+    // 创建(或打开已有的)虚拟机控制组，并在父节点中启用cpu/memory/io控制器
+    // name为空、包含'/'或以'.'开头时两者都返回nullptr
+    static std::unique_ptr<Cgroup> createForDomain(const std::string& partition, const std::string& name);
+    // 打开已存在的虚拟机控制组，不存在时返回nullptr
+    static std::unique_ptr<Cgroup> openForDomain(const std::string& partition, const std::string& name);
+
+    // 获取路径对应的块设备号"major:minor"，普通文件返回其所在文件系统的设备号
+    static std::string deviceNumber(const std::string& path);
+
+    const std::string& getPath() const { return path; }
+    bool hasController(const std::string& controller) const;
+
+    // 打开cgroup.procs用于写入，fork后的子进程向其写入"0"即可在exec前加入控制组
+    int openProcsFile() const;
+    int addProcess(pid_t pid);
+
+    // quota小于0表示不限制
+    int setCpuMax(long long quotaUsec, unsigned long long periodUsec);
+    int setCpuWeight(unsigned long long weight);
+    // bytes为0表示不限制
+    int setMemoryMax(unsigned long long bytes);
+    int setMemoryHigh(unsigned long long bytes);
+    int setIoMax(const std::string& device, const CgroupIoLimit& limit);
+
+    int getCpuStat(CgroupCpuStat& stat) const;
+    int getMemoryCurrent(unsigned long long& bytes) const;
+    int getIoStat(std::map<std::string, CgroupIoStat>& stats) const;
+
+    // 删除控制组，仍有进程时先通过cgroup.kill结束它们
+    int remove();
+
+private:
+    explicit Cgroup(const std::string& path) : path(path) {}
+
+    int writeFile(const std::string& file, const std::string& value) const;
+    int readFile(const std::string& file, std::string& value) const;
+
+    std::string path;
+};
+
+#endif // CGROUP_H
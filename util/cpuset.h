@@ -0,0 +1,120 @@
+#ifndef CPUSET_H
+#define CPUSET_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <stdexcept>
+#include <sched.h>
+#include <sys/types.h>
+
+// 解析形如"0-3,6,^2"的CPU/NUMA节点集合字符串，返回升序排列的编号列表
+inline std::vector<int> parseCpuSet(const std::string& str) {
+    std::set<int> include;
+    std::set<int> exclude;
+    size_t pos = 0;
+    while ( pos < str.size() ) {
+        size_t end = str.find(',', pos);
+        if ( end == std::string::npos ) {
+            end = str.size();
+        }
+        std::string item = str.substr(pos, end - pos);
+        pos = end + 1;
+
+        // 去除首尾空白
+        size_t first = item.find_first_not_of(" \t\n");
+        if ( first == std::string::npos ) {
+            continue;
+        }
+        item = item.substr(first, item.find_last_not_of(" \t\n") - first + 1);
+
+        bool negate = false;
+        if ( item[0] == '^' ) {
+            negate = true;
+            item = item.substr(1);
+        }
+
+        int low, high;
+        try {
+            size_t dash = item.find('-');
+            if ( dash == std::string::npos ) {
+                low = high = std::stoi(item);
+            }
+            else {
+                low = std::stoi(item.substr(0, dash));
+                high = std::stoi(item.substr(dash + 1));
+            }
+        }
+        catch ( const std::exception& ) {
+            throw std::runtime_error("Invalid cpuset: " + str);
+        }
+        if ( low < 0 || high < low ) {
+            throw std::runtime_error("Invalid cpuset range: " + item);
+        }
+        for ( int i = low; i <= high; i++ ) {
+            (negate ? exclude : include).insert(i);
+        }
+    }
+
+    std::vector<int> result;
+    for ( int i : include ) {
+        if ( !exclude.count(i) ) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+// 将编号列表格式化为紧凑的"0-3,6"形式
+inline std::string formatCpuSet(const std::vector<int>& ids) {
+    std::set<int> sorted(ids.begin(), ids.end());
+    std::string result;
+    auto it = sorted.begin();
+    while ( it != sorted.end() ) {
+        int low = *it;
+        int high = low;
+        ++it;
+        while ( it != sorted.end() && *it == high + 1 ) {
+            high = *it;
+            ++it;
+        }
+        if ( !result.empty() ) {
+            result += ",";
+        }
+        result += std::to_string(low);
+        if ( high != low ) {
+            result += "-" + std::to_string(high);
+        }
+    }
+    return result;
+}
+
+// 设置线程的CPU亲和性，tid为内核线程ID
+inline int setThreadAffinity(pid_t tid, const std::vector<int>& cpus) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for ( int cpu : cpus ) {
+        if ( cpu < CPU_SETSIZE ) {
+            CPU_SET(cpu, &mask);
+        }
+    }
+    return sched_setaffinity(tid, sizeof(mask), &mask);
+}
+
+// 读取线程的CPU亲和性
+inline std::vector<int> getThreadAffinity(pid_t tid) {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if ( sched_getaffinity(tid, sizeof(mask), &mask) != 0 ) {
+        return cpus;
+    }
+    for ( int cpu = 0; cpu < CPU_SETSIZE; cpu++ ) {
+        if ( CPU_ISSET(cpu, &mask) ) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+#endif // CPUSET_H
@@ -0,0 +1,230 @@
+#include "file_copy.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/fs.h>
+
+#define COPY_CHUNK_SIZE (64ULL << 20)       // 并行复制时每个线程一次领取的块大小
+#define COPY_BUFFER_SIZE (1 << 20)          // read/write回退时的缓冲区大小
+
+static ssize_t copyFileRange(int srcFd, off_t* srcOff, int dstFd, off_t* dstOff, size_t len) {
+#ifdef SYS_copy_file_range
+    return syscall(SYS_copy_file_range, srcFd, srcOff, dstFd, dstOff, len, 0);
+#else
+    (void)srcFd;
+    (void)srcOff;
+    (void)dstFd;
+    (void)dstOff;
+    (void)len;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// 这些错误表示当前内核或文件系统组合不支持，可以换用更慢的方法重试
+static bool copyUnsupported(int err) {
+    return err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == ENOTTY || err == EINVAL;
+}
+
+const char* fileCopyMethodName(FileCopyMethod method) {
+    switch ( method ) {
+    case FILE_COPY_REFLINK:
+        return "reflink";
+    case FILE_COPY_RANGE:
+        return "copy_file_range";
+    case FILE_COPY_READWRITE:
+        return "read/write";
+    }
+    return "unknown";
+}
+
+static bool isZero(const char* data, size_t len) {
+    // 先检查第一个字节，再与自身错开一个字节比较，等价于逐字节判断全为零
+    return len == 0 || (data[0] == 0 && memcmp(data, data + 1, len - 1) == 0);
+}
+
+// 复制[offset, offset + len)，全零的块不写入，目标中对应位置保持为空洞
+// 返回0表示完成，源文件提前结束时也返回0，written累加实际写入的字节数
+static int copyChunkReadWrite(int srcFd, int dstFd, unsigned long long offset, unsigned long long len,
+    std::vector<char>& buffer, unsigned long long& written) {
+    while ( len > 0 ) {
+        size_t want = static_cast< size_t >(std::min(len, static_cast< unsigned long long >(buffer.size())));
+        ssize_t n = pread(srcFd, buffer.data(), want, static_cast< off_t >(offset));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( n == 0 ) {
+            return 0;
+        }
+        if ( !isZero(buffer.data(), n) ) {
+            ssize_t done = 0;
+            while ( done < n ) {
+                ssize_t w = pwrite(dstFd, buffer.data() + done, n - done, static_cast< off_t >(offset + done));
+                if ( w < 0 ) {
+                    if ( errno == EINTR ) {
+                        continue;
+                    }
+                    return -1;
+                }
+                done += w;
+            }
+            written += n;
+        }
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 返回0表示完成，出错时返回-1，copied中保存出错前已复制的字节数
+static int copyChunkRange(int srcFd, int dstFd, unsigned long long offset, unsigned long long len,
+    unsigned long long& copied) {
+    copied = 0;
+    while ( copied < len ) {
+        off_t srcOff = static_cast< off_t >(offset + copied);
+        off_t dstOff = srcOff;
+        ssize_t n = copyFileRange(srcFd, &srcOff, dstFd, &dstOff, static_cast< size_t >(len - copied));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        copied += n;
+    }
+    return 0;
+}
+
+int fileDataExtents(int fd, unsigned long long length, std::vector<FileExtent>& extents) {
+    extents.clear();
+    unsigned long long pos = 0;
+    while ( pos < length ) {
+        off_t data = lseek(fd, static_cast< off_t >(pos), SEEK_DATA);
+        if ( data < 0 ) {
+            // ENXIO表示pos之后全是空洞
+            if ( errno == ENXIO ) {
+                break;
+            }
+            if ( errno == EINVAL || errno == EOPNOTSUPP ) {
+                extents.push_back(FileExtent{ pos, length - pos });
+                break;
+            }
+            return -1;
+        }
+        unsigned long long start = static_cast< unsigned long long >(data);
+        if ( start >= length ) {
+            break;
+        }
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        unsigned long long end = hole < 0 ? length : std::min(static_cast< unsigned long long >(hole), length);
+        extents.push_back(FileExtent{ start, end - start });
+        pos = end;
+    }
+    return 0;
+}
+
+int fileCopyFd(int srcFd, int dstFd, unsigned long long length, unsigned int threads, FileCopyResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = FileCopyResult();
+    result.bytes = length;
+
+#ifdef FICLONE
+    if ( ioctl(dstFd, FICLONE, srcFd) == 0 ) {
+        // 共享数据块时空洞随之保留，没有数据需要传输
+        result.method = FILE_COPY_REFLINK;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return 0;
+    }
+    if ( !copyUnsupported(errno) ) {
+        return -1;
+    }
+    LOG_DEBUG("FICLONE not supported: %s", strerror(errno));
+#endif
+
+    // 只复制数据区间，copy_file_range在不支持reflink的文件系统上会把源中的空洞写成零
+    std::vector<FileExtent> extents;
+    if ( fileDataExtents(srcFd, length, extents) < 0 ) {
+        return -1;
+    }
+    std::vector<FileExtent> chunks;
+    for ( const auto& extent : extents ) {
+        for ( unsigned long long off = 0; off < extent.length; off += COPY_CHUNK_SIZE ) {
+            chunks.push_back(FileExtent{ extent.offset + off, std::min(COPY_CHUNK_SIZE, extent.length - off) });
+        }
+    }
+    std::atomic<size_t> nextChunk(0);
+    std::atomic<bool> rangeUnsupported(false);
+    std::atomic<bool> usedReadWrite(false);
+    std::atomic<unsigned long long> dataBytes(0);
+    std::atomic<int> firstError(0);
+
+    // 每个线程依次领取下一个块，copy_file_range和pread/pwrite都带显式偏移，线程之间不共享文件位置
+    auto worker = [&]() {
+        std::vector<char> buffer;
+        size_t chunk;
+        while ( firstError == 0 && (chunk = nextChunk.fetch_add(1)) < chunks.size() ) {
+            unsigned long long offset = chunks[chunk].offset;
+            unsigned long long len = chunks[chunk].length;
+            unsigned long long copied = 0;
+            if ( !rangeUnsupported ) {
+                int ret = copyChunkRange(srcFd, dstFd, offset, len, copied);
+                dataBytes += copied;
+                if ( ret == 0 ) {
+                    continue;
+                }
+                if ( !copyUnsupported(errno) ) {
+                    int expected = 0;
+                    firstError.compare_exchange_strong(expected, errno);
+                    return;
+                }
+                rangeUnsupported = true;
+            }
+            usedReadWrite = true;
+            if ( buffer.empty() ) {
+                buffer.resize(COPY_BUFFER_SIZE);
+            }
+            unsigned long long written = 0;
+            int ret = copyChunkReadWrite(srcFd, dstFd, offset + copied, len - copied, buffer, written);
+            dataBytes += written;
+            if ( ret < 0 ) {
+                int expected = 0;
+                firstError.compare_exchange_strong(expected, errno);
+                return;
+            }
+        }
+    };
+
+    unsigned int count = static_cast< unsigned int >(std::min<size_t>(std::max(threads, 1U), std::max<size_t>(chunks.size(), 1)));
+    std::vector<std::thread> workers;
+    for ( unsigned int i = 1; i < count; i++ ) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for ( auto& t : workers ) {
+        t.join();
+    }
+
+    if ( firstError != 0 ) {
+        errno = firstError;
+        return -1;
+    }
+    result.method = usedReadWrite ? FILE_COPY_READWRITE : FILE_COPY_RANGE;
+    result.dataBytes = dataBytes;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <vector>
+
+// 复制实际使用的方法，按速度从快到慢排列
+enum FileCopyMethod {
+    FILE_COPY_REFLINK = 0,      // ioctl(FICLONE)，只共享数据块，不复制数据
+    FILE_COPY_RANGE,            // copy_file_range，数据在内核中复制，支持时由文件系统下推到存储
+    FILE_COPY_READWRITE,        // 用户态read/write
+};
+
+struct FileCopyResult {
+    FileCopyMethod method = FILE_COPY_READWRITE;    // 有分块回退时记录最慢的方法
+    unsigned long long bytes = 0;       // 文件的逻辑大小
+    unsigned long long dataBytes = 0;   // 实际传输的数据量，空洞和全零块不计入
+    double seconds = 0;
+
+    // 每秒复制的逻辑字节数
+    double throughput() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+// 文件中已分配数据的区间
+struct FileExtent {
+    unsigned long long offset;
+    unsigned long long length;
+};
+
+const char* fileCopyMethodName(FileCopyMethod method);
+
+// 用lseek(SEEK_DATA/SEEK_HOLE)列出[0, length)中的数据区间，文件系统不支持时整个范围作为一个区间
+int fileDataExtents(int fd, unsigned long long length, std::vector<FileExtent>& extents);
+
+// 把srcFd的前length字节复制到dstFd的相同偏移，length应为源文件的大小
+// dstFd需以读写方式打开，且应是刚截断到length的空文件：只写入数据区间，空洞和全零块保持为空洞
+// 依次尝试FICLONE、按块由threads个线程并行copy_file_range、read/write，某一块不支持copy_file_range时
+// 该块及之后的块退回read/write。成功返回0，失败返回-1并设置errno，目标文件中可能已写入部分数据
+int fileCopyFd(int srcFd, int dstFd, unsigned long long length, unsigned int threads, FileCopyResult& result);
+
+#endif // FILE_COPY_H
@@ -0,0 +1,446 @@
+#include "file_stream.h"
+#include "file_copy.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <vector>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/falloc.h>
+
+#define STREAM_CHUNK_SIZE (16ULL << 20)     // 每次sendfile/splice的最大长度
+#define STREAM_BUFFER_SIZE (1 << 20)        // 不支持零拷贝时read/write的缓冲区大小
+
+static bool streamUnsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP;
+}
+
+static int writeFull(int fd, const char* buf, size_t len) {
+    while ( len > 0 ) {
+        ssize_t n = write(fd, buf, len);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int pwriteFull(int fd, const char* buf, size_t len, unsigned long long offset) {
+    while ( len > 0 ) {
+        ssize_t n = pwrite(fd, buf, len, static_cast< off_t >(offset));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// 读满len字节，提前结束时返回实际读到的字节数
+static ssize_t readFull(int fd, char* buf, size_t len) {
+    size_t done = 0;
+    while ( done < len ) {
+        ssize_t n = read(fd, buf + done, len - done);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        done += n;
+    }
+    return static_cast< ssize_t >(done);
+}
+
+static bool isRegularFile(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static int writeRecordHeader(int fd, unsigned long long value) {
+    uint64_t header = htobe64(value);
+    return writeFull(fd, reinterpret_cast< const char* >(&header), sizeof(header));
+}
+
+// 让普通文件fd中[pos, pos + len)读为零，只处理文件末尾之前的部分，之后的部分由调用者截断扩展
+static int zeroFileRange(int fd, unsigned long long pos, unsigned long long len) {
+    struct stat st;
+    if ( fstat(fd, &st) < 0 ) {
+        return -1;
+    }
+    unsigned long long size = static_cast< unsigned long long >(st.st_size);
+    if ( pos >= size || len == 0 ) {
+        return 0;
+    }
+    len = std::min(len, size - pos);
+    if ( fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast< off_t >(pos), static_cast< off_t >(len)) == 0 ) {
+        return 0;
+    }
+    if ( !streamUnsupported(errno) ) {
+        return -1;
+    }
+    std::vector<char> zero(static_cast< size_t >(std::min(len, static_cast< unsigned long long >(STREAM_BUFFER_SIZE))), 0);
+    for ( unsigned long long done = 0; done < len; ) {
+        size_t n = static_cast< size_t >(std::min(len - done, static_cast< unsigned long long >(zero.size())));
+        if ( pwriteFull(fd, zero.data(), n, pos + done) < 0 ) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int sendZeros(int outFd, unsigned long long len) {
+    std::vector<char> zero(static_cast< size_t >(std::min(len, static_cast< unsigned long long >(STREAM_BUFFER_SIZE))), 0);
+    while ( len > 0 ) {
+        size_t n = static_cast< size_t >(std::min(len, static_cast< unsigned long long >(zero.size())));
+        if ( writeFull(outFd, zero.data(), n) < 0 ) {
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+// 把fd中[offset, offset + len)写入outFd的当前位置，优先用sendfile，outFd不支持时退回read/write
+static int sendData(int fd, unsigned long long offset, int outFd, unsigned long long len, FileStreamResult& result) {
+    off_t off = static_cast< off_t >(offset);
+    while ( len > 0 ) {
+        ssize_t n = sendfile(outFd, fd, &off, static_cast< size_t >(std::min(len, STREAM_CHUNK_SIZE)));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            if ( streamUnsupported(errno) ) {
+                break;
+            }
+            return -1;
+        }
+        if ( n == 0 ) {
+            // 传输过程中文件被截断
+            errno = EIO;
+            return -1;
+        }
+        len -= n;
+        result.dataBytes += n;
+    }
+    if ( len == 0 ) {
+        return 0;
+    }
+    result.zeroCopy = false;
+    std::vector<char> buffer(STREAM_BUFFER_SIZE);
+    while ( len > 0 ) {
+        ssize_t n = pread(fd, buffer.data(), static_cast< size_t >(std::min(len, static_cast< unsigned long long >(buffer.size()))), off);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( n == 0 ) {
+            errno = EIO;
+            return -1;
+        }
+        if ( writeFull(outFd, buffer.data(), n) < 0 ) {
+            return -1;
+        }
+        off += n;
+        len -= n;
+        result.dataBytes += n;
+    }
+    return 0;
+}
+
+int fileStreamSend(int fd, int outFd, unsigned long long offset, unsigned long long length, bool sparse,
+    FileStreamResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = FileStreamResult();
+    result.zeroCopy = true;
+    result.bytes = length;
+
+    std::vector<FileExtent> extents;
+    if ( fileDataExtents(fd, offset + length, extents) < 0 ) {
+        return -1;
+    }
+    // 对端是普通文件时直接在其中留下空洞，所有位置相对于outFd的当前位置
+    off_t base = isRegularFile(outFd) ? lseek(outFd, 0, SEEK_CUR) : -1;
+    bool outFile = base >= 0;
+    unsigned long long end = offset + length;
+    unsigned long long pos = offset;
+
+    auto sendHole = [&](unsigned long long holeEnd) {
+        unsigned long long len = holeEnd - pos;
+        if ( len == 0 ) {
+            return 0;
+        }
+        if ( !sparse ) {
+            return sendZeros(outFd, len);
+        }
+        if ( outFile ) {
+            unsigned long long outPos = static_cast< unsigned long long >(base) + pos - offset;
+            if ( zeroFileRange(outFd, outPos, len) < 0 ) {
+                return -1;
+            }
+            return lseek(outFd, static_cast< off_t >(outPos + len), SEEK_SET) < 0 ? -1 : 0;
+        }
+        return writeRecordHeader(outFd, FILE_STREAM_HOLE_FLAG | len);
+    };
+
+    for ( const auto& extent : extents ) {
+        unsigned long long dataStart = std::max(extent.offset, offset);
+        unsigned long long dataEnd = std::min(extent.offset + extent.length, end);
+        if ( dataStart >= dataEnd ) {
+            continue;
+        }
+        if ( sendHole(dataStart) < 0 ) {
+            return -1;
+        }
+        pos = dataStart;
+        if ( sparse && !outFile && writeRecordHeader(outFd, dataEnd - dataStart) < 0 ) {
+            return -1;
+        }
+        if ( sendData(fd, dataStart, outFd, dataEnd - dataStart, result) < 0 ) {
+            return -1;
+        }
+        pos = dataEnd;
+    }
+    if ( sendHole(end) < 0 ) {
+        return -1;
+    }
+    if ( sparse && outFile ) {
+        // 末尾的空洞只移动了位置，需要扩展文件
+        struct stat st;
+        unsigned long long outEnd = static_cast< unsigned long long >(base) + length;
+        if ( fstat(outFd, &st) < 0 || (static_cast< unsigned long long >(st.st_size) < outEnd && ftruncate(outFd, static_cast< off_t >(outEnd)) < 0) ) {
+            return -1;
+        }
+    }
+    if ( sparse && !outFile && writeRecordHeader(outFd, 0) < 0 ) {
+        return -1;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 0;
+}
+
+// 从管道或套接字inFd读取最多len字节写入fd的pos处，返回实际传输的字节数，inFd结束时可能少于len
+// inFd本身是管道时直接splice到文件，否则经过一个中转管道，数据始终不进入用户态
+static long long receiveStream(int inFd, int fd, unsigned long long pos, unsigned long long len, FileStreamResult& result) {
+    unsigned long long done = 0;
+    struct stat st;
+    bool inPipe = fstat(inFd, &st) == 0 && S_ISFIFO(st.st_mode);
+    int pipeFds[2] = { -1, -1 };
+    bool zeroCopy = true;
+    if ( !inPipe && pipe2(pipeFds, O_CLOEXEC) < 0 ) {
+        zeroCopy = false;
+    }
+    while ( zeroCopy && done < len ) {
+        size_t want = static_cast< size_t >(std::min(len - done, STREAM_CHUNK_SIZE));
+        loff_t off = static_cast< loff_t >(pos + done);
+        ssize_t n;
+        if ( inPipe ) {
+            n = splice(inFd, nullptr, fd, &off, want, SPLICE_F_MOVE);
+        }
+        else {
+            n = splice(inFd, nullptr, pipeFds[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        }
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            if ( streamUnsupported(errno) && done == 0 ) {
+                zeroCopy = false;
+                break;
+            }
+            int err = errno;
+            if ( pipeFds[0] >= 0 ) {
+                close(pipeFds[0]);
+                close(pipeFds[1]);
+            }
+            errno = err;
+            return -1;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        // 中转管道中的数据必须全部写入文件
+        for ( ssize_t moved = 0; !inPipe && moved < n; ) {
+            ssize_t m = splice(pipeFds[0], nullptr, fd, &off, n - moved, SPLICE_F_MOVE);
+            if ( m <= 0 ) {
+                if ( m < 0 && errno == EINTR ) {
+                    continue;
+                }
+                int err = m < 0 ? errno : EIO;
+                close(pipeFds[0]);
+                close(pipeFds[1]);
+                errno = err;
+                return -1;
+            }
+            moved += m;
+        }
+        done += n;
+    }
+    if ( pipeFds[0] >= 0 ) {
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+    }
+    if ( !zeroCopy ) {
+        result.zeroCopy = false;
+        std::vector<char> buffer(STREAM_BUFFER_SIZE);
+        while ( done < len ) {
+            ssize_t n = read(inFd, buffer.data(), static_cast< size_t >(std::min(len - done, static_cast< unsigned long long >(buffer.size()))));
+            if ( n < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return -1;
+            }
+            if ( n == 0 ) {
+                break;
+            }
+            if ( pwriteFull(fd, buffer.data(), n, pos + done) < 0 ) {
+                return -1;
+            }
+            done += n;
+        }
+    }
+    result.dataBytes += done;
+    return static_cast< long long >(done);
+}
+
+// 把普通文件inFd中[inOffset, inOffset + len)写入fd的pos处
+static int receiveFile(int inFd, unsigned long long inOffset, int fd, unsigned long long pos, unsigned long long len,
+    FileStreamResult& result) {
+    if ( lseek(fd, static_cast< off_t >(pos), SEEK_SET) < 0 ) {
+        return -1;
+    }
+    return sendData(inFd, inOffset, fd, len, result);
+}
+
+int fileStreamReceive(int inFd, int fd, unsigned long long offset, unsigned long long length, bool sparse,
+    FileStreamResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = FileStreamResult();
+    result.zeroCopy = true;
+    unsigned long long limit = length > 0 ? length : ULLONG_MAX - offset;
+    unsigned long long pos = offset;
+
+    struct stat inStat;
+    if ( fstat(inFd, &inStat) < 0 ) {
+        return -1;
+    }
+    off_t inPos = S_ISREG(inStat.st_mode) ? lseek(inFd, 0, SEEK_CUR) : -1;
+    if ( inPos >= 0 ) {
+        // 位置可以在文件末尾之后，此时没有可读的数据，按位于末尾处理，之后的inSize - inCur不会下溢
+        unsigned long long inSize = static_cast< unsigned long long >(inStat.st_size);
+        unsigned long long inStart = std::min(static_cast< unsigned long long >(inPos), inSize);
+        unsigned long long avail = inSize - inStart;
+        if ( avail > limit ) {
+            errno = EFBIG;
+            return -1;
+        }
+        std::vector<FileExtent> extents;
+        if ( !sparse ) {
+            extents.push_back(FileExtent{ inStart, avail });
+        }
+        else if ( fileDataExtents(inFd, inSize, extents) < 0 ) {
+            return -1;
+        }
+        unsigned long long inCur = inStart;
+        for ( const auto& extent : extents ) {
+            unsigned long long dataStart = std::max(extent.offset, inStart);
+            unsigned long long dataEnd = extent.offset + extent.length;
+            if ( dataStart >= dataEnd ) {
+                continue;
+            }
+            if ( zeroFileRange(fd, offset + inCur - inStart, dataStart - inCur) < 0 ||
+                receiveFile(inFd, dataStart, fd, offset + dataStart - inStart, dataEnd - dataStart, result) < 0 ) {
+                return -1;
+            }
+            inCur = dataEnd;
+        }
+        if ( zeroFileRange(fd, offset + inCur - inStart, inSize - inCur) < 0 ) {
+            return -1;
+        }
+        // 与从管道读取时一致，输入被消费掉
+        lseek(inFd, static_cast< off_t >(inSize), SEEK_SET);
+        pos = offset + avail;
+    }
+    else if ( !sparse ) {
+        long long n = receiveStream(inFd, fd, pos, limit, result);
+        if ( n < 0 ) {
+            return -1;
+        }
+        pos += n;
+        char extra;
+        if ( length > 0 && static_cast< unsigned long long >(n) == length && readFull(inFd, &extra, 1) > 0 ) {
+            errno = EFBIG;
+            return -1;
+        }
+    }
+    else {
+        for ( ;; ) {
+            uint64_t header;
+            ssize_t n = readFull(inFd, reinterpret_cast< char* >(&header), sizeof(header));
+            if ( n < 0 ) {
+                return -1;
+            }
+            if ( n != sizeof(header) ) {
+                // 没有结束记录，流被截断
+                errno = EPROTO;
+                return -1;
+            }
+            header = be64toh(header);
+            unsigned long long len = header & ~FILE_STREAM_HOLE_FLAG;
+            if ( len == 0 ) {
+                break;
+            }
+            if ( len > limit - (pos - offset) ) {
+                errno = EFBIG;
+                return -1;
+            }
+            if ( header & FILE_STREAM_HOLE_FLAG ) {
+                if ( zeroFileRange(fd, pos, len) < 0 ) {
+                    return -1;
+                }
+            }
+            else {
+                long long moved = receiveStream(inFd, fd, pos, len, result);
+                if ( moved < 0 ) {
+                    return -1;
+                }
+                if ( static_cast< unsigned long long >(moved) != len ) {
+                    errno = EPROTO;
+                    return -1;
+                }
+            }
+            pos += len;
+        }
+    }
+
+    // 末尾的空洞没有写入数据，需要扩展文件
+    struct stat st;
+    if ( fstat(fd, &st) < 0 || (static_cast< unsigned long long >(st.st_size) < pos && ftruncate(fd, static_cast< off_t >(pos)) < 0) ) {
+        return -1;
+    }
+    result.bytes = pos - offset;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef FILE_STREAM_H
+#define FILE_STREAM_H
+
+// 稀疏模式下，对端不是普通文件(管道、套接字等)时数据以记录的形式传输：
+// 每条记录以8字节大端整数开头，最高位为1表示空洞，其余位为长度；数据记录之后紧跟对应长度的数据，
+// 空洞记录没有数据，长度为0的记录表示结束
+#define FILE_STREAM_HOLE_FLAG (1ULL << 63)
+
+struct FileStreamResult {
+    unsigned long long bytes = 0;       // 传输的逻辑字节数，空洞计入
+    unsigned long long dataBytes = 0;   // 实际传输的数据量
+    bool zeroCopy = false;              // 数据全部由sendfile/splice在内核中传输
+    double seconds = 0;
+
+    double throughput() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+// 把fd中[offset, offset + length)的内容写入outFd的当前位置，数据用sendfile传输，不经过用户态缓冲区
+// sparse为false时空洞以零写出；为true时跳过空洞：outFd是普通文件时在其中留下空洞，否则按记录格式写出
+// 成功返回0，失败返回-1并设置errno
+int fileStreamSend(int fd, int outFd, unsigned long long offset, unsigned long long length, bool sparse,
+    FileStreamResult& result);
+
+// 从inFd读取内容写入fd的offset处，length为0时读到inFd结束，否则最多length字节，输入更多时失败(EFBIG)
+// inFd为管道或套接字时用splice传输，为普通文件时用sendfile，从其当前位置开始读取
+// sparse为true时inFd是普通文件则跳过其中的空洞，否则按记录格式解析；空洞在fd中打洞，fd只会变大不会变小
+// 成功返回0，失败返回-1并设置errno
+int fileStreamReceive(int inFd, int fd, unsigned long long offset, unsigned long long length, bool sparse,
+    FileStreamResult& result);
+
+#endif // FILE_STREAM_H
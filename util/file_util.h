@@ -0,0 +1,16 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <string>
+#include <sys/stat.h>
+
+// 同一个镜像可能以相对路径或符号链接的形式被引用，按设备号和inode比较
+inline bool isSameFile(const std::string& a, const std::string& b) {
+    if ( a == b ) {
+        return true;
+    }
+    struct stat sa, sb;
+    return stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+#endif // FILE_UTIL_H
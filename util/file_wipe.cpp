@@ -0,0 +1,324 @@
+#include "file_wipe.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+
+#define WIPE_ALIGN 4096                     // O_DIRECT要求的缓冲区、偏移和长度对齐
+#define WIPE_BUFFER_SIZE (1 << 20)          // 每次写请求的大小
+#define WIPE_CHUNK_SIZE (16ULL << 20)       // 写入线程一次领取的范围
+#define WIPE_RANGE_STEP (1ULL << 30)        // 打洞、清零每次处理的范围，便于报告进度和限速
+
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+typedef std::function<void(unsigned long long, unsigned long long)> ProgressFn;
+
+// 多个线程共用的限速器，按字节数依次分配发送时间
+class WipeRateLimiter {
+public:
+    explicit WipeRateLimiter(unsigned long long bandwidth) : bandwidth(bandwidth), next(std::chrono::steady_clock::now()) {
+    }
+
+    void acquire(unsigned long long bytes) {
+        if ( bandwidth == 0 ) {
+            return;
+        }
+        std::chrono::steady_clock::time_point at;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto now = std::chrono::steady_clock::now();
+            if ( next < now ) {
+                next = now;
+            }
+            at = next;
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(static_cast< double >(bytes) / bandwidth));
+        }
+        std::this_thread::sleep_until(at);
+    }
+
+private:
+    unsigned long long bandwidth;
+    std::mutex lock;
+    std::chrono::steady_clock::time_point next;
+};
+
+// 当前线程只在磁盘空闲时才能得到IO，擦除不与虚拟机争抢带宽
+static void setIdleIoPriority() {
+#ifdef SYS_ioprio_set
+    if ( syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0 ) {
+        LOG_DEBUG("ioprio_set failed: %s", strerror(errno));
+    }
+#endif
+}
+
+static bool wipeUnsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOTTY || err == EINVAL || err == ENOSYS;
+}
+
+const char* fileWipeMethodName(FileWipeMethod method) {
+    switch ( method ) {
+    case FILE_WIPE_DISCARD:
+        return "discard";
+    case FILE_WIPE_ZERO_RANGE:
+        return "zero-range";
+    case FILE_WIPE_WRITE:
+        return "write";
+    }
+    return "unknown";
+}
+
+// 由文件系统或设备完成打洞或清零，按步长推进以便报告进度
+static int wipeRanges(int fd, bool block, FileWipeMethod method, unsigned long long size,
+    WipeRateLimiter& limiter, const ProgressFn& progress) {
+    auto lastReport = std::chrono::steady_clock::now();
+    for ( unsigned long long offset = 0; offset < size; offset += WIPE_RANGE_STEP ) {
+        unsigned long long len = std::min(WIPE_RANGE_STEP, size - offset);
+        int ret;
+        if ( block ) {
+            uint64_t range[2] = { offset, len };
+            if ( method == FILE_WIPE_ZERO_RANGE ) {
+                // 设备不支持WRITE ZEROES时内核会改为写零页，需要限速
+                limiter.acquire(len);
+            }
+            ret = ioctl(fd, method == FILE_WIPE_DISCARD ? BLKDISCARD : BLKZEROOUT, range);
+        }
+        else {
+            int mode = (method == FILE_WIPE_DISCARD ? FALLOC_FL_PUNCH_HOLE : FALLOC_FL_ZERO_RANGE) | FALLOC_FL_KEEP_SIZE;
+            ret = fallocate(fd, mode, static_cast< off_t >(offset), static_cast< off_t >(len));
+        }
+        if ( ret < 0 ) {
+            return -1;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if ( progress && now - lastReport >= std::chrono::seconds(1) ) {
+            progress(offset + len, size);
+            lastReport = now;
+        }
+    }
+    return 0;
+}
+
+static void fillRandom(char* buffer, size_t len, uint64_t& state) {
+    uint64_t* words = reinterpret_cast< uint64_t* >(buffer);
+    for ( size_t i = 0; i < len / sizeof(uint64_t); i++ ) {
+        // xorshift64*，只用于覆盖数据，不需要密码学强度
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        words[i] = state * 0x2545F4914F6CDD1DULL;
+    }
+}
+
+static int writeFull(int fd, const char* buffer, size_t len, unsigned long long offset) {
+    size_t done = 0;
+    while ( done < len ) {
+        ssize_t n = pwrite(fd, buffer + done, len - done, static_cast< off_t >(offset + done));
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// 多个线程各自领取范围并写入，能用O_DIRECT时绕过页缓存，避免擦除挤掉虚拟机的缓存
+static int wipeWrite(const std::string& path, int fd, unsigned long long size, const FileWipeOptions& options,
+    WipeRateLimiter& limiter) {
+    int directFd = open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+    if ( directFd < 0 ) {
+        LOG_DEBUG("O_DIRECT not available for %s: %s", path.c_str(), strerror(errno));
+    }
+    int writeFd = directFd >= 0 ? directFd : fd;
+    // O_DIRECT只能写对齐的部分，剩余的尾部最后用普通方式写入
+    unsigned long long alignedSize = directFd >= 0 ? size & ~static_cast< unsigned long long >(WIPE_ALIGN - 1) : size;
+    unsigned long long chunks = (alignedSize + WIPE_CHUNK_SIZE - 1) / WIPE_CHUNK_SIZE;
+
+    std::atomic<unsigned long long> nextChunk(0);
+    std::atomic<unsigned long long> done(0);
+    std::atomic<int> firstError(0);
+    std::mutex lock;
+    std::condition_variable finished;
+    unsigned int count = static_cast< unsigned int >(std::min<unsigned long long>(std::max(options.threads, 1U), std::max(chunks, 1ULL)));
+    unsigned int running = count;
+    std::random_device rd;
+    std::vector<uint64_t> seeds;
+    for ( unsigned int i = 0; i < count; i++ ) {
+        seeds.push_back((static_cast< uint64_t >(rd()) << 32) | rd() | 1);
+    }
+
+    auto worker = [&](unsigned int index) {
+        if ( options.idlePriority ) {
+            setIdleIoPriority();
+        }
+        void* mem = nullptr;
+        if ( posix_memalign(&mem, WIPE_ALIGN, WIPE_BUFFER_SIZE) != 0 ) {
+            int expected = 0;
+            firstError.compare_exchange_strong(expected, ENOMEM);
+        }
+        else {
+            char* buffer = static_cast< char* >(mem);
+            memset(buffer, 0, WIPE_BUFFER_SIZE);
+            uint64_t state = seeds[index];
+            unsigned long long chunk;
+            while ( firstError == 0 && (chunk = nextChunk.fetch_add(1)) < chunks ) {
+                unsigned long long offset = chunk * WIPE_CHUNK_SIZE;
+                unsigned long long end = std::min(offset + WIPE_CHUNK_SIZE, alignedSize);
+                for ( ; offset < end && firstError == 0; offset += WIPE_BUFFER_SIZE ) {
+                    size_t len = static_cast< size_t >(std::min(static_cast< unsigned long long >(WIPE_BUFFER_SIZE), end - offset));
+                    if ( options.random ) {
+                        fillRandom(buffer, len, state);
+                    }
+                    limiter.acquire(len);
+                    if ( writeFull(writeFd, buffer, len, offset) < 0 ) {
+                        int expected = 0;
+                        firstError.compare_exchange_strong(expected, errno);
+                        break;
+                    }
+                    done += len;
+                }
+            }
+            free(mem);
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        running--;
+        finished.notify_all();
+    };
+
+    std::vector<std::thread> workers;
+    for ( unsigned int i = 0; i < count; i++ ) {
+        workers.emplace_back(worker, i);
+    }
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while ( !finished.wait_for(guard, std::chrono::seconds(1), [&]() { return running == 0; }) ) {
+            if ( options.progress ) {
+                guard.unlock();
+                options.progress(done, size);
+                guard.lock();
+            }
+        }
+    }
+    for ( auto& t : workers ) {
+        t.join();
+    }
+
+    int ret = firstError == 0 ? 0 : -1;
+    int err = firstError;
+    if ( ret == 0 && alignedSize < size ) {
+        std::vector<char> tail(static_cast< size_t >(size - alignedSize), 0);
+        uint64_t state = seeds[0];
+        if ( options.random ) {
+            std::vector<char> words((tail.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t));
+            fillRandom(words.data(), words.size(), state);
+            memcpy(tail.data(), words.data(), tail.size());
+        }
+        if ( writeFull(fd, tail.data(), tail.size(), alignedSize) < 0 ) {
+            ret = -1;
+            err = errno;
+        }
+    }
+    // O_DIRECT不保证设备缓存落盘
+    if ( ret == 0 && fdatasync(writeFd) < 0 ) {
+        ret = -1;
+        err = errno;
+    }
+    if ( ret == 0 && writeFd != fd && fdatasync(fd) < 0 ) {
+        ret = -1;
+        err = errno;
+    }
+    if ( directFd >= 0 ) {
+        close(directFd);
+    }
+    errno = err;
+    return ret;
+}
+
+int fileWipe(const std::string& path, const FileWipeOptions& options, FileWipeResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = FileWipeResult();
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        return -1;
+    }
+    struct stat st;
+    if ( fstat(fd, &st) < 0 ) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    bool block = S_ISBLK(st.st_mode);
+    unsigned long long size = static_cast< unsigned long long >(st.st_size);
+    if ( block ) {
+        uint64_t bytes = 0;
+        if ( ioctl(fd, BLKGETSIZE64, &bytes) < 0 ) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        size = bytes;
+    }
+    result.bytes = size;
+
+    WipeRateLimiter limiter(options.bandwidth);
+    int ret = -1;
+    // 依次尝试打洞、清零和写入，前面的方法不支持时换下一种
+    std::vector<FileWipeMethod> methods;
+    if ( !options.random && !options.writeOnly ) {
+        if ( options.discard ) {
+            methods.push_back(FILE_WIPE_DISCARD);
+        }
+        methods.push_back(FILE_WIPE_ZERO_RANGE);
+    }
+    int err = 0;
+    for ( FileWipeMethod method : methods ) {
+        ret = wipeRanges(fd, block, method, size, limiter, options.progress);
+        if ( ret == 0 ) {
+            result.method = method;
+            break;
+        }
+        err = errno;
+        if ( !wipeUnsupported(err) ) {
+            break;
+        }
+        LOG_DEBUG("Wipe method %s not supported for %s: %s", fileWipeMethodName(method), path.c_str(), strerror(err));
+    }
+    if ( ret != 0 && (methods.empty() || wipeUnsupported(err)) ) {
+        ret = wipeWrite(path, fd, size, options, limiter);
+        err = errno;
+        result.method = FILE_WIPE_WRITE;
+    }
+    close(fd);
+    if ( ret != 0 ) {
+        errno = err;
+        return -1;
+    }
+    if ( options.progress ) {
+        options.progress(size, size);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef FILE_WIPE_H
+#define FILE_WIPE_H
+
+#include <functional>
+#include <string>
+
+// 擦除实际使用的方法
+enum FileWipeMethod {
+    FILE_WIPE_DISCARD = 0,      // 文件打洞或BLKDISCARD，释放空间
+    FILE_WIPE_ZERO_RANGE,       // fallocate(FALLOC_FL_ZERO_RANGE)或BLKZEROOUT，由文件系统或设备清零
+    FILE_WIPE_WRITE,            // 多线程写入零或随机数据
+};
+
+struct FileWipeOptions {
+    bool random = false;        // 写入随机数据，只能用写入的方式
+    bool discard = false;       // 优先释放空间，不支持时按清零处理
+    bool writeOnly = false;     // 总是实际写入，用于完全预分配新卷
+    unsigned int threads = 2;   // 写入线程数，每个线程同时只有一个未完成的写请求
+    unsigned long long bandwidth = 0;   // 写入和BLKZEROOUT的限速(字节/秒)，0表示不限速
+    bool idlePriority = true;   // 写入线程使用IOPRIO_CLASS_IDLE，只在磁盘空闲时推进
+    // 在调用者线程中大约每秒调用一次，结束时以done == total再调用一次
+    std::function<void(unsigned long long done, unsigned long long total)> progress;
+};
+
+struct FileWipeResult {
+    FileWipeMethod method = FILE_WIPE_WRITE;
+    unsigned long long bytes = 0;
+    double seconds = 0;
+};
+
+const char* fileWipeMethodName(FileWipeMethod method);
+
+// 擦除普通文件或块设备的全部内容，文件大小不变
+// 清零和打洞只保证之后读到零，不保证原有数据块被物理覆盖，需要覆盖时使用random
+// 成功返回0，失败返回-1并设置errno
+int fileWipe(const std::string& path, const FileWipeOptions& options, FileWipeResult& result);
+
+#endif // FILE_WIPE_H
@@ -0,0 +1,506 @@
+#include "host_topology.h"
+#include "cpuset.h"
+#include "../log/log.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <sys/utsname.h>
+
+static const char* NODE_SYSFS_DIR = "/sys/devices/system/node";
+
+// 读取sysfs中只有一个数值的文件
+static bool readULongLongFile(const std::string& path, unsigned long long& value) {
+    std::ifstream file(path);
+    if ( !file.is_open() ) {
+        return false;
+    }
+    file >> value;
+    return !file.fail();
+}
+
+// 读取hugepages目录下所有"hugepages-<size>kB"子目录的统计信息
+static void readHugepages(const std::string& dirPath, std::map<unsigned long long, HostHugepageInfo>& hugepages) {
+    DIR* dir = opendir(dirPath.c_str());
+    if ( !dir ) {
+        return;
+    }
+    struct dirent* entry;
+    while ( (entry = readdir(dir)) != nullptr ) {
+        unsigned long long sizeKiB = 0;
+        if ( sscanf(entry->d_name, "hugepages-%llukB", &sizeKiB) != 1 ) {
+            continue;
+        }
+        HostHugepageInfo info;
+        std::string base = dirPath + "/" + entry->d_name;
+        readULongLongFile(base + "/nr_hugepages", info.total);
+        readULongLongFile(base + "/free_hugepages", info.free);
+        hugepages[sizeKiB] = info;
+    }
+    closedir(dir);
+}
+
+// 从meminfo格式的文件中读取指定字段(单位kB)
+static unsigned long long readMeminfoField(const std::string& path, const std::string& field) {
+    std::ifstream file(path);
+    std::string line;
+    while ( std::getline(file, line) ) {
+        size_t pos = line.find(field + ":");
+        if ( pos == std::string::npos ) {
+            continue;
+        }
+        std::istringstream is(line.substr(pos + field.size() + 1));
+        unsigned long long value = 0;
+        is >> value;
+        return value;
+    }
+    return 0;
+}
+
+std::vector<HostNumaNode> HostTopology::readNumaNodes() {
+    std::vector<HostNumaNode> nodes;
+
+    DIR* dir = opendir(NODE_SYSFS_DIR);
+    if ( dir ) {
+        struct dirent* entry;
+        while ( (entry = readdir(dir)) != nullptr ) {
+            int id;
+            char trailing;
+            if ( sscanf(entry->d_name, "node%d%c", &id, &trailing) != 1 ) {
+                continue;
+            }
+            HostNumaNode node;
+            node.id = id;
+            std::string base = std::string(NODE_SYSFS_DIR) + "/" + entry->d_name;
+            node.memTotalKiB = readMeminfoField(base + "/meminfo", "MemTotal");
+            node.memFreeKiB = readMeminfoField(base + "/meminfo", "MemFree");
+
+            std::ifstream cpulist(base + "/cpulist");
+            std::string cpus;
+            if ( std::getline(cpulist, cpus) ) {
+                try {
+                    node.cpus = parseCpuSet(cpus);
+                }
+                catch ( const std::exception& e ) {
+                    LOG_WARN("Failed to parse cpulist of NUMA node %d: %s", id, e.what());
+                }
+            }
+            readHugepages(base + "/hugepages", node.hugepages);
+            nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+
+    if ( nodes.empty() ) {
+        // 非NUMA宿主机，整机视为节点0
+        HostNumaNode node;
+        node.id = 0;
+        node.memTotalKiB = readMeminfoField("/proc/meminfo", "MemTotal");
+        node.memFreeKiB = readMeminfoField("/proc/meminfo", "MemFree");
+        readHugepages("/sys/kernel/mm/hugepages", node.hugepages);
+        nodes.push_back(node);
+    }
+
+    std::sort(nodes.begin(), nodes.end(),
+        [](const HostNumaNode& a, const HostNumaNode& b) { return a.id < b.id; });
+    return nodes;
+}
+
+std::vector<HostCpu> HostTopology::readCpus() {
+    std::vector<HostCpu> cpus;
+
+    std::vector<int> online;
+    std::ifstream onlineFile("/sys/devices/system/cpu/online");
+    std::string onlineList;
+    if ( std::getline(onlineFile, onlineList) ) {
+        try {
+            online = parseCpuSet(onlineList);
+        }
+        catch ( const std::exception& e ) {
+            LOG_WARN("Failed to parse online cpu list: %s", e.what());
+        }
+    }
+
+    // CPU编号 -> NUMA节点
+    std::map<int, int> cpuToNode;
+    for ( const auto& node : readNumaNodes() ) {
+        for ( int cpu : node.cpus ) {
+            cpuToNode[cpu] = node.id;
+        }
+    }
+
+    for ( int id : online ) {
+        HostCpu cpu;
+        cpu.id = id;
+        std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology";
+        unsigned long long value = 0;
+        cpu.coreId = readULongLongFile(base + "/core_id", value) ? static_cast< int >(value) : id;
+        cpu.packageId = readULongLongFile(base + "/physical_package_id", value) ? static_cast< int >(value) : 0;
+        auto it = cpuToNode.find(id);
+        cpu.nodeId = it != cpuToNode.end() ? it->second : 0;
+        cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+unsigned long long HostTopology::defaultHugepageSizeKiB() {
+    return readMeminfoField("/proc/meminfo", "Hugepagesize");
+}
+
+std::string HostTopology::hugetlbfsMountPoint(unsigned long long pageSizeKiB) {
+    std::ifstream mounts("/proc/mounts");
+    std::string line;
+    unsigned long long defaultSize = defaultHugepageSizeKiB();
+    while ( std::getline(mounts, line) ) {
+        std::istringstream is(line);
+        std::string source, target, fstype, options;
+        if ( !(is >> source >> target >> fstype >> options) || fstype != "hugetlbfs" ) {
+            continue;
+        }
+
+        // 挂载选项中没有pagesize时使用系统默认大页大小
+        unsigned long long mountSize = defaultSize;
+        size_t pos = options.find("pagesize=");
+        if ( pos != std::string::npos ) {
+            std::string value = options.substr(pos + 9, options.find(',', pos) - pos - 9);
+            unsigned long long number = std::stoull(value);
+            char unit = value.empty() ? 'K' : value.back();
+            if ( unit == 'G' ) {
+                mountSize = number * 1024 * 1024;
+            }
+            else if ( unit == 'M' ) {
+                mountSize = number * 1024;
+            }
+            else if ( unit == 'K' || unit == 'k' ) {
+                mountSize = number;
+            }
+            else {
+                mountSize = number / 1024;
+            }
+        }
+        if ( mountSize == pageSizeKiB ) {
+            return target;
+        }
+    }
+    return "";
+}
+
+int HostTopology::pickNodeForHugepages(const std::vector<HostNumaNode>& nodes, unsigned long long pageSizeKiB,
+    unsigned long long pagesNeeded, const std::vector<int>& allowedNodes) {
+    int best = -1;
+    unsigned long long bestFree = 0;
+    for ( const auto& node : nodes ) {
+        if ( !allowedNodes.empty() &&
+            std::find(allowedNodes.begin(), allowedNodes.end(), node.id) == allowedNodes.end() ) {
+            continue;
+        }
+        auto it = node.hugepages.find(pageSizeKiB);
+        if ( it == node.hugepages.end() || it->second.free < pagesNeeded ) {
+            continue;
+        }
+        if ( best < 0 || it->second.free > bestFree ) {
+            best = node.id;
+            bestFree = it->second.free;
+        }
+    }
+    return best;
+}
+
+static unsigned long long monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast< unsigned long long >(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 缓存时间未超过maxAgeMs时不需要刷新
+static bool isFresh(unsigned long long updated, unsigned int maxAgeMs) {
+    return updated != 0 && maxAgeMs != 0 && monotonicMs() - updated < maxAgeMs;
+}
+
+// 从打开的procfs/sysfs文件开头重新读取全部内容，文件内容会在偏移0处重新生成
+static ssize_t preadAll(int fd, std::vector<char>& buf) {
+    if ( fd < 0 ) {
+        return -1;
+    }
+    size_t total = 0;
+    while ( true ) {
+        if ( total + 1 >= buf.size() ) {
+            buf.resize(buf.size() * 2);
+        }
+        ssize_t ret = pread(fd, buf.data() + total, buf.size() - 1 - total, total);
+        if ( ret < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( ret == 0 ) {
+            break;
+        }
+        total += ret;
+    }
+    buf[total] = '\0';
+    return total;
+}
+
+static unsigned long long preadULongLong(int fd, std::vector<char>& buf) {
+    if ( preadAll(fd, buf) <= 0 ) {
+        return 0;
+    }
+    return strtoull(buf.data(), nullptr, 10);
+}
+
+// 在meminfo格式的内容中查找字段，字段名前只能是行首或空格(节点的meminfo以"Node N "开头)
+static unsigned long long findMeminfoValue(const char* buf, const char* key) {
+    size_t keyLen = strlen(key);
+    for ( const char* p = strstr(buf, key); p; p = strstr(p + 1, key) ) {
+        if ( (p == buf || p[-1] == '\n' || p[-1] == ' ') && p[keyLen] == ':' ) {
+            return strtoull(p + keyLen + 1, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+HostInfo* HostInfo::Instance() {
+    static HostInfo instance;
+    return &instance;
+}
+
+HostInfo::HostInfo()
+    : loaded(false), cpuMhz(0), defaultHugepageSizeKiB(0), nodesUpdated(0), statFd(-1), timesUpdated(0),
+    meminfoFd(-1), memoryUpdated(0), readBuffer(65536) {
+}
+
+HostInfo::~HostInfo() {
+    closeFds();
+}
+
+void HostInfo::closeFds() {
+    for ( auto& node : nodeFds ) {
+        if ( node.meminfoFd >= 0 ) {
+            close(node.meminfoFd);
+        }
+        for ( auto& entry : node.hugepages ) {
+            if ( entry.second.totalFd >= 0 ) {
+                close(entry.second.totalFd);
+            }
+            if ( entry.second.freeFd >= 0 ) {
+                close(entry.second.freeFd);
+            }
+        }
+    }
+    nodeFds.clear();
+    if ( statFd >= 0 ) {
+        close(statFd);
+        statFd = -1;
+    }
+    if ( meminfoFd >= 0 ) {
+        close(meminfoFd);
+        meminfoFd = -1;
+    }
+}
+
+void HostInfo::loadStatic() {
+    if ( loaded ) {
+        return;
+    }
+
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    cpuModel.clear();
+    cpuMhz = 0;
+    while ( std::getline(cpuinfo, line) && (cpuModel.empty() || cpuMhz == 0) ) {
+        size_t colon = line.find(':');
+        if ( colon == std::string::npos ) {
+            continue;
+        }
+        std::string key = line.substr(0, line.find_last_not_of(" \t", colon - 1) + 1);
+        std::string value = line.substr(std::min(colon + 2, line.size()));
+        if ( key == "model name" && cpuModel.empty() ) {
+            cpuModel = value;
+        }
+        else if ( key == "cpu MHz" && cpuMhz == 0 ) {
+            cpuMhz = static_cast< unsigned int >(strtod(value.c_str(), nullptr));
+        }
+    }
+    if ( cpuModel.empty() ) {
+        struct utsname uts;
+        cpuModel = uname(&uts) == 0 ? uts.machine : "unknown";
+    }
+
+    cpus = HostTopology::readCpus();
+    defaultHugepageSizeKiB = HostTopology::defaultHugepageSizeKiB();
+    nodes = HostTopology::readNumaNodes();
+
+    // 为计数类文件保持打开的描述符，非NUMA宿主机的节点0使用整机的文件
+    bool numa = access(NODE_SYSFS_DIR, F_OK) == 0;
+    for ( const auto& node : nodes ) {
+        NodeFds fds;
+        std::string base = std::string(NODE_SYSFS_DIR) + "/node" + std::to_string(node.id);
+        std::string meminfoPath = numa ? base + "/meminfo" : "/proc/meminfo";
+        std::string hugepageDir = numa ? base + "/hugepages" : "/sys/kernel/mm/hugepages";
+        fds.meminfoFd = open(meminfoPath.c_str(), O_RDONLY | O_CLOEXEC);
+        for ( const auto& entry : node.hugepages ) {
+            std::string dir = hugepageDir + "/hugepages-" + std::to_string(entry.first) + "kB";
+            HugepageFds hp;
+            hp.totalFd = open((dir + "/nr_hugepages").c_str(), O_RDONLY | O_CLOEXEC);
+            hp.freeFd = open((dir + "/free_hugepages").c_str(), O_RDONLY | O_CLOEXEC);
+            fds.hugepages[entry.first] = hp;
+        }
+        nodeFds.push_back(fds);
+    }
+    nodesUpdated = monotonicMs();
+
+    statFd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    meminfoFd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    timesUpdated = 0;
+    memoryUpdated = 0;
+    loaded = true;
+    LOG_INFO("Host topology cached: %zu cpus, %zu NUMA nodes, model %s", cpus.size(), nodes.size(), cpuModel.c_str());
+}
+
+void HostInfo::invalidate() {
+    std::lock_guard<std::mutex> guard(lock);
+    closeFds();
+    loaded = false;
+}
+
+void HostInfo::refreshCpuTimes(unsigned int maxAgeMs) {
+    if ( isFresh(timesUpdated, maxAgeMs) ) {
+        return;
+    }
+    if ( preadAll(statFd, readBuffer) <= 0 ) {
+        LOG_ERROR("Failed to read /proc/stat");
+        return;
+    }
+    static const unsigned long long nsPerTick = 1000000000ULL / sysconf(_SC_CLK_TCK);
+    std::fill(cpuPresent.begin(), cpuPresent.end(), false);
+
+    // 开头依次为"cpu"合计行和各个"cpuN"行
+    char* save = nullptr;
+    for ( char* line = strtok_r(readBuffer.data(), "\n", &save); line && strncmp(line, "cpu", 3) == 0;
+        line = strtok_r(nullptr, "\n", &save) ) {
+        unsigned long long v[7] = { 0 };
+        int id = -1;
+        char* fields = line + 3;
+        if ( *fields != ' ' ) {
+            id = static_cast< int >(strtol(fields, &fields, 10));
+        }
+        if ( sscanf(fields, "%llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) < 4 ) {
+            continue;
+        }
+        HostCpuTimes times;
+        times.user = v[0] * nsPerTick;
+        times.nice = v[1] * nsPerTick;
+        times.system = v[2] * nsPerTick;
+        times.idle = v[3] * nsPerTick;
+        times.iowait = v[4] * nsPerTick;
+        times.irq = v[5] * nsPerTick;
+        times.softirq = v[6] * nsPerTick;
+        if ( id < 0 ) {
+            totalTimes = times;
+            continue;
+        }
+        if ( static_cast< size_t >(id) >= cpuTimes.size() ) {
+            cpuTimes.resize(id + 1);
+            cpuPresent.resize(id + 1, false);
+        }
+        cpuTimes[id] = times;
+        cpuPresent[id] = true;
+    }
+    timesUpdated = monotonicMs();
+}
+
+void HostInfo::refreshMemory(unsigned int maxAgeMs) {
+    if ( isFresh(memoryUpdated, maxAgeMs) ) {
+        return;
+    }
+    if ( preadAll(meminfoFd, readBuffer) <= 0 ) {
+        LOG_ERROR("Failed to read /proc/meminfo");
+        return;
+    }
+    memory.total = findMeminfoValue(readBuffer.data(), "MemTotal");
+    memory.free = findMeminfoValue(readBuffer.data(), "MemFree");
+    memory.available = findMeminfoValue(readBuffer.data(), "MemAvailable");
+    memory.buffers = findMeminfoValue(readBuffer.data(), "Buffers");
+    memory.cached = findMeminfoValue(readBuffer.data(), "Cached");
+    memoryUpdated = monotonicMs();
+}
+
+void HostInfo::refreshNodes(unsigned int maxAgeMs) {
+    if ( isFresh(nodesUpdated, maxAgeMs) ) {
+        return;
+    }
+    for ( size_t i = 0; i < nodes.size(); i++ ) {
+        NodeFds& fds = nodeFds[i];
+        if ( preadAll(fds.meminfoFd, readBuffer) > 0 ) {
+            nodes[i].memTotalKiB = findMeminfoValue(readBuffer.data(), "MemTotal");
+            nodes[i].memFreeKiB = findMeminfoValue(readBuffer.data(), "MemFree");
+        }
+        for ( auto& entry : fds.hugepages ) {
+            HostHugepageInfo& info = nodes[i].hugepages[entry.first];
+            info.total = preadULongLong(entry.second.totalFd, readBuffer);
+            info.free = preadULongLong(entry.second.freeFd, readBuffer);
+        }
+    }
+    nodesUpdated = monotonicMs();
+}
+
+std::string HostInfo::getCpuModel() {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    return cpuModel;
+}
+
+unsigned int HostInfo::getCpuMhz() {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    return cpuMhz;
+}
+
+std::vector<HostCpu> HostInfo::getCpus() {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    return cpus;
+}
+
+unsigned long long HostInfo::getDefaultHugepageSizeKiB() {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    return defaultHugepageSizeKiB;
+}
+
+std::vector<HostNumaNode> HostInfo::getNumaNodes(unsigned int maxAgeMs) {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    refreshNodes(maxAgeMs);
+    return nodes;
+}
+
+bool HostInfo::getCpuTimes(int cpu, HostCpuTimes& times, unsigned int maxAgeMs) {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    refreshCpuTimes(maxAgeMs);
+    if ( cpu < 0 ) {
+        times = totalTimes;
+        return true;
+    }
+    if ( static_cast< size_t >(cpu) >= cpuTimes.size() || !cpuPresent[cpu] ) {
+        return false;
+    }
+    times = cpuTimes[cpu];
+    return true;
+}
+
+HostMemory HostInfo::getMemory(unsigned int maxAgeMs) {
+    std::lock_guard<std::mutex> guard(lock);
+    loadStatic();
+    refreshMemory(maxAgeMs);
+    return memory;
+}
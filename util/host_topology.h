@@ -0,0 +1,140 @@
+#ifndef HOST_TOPOLOGY_H
+#define HOST_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+// 某一种大页在NUMA节点上的数量
+struct HostHugepageInfo {
+    unsigned long long total = 0;   // 已预留的大页数量
+    unsigned long long free = 0;    // 空闲大页数量
+};
+
+// 宿主机NUMA节点信息
+struct HostNumaNode {
+    int id = 0;
+    unsigned long long memTotalKiB = 0;
+    unsigned long long memFreeKiB = 0;
+    std::vector<int> cpus;                                  // 节点上的CPU编号
+    std::map<unsigned long long, HostHugepageInfo> hugepages;   // 大页大小(KiB) -> 数量
+};
+
+// 宿主机逻辑CPU信息
+struct HostCpu {
+    int id = 0;
+    int coreId = 0;         // 物理核编号(在同一个socket内唯一)
+    int packageId = 0;      // socket编号
+    int nodeId = 0;         // 所属NUMA节点
+};
+
+// 读取宿主机拓扑信息，数据来自/sys/devices/system/node及/proc
+// 不支持NUMA的宿主机会被视为只有一个节点0
+class HostTopology {
+public:
+    static std::vector<HostNumaNode> readNumaNodes();
+
+    // 读取所有在线CPU的拓扑，数据来自/sys/devices/system/cpu
+    static std::vector<HostCpu> readCpus();
+
+    // 系统默认大页大小(KiB)，来自/proc/meminfo中的Hugepagesize
+    static unsigned long long defaultHugepageSizeKiB();
+
+    // 查找给定大页大小对应的hugetlbfs挂载点，未挂载时返回空字符串
+    static std::string hugetlbfsMountPoint(unsigned long long pageSizeKiB);
+
+    // 在允许的节点中选择空闲大页足够且最多的节点，allowedNodes为空表示不限制
+    // 没有任何单个节点满足要求时返回-1
+    static int pickNodeForHugepages(const std::vector<HostNumaNode>& nodes, unsigned long long pageSizeKiB,
+        unsigned long long pagesNeeded, const std::vector<int>& allowedNodes);
+};
+
+// 宿主机CPU累计时间(ns)，来自/proc/stat
+struct HostCpuTimes {
+    unsigned long long user = 0;
+    unsigned long long nice = 0;
+    unsigned long long system = 0;
+    unsigned long long idle = 0;
+    unsigned long long iowait = 0;
+    unsigned long long irq = 0;
+    unsigned long long softirq = 0;
+};
+
+// 宿主机内存信息(KiB)，来自/proc/meminfo
+struct HostMemory {
+    unsigned long long total = 0;
+    unsigned long long free = 0;
+    unsigned long long available = 0;
+    unsigned long long buffers = 0;
+    unsigned long long cached = 0;
+};
+
+// 宿主机信息缓存
+// CPU型号、CPU拓扑和节点组成等静态信息只在第一次使用时读取一次；
+// CPU时间、内存和大页数量等计数保持文件描述符打开，刷新时只用pread重读这些小文件
+// maxAgeMs表示可以接受的缓存时间，为0时总是刷新
+class HostInfo {
+public:
+    static HostInfo* Instance();
+
+    std::string getCpuModel();
+    unsigned int getCpuMhz();
+    std::vector<HostCpu> getCpus();
+    unsigned long long getDefaultHugepageSizeKiB();
+    std::vector<HostNumaNode> getNumaNodes(unsigned int maxAgeMs = 0);
+
+    // cpu为-1时返回所有CPU的合计，CPU不存在时返回false
+    bool getCpuTimes(int cpu, HostCpuTimes& times, unsigned int maxAgeMs = 0);
+    HostMemory getMemory(unsigned int maxAgeMs = 0);
+
+    // CPU或内存热插拔后调用，下次访问时重新读取静态信息
+    void invalidate();
+
+private:
+    HostInfo();
+    ~HostInfo();
+    HostInfo(const HostInfo&) = delete;
+    HostInfo& operator=(const HostInfo&) = delete;
+
+    // 以下函数调用时需持有lock
+    void loadStatic();
+    void closeFds();
+    void refreshCpuTimes(unsigned int maxAgeMs);
+    void refreshMemory(unsigned int maxAgeMs);
+    void refreshNodes(unsigned int maxAgeMs);
+
+    struct HugepageFds {
+        int totalFd = -1;
+        int freeFd = -1;
+    };
+    struct NodeFds {
+        int meminfoFd = -1;
+        std::map<unsigned long long, HugepageFds> hugepages;
+    };
+
+    std::mutex lock;
+    bool loaded;
+    std::string cpuModel;
+    unsigned int cpuMhz;
+    std::vector<HostCpu> cpus;
+    unsigned long long defaultHugepageSizeKiB;
+
+    std::vector<HostNumaNode> nodes;
+    std::vector<NodeFds> nodeFds;               // 与nodes一一对应
+    unsigned long long nodesUpdated;            // 上次刷新时间(CLOCK_MONOTONIC, ms)，0表示未读取
+
+    int statFd;
+    HostCpuTimes totalTimes;
+    std::vector<HostCpuTimes> cpuTimes;         // 按CPU编号索引
+    std::vector<bool> cpuPresent;
+    unsigned long long timesUpdated;
+
+    int meminfoFd;
+    HostMemory memory;
+    unsigned long long memoryUpdated;
+
+    std::vector<char> readBuffer;               // pread使用的缓冲区，避免每次刷新分配内存
+};
+
+#endif // HOST_TOPOLOGY_H
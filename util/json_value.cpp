@@ -0,0 +1,310 @@
+#include "json_value.h"
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+// 递归下降解析器
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text(text), pos(0) {}
+
+    JsonValue parseDocument() {
+        JsonValue value = parseValue(0);
+        skipWhitespace();
+        if ( pos != text.size() ) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    static const int MAX_DEPTH = 128;
+    const std::string& text;
+    size_t pos;
+
+    void fail(const std::string& what) {
+        throw std::runtime_error("Invalid JSON at offset " + std::to_string(pos) + ": " + what);
+    }
+
+    void skipWhitespace() {
+        while ( pos < text.size() &&
+            (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n') ) {
+            pos++;
+        }
+    }
+
+    bool consume(const char* literal) {
+        size_t len = strlen(literal);
+        if ( text.compare(pos, len, literal) == 0 ) {
+            pos += len;
+            return true;
+        }
+        return false;
+    }
+
+    JsonValue parseValue(int depth) {
+        if ( depth > MAX_DEPTH ) {
+            fail("nesting too deep");
+        }
+        skipWhitespace();
+        if ( pos >= text.size() ) {
+            fail("unexpected end of input");
+        }
+
+        JsonValue value;
+        char c = text[pos];
+        if ( c == '{' ) {
+            pos++;
+            value.type = JsonValue::JSON_OBJECT;
+            skipWhitespace();
+            if ( pos < text.size() && text[pos] == '}' ) {
+                pos++;
+                return value;
+            }
+            while ( true ) {
+                skipWhitespace();
+                if ( pos >= text.size() || text[pos] != '"' ) {
+                    fail("expected object key");
+                }
+                std::string key = parseString();
+                skipWhitespace();
+                if ( pos >= text.size() || text[pos] != ':' ) {
+                    fail("expected ':'");
+                }
+                pos++;
+                value.object.push_back(std::make_pair(key, parseValue(depth + 1)));
+                skipWhitespace();
+                if ( pos < text.size() && text[pos] == ',' ) {
+                    pos++;
+                    continue;
+                }
+                if ( pos < text.size() && text[pos] == '}' ) {
+                    pos++;
+                    return value;
+                }
+                fail("expected ',' or '}'");
+            }
+        }
+        if ( c == '[' ) {
+            pos++;
+            value.type = JsonValue::JSON_ARRAY;
+            skipWhitespace();
+            if ( pos < text.size() && text[pos] == ']' ) {
+                pos++;
+                return value;
+            }
+            while ( true ) {
+                value.array.push_back(parseValue(depth + 1));
+                skipWhitespace();
+                if ( pos < text.size() && text[pos] == ',' ) {
+                    pos++;
+                    continue;
+                }
+                if ( pos < text.size() && text[pos] == ']' ) {
+                    pos++;
+                    return value;
+                }
+                fail("expected ',' or ']'");
+            }
+        }
+        if ( c == '"' ) {
+            value.type = JsonValue::JSON_STRING;
+            value.str = parseString();
+            return value;
+        }
+        if ( consume("true") ) {
+            value.type = JsonValue::JSON_BOOL;
+            value.boolean = true;
+            return value;
+        }
+        if ( consume("false") ) {
+            value.type = JsonValue::JSON_BOOL;
+            return value;
+        }
+        if ( consume("null") ) {
+            return value;
+        }
+        if ( c == '-' || (c >= '0' && c <= '9') ) {
+            size_t start = pos;
+            pos++;
+            while ( pos < text.size() && (isdigit(static_cast< unsigned char >(text[pos])) || text[pos] == '.' ||
+                text[pos] == 'e' || text[pos] == 'E' || text[pos] == '+' || text[pos] == '-') ) {
+                pos++;
+            }
+            value.type = JsonValue::JSON_NUMBER;
+            value.numberText = text.substr(start, pos - start);
+            value.number = strtod(value.numberText.c_str(), nullptr);
+            return value;
+        }
+        fail(std::string("unexpected character '") + c + "'");
+        return value;
+    }
+
+    static void appendUtf8(std::string& out, unsigned int cp) {
+        if ( cp < 0x80 ) {
+            out += static_cast< char >(cp);
+        }
+        else if ( cp < 0x800 ) {
+            out += static_cast< char >(0xC0 | (cp >> 6));
+            out += static_cast< char >(0x80 | (cp & 0x3F));
+        }
+        else if ( cp < 0x10000 ) {
+            out += static_cast< char >(0xE0 | (cp >> 12));
+            out += static_cast< char >(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast< char >(0x80 | (cp & 0x3F));
+        }
+        else {
+            out += static_cast< char >(0xF0 | (cp >> 18));
+            out += static_cast< char >(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast< char >(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast< char >(0x80 | (cp & 0x3F));
+        }
+    }
+
+    unsigned int parseHex4() {
+        if ( pos + 4 > text.size() ) {
+            fail("truncated unicode escape");
+        }
+        unsigned int cp = 0;
+        for ( int i = 0; i < 4; i++ ) {
+            char h = text[pos++];
+            cp <<= 4;
+            if ( h >= '0' && h <= '9' ) cp |= h - '0';
+            else if ( h >= 'a' && h <= 'f' ) cp |= h - 'a' + 10;
+            else if ( h >= 'A' && h <= 'F' ) cp |= h - 'A' + 10;
+            else fail("invalid unicode escape");
+        }
+        return cp;
+    }
+
+    std::string parseString() {
+        pos++;  // 跳过起始引号
+        std::string out;
+        while ( pos < text.size() ) {
+            char c = text[pos++];
+            if ( c == '"' ) {
+                return out;
+            }
+            if ( c != '\\' ) {
+                out += c;
+                continue;
+            }
+            if ( pos >= text.size() ) {
+                break;
+            }
+            char e = text[pos++];
+            switch ( e ) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned int cp = parseHex4();
+                // 代理对
+                if ( cp >= 0xD800 && cp <= 0xDBFF && text.compare(pos, 2, "\\u") == 0 ) {
+                    pos += 2;
+                    unsigned int low = parseHex4();
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default:
+                fail("invalid escape");
+            }
+        }
+        fail("unterminated string");
+        return out;
+    }
+};
+
+JsonValue JsonValue::parse(const std::string& text) {
+    JsonParser parser(text);
+    return parser.parseDocument();
+}
+
+std::string JsonValue::quote(const std::string& str) {
+    std::string out = "\"";
+    for ( char c : str ) {
+        switch ( c ) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ( static_cast< unsigned char >(c) < 0x20 ) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    out += "\"";
+    return out;
+}
+
+const JsonValue* JsonValue::get(const std::string& key) const {
+    if ( type != JSON_OBJECT ) {
+        return nullptr;
+    }
+    for ( const auto& member : object ) {
+        if ( member.first == key ) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+bool JsonValue::asBool(bool def) const {
+    return type == JSON_BOOL ? boolean : def;
+}
+
+long long JsonValue::asInt(long long def) const {
+    if ( type != JSON_NUMBER ) {
+        return def;
+    }
+    char* end = nullptr;
+    long long value = strtoll(numberText.c_str(), &end, 10);
+    return (end && *end == '\0') ? value : static_cast< long long >(number);
+}
+
+unsigned long long JsonValue::asUInt(unsigned long long def) const {
+    if ( type != JSON_NUMBER ) {
+        return def;
+    }
+    if ( !numberText.empty() && numberText[0] == '-' ) {
+        return def;
+    }
+    char* end = nullptr;
+    unsigned long long value = strtoull(numberText.c_str(), &end, 10);
+    return (end && *end == '\0') ? value : static_cast< unsigned long long >(number);
+}
+
+double JsonValue::asDouble(double def) const {
+    return type == JSON_NUMBER ? number : def;
+}
+
+long long JsonValue::getInt(const std::string& key, long long def) const {
+    const JsonValue* value = get(key);
+    return value ? value->asInt(def) : def;
+}
+
+unsigned long long JsonValue::getUInt(const std::string& key, unsigned long long def) const {
+    const JsonValue* value = get(key);
+    return value ? value->asUInt(def) : def;
+}
+
+std::string JsonValue::getString(const std::string& key, const std::string& def) const {
+    const JsonValue* value = get(key);
+    return (value && value->isString()) ? value->asString() : def;
+}
@@ -0,0 +1,59 @@
+#ifndef JSON_VALUE_H
+#define JSON_VALUE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// 轻量的JSON值，用于解析QMP返回的消息
+class JsonValue {
+public:
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+    JsonValue() : type(JSON_NULL) {}
+
+    // 解析JSON文本，格式错误时抛出std::runtime_error
+    static JsonValue parse(const std::string& text);
+    // 将字符串转义为JSON字符串字面量(包含两侧引号)，用于拼接QMP命令
+    static std::string quote(const std::string& str);
+
+    Type getType() const { return type; }
+    bool isNull() const { return type == JSON_NULL; }
+    bool isObject() const { return type == JSON_OBJECT; }
+    bool isArray() const { return type == JSON_ARRAY; }
+    bool isString() const { return type == JSON_STRING; }
+    bool isNumber() const { return type == JSON_NUMBER; }
+
+    // 对象成员查找，不存在或者不是对象时返回nullptr
+    const JsonValue* get(const std::string& key) const;
+    bool has(const std::string& key) const { return get(key) != nullptr; }
+
+    // 取值，类型不匹配时返回默认值
+    bool asBool(bool def = false) const;
+    long long asInt(long long def = 0) const;
+    unsigned long long asUInt(unsigned long long def = 0) const;
+    double asDouble(double def = 0) const;
+    const std::string& asString() const { return str; }
+
+    // 读取对象成员的便捷方法，成员不存在时返回默认值
+    long long getInt(const std::string& key, long long def = 0) const;
+    unsigned long long getUInt(const std::string& key, unsigned long long def = 0) const;
+    std::string getString(const std::string& key, const std::string& def = "") const;
+
+    const std::vector<JsonValue>& elements() const { return array; }
+    const std::vector<std::pair<std::string, JsonValue>>& members() const { return object; }
+    size_t size() const { return type == JSON_ARRAY ? array.size() : object.size(); }
+
+private:
+    Type type;
+    bool boolean = false;
+    double number = 0;
+    std::string numberText;     // 保留原始文本，避免大整数经过double后丢失精度
+    std::string str;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    friend class JsonParser;
+};
+
+#endif // JSON_VALUE_H
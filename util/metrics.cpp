@@ -0,0 +1,157 @@
+#include "metrics.h"
+#include <cstdio>
+#include <stdexcept>
+
+static const double defaultLatencyBounds[] = {
+    0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+};
+
+MetricHistogram::MetricHistogram(const std::vector<double>& bounds)
+    : bounds(bounds), buckets(new std::atomic<unsigned long long>[bounds.size() + 1]) {
+    for ( size_t i = 0; i <= bounds.size(); i++ ) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricHistogram::observe(double seconds) {
+    size_t i = 0;
+    while ( i < bounds.size() && seconds > bounds[i] ) {
+        i++;
+    }
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(static_cast< unsigned long long >(seconds * 1e9), std::memory_order_relaxed);
+}
+
+void MetricHistogram::render(const std::string& name, const std::string& labels, std::string& out) const {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    char buf[512];
+    unsigned long long cumulative = 0;
+    for ( size_t i = 0; i < bounds.size(); i++ ) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        snprintf(buf, sizeof(buf), "%s_bucket{%sle=\"%g\"} %llu\n", name.c_str(), prefix.c_str(), bounds[i], cumulative);
+        out += buf;
+    }
+    cumulative += buckets[bounds.size()].load(std::memory_order_relaxed);
+    std::string braced = labels.empty() ? "" : "{" + labels + "}";
+    snprintf(buf, sizeof(buf), "%s_bucket{%sle=\"+Inf\"} %llu\n%s_sum%s %.9f\n%s_count%s %llu\n",
+        name.c_str(), prefix.c_str(), cumulative,
+        name.c_str(), braced.c_str(), sumNs.load(std::memory_order_relaxed) / 1e9,
+        name.c_str(), braced.c_str(), cumulative);
+    out += buf;
+}
+
+Metrics* Metrics::Instance() {
+    static Metrics instance;
+    return &instance;
+}
+
+Metrics::Family& Metrics::family(const std::string& name, const std::string& help, MetricType type) {
+    auto it = families.find(name);
+    if ( it == families.end() ) {
+        Family& f = families[name];
+        f.help = help;
+        f.type = type;
+        return f;
+    }
+    if ( it->second.type != type ) {
+        throw std::runtime_error("Metric " + name + " registered with a different type");
+    }
+    return it->second;
+}
+
+MetricCounter* Metrics::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto& slot = family(name, help, METRIC_COUNTER).counters[labels];
+    if ( !slot ) {
+        slot.reset(new MetricCounter());
+    }
+    return slot.get();
+}
+
+MetricGauge* Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto& slot = family(name, help, METRIC_GAUGE).gauges[labels];
+    if ( !slot ) {
+        slot.reset(new MetricGauge());
+    }
+    return slot.get();
+}
+
+MetricHistogram* Metrics::histogram(const std::string& name, const std::string& help, const std::string& labels,
+    const std::vector<double>& bounds) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto& slot = family(name, help, METRIC_HISTOGRAM).histograms[labels];
+    if ( !slot ) {
+        if ( bounds.empty() ) {
+            slot.reset(new MetricHistogram(std::vector<double>(defaultLatencyBounds,
+                defaultLatencyBounds + sizeof(defaultLatencyBounds) / sizeof(defaultLatencyBounds[0]))));
+        }
+        else {
+            slot.reset(new MetricHistogram(bounds));
+        }
+    }
+    return slot.get();
+}
+
+void Metrics::render(std::string& out) const {
+    static const char* typeNames[] = { "counter", "gauge", "histogram" };
+    std::lock_guard<std::mutex> guard(lock);
+    char buf[512];
+    for ( const auto& entry : families ) {
+        const std::string& name = entry.first;
+        const Family& f = entry.second;
+        out += "# HELP " + name + " " + f.help + "\n";
+        out += "# TYPE " + name + " " + typeNames[f.type] + "\n";
+        for ( const auto& c : f.counters ) {
+            std::string braced = c.first.empty() ? "" : "{" + c.first + "}";
+            snprintf(buf, sizeof(buf), "%s%s %llu\n", name.c_str(), braced.c_str(), c.second->get());
+            out += buf;
+        }
+        for ( const auto& g : f.gauges ) {
+            std::string braced = g.first.empty() ? "" : "{" + g.first + "}";
+            snprintf(buf, sizeof(buf), "%s%s %lld\n", name.c_str(), braced.c_str(), g.second->get());
+            out += buf;
+        }
+        for ( const auto& h : f.histograms ) {
+            h.second->render(name, h.first, out);
+        }
+    }
+}
+
+std::string Metrics::escapeLabel(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for ( char c : value ) {
+        if ( c == '\\' || c == '"' ) {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if ( c == '\n' ) {
+            escaped += "\\n";
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static MetricGauge* apiQueueDepth() {
+    static MetricGauge* depth = Metrics::Instance()->gauge("tinyvirt_api_queue_depth",
+        "Driver API calls currently running or waiting for the driver lock");
+    return depth;
+}
+
+MetricsOpTimer::MetricsOpTimer(const char* op)
+    : histogram(Metrics::Instance()->histogram("tinyvirt_api_duration_seconds",
+        "Latency of hypervisor driver API calls, including time spent waiting for the driver lock",
+        std::string("op=\"") + op + "\"")),
+    start(std::chrono::steady_clock::now()) {
+    apiQueueDepth()->inc();
+}
+
+MetricsOpTimer::~MetricsOpTimer() {
+    apiQueueDepth()->dec();
+    histogram->observe(std::chrono::duration_cast< std::chrono::duration<double> >(
+        std::chrono::steady_clock::now() - start).count());
+}
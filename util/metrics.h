@@ -0,0 +1,89 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 进程内指标注册表，按Prometheus文本格式输出
+// 指标对象注册后地址不变，更新只涉及原子操作，调用方可以缓存返回的指针
+
+class MetricCounter {
+public:
+    void inc(unsigned long long n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    unsigned long long get() const { return value.load(std::memory_order_relaxed); }
+private:
+    std::atomic<unsigned long long> value{ 0 };
+};
+
+class MetricGauge {
+public:
+    void set(long long v) { value.store(v, std::memory_order_relaxed); }
+    void inc(long long n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    void dec(long long n = 1) { value.fetch_sub(n, std::memory_order_relaxed); }
+    long long get() const { return value.load(std::memory_order_relaxed); }
+private:
+    std::atomic<long long> value{ 0 };
+};
+
+// 固定分桶的直方图，观测值单位为秒，累计和以纳秒保存
+class MetricHistogram {
+public:
+    explicit MetricHistogram(const std::vector<double>& bounds);
+    void observe(double seconds);
+    void render(const std::string& name, const std::string& labels, std::string& out) const;
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<unsigned long long>[]> buckets;  // 非累计计数，最后一个为+Inf
+    std::atomic<unsigned long long> sumNs{ 0 };
+};
+
+class Metrics {
+public:
+    static Metrics* Instance();
+
+    // labels为Prometheus标签串(不含大括号)，如 op="domainCreate"，同名同标签返回同一对象
+    MetricCounter* counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    MetricGauge* gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    // bounds为空时使用默认的延迟分桶(1ms ~ 60s)
+    MetricHistogram* histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+        const std::vector<double>& bounds = std::vector<double>());
+
+    // 按文本格式输出全部指标
+    void render(std::string& out) const;
+
+    // 标签值转义：反斜杠、双引号和换行
+    static std::string escapeLabel(const std::string& value);
+
+private:
+    Metrics() = default;
+
+    enum MetricType { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM };
+    struct Family {
+        std::string help;
+        MetricType type;
+        std::map<std::string, std::unique_ptr<MetricCounter>> counters;
+        std::map<std::string, std::unique_ptr<MetricGauge>> gauges;
+        std::map<std::string, std::unique_ptr<MetricHistogram>> histograms;
+    };
+    Family& family(const std::string& name, const std::string& help, MetricType type);
+
+    std::map<std::string, Family> families;
+    mutable std::mutex lock;
+};
+
+// 记录一次API调用的耗时，同时维护正在执行或等待驱动锁的调用数量
+class MetricsOpTimer {
+public:
+    explicit MetricsOpTimer(const char* op);
+    ~MetricsOpTimer();
+private:
+    MetricHistogram* histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // METRICS_H
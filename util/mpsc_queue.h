@@ -0,0 +1,62 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// 无锁多生产者单消费者队列(Vyukov算法)
+// push可以在任意线程中并发调用，只需一次原子交换；pop只能由唯一的消费者线程调用
+// 生产者在交换head之后、链接next之前被挂起时，消费者暂时看不到后续元素，pop返回false，稍后重试即可
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(nullptr), tail(new Node()) {
+        head.store(tail, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue() {
+        T value;
+        while ( pop(value) ) {
+        }
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T& value) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if ( !next ) {
+            return false;
+        }
+        // next成为新的哨兵节点，其中的值移交给调用者
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+    // 只在消费者线程中调用才有意义
+    bool empty() const {
+        return tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(T&& value) : value(std::move(value)), next(nullptr) {}
+        T value;
+        std::atomic<Node*> next;
+    };
+
+    std::atomic<Node*> head;    // 生产者端，最新加入的节点
+    Node* tail;                 // 消费者端，当前的哨兵节点
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,84 @@
+#include "netdev_tap.h"
+#include "../log/log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <cerrno>
+#include <cstring>
+
+int netdevTapOpen(const std::string& ifname, unsigned int queues, bool vnetHdr, std::vector<int>& tapfds) {
+    if ( queues == 0 ) {
+        queues = 1;
+    }
+    if ( ifname.size() >= IFNAMSIZ ) {
+        LOG_ERROR("TAP device name too long: %s", ifname.c_str());
+        return -1;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+    // 单队列时不使用IFF_MULTI_QUEUE，否则无法打开没有以multi_queue创建的已有TAP设备
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    if ( queues > 1 ) {
+        ifr.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+    if ( vnetHdr ) {
+        ifr.ifr_flags |= IFF_VNET_HDR;
+    }
+
+    std::vector<int> fds;
+    for ( unsigned int i = 0; i < queues; i++ ) {
+        int fd = open("/dev/net/tun", O_RDWR);
+        if ( fd < 0 ) {
+            LOG_ERROR("Failed to open /dev/net/tun: %s", strerror(errno));
+            netdevCloseFds(fds);
+            return -1;
+        }
+        if ( ioctl(fd, TUNSETIFF, &ifr) < 0 ) {
+            LOG_ERROR("Failed to attach queue %u of TAP device %s: %s%s", i, ifname.c_str(), strerror(errno),
+                errno == EINVAL ? " (device may have been created without multi_queue)" : "");
+            close(fd);
+            netdevCloseFds(fds);
+            return -1;
+        }
+        fds.push_back(fd);
+    }
+
+    LOG_INFO("Opened TAP device %s with %u queue(s)", ifname.c_str(), queues);
+    tapfds.insert(tapfds.end(), fds.begin(), fds.end());
+    return 0;
+}
+
+int netdevVhostNetOpen(unsigned int queues, std::vector<int>& vhostfds) {
+    if ( queues == 0 ) {
+        queues = 1;
+    }
+    std::vector<int> fds;
+    for ( unsigned int i = 0; i < queues; i++ ) {
+        int fd = open("/dev/vhost-net", O_RDWR);
+        if ( fd < 0 ) {
+            LOG_ERROR("Failed to open /dev/vhost-net: %s", strerror(errno));
+            netdevCloseFds(fds);
+            return -1;
+        }
+        fds.push_back(fd);
+    }
+    vhostfds.insert(vhostfds.end(), fds.begin(), fds.end());
+    return 0;
+}
+
+bool netdevVhostNetAvailable() {
+    return access("/dev/vhost-net", R_OK | W_OK) == 0;
+}
+
+void netdevCloseFds(std::vector<int>& fds) {
+    for ( int fd : fds ) {
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+    }
+    fds.clear();
+}
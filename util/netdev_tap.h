@@ -0,0 +1,19 @@
+#ifndef NETDEV_TAP_H
+#define NETDEV_TAP_H
+
+#include <string>
+#include <vector>
+
+// 打开TAP设备，每个队列对应一个fd，queues大于1时以IFF_MULTI_QUEUE方式打开，设备也必须以multi_queue创建
+// 设备不存在时内核会创建一个临时TAP设备，返回0表示成功，失败时不会遗留已打开的fd
+int netdevTapOpen(const std::string& ifname, unsigned int queues, bool vnetHdr, std::vector<int>& tapfds);
+
+// 打开vhost-net设备，每个队列对应一个fd
+int netdevVhostNetOpen(unsigned int queues, std::vector<int>& vhostfds);
+
+// 检查当前进程是否可以使用vhost-net
+bool netdevVhostNetAvailable();
+
+void netdevCloseFds(std::vector<int>& fds);
+
+#endif // NETDEV_TAP_H
@@ -0,0 +1,157 @@
+#include "proc_stat.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 使用固定大小的栈上缓冲区读取整个procfs文件，避免频繁采集时的内存分配
+static ssize_t readProcFile(const char* path, char* buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        return -1;
+    }
+    size_t total = 0;
+    while ( total < size - 1 ) {
+        ssize_t ret = read(fd, buf + total, size - 1 - total);
+        if ( ret < 0 ) {
+            close(fd);
+            return -1;
+        }
+        if ( ret == 0 ) {
+            break;
+        }
+        total += ret;
+    }
+    close(fd);
+    buf[total] = '\0';
+    return total;
+}
+
+int procReadTaskStat(pid_t pid, pid_t tid, ProcTaskStat& stat) {
+    static const long ticks = sysconf(_SC_CLK_TCK);
+    static const long pageKiB = sysconf(_SC_PAGESIZE) / 1024;
+
+    char path[64];
+    if ( tid > 0 ) {
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, tid);
+    }
+    else {
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    }
+    char buf[1024];
+    if ( readProcFile(path, buf, sizeof(buf)) <= 0 ) {
+        return -1;
+    }
+
+    // 第二个字段是括号包围的线程名，其中可能包含空格，从最后一个')'之后开始解析
+    char* p = strrchr(buf, ')');
+    if ( !p ) {
+        return -1;
+    }
+    p++;
+    // 从第3个字段(state)开始，依次需要第14/15(utime/stime)、24(rss)和39(processor)个字段
+    int field = 3;
+    char* save = nullptr;
+    for ( char* token = strtok_r(p, " ", &save); token; token = strtok_r(nullptr, " ", &save), field++ ) {
+        switch ( field ) {
+        case 3:
+            stat.state = token[0];
+            break;
+        case 14:
+            stat.userTime = strtoull(token, nullptr, 10) * (1000000000ULL / ticks);
+            break;
+        case 15:
+            stat.systemTime = strtoull(token, nullptr, 10) * (1000000000ULL / ticks);
+            break;
+        case 24:
+            stat.rssKiB = strtoull(token, nullptr, 10) * pageKiB;
+            break;
+        case 39:
+            stat.processor = atoi(token);
+            return 0;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+int procReadNetDev(std::map<std::string, ProcNetDevStat>& devices) {
+    char buf[65536];
+    if ( readProcFile("/proc/net/dev", buf, sizeof(buf)) <= 0 ) {
+        return -1;
+    }
+    // 前两行为表头，其余每行格式为"  name: rx(8个字段) tx(8个字段)"
+    char* save = nullptr;
+    int lineNo = 0;
+    for ( char* line = strtok_r(buf, "\n", &save); line; line = strtok_r(nullptr, "\n", &save) ) {
+        if ( lineNo++ < 2 ) {
+            continue;
+        }
+        char* colon = strchr(line, ':');
+        if ( !colon ) {
+            continue;
+        }
+        *colon = '\0';
+        while ( *line == ' ' ) {
+            line++;
+        }
+        unsigned long long v[16] = { 0 };
+        if ( sscanf(colon + 1, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+            &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7],
+            &v[8], &v[9], &v[10], &v[11], &v[12], &v[13], &v[14], &v[15]) != 16 ) {
+            continue;
+        }
+        ProcNetDevStat& dev = devices[line];
+        dev.rxBytes = v[0];
+        dev.rxPackets = v[1];
+        dev.rxErrs = v[2];
+        dev.rxDrop = v[3];
+        dev.txBytes = v[8];
+        dev.txPackets = v[9];
+        dev.txErrs = v[10];
+        dev.txDrop = v[11];
+    }
+    return 0;
+}
+
+int procReadHostStat(ProcHostStat& stat) {
+    static const long ticks = sysconf(_SC_CLK_TCK);
+
+    char buf[8192];
+    if ( readProcFile("/proc/stat", buf, sizeof(buf)) <= 0 ) {
+        return -1;
+    }
+    // 第一行"cpu  user nice system idle iowait ..."为所有CPU的合计
+    unsigned long long v[5] = { 0 };
+    if ( sscanf(buf, "cpu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4]) != 5 ) {
+        return -1;
+    }
+    stat.cpuUser = v[0] * (1000000000ULL / ticks);
+    stat.cpuNice = v[1] * (1000000000ULL / ticks);
+    stat.cpuSystem = v[2] * (1000000000ULL / ticks);
+    stat.cpuIdle = v[3] * (1000000000ULL / ticks);
+    stat.cpuIowait = v[4] * (1000000000ULL / ticks);
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    stat.cpuCount = online > 0 ? static_cast< unsigned int >(online) : 0;
+
+    if ( readProcFile("/proc/meminfo", buf, sizeof(buf)) <= 0 ) {
+        return -1;
+    }
+    char* save = nullptr;
+    for ( char* line = strtok_r(buf, "\n", &save); line; line = strtok_r(nullptr, "\n", &save) ) {
+        unsigned long long value = 0;
+        if ( sscanf(line, "MemTotal: %llu", &value) == 1 ) {
+            stat.memTotalKiB = value;
+        }
+        else if ( sscanf(line, "MemFree: %llu", &value) == 1 ) {
+            stat.memFreeKiB = value;
+        }
+        else if ( sscanf(line, "MemAvailable: %llu", &value) == 1 ) {
+            stat.memAvailableKiB = value;
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef PROC_STAT_H
+#define PROC_STAT_H
+
+#include <string>
+#include <map>
+#include <sys/types.h>
+
+// /proc/<pid>/stat或/proc/<pid>/task/<tid>/stat中的调度统计
+struct ProcTaskStat {
+    char state = '?';
+    unsigned long long userTime = 0;    // 用户态CPU时间(ns)
+    unsigned long long systemTime = 0;  // 内核态CPU时间(ns)
+    unsigned long long rssKiB = 0;      // 常驻内存(KiB)
+    int processor = -1;                 // 最近一次运行的CPU
+};
+
+// /proc/net/dev中单个网络设备的计数，方向以宿主机为准
+struct ProcNetDevStat {
+    unsigned long long rxBytes = 0;
+    unsigned long long rxPackets = 0;
+    unsigned long long rxErrs = 0;
+    unsigned long long rxDrop = 0;
+    unsigned long long txBytes = 0;
+    unsigned long long txPackets = 0;
+    unsigned long long txErrs = 0;
+    unsigned long long txDrop = 0;
+};
+
+// /proc/stat中的宿主机CPU时间以及/proc/meminfo中的内存信息
+struct ProcHostStat {
+    unsigned int cpuCount = 0;          // 在线CPU数量
+    unsigned long long cpuUser = 0;     // 所有CPU累计时间(ns)，下同
+    unsigned long long cpuNice = 0;
+    unsigned long long cpuSystem = 0;
+    unsigned long long cpuIdle = 0;
+    unsigned long long cpuIowait = 0;
+    unsigned long long memTotalKiB = 0;
+    unsigned long long memFreeKiB = 0;
+    unsigned long long memAvailableKiB = 0;
+};
+
+// 读取进程(tid为0)或线程的stat文件，失败时返回-1
+int procReadTaskStat(pid_t pid, pid_t tid, ProcTaskStat& stat);
+
+// 一次读取/proc/net/dev中的全部设备
+int procReadNetDev(std::map<std::string, ProcNetDevStat>& devices);
+
+// 读取宿主机的CPU时间和内存信息
+int procReadHostStat(ProcHostStat& stat);
+
+#endif // PROC_STAT_H
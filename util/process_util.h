@@ -0,0 +1,29 @@
+#ifndef PROCESS_UTIL_H
+#define PROCESS_UTIL_H
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/types.h>
+
+// 列出进程的所有线程ID，数据来自/proc/<pid>/task
+inline std::vector<pid_t> listProcessThreads(pid_t pid) {
+    std::vector<pid_t> threads;
+    std::string taskDir = "/proc/" + std::to_string(pid) + "/task";
+    DIR* dir = opendir(taskDir.c_str());
+    if ( !dir ) {
+        return threads;
+    }
+    struct dirent* entry;
+    while ( (entry = readdir(dir)) != nullptr ) {
+        if ( entry->d_name[0] < '0' || entry->d_name[0] > '9' ) {
+            continue;
+        }
+        threads.push_back(static_cast< pid_t >(atoi(entry->d_name)));
+    }
+    closedir(dir);
+    return threads;
+}
+
+#endif // PROCESS_UTIL_H
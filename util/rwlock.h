@@ -0,0 +1,55 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include <pthread.h>
+#include <system_error>
+
+// 读写锁，C++11中没有std::shared_mutex，基于pthread_rwlock实现相同的接口
+// 写者优先：有写者等待时新的读者会阻塞，频繁的查询不会让修改一直拿不到锁
+// 不可重入，同一线程持有读锁时再加写锁(或反之)会死锁
+class RWLock {
+public:
+    RWLock() {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        int ret = pthread_rwlock_init(&rwlock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+        if ( ret != 0 ) {
+            throw std::system_error(ret, std::generic_category(), "pthread_rwlock_init");
+        }
+    }
+
+    ~RWLock() {
+        pthread_rwlock_destroy(&rwlock);
+    }
+
+    RWLock(const RWLock&) = delete;
+    RWLock& operator=(const RWLock&) = delete;
+
+    // 写锁，可以直接用于std::lock_guard和std::unique_lock
+    void lock() { pthread_rwlock_wrlock(&rwlock); }
+    void unlock() { pthread_rwlock_unlock(&rwlock); }
+
+    // 读锁，配合SharedLockGuard使用
+    void lock_shared() { pthread_rwlock_rdlock(&rwlock); }
+    void unlock_shared() { pthread_rwlock_unlock(&rwlock); }
+
+private:
+    pthread_rwlock_t rwlock;
+};
+
+// 持有读锁的作用域守卫，相当于C++14的std::shared_lock
+class SharedLockGuard {
+public:
+    explicit SharedLockGuard(RWLock& lock) : lock(lock) { lock.lock_shared(); }
+    ~SharedLockGuard() { lock.unlock_shared(); }
+
+    SharedLockGuard(const SharedLockGuard&) = delete;
+    SharedLockGuard& operator=(const SharedLockGuard&) = delete;
+
+private:
+    RWLock& lock;
+};
+
+#endif // RWLOCK_H
@@ -0,0 +1,109 @@
+#include "timer_service.h"
+#include "../log/log.h"
+#include <chrono>
+#include <stdexcept>
+
+TimerService* TimerService::Instance() {
+    static TimerService instance;
+    return &instance;
+}
+
+TimerService::TimerService() : wheel(10), wakeAtMs(0), runningID(0), running(false) {
+}
+
+TimerService::~TimerService() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if ( !running ) {
+            return;
+        }
+        running = false;
+    }
+    wakeup.notify_all();
+    if ( worker.joinable() ) {
+        worker.join();
+    }
+}
+
+uint64_t TimerService::addTimer(unsigned int delayMs, Callback callback) {
+    uint64_t id = wheel.add(delayMs, std::move(callback));
+    wakeIfEarlier(delayMs);
+    return id;
+}
+
+uint64_t TimerService::addPeriodicTimer(unsigned int intervalMs, Callback callback) {
+    uint64_t id = wheel.addPeriodic(intervalMs, std::move(callback));
+    wakeIfEarlier(intervalMs);
+    return id;
+}
+
+void TimerService::wakeIfEarlier(unsigned int delayMs) {
+    std::lock_guard<std::mutex> guard(lock);
+    if ( !running ) {
+        running = true;
+        worker = std::thread(&TimerService::run, this);
+        workerID = worker.get_id();
+        return;
+    }
+    if ( wakeAtMs == 0 || TimerWheel::nowMs() + delayMs < wakeAtMs ) {
+        wakeup.notify_one();
+    }
+}
+
+bool TimerService::cancelTimer(uint64_t id) {
+    bool cancelled = wheel.cancel(id);
+    std::unique_lock<std::mutex> guard(lock);
+    // 已经到期但还没轮到执行的回调直接丢弃
+    if ( pendingIDs.erase(id) > 0 ) {
+        cancelled = true;
+    }
+    // 周期定时器在执行回调时已经重新登记，取消成功也要等待本次回调结束
+    if ( std::this_thread::get_id() != workerID ) {
+        callbackDone.wait(guard, [this, id]() { return runningID != id; });
+    }
+    return cancelled;
+}
+
+void TimerService::run() {
+    LOG_INFO("Timer service started");
+    std::unique_lock<std::mutex> guard(lock);
+    while ( running ) {
+        unsigned long long now = TimerWheel::nowMs();
+        int timeout = wheel.nextTimeout(now);
+        if ( timeout != 0 ) {
+            wakeAtMs = timeout < 0 ? 0 : now + timeout;
+            if ( timeout < 0 ) {
+                wakeup.wait(guard);
+            }
+            else {
+                wakeup.wait_for(guard, std::chrono::milliseconds(timeout));
+            }
+            wakeAtMs = 0;
+            continue;
+        }
+
+        TimerWheel::ExpiredList expired;
+        wheel.advance(TimerWheel::nowMs(), expired);
+        for ( const auto& entry : expired ) {
+            pendingIDs.insert(entry.first);
+        }
+        for ( auto& entry : expired ) {
+            // 在前面的回调执行期间被取消的定时器不再执行，cancelTimer看到runningID时会等待回调结束
+            if ( pendingIDs.erase(entry.first) == 0 ) {
+                continue;
+            }
+            runningID = entry.first;
+            guard.unlock();
+            try {
+                entry.second();
+            }
+            catch ( const std::exception& e ) {
+                LOG_ERROR("Timer callback failed: %s", e.what());
+            }
+            guard.lock();
+            runningID = 0;
+            callbackDone.notify_all();
+        }
+    }
+    LOG_INFO("Timer service stopped");
+}
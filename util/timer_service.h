@@ -0,0 +1,48 @@
+#ifndef TIMER_SERVICE_H
+#define TIMER_SERVICE_H
+
+#include "timer_wheel.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+// 进程内共享的定时器服务：所有超时、截止时间和周期任务都登记在同一个时间轮上，由一个线程推进
+// 回调在定时器线程中依次执行，必须很快返回，不能等待驱动锁或QMP回复，
+// 需要做耗时工作的回调应只负责把工作交给其他线程
+class TimerService {
+public:
+    typedef TimerWheel::Callback Callback;
+
+    static TimerService* Instance();
+
+    // 第一次添加定时器时启动定时器线程
+    uint64_t addTimer(unsigned int delayMs, Callback callback);
+    uint64_t addPeriodicTimer(unsigned int intervalMs, Callback callback);
+    // 定时器已触发或不存在时返回false；返回后回调一定不在执行，在回调中取消定时器时不等待
+    bool cancelTimer(uint64_t id);
+    size_t size() const { return wheel.size(); }
+
+private:
+    TimerService();
+    ~TimerService();
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    void run();
+    // 新定时器比定时器线程计划醒来的时间更早时唤醒它
+    void wakeIfEarlier(unsigned int delayMs);
+
+    TimerWheel wheel;
+    std::mutex lock;                    // 保护以下成员
+    std::condition_variable wakeup;
+    std::condition_variable callbackDone;
+    unsigned long long wakeAtMs;        // 定时器线程计划醒来的时间，0表示无限期等待
+    std::unordered_set<uint64_t> pendingIDs;    // 已经到期、等待执行的定时器
+    uint64_t runningID;                 // 正在执行的回调对应的定时器ID
+    std::thread::id workerID;
+    std::thread worker;
+    bool running;
+};
+
+#endif // TIMER_SERVICE_H
@@ -0,0 +1,160 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <climits>
+#include <ctime>
+
+TimerWheel::TimerWheel(unsigned int tickMs)
+    : tickMs(tickMs > 0 ? tickMs : 1), slots(LEVELS * LEVEL_SIZE), nextID(1) {
+    nextTick = nowMs() / this->tickMs + 1;
+}
+
+unsigned long long TimerWheel::nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast< unsigned long long >(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+unsigned long long TimerWheel::toTicks(unsigned int delayMs) const {
+    // 至少等待一个完整的tick，向上取整
+    unsigned long long ticks = (static_cast< unsigned long long >(delayMs) + tickMs - 1) / tickMs;
+    return std::max(ticks, 1ULL);
+}
+
+uint64_t TimerWheel::add(unsigned int delayMs, Callback callback) {
+    return insert(toTicks(delayMs), 0, std::move(callback));
+}
+
+uint64_t TimerWheel::addPeriodic(unsigned int intervalMs, Callback callback) {
+    unsigned long long ticks = toTicks(intervalMs);
+    return insert(ticks, ticks, std::move(callback));
+}
+
+uint64_t TimerWheel::insert(unsigned long long ticks, unsigned long long intervalTicks, Callback callback) {
+    std::lock_guard<std::mutex> guard(lock);
+    unsigned long long nowTick = nowMs() / tickMs;
+    // 空闲时没有人推进时间轮，先对齐到当前时间
+    if ( index.empty() && nextTick <= nowTick ) {
+        nextTick = nowTick + 1;
+    }
+    // 以当前时间为基准计算到期tick，时间轮暂时落后时也不会提前触发
+    Timer timer;
+    timer.id = nextID++;
+    timer.expireTick = std::max(nextTick - 1, nowTick) + ticks;
+    timer.intervalTicks = intervalTicks;
+    timer.callback = std::move(callback);
+    size_t slot = slotFor(timer.expireTick);
+    slots[slot].push_front(std::move(timer));
+    index[slots[slot].front().id] = std::make_pair(slot, slots[slot].begin());
+    return slots[slot].front().id;
+}
+
+size_t TimerWheel::slotFor(unsigned long long expireTick) const {
+    unsigned long long tick = std::max(expireTick, nextTick);
+    unsigned long long delta = tick - nextTick;
+    for ( unsigned int level = 0; level < LEVELS; level++ ) {
+        if ( delta < (1ULL << (LEVEL_BITS * (level + 1))) ) {
+            return level * LEVEL_SIZE + ((tick >> (LEVEL_BITS * level)) & LEVEL_MASK);
+        }
+    }
+    // 超出最高层的范围时先放在最远的槽，下放时按真实的到期tick重新放置
+    tick = nextTick + (1ULL << (LEVEL_BITS * LEVELS)) - 1;
+    return (LEVELS - 1) * LEVEL_SIZE + ((tick >> (LEVEL_BITS * (LEVELS - 1))) & LEVEL_MASK);
+}
+
+void TimerWheel::place(Slot& from, Slot::iterator it) {
+    size_t slot = slotFor(it->expireTick);
+    // splice之后迭代器仍然有效，指向新链表中的同一个节点
+    slots[slot].splice(slots[slot].begin(), from, it);
+    index[it->id] = std::make_pair(slot, it);
+}
+
+void TimerWheel::cascade(unsigned int level, size_t slotIndex) {
+    Slot pending;
+    pending.splice(pending.begin(), slots[level * LEVEL_SIZE + slotIndex]);
+    while ( !pending.empty() ) {
+        place(pending, pending.begin());
+    }
+}
+
+bool TimerWheel::cancel(uint64_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(id);
+    if ( it == index.end() ) {
+        return false;
+    }
+    slots[it->second.first].erase(it->second.second);
+    index.erase(it);
+    return true;
+}
+
+size_t TimerWheel::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return index.size();
+}
+
+void TimerWheel::advance(unsigned long long now, ExpiredList& expired) {
+    std::lock_guard<std::mutex> guard(lock);
+    unsigned long long targetTick = now / tickMs;
+    while ( nextTick <= targetTick ) {
+        // 长时间没有推进且没有定时器时直接跳过中间的tick
+        if ( index.empty() ) {
+            nextTick = targetTick + 1;
+            break;
+        }
+        size_t slotIndex = nextTick & LEVEL_MASK;
+        // 第0层转完一圈，依次把上层对应的槽下放，上层也转完一圈时继续向上
+        if ( slotIndex == 0 ) {
+            for ( unsigned int level = 1; level < LEVELS; level++ ) {
+                size_t upper = (nextTick >> (LEVEL_BITS * level)) & LEVEL_MASK;
+                cascade(level, upper);
+                if ( upper != 0 ) {
+                    break;
+                }
+            }
+        }
+        Slot& slot = slots[slotIndex];
+        while ( !slot.empty() ) {
+            auto it = slot.begin();
+            if ( it->intervalTicks > 0 ) {
+                expired.push_back(std::make_pair(it->id, it->callback));
+                it->expireTick = nextTick + it->intervalTicks;
+                place(slot, it);
+                continue;
+            }
+            expired.push_back(std::make_pair(it->id, std::move(it->callback)));
+            index.erase(it->id);
+            slot.erase(it);
+        }
+        nextTick++;
+    }
+}
+
+size_t TimerWheel::advance(unsigned long long now) {
+    ExpiredList expired;
+    advance(now, expired);
+    for ( auto& entry : expired ) {
+        entry.second();
+    }
+    return expired.size();
+}
+
+int TimerWheel::nextTimeout(unsigned long long now) const {
+    std::lock_guard<std::mutex> guard(lock);
+    if ( index.empty() ) {
+        return -1;
+    }
+    // 第0层只保存本圈内到期的定时器，找到第一个非空槽或下一次下放的时间点即可
+    unsigned long long dueTick = nextTick + LEVEL_SIZE;
+    for ( size_t i = 0; i < LEVEL_SIZE; i++ ) {
+        unsigned long long tick = nextTick + i;
+        if ( (tick & LEVEL_MASK) == 0 || !slots[tick & LEVEL_MASK].empty() ) {
+            dueTick = tick;
+            break;
+        }
+    }
+    unsigned long long dueMs = dueTick * tickMs;
+    if ( dueMs <= now ) {
+        return 0;
+    }
+    return static_cast< int >(std::min(dueMs - now, static_cast< unsigned long long >(INT_MAX)));
+}
@@ -0,0 +1,72 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 分层时间轮：共4层，每层256个槽，第0层每个槽对应一个tick，上一层的一个槽对应下一层转一整圈
+// 定时器按到期tick放入能容纳其剩余时间的最低一层，上层的槽在下层转完一圈时整体下放(cascade)
+// 添加和取消都是O(1)，每个tick只处理一个槽，适合大量长超时且多数会被取消的定时器
+// tick为10ms时最长可以表示约497天，更长的延迟按最大值处理
+class TimerWheel {
+public:
+    typedef std::function<void()> Callback;
+    typedef std::vector<std::pair<uint64_t, Callback>> ExpiredList;
+
+    explicit TimerWheel(unsigned int tickMs = 10);
+
+    // 返回定时器ID，ID从1开始，不会重复
+    uint64_t add(unsigned int delayMs, Callback callback);
+    // 周期定时器，每intervalMs触发一次，直到被取消
+    uint64_t addPeriodic(unsigned int intervalMs, Callback callback);
+    // 一次性定时器已触发或不存在时返回false
+    bool cancel(uint64_t id);
+    size_t size() const;
+    unsigned int getTickMs() const { return tickMs; }
+
+    // 推进到nowMs(CLOCK_MONOTONIC)并执行到期的回调，返回执行的回调数
+    // 回调在调用者线程中执行，执行时不持有内部锁，回调中可以添加或取消定时器
+    size_t advance(unsigned long long nowMs);
+    // 只推进不执行，到期的回调按到期顺序追加到expired中，由调用者决定如何执行
+    void advance(unsigned long long nowMs, ExpiredList& expired);
+    // 距离下一次需要推进的毫秒数，没有定时器时返回-1，可直接用作epoll_wait的超时
+    // 第0层在本圈内没有定时器时返回到下一次下放的时间，最长约为256个tick
+    int nextTimeout(unsigned long long nowMs) const;
+
+    static unsigned long long nowMs();
+
+private:
+    static const unsigned int LEVEL_BITS = 8;
+    static const size_t LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const size_t LEVEL_MASK = LEVEL_SIZE - 1;
+    static const unsigned int LEVELS = 4;
+
+    struct Timer {
+        uint64_t id;
+        unsigned long long expireTick;
+        unsigned long long intervalTicks;   // 周期定时器的间隔，一次性定时器为0
+        Callback callback;
+    };
+    typedef std::list<Timer> Slot;
+
+    unsigned long long toTicks(unsigned int delayMs) const;
+    uint64_t insert(unsigned long long ticks, unsigned long long intervalTicks, Callback callback);
+    size_t slotFor(unsigned long long expireTick) const;
+    // 把from中it指向的定时器移动到其到期tick对应的槽，不重新分配节点
+    void place(Slot& from, Slot::iterator it);
+    void cascade(unsigned int level, size_t index);
+
+    unsigned int tickMs;
+    std::vector<Slot> slots;            // 第level层第i个槽位于level * LEVEL_SIZE + i
+    std::unordered_map<uint64_t, std::pair<size_t, Slot::iterator>> index;     // ID -> 所在槽及位置
+    unsigned long long nextTick;        // 下一个要处理的tick
+    uint64_t nextID;
+    mutable std::mutex lock;
+};
+
+#endif // TIMER_WHEEL_H
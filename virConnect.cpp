@@ -1,9 +1,15 @@
 #include "virConnect.h"
+#include "./conf/config_manager.h"
+#include "./util/host_topology.h"
+#include "./util/file_util.h"
 #include <fstream>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <algorithm>
+#include <cstring>
+#include <set>
 
 
 VirConnect::VirConnect(const std::string& uri, unsigned int flags) : uri(uri) {
@@ -20,6 +26,44 @@ VirConnect::VirConnect(const std::string& uri, unsigned int flags) : uri(uri) {
     for ( const auto& domain : domains_ ) {
         domains.push_back(std::make_shared<VirDomain>(domain->virDomainGetName(), domain->virDomainGetID(), domain->virDomainGetUUID(), driver.get()));
     }
+    // 正被运行中虚拟机使用的卷由QEMU在线扩容，客户机无需重启即可看到新的容量
+    HypervisorDriver* hypervisor = driver.get();
+    storageDriver->setOnlineResizeHandler([hypervisor](const std::string& path, unsigned long long oldCapacity,
+        unsigned long long newCapacity) {
+        std::shared_ptr<VirDomain> domain = hypervisor->domainLookupByDiskSource(path);
+        if ( !domain ) {
+            return false;
+        }
+        if ( newCapacity < oldCapacity ) {
+            throw std::runtime_error("Cannot shrink " + path + " while it is used by running domain " + domain->virDomainGetName());
+        }
+        if ( hypervisor->domainBlockResize(domain, path, newCapacity, VIR_DOMAIN_BLOCK_RESIZE_BYTES) < 0 ) {
+            throw std::runtime_error("Failed to resize " + path + " of running domain " + domain->virDomainGetName());
+        }
+        return true;
+    });
+    // 合并后备链同样交给QEMU，block-stream在后台复制数据，完成后QEMU会改写镜像头并产生BLOCK_JOB事件
+    // 在启动任务前订阅该事件，收到该磁盘的事件后通知存储驱动并注销
+    storageDriver->setOnlineFlattenHandler([hypervisor](const std::string& path, std::function<void()> onFinished) {
+        std::shared_ptr<VirDomain> domain = hypervisor->domainLookupByDiskSource(path);
+        if ( !domain ) {
+            return false;
+        }
+        std::shared_ptr<int> callbackID = std::make_shared<int>(-1);
+        *callbackID = hypervisor->connectDomainEventRegisterAny(domain, VIR_DOMAIN_EVENT_ID_BLOCK_JOB,
+            [hypervisor, path, onFinished, callbackID](const virDomainEvent& event) {
+                if ( !isSameFile(event.device, path) ) {
+                    return;
+                }
+                hypervisor->connectDomainEventDeregisterAny(*callbackID);
+                onFinished();
+            });
+        if ( hypervisor->domainBlockPull(domain, path, 0, 0) < 0 ) {
+            hypervisor->connectDomainEventDeregisterAny(*callbackID);
+            throw std::runtime_error("Failed to start block pull of " + path + " on running domain " + domain->virDomainGetName());
+        }
+        return true;
+    });
     std::vector<std::shared_ptr<VirStoragePool>> storagePools_ = storageDriver->connectListStoragePools(flags);
     for ( const auto& pool : storagePools_ ) {
         storagePools.push_back(std::make_shared<VirStoragePool>(pool->virStoragePoolGetName(), pool->virStoragePoolGetUUID(), storageDriver.get()));
@@ -88,6 +132,197 @@ std::vector<std::shared_ptr<VirDomain>> VirConnect::virConnectListAllDomains(uns
     }
 }
 
+std::vector<virDomainStatsRecord> VirConnect::virConnectGetAllDomainStats(unsigned int stats, unsigned int flags) const {
+    std::vector<virDomainStatsRecord> records = driver->connectGetAllDomainStats(stats, flags);
+    for ( auto& record : records ) {
+        for ( const auto& domain : domains ) {
+            if ( domain->virDomainGetName() == record.name ) {
+                record.dom = domain;
+                break;
+            }
+        }
+    }
+    return records;
+}
+
+void VirConnect::virConnectStatsSamplerStart(unsigned int intervalMs, size_t historySize) {
+    if ( statsSampler && statsSampler->isRunning() ) {
+        throw std::runtime_error("Stats sampler is already running.");
+    }
+    ConfigManager* configManager = ConfigManager::Instance();
+    if ( intervalMs == 0 ) {
+        intervalMs = configManager->getIntValue("stats.sample_interval_ms", 1000);
+    }
+    if ( historySize == 0 ) {
+        historySize = configManager->getIntValue("stats.history_size", 360);
+    }
+    statsSampler.reset(new StatsSampler(driver.get(), intervalMs, historySize));
+
+    // 共享内存导出失败不影响采样本身
+    std::string shmPath = configManager->getValue("stats.shm_path", "./temp/run/stats.shm");
+    if ( !shmPath.empty() ) {
+        try {
+            statsShm.reset(new StatsShmWriter(shmPath, configManager->getIntValue("stats.shm_slots", 64)));
+            statsSampler->addSink(statsShm.get());
+        }
+        catch ( const std::exception& e ) {
+            LOG_ERROR("Failed to export stats to shared memory: %s", e.what());
+        }
+    }
+    std::string promSocket = configManager->getValue("stats.prometheus_socket", "./temp/run/metrics.sock");
+    int promPort = configManager->getIntValue("stats.prometheus_port", 0);
+    if ( !promSocket.empty() || promPort > 0 ) {
+        try {
+            statsExporter.reset(new PrometheusExporter(promSocket, promPort));
+            statsExporter->start();
+            statsSampler->addSink(statsExporter.get());
+        }
+        catch ( const std::exception& e ) {
+            statsExporter.reset();
+            LOG_ERROR("Failed to start Prometheus exporter: %s", e.what());
+        }
+    }
+    statsSampler->start();
+}
+
+void VirConnect::virConnectStatsSamplerStop() {
+    if ( statsSampler ) {
+        statsSampler->stop();
+        if ( statsShm ) {
+            statsSampler->removeSink(statsShm.get());
+        }
+        if ( statsExporter ) {
+            statsSampler->removeSink(statsExporter.get());
+        }
+    }
+    statsShm.reset();
+    statsExporter.reset();
+}
+
+bool VirConnect::virDomainGetStatsHistory(const std::shared_ptr<VirDomain> domain, size_t count,
+    std::vector<virDomainStatsSample>& samples) const {
+    if ( !statsSampler ) {
+        throw std::runtime_error("Stats sampler is not started.");
+    }
+    return statsSampler->getHistory(domain->virDomainGetName(), count, samples);
+}
+
+std::map<std::string, virDomainStatsSample> VirConnect::virConnectGetLatestStats() const {
+    if ( !statsSampler ) {
+        throw std::runtime_error("Stats sampler is not started.");
+    }
+    return statsSampler->getLatest();
+}
+
+int VirConnect::virConnectDomainEventRegisterAny(std::shared_ptr<VirDomain> domain, int eventID,
+    virConnectDomainEventCallback callback) {
+    return driver->connectDomainEventRegisterAny(domain, eventID, callback);
+}
+
+int VirConnect::virConnectDomainEventDeregisterAny(int callbackID) {
+    return driver->connectDomainEventDeregisterAny(callbackID);
+}
+
+int VirConnect::virNodeGetInfo(virNodeInfo& info) const {
+    HostInfo* host = HostInfo::Instance();
+    std::vector<HostCpu> cpus = host->getCpus();
+    std::vector<HostNumaNode> nodes = host->getNumaNodes();
+
+    memset(&info, 0, sizeof(info));
+    strncpy(info.model, host->getCpuModel().c_str(), sizeof(info.model) - 1);
+    info.memory = host->getMemory().total;
+    info.cpus = cpus.size();
+    info.mhz = host->getCpuMhz();
+    info.nodes = nodes.empty() ? 1 : nodes.size();
+
+    std::set<int> packages;
+    std::set<std::pair<int, int>> cores;
+    for ( const auto& cpu : cpus ) {
+        packages.insert(cpu.packageId);
+        cores.insert(std::make_pair(cpu.packageId, cpu.coreId));
+    }
+    info.sockets = std::max< size_t >(packages.size() / info.nodes, 1);
+    info.cores = std::max< size_t >(cores.size() / std::max< size_t >(packages.size(), 1), 1);
+    info.threads = std::max< size_t >(cpus.size() / std::max< size_t >(cores.size(), 1), 1);
+    // 拓扑不对称时无法用乘积表示，与libvirt一样退化为扁平拓扑
+    if ( info.nodes * info.sockets * info.cores * info.threads != info.cpus ) {
+        info.nodes = 1;
+        info.sockets = 1;
+        info.cores = info.cpus;
+        info.threads = 1;
+    }
+    return 0;
+}
+
+int VirConnect::virNodeGetCPUStats(int cpuNum, std::map<std::string, unsigned long long>& params, unsigned int flags) const {
+    if ( flags != 0 ) {
+        throw std::invalid_argument("Unsupported flags for virNodeGetCPUStats.");
+    }
+    HostCpuTimes times;
+    if ( cpuNum < VIR_NODE_CPU_STATS_ALL_CPUS || !HostInfo::Instance()->getCpuTimes(cpuNum, times) ) {
+        throw std::runtime_error("Invalid cpu number " + std::to_string(cpuNum));
+    }
+    params.clear();
+    params[VIR_NODE_CPU_STATS_KERNEL] = times.system;
+    params[VIR_NODE_CPU_STATS_USER] = times.user + times.nice;
+    params[VIR_NODE_CPU_STATS_IDLE] = times.idle;
+    params[VIR_NODE_CPU_STATS_IOWAIT] = times.iowait;
+    params[VIR_NODE_CPU_STATS_INTR] = times.irq + times.softirq;
+    return params.size();
+}
+
+int VirConnect::virNodeGetMemoryStats(int cellNum, std::map<std::string, unsigned long long>& params, unsigned int flags) const {
+    if ( flags != 0 ) {
+        throw std::invalid_argument("Unsupported flags for virNodeGetMemoryStats.");
+    }
+    params.clear();
+    if ( cellNum == VIR_NODE_MEMORY_STATS_ALL_CELLS ) {
+        HostMemory memory = HostInfo::Instance()->getMemory();
+        params[VIR_NODE_MEMORY_STATS_TOTAL] = memory.total;
+        params[VIR_NODE_MEMORY_STATS_FREE] = memory.free;
+        params[VIR_NODE_MEMORY_STATS_BUFFERS] = memory.buffers;
+        params[VIR_NODE_MEMORY_STATS_CACHED] = memory.cached;
+        return params.size();
+    }
+    for ( const auto& node : HostInfo::Instance()->getNumaNodes() ) {
+        if ( node.id == cellNum ) {
+            params[VIR_NODE_MEMORY_STATS_TOTAL] = node.memTotalKiB;
+            params[VIR_NODE_MEMORY_STATS_FREE] = node.memFreeKiB;
+            return params.size();
+        }
+    }
+    throw std::runtime_error("Invalid cell number " + std::to_string(cellNum));
+}
+
+int VirConnect::virNodeGetFreePages(const std::vector<unsigned int>& pages, int startCell, unsigned int cellCount,
+    std::vector<unsigned long long>& counts, unsigned int flags) const {
+    if ( flags != 0 ) {
+        throw std::invalid_argument("Unsupported flags for virNodeGetFreePages.");
+    }
+    std::vector<HostNumaNode> nodes = HostInfo::Instance()->getNumaNodes();
+    static const unsigned int basePageKiB = sysconf(_SC_PAGESIZE) / 1024;
+    counts.clear();
+    for ( unsigned int i = 0; i < cellCount; i++ ) {
+        int cell = startCell + i;
+        auto node = std::find_if(nodes.begin(), nodes.end(), [cell](const HostNumaNode& n) { return n.id == cell; });
+        if ( node == nodes.end() ) {
+            throw std::runtime_error("Invalid cell number " + std::to_string(cell));
+        }
+        for ( unsigned int pageSize : pages ) {
+            if ( pageSize == basePageKiB ) {
+                counts.push_back(node->memFreeKiB / basePageKiB);
+                continue;
+            }
+            auto hugepage = node->hugepages.find(pageSize);
+            if ( hugepage == node->hugepages.end() ) {
+                throw std::runtime_error("Page size " + std::to_string(pageSize) + "KiB is not supported on cell " + std::to_string(cell));
+            }
+            counts.push_back(hugepage->second.free);
+        }
+    }
+    return counts.size();
+}
+
 std::shared_ptr<VirDomain> VirConnect::virDomainCreateXML(const std::string& xmlDesc, unsigned int flags) {
     if ( flags == 0 ) {
         std::shared_ptr<VirDomain> domain = std::make_shared<VirDomain>(xmlDesc, driver.get());
@@ -121,6 +356,14 @@ void VirConnect::virDomainShutdown(const std::shared_ptr<VirDomain> domain) {
     return;
 }
 
+void VirConnect::virDomainShutdownFlags(const std::shared_ptr<VirDomain> domain, unsigned int flags, int timeoutSec) {
+    driver->domainShutdownFlags(domain, flags, timeoutSec);
+}
+
+std::vector<std::shared_ptr<VirDomain>> VirConnect::virConnectShutdownAllDomains(unsigned int flags, int timeoutSec) {
+    return driver->connectShutdownAllDomains(flags, timeoutSec);
+}
+
 std::shared_ptr<VirStoragePool> VirConnect::virStoragePoolDefineXML(const std::string& xmlDesc, unsigned int flags) {
     std::shared_ptr<VirStoragePool> pool = storageDriver->storagePoolDefine(xmlDesc, flags);
     storagePools.push_back(pool);
@@ -204,6 +447,32 @@ int VirConnect::virStorageVolDelete(const std::shared_ptr<VirStorageVol> vol, un
     return storageDriver->storageVolDelete(vol, flags);
 }
 
+int VirConnect::virStorageVolResize(const std::shared_ptr<VirStorageVol> vol, unsigned long long capacity, unsigned int flags) {
+    return storageDriver->storageVolResize(vol, capacity, flags);
+}
+
+int VirConnect::virStorageVolWipe(const std::shared_ptr<VirStorageVol> vol, unsigned int flags) {
+    return storageDriver->storageVolWipe(vol, flags);
+}
+
+int VirConnect::virStorageVolWipePattern(const std::shared_ptr<VirStorageVol> vol, unsigned int algorithm, unsigned int flags) {
+    return storageDriver->storageVolWipePattern(vol, algorithm, flags);
+}
+
+int VirConnect::virStorageVolFlatten(const std::shared_ptr<VirStorageVol> vol, unsigned int flags) {
+    return storageDriver->storageVolFlatten(vol, flags);
+}
+
+int VirConnect::virStorageVolDownload(const std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+    unsigned long long length, unsigned int flags) {
+    return storageDriver->storageVolDownload(vol, fd, offset, length, flags);
+}
+
+int VirConnect::virStorageVolUpload(const std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+    unsigned long long length, unsigned int flags) {
+    return storageDriver->storageVolUpload(vol, fd, offset, length, flags);
+}
+
 std::vector<std::shared_ptr<VirNetwork>> VirConnect::virConnectListAllNetworks(unsigned int flags) const {
     if ( flags == 0 ) {
         return networks;
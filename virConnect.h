@@ -13,6 +13,9 @@
 #include "driver-hypervisor.h"
 #include "driver-storage.h"
 #include "driver-network.h"
+#include "./stats/stats_sampler.h"
+#include "./stats/stats_shm.h"
+#include "./stats/prometheus_exporter.h"
 #include "./log/log.h"
 
 // 虚拟机状态枚举
@@ -51,6 +54,15 @@ typedef enum {
     VIR_STORAGE_VOL_DIR = 2,      /* 目录卷 */
 } virStorageVolType;
 
+/**
+ * virStorageVolWipeAlgorithm: 存储卷擦除算法，取值与libvirt一致，多遍覆写的算法暂不支持
+ */
+typedef enum {
+    VIR_STORAGE_VOL_WIPE_ALG_ZERO = 0,      /* 清零，优先由文件系统或设备完成 */
+    VIR_STORAGE_VOL_WIPE_ALG_RANDOM = 8,    /* 写入一遍随机数据 */
+    VIR_STORAGE_VOL_WIPE_ALG_TRIM = 9,      /* 打洞或discard释放空间，不支持时清零 */
+} virStorageVolWipeAlgorithm;
+
 /**
  * virDomainDefineFlags:
  */
@@ -58,6 +70,123 @@ typedef enum {
     VIR_DOMAIN_DEFINE_VALIDATE = (1 << 0), /* Validate the XML document against schema */
 } virDomainDefineFlags;
 
+/**
+ * virDomainModificationImpact: 资源控制等修改接口的作用范围
+ */
+typedef enum {
+    VIR_DOMAIN_AFFECT_CURRENT = 0,      /* 作用于当前状态，运行中即为LIVE */
+    VIR_DOMAIN_AFFECT_LIVE = 1 << 0,    /* 作用于运行中的虚拟机 */
+    VIR_DOMAIN_AFFECT_CONFIG = 1 << 1,  /* 作用于持久化配置，暂不支持 */
+} virDomainModificationImpact;
+
+/**
+ * virDomainGetStateFlags: 当前连接注册了事件回调时默认返回由事件维护的缓存状态，
+ * 否则每次都通过QMP查询，查询失败时virDomainGetState返回-1
+ */
+typedef enum {
+    VIR_DOMAIN_GET_STATE_FORCE_REFRESH = (1 << 0), /* 通过QMP重新查询状态并更新缓存 */
+} virDomainGetStateFlags;
+
+/**
+ * virDomainShutdownFlagValues: 关机方式，DEFAULT由驱动选择
+ */
+typedef enum {
+    VIR_DOMAIN_SHUTDOWN_DEFAULT = 0,
+    VIR_DOMAIN_SHUTDOWN_ACPI_POWER_BTN = (1 << 0), /* 发送ACPI关机按钮事件 */
+    VIR_DOMAIN_SHUTDOWN_GUEST_AGENT = (1 << 1),    /* 通过客户机代理关机 */
+} virDomainShutdownFlagValues;
+
+/**
+ * virDomainBlockResizeFlags: 默认size的单位为KiB
+ */
+typedef enum {
+    VIR_DOMAIN_BLOCK_RESIZE_BYTES = (1 << 0),   /* size的单位为字节 */
+} virDomainBlockResizeFlags;
+
+/**
+ * virStorageVolCreateFlags: virStorageVolCreateXMLFrom的flags
+ */
+typedef enum {
+    VIR_STORAGE_VOL_CREATE_LINKED = (1 << 0),   /* 创建以源卷为后备镜像的qcow2卷，不复制数据 */
+} virStorageVolCreateFlags;
+
+/**
+ * virStorageVolDownloadFlags / virStorageVolUploadFlags: 取值与libvirt一致
+ */
+typedef enum {
+    VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM = (1 << 0),  /* 跳过空洞，对端不是普通文件时按记录格式传输 */
+} virStorageVolDownloadFlags;
+
+typedef enum {
+    VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM = (1 << 0),    /* 输入中的空洞在卷中打洞，输入不是普通文件时按记录格式解析 */
+} virStorageVolUploadFlags;
+
+/**
+ * virDomainBlockPullFlags: 默认bandwidth的单位为MiB/s
+ */
+typedef enum {
+    VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES = (1 << 6),   /* bandwidth的单位为字节/秒 */
+} virDomainBlockPullFlags;
+
+/**
+ * virStorageVolResizeFlags: 默认capacity为新的容量，只能扩大
+ */
+typedef enum {
+    VIR_STORAGE_VOL_RESIZE_ALLOCATE = (1 << 0), /* 为新增的容量预先分配空间 */
+    VIR_STORAGE_VOL_RESIZE_DELTA = (1 << 1),    /* capacity为在当前容量上增加(或减少)的大小 */
+    VIR_STORAGE_VOL_RESIZE_SHRINK = (1 << 2),   /* 允许缩小容量 */
+} virStorageVolResizeFlags;
+
+/**
+ * virDomainStatsTypes: virConnectGetAllDomainStats需要采集的统计类型
+ */
+typedef enum {
+    VIR_DOMAIN_STATS_STATE = (1 << 0),      /* 运行状态 */
+    VIR_DOMAIN_STATS_CPU_TOTAL = (1 << 1),  /* QEMU进程CPU时间和RSS */
+    VIR_DOMAIN_STATS_BALLOON = (1 << 2),    /* 气球设备统计 */
+    VIR_DOMAIN_STATS_VCPU = (1 << 3),       /* 每个vCPU线程的CPU时间 */
+    VIR_DOMAIN_STATS_INTERFACE = (1 << 4),  /* 网卡流量 */
+    VIR_DOMAIN_STATS_BLOCK = (1 << 5),      /* 磁盘IO */
+} virDomainStatsTypes;
+
+/**
+ * virConnectGetAllDomainStatsFlags: 为0时返回所有虚拟机，未运行的虚拟机只包含状态
+ */
+typedef enum {
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE = (1 << 0),    /* 只返回运行中的虚拟机 */
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_INACTIVE = (1 << 1),  /* 只返回未运行的虚拟机 */
+} virConnectGetAllDomainStatsFlags;
+
+/**
+ * virNodeInfo: 宿主机基本信息，sockets/cores/threads分别为每个NUMA节点的socket数、每个socket的核数和每个核的线程数
+ */
+typedef struct {
+    char model[32];             /* CPU型号，过长时截断 */
+    unsigned long memory;       /* 内存大小(KiB) */
+    unsigned int cpus;          /* 在线逻辑CPU数 */
+    unsigned int mhz;           /* CPU频率(MHz) */
+    unsigned int nodes;         /* NUMA节点数 */
+    unsigned int sockets;
+    unsigned int cores;
+    unsigned int threads;
+} virNodeInfo;
+
+#define VIR_NODE_CPU_STATS_ALL_CPUS (-1)
+#define VIR_NODE_MEMORY_STATS_ALL_CELLS (-1)
+
+// virNodeGetCPUStats返回的字段，单位为纳秒
+#define VIR_NODE_CPU_STATS_KERNEL "kernel"
+#define VIR_NODE_CPU_STATS_USER "user"
+#define VIR_NODE_CPU_STATS_IDLE "idle"
+#define VIR_NODE_CPU_STATS_IOWAIT "iowait"
+#define VIR_NODE_CPU_STATS_INTR "intr"
+
+// virNodeGetMemoryStats返回的字段，单位为KiB，单个NUMA节点只有total和free
+#define VIR_NODE_MEMORY_STATS_TOTAL "total"
+#define VIR_NODE_MEMORY_STATS_FREE "free"
+#define VIR_NODE_MEMORY_STATS_BUFFERS "buffers"
+#define VIR_NODE_MEMORY_STATS_CACHED "cached"
+
 class VirConnect {
 private:
     std::string uri;                                    // 连接 URI
@@ -71,6 +200,10 @@ private:
     std::unique_ptr<NetworkDriver> networkDriver;       // 网络驱动实例
     std::vector<std::shared_ptr<VirNetwork>> networks;   // 网络链表
 
+    std::unique_ptr<StatsShmWriter> statsShm;           // 统计共享内存导出，需晚于采样器析构
+    std::unique_ptr<PrometheusExporter> statsExporter;  // Prometheus指标服务，需晚于采样器析构
+    std::unique_ptr<StatsSampler> statsSampler;         // 后台统计采样器，需先于driver析构
+
     // const std::string pathToConfigDir = "./temp/domains";
 public:
     // 仿照Libvirt中的定义，增加一些方法，请根据以下方法编写程序
@@ -91,12 +224,40 @@ public:
 
     // Enumeration: 用于枚举给定的 hypervisor 上可用的一组对象
     std::vector<std::shared_ptr<VirDomain>> virConnectListAllDomains(unsigned int flags = 0) const;
+
+    // Statistics: 一次调用采集所有虚拟机的统计信息，stats为virDomainStatsTypes的组合，0表示全部
+    std::vector<virDomainStatsRecord> virConnectGetAllDomainStats(unsigned int stats = 0, unsigned int flags = 0) const;
+
+    // 后台采样：参数为0时使用配置文件中的stats.sample_interval_ms和stats.history_size
+    // stats.shm_path不为空时同时把每轮采样结果导出到该内存映射文件
+    // stats.prometheus_socket或stats.prometheus_port配置时同时提供Prometheus文本格式的HTTP服务
+    void virConnectStatsSamplerStart(unsigned int intervalMs = 0, size_t historySize = 0);
+    void virConnectStatsSamplerStop();
+    // 读取采样历史，不会触发新的采集
+    bool virDomainGetStatsHistory(const std::shared_ptr<VirDomain> domain, size_t count,
+        std::vector<virDomainStatsSample>& samples) const;
+    std::map<std::string, virDomainStatsSample> virConnectGetLatestStats() const;
+
+    // 事件订阅，domain为空时接收所有虚拟机的事件，eventID为virDomainEventID，返回回调ID
+    // 回调在驱动的事件分发线程中调用，替代轮询virDomainGetState
+    // QMP事件来自每个虚拟机单独的事件套接字，同一时间只有一个进程能收到，不影响其他进程的QMP命令
+    // 其他进程启动的虚拟机在几秒内被发现并补发STARTED事件
+    int virConnectDomainEventRegisterAny(std::shared_ptr<VirDomain> domain, int eventID,
+        virConnectDomainEventCallback callback);
+    int virConnectDomainEventDeregisterAny(int callbackID);
     // TODO: 枚举HyperVisor上的网络对象以及存储对象
 
     // Description: 通用访问器，提供一组关于对象的通用信息
 
     // Accessors: 特定的访问器方法，用于查询或修改给定对象的数据
-    // TODO：需要定义一个结点的信息的数据结构用于返回值
+    // 宿主机信息，静态拓扑只读取一次，计数类数据按需刷新
+    int virNodeGetInfo(virNodeInfo& info) const;
+    int virNodeGetCPUStats(int cpuNum, std::map<std::string, unsigned long long>& params, unsigned int flags = 0) const;
+    int virNodeGetMemoryStats(int cellNum, std::map<std::string, unsigned long long>& params, unsigned int flags = 0) const;
+    // 查询从startCell开始cellCount个NUMA节点上各页大小(KiB)的空闲页数，
+    // counts按节点优先的顺序排列，共cellCount * pages.size()项，返回填充的项数
+    int virNodeGetFreePages(const std::vector<unsigned int>& pages, int startCell, unsigned int cellCount,
+        std::vector<unsigned long long>& counts, unsigned int flags = 0) const;
 
     // 为了和Libvirt中的方法定义保持一致，这里的Create和Destroy方法也遵循libvirt中的定义，即：
     // Create真正的作用其实是启动一个已定义的虚拟机，或启动一个临时的虚拟机
@@ -110,6 +271,12 @@ public:
     // Destruction: 用于关闭或停用并析构对象
     void virDomainDestroy(const std::shared_ptr<VirDomain> domain);
     void virDomainShutdown(const std::shared_ptr<VirDomain> domain);
+    // 发起优雅关机后立即返回，虚拟机退出时订阅了事件的连接收到VIR_DOMAIN_EVENT_STOPPED事件
+    // 超时后升级为quit和SIGKILL；连接在此之前关闭时由独立的看门狗进程按剩余时间继续升级
+    // timeoutSec为等待客户机关机的秒数，小于0时使用配置文件中的qemu.shutdown_timeout
+    void virDomainShutdownFlags(const std::shared_ptr<VirDomain> domain, unsigned int flags, int timeoutSec = -1);
+    // 对所有运行中的虚拟机发起关机，用于宿主机维护，返回已发起关机的虚拟机
+    std::vector<std::shared_ptr<VirDomain>> virConnectShutdownAllDomains(unsigned int flags = 0, int timeoutSec = -1);
 
     // 存储池管理
     std::shared_ptr<VirStoragePool> virStoragePoolDefineXML(const std::string& xmlDesc, unsigned int flags = 0);
@@ -134,6 +301,21 @@ public:
     std::shared_ptr<VirStorageVol> virStorageVolLookupByPath(const std::string& path) const;
 
     int virStorageVolDelete(const std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0);
+    // flags为virStorageVolResizeFlags，卷正被运行中的虚拟机使用时在线扩容
+    int virStorageVolResize(const std::shared_ptr<VirStorageVol> vol, unsigned long long capacity, unsigned int flags = 0);
+    int virStorageVolWipe(const std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0);
+    // algorithm取值见virStorageVolWipeAlgorithm
+    int virStorageVolWipePattern(const std::shared_ptr<VirStorageVol> vol, unsigned int algorithm, unsigned int flags = 0);
+    // 把后备链中的数据合并到卷中并去掉后备镜像，卷正被运行中的虚拟机使用时由QEMU在后台完成
+    // 后台合并时立即返回，只有当前进程仍在运行时才会在完成后更新卷信息，其他进程刷新存储池后才能看到
+    int virStorageVolFlatten(const std::shared_ptr<VirStorageVol> vol, unsigned int flags = 0);
+    // 在卷和fd之间传输[offset, offset + length)的内容，length为0表示到卷末尾(下载)或输入结束(上传)
+    // 上传不能超出卷的容量，输入比剩余容量多时失败；上传不改变卷的格式，raw卷中写入的qcow2镜像仍按raw处理
+    // fd可以是普通文件、管道或套接字，数据由sendfile/splice在内核中传输，flags见virStorageVolDownloadFlags等
+    int virStorageVolDownload(const std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+        unsigned long long length, unsigned int flags = 0);
+    int virStorageVolUpload(const std::shared_ptr<VirStorageVol> vol, int fd, unsigned long long offset,
+        unsigned long long length, unsigned int flags = 0);
 
     // 网络管理
     std::vector<std::shared_ptr<VirNetwork>> virConnectListAllNetworks(unsigned int flags = 0) const;
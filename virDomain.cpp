@@ -33,11 +33,12 @@ VirDomain::VirDomain(const std::string& xmlDesc, HypervisorDriver* driver, unsig
     if ( uuidElem ) uuid = uuidElem->GetText();
 }
 
-int VirDomain::virDomainGetState(unsigned int& reason) const {
+int VirDomain::virDomainGetState(unsigned int& reason, unsigned int flags) const {
     // 调用驱动的接口获取虚拟机的状态
-    // TODO: 返回正确的reason
-    reason = 0;
-    return driver->domainGetState(std::make_shared<VirDomain>(*this));
+    int stateReason = 0;
+    int state = driver->domainGetStateFlags(std::make_shared<VirDomain>(*this), stateReason, flags);
+    reason = static_cast< unsigned int >(stateReason);
+    return state;
 }
 
 std::string VirDomain::virDomainGetName() const {
@@ -55,3 +56,27 @@ std::string VirDomain::virDomainGetUUID() const {
 int VirDomain::virDomainAttachDevice(const std::string& xmlDesc, unsigned int flags) {
     return driver->domainAttachDevice(std::make_shared<VirDomain>(*this), xmlDesc, flags);
 }
+
+int VirDomain::virDomainSetSchedulerParameters(const std::map<std::string, long long>& params, unsigned int flags) {
+    return driver->domainSetSchedulerParameters(std::make_shared<VirDomain>(*this), params, flags);
+}
+
+int VirDomain::virDomainSetMemoryParameters(const std::map<std::string, unsigned long long>& params, unsigned int flags) {
+    return driver->domainSetMemoryParameters(std::make_shared<VirDomain>(*this), params, flags);
+}
+
+int VirDomain::virDomainSetBlkioParameters(const std::map<std::string, std::string>& params, unsigned int flags) {
+    return driver->domainSetBlkioParameters(std::make_shared<VirDomain>(*this), params, flags);
+}
+
+int VirDomain::virDomainGetResourceUsage(virDomainResourceUsage& usage) {
+    return driver->domainGetResourceUsage(std::make_shared<VirDomain>(*this), usage);
+}
+
+int VirDomain::virDomainBlockResize(const std::string& disk, unsigned long long size, unsigned int flags) {
+    return driver->domainBlockResize(std::make_shared<VirDomain>(*this), disk, size, flags);
+}
+
+int VirDomain::virDomainBlockPull(const std::string& disk, unsigned long long bandwidth, unsigned int flags) {
+    return driver->domainBlockPull(std::make_shared<VirDomain>(*this), disk, bandwidth, flags);
+}
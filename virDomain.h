@@ -6,6 +6,21 @@
 #include <iostream>
 #include "driver-hypervisor.h"
 
+// virDomainSetSchedulerParameters的参数名
+#define VIR_DOMAIN_SCHEDULER_CPU_SHARES "cpu_shares"        // CPU权重，对应cpu.weight
+#define VIR_DOMAIN_SCHEDULER_GLOBAL_PERIOD "global_period"  // 带宽控制周期(us)
+#define VIR_DOMAIN_SCHEDULER_GLOBAL_QUOTA "global_quota"    // 每周期CPU时间(us)，负数表示不限制
+
+// virDomainSetMemoryParameters的参数名，单位KiB，0表示不限制
+#define VIR_DOMAIN_MEMORY_HARD_LIMIT "hard_limit"           // 对应memory.max
+#define VIR_DOMAIN_MEMORY_SOFT_LIMIT "soft_limit"           // 对应memory.high
+
+// virDomainSetBlkioParameters的参数名，值的格式为"/dev/sda,1000"，0表示不限制
+#define VIR_DOMAIN_BLKIO_DEVICE_READ_IOPS "device_read_iops_sec"
+#define VIR_DOMAIN_BLKIO_DEVICE_WRITE_IOPS "device_write_iops_sec"
+#define VIR_DOMAIN_BLKIO_DEVICE_READ_BPS "device_read_bytes_sec"
+#define VIR_DOMAIN_BLKIO_DEVICE_WRITE_BPS "device_write_bytes_sec"
+
 class VirDomain {
 private:
     std::string name;
@@ -23,12 +38,24 @@ public:
         this->id = id;
     }
     // Accessors
-    int virDomainGetState(unsigned int& reason) const;
+    // flags为virDomainGetStateFlags，无法获取状态时返回-1
+    int virDomainGetState(unsigned int& reason, unsigned int flags = 0) const;
     std::string virDomainGetName() const;
     int virDomainGetID() const;
     std::string virDomainGetUUID() const;
 
     int virDomainAttachDevice(const std::string& xmlDesc, unsigned int flags = 0);
+
+    // 资源控制，修改立即作用于运行中的虚拟机
+    int virDomainSetSchedulerParameters(const std::map<std::string, long long>& params, unsigned int flags = 0);
+    int virDomainSetMemoryParameters(const std::map<std::string, unsigned long long>& params, unsigned int flags = 0);
+    int virDomainSetBlkioParameters(const std::map<std::string, std::string>& params, unsigned int flags = 0);
+    int virDomainGetResourceUsage(virDomainResourceUsage& usage);
+
+    // disk为目标设备名或镜像路径，flags为virDomainBlockResizeFlags，默认size的单位为KiB
+    int virDomainBlockResize(const std::string& disk, unsigned long long size, unsigned int flags = 0);
+    // 在后台把后备链中的数据合并到磁盘镜像中，bandwidth默认单位为MiB/s，flags为virDomainBlockPullFlags
+    int virDomainBlockPull(const std::string& disk, unsigned long long bandwidth = 0, unsigned int flags = 0);
 };
 
 #endif // VIRDOMAIN_H
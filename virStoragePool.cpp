@@ -21,6 +21,14 @@ int VirStoragePool::virStoragePoolGetState() const {
     return driver ? driver->storagePoolGetState(std::make_shared<VirStoragePool>(*this)) : -1;
 }
 
+int VirStoragePool::virStoragePoolGetInfo(virStoragePoolInfo& info) const {
+    return driver ? driver->storagePoolGetInfo(std::make_shared<VirStoragePool>(*this), info) : -1;
+}
+
+int VirStoragePool::virStoragePoolRefresh(unsigned int flags) {
+    return driver ? driver->storagePoolRefresh(std::make_shared<VirStoragePool>(*this), flags) : -1;
+}
+
 int VirStoragePool::virStoragePoolDelete(unsigned int flags) {
     return driver ? driver->storagePoolDelete(std::make_shared<VirStoragePool>(*this), flags) : -1;
 }
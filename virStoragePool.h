@@ -8,6 +8,16 @@
 class StorageDriver;
 class VirStorageVol;
 
+/**
+ * virStoragePoolInfo: 存储池的状态和空间信息，单位为字节，容量和可用空间来自存储池目录所在的文件系统
+ */
+typedef struct {
+    int state;                      /* virStoragePoolState */
+    unsigned long long capacity;    /* 总容量 */
+    unsigned long long allocation;  /* 已使用的空间 */
+    unsigned long long available;   /* 可用于新建卷的空间 */
+} virStoragePoolInfo;
+
 class VirStoragePool {
 private:
     std::string name;
@@ -30,6 +40,9 @@ public:
     // int virStoragePoolBuild(unsigned int flags = 0);
     int virStoragePoolDelete(unsigned int flags = 0);
     int virStoragePoolGetState() const;
+    int virStoragePoolGetInfo(virStoragePoolInfo& info) const;
+    // 重新扫描存储池目录，发现外部拷入或删除的镜像，并更新卷和存储池的容量信息
+    int virStoragePoolRefresh(unsigned int flags = 0);
 
     // 存储卷列表
     std::vector<std::shared_ptr<VirStorageVol>> virStoragePoolListAllVolumes(unsigned int flags = 0) const;
@@ -44,3 +44,15 @@ int VirStorageVol::virStorageVolResize(unsigned long long capacity, unsigned int
 int VirStorageVol::virStorageVolWipe(unsigned int flags) {
     return driver ? driver->storageVolWipe(std::make_shared<VirStorageVol>(*this), flags) : -1;
 }
+int VirStorageVol::virStorageVolWipePattern(unsigned int algorithm, unsigned int flags) {
+    return driver ? driver->storageVolWipePattern(std::make_shared<VirStorageVol>(*this), algorithm, flags) : -1;
+}
+int VirStorageVol::virStorageVolFlatten(unsigned int flags) {
+    return driver ? driver->storageVolFlatten(std::make_shared<VirStorageVol>(*this), flags) : -1;
+}
+int VirStorageVol::virStorageVolDownload(int fd, unsigned long long offset, unsigned long long length, unsigned int flags) {
+    return driver ? driver->storageVolDownload(std::make_shared<VirStorageVol>(*this), fd, offset, length, flags) : -1;
+}
+int VirStorageVol::virStorageVolUpload(int fd, unsigned long long offset, unsigned long long length, unsigned int flags) {
+    return driver ? driver->storageVolUpload(std::make_shared<VirStorageVol>(*this), fd, offset, length, flags) : -1;
+}
@@ -38,6 +38,10 @@ public:
     int virStorageVolDelete(unsigned int flags = 0);
     int virStorageVolResize(unsigned long long capacity, unsigned int flags = 0);
     int virStorageVolWipe(unsigned int flags = 0);
+    int virStorageVolWipePattern(unsigned int algorithm, unsigned int flags = 0);
+    int virStorageVolFlatten(unsigned int flags = 0);
+    int virStorageVolDownload(int fd, unsigned long long offset, unsigned long long length, unsigned int flags = 0);
+    int virStorageVolUpload(int fd, unsigned long long offset, unsigned long long length, unsigned int flags = 0);
 };
 
 #endif // VIRSTORAGEVOL_H
\ No newline at end of file
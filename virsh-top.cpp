@@ -0,0 +1,564 @@
+#include "virsh-top.h"
+#include "conf/config_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define TOP_HEADER_LINES 4  // 概要、按键说明、空行、列标题
+
+typedef std::map<std::string, virDomainStatsSample>::value_type TopEntry;
+
+enum TopColumnId {
+    TOP_COL_NAME,
+    TOP_COL_STATE,
+    TOP_COL_CPU,
+    TOP_COL_MEM,
+    TOP_COL_RD_IOPS,
+    TOP_COL_WR_IOPS,
+    TOP_COL_RD_BYTES,
+    TOP_COL_WR_BYTES,
+    TOP_COL_RX_PKTS,
+    TOP_COL_TX_PKTS,
+    TOP_COL_RX_BYTES,
+    TOP_COL_TX_BYTES,
+    TOP_COL_LAST
+};
+
+struct TopColumn {
+    const char* title;
+    int width;
+};
+
+static const TopColumn topColumns[TOP_COL_LAST] = {
+    { "NAME", 20 },
+    { "STATE", 9 },
+    { "%CPU", 7 },
+    { "MEM", 8 },
+    { "RD_IOPS", 9 },
+    { "WR_IOPS", 9 },
+    { "RD/s", 8 },
+    { "WR/s", 8 },
+    { "RX_PPS", 9 },
+    { "TX_PPS", 9 },
+    { "RX/s", 8 },
+    { "TX/s", 8 },
+};
+
+static volatile sig_atomic_t topQuit = 0;
+static volatile sig_atomic_t topResize = 0;
+
+static void topSignalHandler(int sig) {
+    if ( sig == SIGWINCH ) {
+        topResize = 1;
+    }
+    else {
+        topQuit = 1;
+    }
+}
+
+static const char* topStateString(int state) {
+    switch ( state ) {
+    case VIR_DOMAIN_RUNNING: return "running";
+    case VIR_DOMAIN_BLOCKED: return "blocked";
+    case VIR_DOMAIN_PAUSED: return "paused";
+    case VIR_DOMAIN_SHUTDOWN: return "shutdown";
+    case VIR_DOMAIN_SHUTOFF: return "shutoff";
+    case VIR_DOMAIN_CRASHED: return "crashed";
+    case VIR_DOMAIN_PMSUSPENDED: return "pmsuspend";
+    default: return "nostate";
+    }
+}
+
+static double topColumnValue(const virDomainStatsSample& sample, int column) {
+    switch ( column ) {
+    case TOP_COL_STATE: return sample.state;
+    case TOP_COL_CPU: return sample.cpuPercent;
+    case TOP_COL_MEM: return static_cast< double >(sample.memory);
+    case TOP_COL_RD_IOPS: return sample.rdIops;
+    case TOP_COL_WR_IOPS: return sample.wrIops;
+    case TOP_COL_RD_BYTES: return sample.rdBytesPerSec;
+    case TOP_COL_WR_BYTES: return sample.wrBytesPerSec;
+    case TOP_COL_RX_PKTS: return sample.rxPktsPerSec;
+    case TOP_COL_TX_PKTS: return sample.txPktsPerSec;
+    case TOP_COL_RX_BYTES: return sample.rxBytesPerSec;
+    case TOP_COL_TX_BYTES: return sample.txBytesPerSec;
+    default: return 0;
+    }
+}
+
+// 按1024进位格式化字节数，如 512 / 3.5K / 12.0M
+static void topFormatBytes(double value, char* buf, size_t len) {
+    static const char units[] = { 'K', 'M', 'G', 'T', 'P' };
+    if ( value < 1024 ) {
+        snprintf(buf, len, "%.0f", value);
+        return;
+    }
+    size_t unit = 0;
+    value /= 1024;
+    while ( value >= 1024 && unit + 1 < sizeof(units) ) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(buf, len, "%.1f%c", value, units[unit]);
+}
+
+// 按1000进位格式化次数，如 87 / 1.2k / 3.4m
+static void topFormatCount(double value, char* buf, size_t len) {
+    if ( value < 1000 ) {
+        snprintf(buf, len, value < 10 ? "%.1f" : "%.0f", value);
+    }
+    else if ( value < 1000000 ) {
+        snprintf(buf, len, "%.1fk", value / 1000);
+    }
+    else {
+        snprintf(buf, len, "%.1fm", value / 1000000);
+    }
+}
+
+class TopView {
+public:
+    TopView(VirConnect& conn, const VirshTopOptions& options, unsigned int intervalMs)
+        : conn(conn), options(options), intervalMs(intervalMs), sortColumn(TOP_COL_CPU), descending(true),
+        offset(0), termRows(24), termCols(80) {
+    }
+
+    int runInteractive();
+    int runBatch();
+
+private:
+    void fetch();
+    void querySize();
+    size_t visibleRows() const {
+        return termRows > TOP_HEADER_LINES ? termRows - TOP_HEADER_LINES : 0;
+    }
+    void clampOffset();
+    // 只对[0, limit)范围内的行排序，其余行保持未定义的顺序
+    void sortRows(size_t limit);
+    std::string formatSummary() const;
+    std::string formatTitle() const;
+    std::string formatRow(const TopEntry& entry) const;
+    void buildFrame(std::vector<std::string>& lines);
+    void flushFrame(const std::vector<std::string>& lines);
+    bool handleInput(const char* buf, ssize_t len, bool& refresh);
+    static void writeAll(const std::string& data);
+
+    VirConnect& conn;
+    const VirshTopOptions& options;
+    unsigned int intervalMs;
+
+    std::map<std::string, virDomainStatsSample> latest;
+    std::vector<const TopEntry*> rows;
+    std::vector<std::string> screen;   // 终端上当前显示的内容，用于增量重绘
+
+    int sortColumn;
+    bool descending;
+    size_t offset;
+    size_t termRows;
+    size_t termCols;
+};
+
+void TopView::fetch() {
+    latest = conn.virConnectGetLatestStats();
+    rows.clear();
+    rows.reserve(latest.size());
+    for ( const auto& entry : latest ) {
+        rows.push_back(&entry);
+    }
+}
+
+void TopView::querySize() {
+    struct winsize ws;
+    if ( ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0 ) {
+        termRows = ws.ws_row;
+        termCols = ws.ws_col;
+    }
+}
+
+void TopView::clampOffset() {
+    size_t visible = visibleRows();
+    size_t maxOffset = rows.size() > visible ? rows.size() - visible : 0;
+    if ( offset > maxOffset ) {
+        offset = maxOffset;
+    }
+}
+
+void TopView::sortRows(size_t limit) {
+    int column = sortColumn;
+    bool desc = descending;
+    auto less = [column, desc](const TopEntry* a, const TopEntry* b) {
+        if ( column != TOP_COL_NAME ) {
+            double va = topColumnValue(a->second, column);
+            double vb = topColumnValue(b->second, column);
+            if ( va != vb ) {
+                return desc ? va > vb : va < vb;
+            }
+            return a->first < b->first;
+        }
+        return desc ? a->first > b->first : a->first < b->first;
+    };
+    limit = std::min(limit, rows.size());
+    std::partial_sort(rows.begin(), rows.begin() + limit, rows.end(), less);
+}
+
+std::string TopView::formatSummary() const {
+    char timeBuf[16];
+    time_t now = time(nullptr);
+    struct tm tmNow;
+    localtime_r(&now, &tmNow);
+    strftime(timeBuf, sizeof(timeBuf), "%H:%M:%S", &tmNow);
+
+    double cpuTotal = 0;
+    for ( const TopEntry* entry : rows ) {
+        cpuTotal += entry->second.cpuPercent;
+    }
+    char buf[256];
+    snprintf(buf, sizeof(buf), "myVirsh top - %s  运行中: %zu  CPU合计: %.1f%%  刷新间隔: %u ms  排序: %s %s",
+        timeBuf, rows.size(), cpuTotal, intervalMs, topColumns[sortColumn].title, descending ? "降序" : "升序");
+    return buf;
+}
+
+std::string TopView::formatTitle() const {
+    std::string line;
+    char buf[64];
+    for ( int i = 0; i < TOP_COL_LAST; i++ ) {
+        std::string title = topColumns[i].title;
+        if ( i == sortColumn ) {
+            title = (descending ? "v" : "^") + title;
+        }
+        if ( i == TOP_COL_NAME ) {
+            snprintf(buf, sizeof(buf), "%-*s", topColumns[i].width, title.c_str());
+        }
+        else {
+            snprintf(buf, sizeof(buf), " %*s", topColumns[i].width, title.c_str());
+        }
+        line += buf;
+    }
+    return line;
+}
+
+std::string TopView::formatRow(const TopEntry& entry) const {
+    const virDomainStatsSample& sample = entry.second;
+    char value[32];
+    char buf[64];
+    std::string line;
+
+    snprintf(buf, sizeof(buf), "%-*.*s", topColumns[TOP_COL_NAME].width, topColumns[TOP_COL_NAME].width,
+        entry.first.c_str());
+    line += buf;
+    snprintf(buf, sizeof(buf), " %*s", topColumns[TOP_COL_STATE].width, topStateString(sample.state));
+    line += buf;
+    for ( int i = TOP_COL_CPU; i < TOP_COL_LAST; i++ ) {
+        double v = topColumnValue(sample, i);
+        switch ( i ) {
+        case TOP_COL_CPU:
+            snprintf(value, sizeof(value), "%.1f", v);
+            break;
+        case TOP_COL_MEM:
+            topFormatBytes(v * 1024, value, sizeof(value));
+            break;
+        case TOP_COL_RD_BYTES:
+        case TOP_COL_WR_BYTES:
+        case TOP_COL_RX_BYTES:
+        case TOP_COL_TX_BYTES:
+            topFormatBytes(v, value, sizeof(value));
+            break;
+        default:
+            topFormatCount(v, value, sizeof(value));
+            break;
+        }
+        snprintf(buf, sizeof(buf), " %*s", topColumns[i].width, value);
+        line += buf;
+    }
+    return line;
+}
+
+void TopView::buildFrame(std::vector<std::string>& lines) {
+    clampOffset();
+    size_t visible = visibleRows();
+    size_t end = std::min(rows.size(), offset + visible);
+    sortRows(end);
+
+    lines.clear();
+    lines.push_back(formatSummary());
+    lines.push_back("按键: q 退出  </> 切换排序列  r 反转排序  上/下/PgUp/PgDn 滚动  空格 立即刷新");
+    lines.push_back("");
+    std::string title = formatTitle();
+    if ( title.size() > termCols ) {
+        title.resize(termCols);
+    }
+    lines.push_back("\033[7m" + title + "\033[0m");
+    for ( size_t i = offset; i < end; i++ ) {
+        std::string line = formatRow(*rows[i]);
+        if ( line.size() > termCols ) {
+            line.resize(termCols);
+        }
+        lines.push_back(line);
+    }
+}
+
+void TopView::flushFrame(const std::vector<std::string>& lines) {
+    // 只输出内容变化的行，上千台虚拟机时每次刷新的输出量也只与屏幕大小有关
+    std::string out;
+    char move[32];
+    for ( size_t i = 0; i < lines.size(); i++ ) {
+        if ( i < screen.size() && screen[i] == lines[i] ) {
+            continue;
+        }
+        snprintf(move, sizeof(move), "\033[%zu;1H", i + 1);
+        out += move;
+        out += lines[i];
+        out += "\033[K";
+    }
+    for ( size_t i = lines.size(); i < screen.size(); i++ ) {
+        snprintf(move, sizeof(move), "\033[%zu;1H\033[K", i + 1);
+        out += move;
+    }
+    screen = lines;
+    if ( !out.empty() ) {
+        writeAll(out);
+    }
+}
+
+void TopView::writeAll(const std::string& data) {
+    size_t written = 0;
+    while ( written < data.size() ) {
+        ssize_t ret = write(STDOUT_FILENO, data.data() + written, data.size() - written);
+        if ( ret < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return;
+        }
+        written += ret;
+    }
+}
+
+bool TopView::handleInput(const char* buf, ssize_t len, bool& refresh) {
+    size_t page = std::max< size_t >(visibleRows(), 1);
+    for ( ssize_t i = 0; i < len; i++ ) {
+        char c = buf[i];
+        if ( c == '\033' && i + 2 < len && buf[i + 1] == '[' ) {
+            char code = buf[i + 2];
+            i += 2;
+            if ( (code == '5' || code == '6') && i + 1 < len && buf[i + 1] == '~' ) {
+                i++;
+                if ( code == '5' ) {
+                    offset = offset > page ? offset - page : 0;
+                }
+                else {
+                    offset += page;
+                }
+            }
+            else if ( code == 'A' ) {
+                offset = offset > 0 ? offset - 1 : 0;
+            }
+            else if ( code == 'B' ) {
+                offset++;
+            }
+            else if ( code == 'C' ) {
+                sortColumn = (sortColumn + 1) % TOP_COL_LAST;
+                descending = sortColumn != TOP_COL_NAME;
+            }
+            else if ( code == 'D' ) {
+                sortColumn = (sortColumn + TOP_COL_LAST - 1) % TOP_COL_LAST;
+                descending = sortColumn != TOP_COL_NAME;
+            }
+            continue;
+        }
+        switch ( c ) {
+        case 'q':
+        case 'Q':
+            return false;
+        case '>':
+        case '.':
+            sortColumn = (sortColumn + 1) % TOP_COL_LAST;
+            descending = sortColumn != TOP_COL_NAME;
+            break;
+        case '<':
+        case ',':
+            sortColumn = (sortColumn + TOP_COL_LAST - 1) % TOP_COL_LAST;
+            descending = sortColumn != TOP_COL_NAME;
+            break;
+        case 'r':
+        case 'R':
+            descending = !descending;
+            break;
+        case 'k':
+            offset = offset > 0 ? offset - 1 : 0;
+            break;
+        case 'j':
+            offset++;
+            break;
+        case ' ':
+            refresh = true;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+int TopView::runInteractive() {
+    struct termios saved;
+    if ( tcgetattr(STDIN_FILENO, &saved) < 0 ) {
+        std::cerr << "错误: 无法读取终端属性: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    struct termios raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    // 切换到备用屏幕并隐藏光标，退出时恢复
+    writeAll("\033[?1049h\033[?25l\033[2J");
+
+    querySize();
+    auto next = std::chrono::steady_clock::now();
+    unsigned int frames = 0;
+    bool refresh = true;
+    bool dirty = true;
+    int ret = 0;
+    std::vector<std::string> lines;
+
+    try {
+        while ( !topQuit ) {
+            if ( refresh ) {
+                fetch();
+                frames++;
+                refresh = false;
+                dirty = true;
+                next = std::chrono::steady_clock::now() + std::chrono::milliseconds(intervalMs);
+            }
+            if ( topResize ) {
+                topResize = 0;
+                querySize();
+                screen.clear();
+                writeAll("\033[2J");
+                dirty = true;
+            }
+            if ( dirty ) {
+                buildFrame(lines);
+                flushFrame(lines);
+                dirty = false;
+            }
+            if ( options.iterations > 0 && frames >= options.iterations ) {
+                break;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            int timeout = 0;
+            if ( next > now ) {
+                timeout = static_cast< int >(
+                    std::chrono::duration_cast< std::chrono::milliseconds >(next - now).count());
+            }
+            struct pollfd pfd;
+            pfd.fd = STDIN_FILENO;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int n = poll(&pfd, 1, timeout);
+            if ( n > 0 ) {
+                char buf[64];
+                ssize_t len = read(STDIN_FILENO, buf, sizeof(buf));
+                if ( len > 0 ) {
+                    if ( !handleInput(buf, len, refresh) ) {
+                        break;
+                    }
+                    dirty = true;
+                }
+            }
+            else if ( n < 0 && errno != EINTR ) {
+                break;
+            }
+            if ( std::chrono::steady_clock::now() >= next ) {
+                refresh = true;
+            }
+        }
+    }
+    catch ( const std::exception& e ) {
+        writeAll("\033[?25h\033[?1049l");
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+        std::cerr << "错误: " << e.what() << std::endl;
+        return 1;
+    }
+
+    writeAll("\033[?25h\033[?1049l");
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    return ret;
+}
+
+int TopView::runBatch() {
+    // 采样器启动后的第一个样本没有差值，等待一个间隔后再输出，保证每一帧都有速率数据
+    unsigned int frames = 0;
+    termCols = static_cast< size_t >(-1);
+    auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(intervalMs);
+    while ( !topQuit ) {
+        auto now = std::chrono::steady_clock::now();
+        if ( next > now ) {
+            int timeout = static_cast< int >(
+                std::chrono::duration_cast< std::chrono::milliseconds >(next - now).count());
+            poll(nullptr, 0, timeout);
+            continue;
+        }
+        next += std::chrono::milliseconds(intervalMs);
+
+        fetch();
+        sortRows(rows.size());
+        std::string out = formatSummary() + "\n" + formatTitle() + "\n";
+        for ( const TopEntry* entry : rows ) {
+            out += formatRow(*entry);
+            out += "\n";
+        }
+        out += "\n";
+        writeAll(out);
+
+        frames++;
+        if ( options.iterations > 0 && frames >= options.iterations ) {
+            break;
+        }
+    }
+    return 0;
+}
+
+int virshTop(VirConnect& conn, const VirshTopOptions& options) {
+    bool interactive = !options.batch && isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+
+    // top只需要最新样本，历史长度取2即可，避免虚拟机很多时白白占用内存
+    conn.virConnectStatsSamplerStart(options.intervalMs, 2);
+    unsigned int intervalMs = options.intervalMs;
+    if ( intervalMs == 0 ) {
+        intervalMs = ConfigManager::Instance()->getIntValue("stats.sample_interval_ms", 1000);
+    }
+
+    struct sigaction sa, oldInt, oldTerm, oldWinch;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = topSignalHandler;
+    sigemptyset(&sa.sa_mask);
+    // 不设置SA_RESTART，让poll被信号打断后立即响应
+    sigaction(SIGINT, &sa, &oldInt);
+    sigaction(SIGTERM, &sa, &oldTerm);
+    sigaction(SIGWINCH, &sa, &oldWinch);
+    topQuit = 0;
+    topResize = 0;
+
+    TopView view(conn, options, intervalMs);
+    int ret = interactive ? view.runInteractive() : view.runBatch();
+
+    sigaction(SIGINT, &oldInt, nullptr);
+    sigaction(SIGTERM, &oldTerm, nullptr);
+    sigaction(SIGWINCH, &oldWinch, nullptr);
+    conn.virConnectStatsSamplerStop();
+    return ret;
+}
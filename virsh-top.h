@@ -0,0 +1,17 @@
+#ifndef VIRSH_TOP_H
+#define VIRSH_TOP_H
+
+#include "virConnect.h"
+
+// myVirsh top 的运行参数
+struct VirshTopOptions {
+    unsigned int intervalMs = 0;    // 刷新间隔，0表示使用配置文件中的采样间隔
+    unsigned int iterations = 0;    // 刷新次数，0表示直到按q或收到信号为止
+    bool batch = false;             // 批处理模式：不接管终端，每次刷新完整输出所有虚拟机
+};
+
+// 基于后台统计采样器的实时视图，数值均来自采样器中相邻两次采样的差值
+// 交互模式下只重绘发生变化的行，排序和格式化只针对屏幕上可见的行
+int virshTop(VirConnect& conn, const VirshTopOptions& options);
+
+#endif // VIRSH_TOP_H
@@ -327,7 +327,11 @@ std::shared_ptr<xenDomainObj> XenDriver::parseAndCreateDomainObj(const std::stri
     def->vcpus = vcpus;
     def->memory = memoryMB;
     def->xmlDesc = xmlDesc;
-    def->diskPath = diskPath;
+    if ( !diskPath.empty() ) {
+        virDomainDiskDef disk;
+        disk.source = diskPath;
+        def->disks.push_back(disk);
+    }
     def->cdromPath = cdromPath;
 
     // 创建virDomainObj对象